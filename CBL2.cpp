@@ -14,14 +14,26 @@
 CBL2::CBL2() :
 	TICL()
 {
-	return;
+	callback_init = false;
+	store_ = NULL;
+	handler_ = NULL;
+	pool_ = NULL;
+	rx_buffer_ = -1;
+	done_buffer_ = -1;
+	cts_endpoint_ = -1;
 }
 
 // Constructor with custom communication lines.
 CBL2::CBL2(int tip, int ring) :
 	TICL(tip, ring)
 {
-	return;
+	callback_init = false;
+	store_ = NULL;
+	handler_ = NULL;
+	pool_ = NULL;
+	rx_buffer_ = -1;
+	done_buffer_ = -1;
+	cts_endpoint_ = -1;
 }
 
 int CBL2::getFromCBL2(uint8_t type, uint8_t* header, uint8_t* data, int* datalength, int maxlength) {
@@ -36,14 +48,12 @@ int CBL2::getFromCBL2(uint8_t type, uint8_t* header, uint8_t* data, int* datalen
 	msg_header[0] = endpoint;
 	msg_header[1] = REQ;
 	TIVar::intToSizeWord(11, &msg_header[2]);
-	rval = send(msg_header, header, 11);
-	
-	if (rval || get(msg_header, NULL, &length, 0) || msg_header[1] != ACK) {
-		// Either the message was not an ACK, or we didn't even get a message
+	if (sendAwaitAck(msg_header, header, 11)) {
+		// Either the message was not ACKed, or we didn't even get a message
 		return -1;
 	}
 	
-	if (get(msg_header, header, &length, 11) || msg_header[1] != VAR) {
+	if (getOrRetry(msg_header, header, &length, 11, endpoint) || msg_header[1] != VAR) {
 		// Either the message was not a VAR, or we didn't even get a message
 		return -1;
 	}
@@ -67,7 +77,7 @@ int CBL2::getFromCBL2(uint8_t type, uint8_t* header, uint8_t* data, int* datalen
 		return -1;
 	}
 
-	if (get(msg_header, NULL, datalength, maxlength) || msg_header[1] != DATA) {
+	if (getOrRetry(msg_header, data, datalength, maxlength, endpoint) || msg_header[1] != DATA) {
 		// Either the message was not a DATA, or we didn't even get a message
 		return -1;
 	}
@@ -92,10 +102,8 @@ int CBL2::sendToCBL2(uint8_t type, uint8_t* header, uint8_t* data, int datalengt
 	msg_header[1] = RTS;
 	msg_header[2] = 11;
 	msg_header[3] = 0;
-	rval = send(msg_header, header, 11);
-	
-	if (rval || (rval = get(msg_header, NULL, &length, 0)) || msg_header[1] != ACK) {
-		// Either the message was not an ACK, or we didn't even get a message
+	if (sendAwaitAck(msg_header, header, 11)) {
+		// Either the message was not ACKed, or we didn't even get a message
 		return -1;
 	}
 
@@ -118,10 +126,8 @@ int CBL2::sendToCBL2(uint8_t type, uint8_t* header, uint8_t* data, int datalengt
 	msg_header[0] = endpoint;
 	msg_header[1] = DATA;
 	TIVar::intToSizeWord(11, &msg_header[2]);
-	rval = send(msg_header, data, datalength);
-	
-	if (rval || get(msg_header, NULL, &length, 0) || msg_header[1] != ACK) {
-		// Either the message was not an ACK, or we didn't even get a message
+	if (sendAwaitAck(msg_header, data, datalength)) {
+		// Either the message was not ACKed, or we didn't even get a message
 		return -1;
 	}
 
@@ -147,24 +153,133 @@ int CBL2::setupCallbacks(uint8_t* header, uint8_t* data, int maxlength,
 	maxlength_ = maxlength;
 	get_callback_ = get_callback;
 	send_callback_ = send_callback;
+	handler_ = NULL;
 	callback_init = true;
 	return 0;
 }
 
+// As setupCallbacks(), with the handler's methods in place of the
+// callbacks
+int CBL2::setupHandler(uint8_t* header, uint8_t* data, int maxlength, CBL2Handler* handler) {
+	setupCallbacks(header, data, maxlength, NULL, NULL);
+	handler_ = handler;
+	return 0;
+}
+
+uint8_t* CBL2::header() {
+	return header_;
+}
+
+uint8_t* CBL2::data() {
+	return data_;
+}
+
+// Variables in the store are sent to the calculator without calling
+// send_callback; requests for anything else still go to the callback.
+// setupCallbacks() must still be called to provide receive buffers.
+int CBL2::setupVarStore(VarStore* store) {
+	store_ = store;
+	return 0;
+}
+
+int CBL2::setupBufferPool(PacketPool* pool) {
+	if (pool && pool->slotSize() <= CBL2_HEADER_LEN) {
+		return -1;
+	}
+	pool_ = pool;
+	rx_buffer_ = -1;
+	rx_named_ = false;
+	done_buffer_ = -1;
+	cts_endpoint_ = -1;
+	return 0;
+}
+
+// Hand out the oldest received variable. Its slot stays out of the
+// rotation until it's released.
+int CBL2::nextVariable(uint8_t** header, uint8_t** data, enum Endpoint* model, int* datalength) {
+	int buffer = pool_ ? pool_->dequeue() : -1;
+	if (buffer < 0) {
+		return -1;
+	}
+	*header = pool_->slot(buffer);
+	*data = *header + CBL2_HEADER_LEN;
+	*model = (enum Endpoint)models_[buffer];
+	*datalength = pool_->length(buffer);
+	return buffer;
+}
+
+void CBL2::release(int buffer) {
+	if (pool_) {
+		pool_->release(buffer);
+	}
+}
+
+// Hand the variable whose exchange just ended to the application.
+// Doing that only after the EOT keeps the application's work out of
+// the exchange, so the calculator is free to go on with its program.
+void CBL2::queueReceived() {
+	if (pool_ && done_buffer_ >= 0) {
+		pool_->queue(done_buffer_);
+		done_buffer_ = -1;
+	}
+}
+
 int CBL2::eventLoopTick(bool quick_fail) {
 	uint8_t msg_header[4];
+	uint8_t* rx_header = header_;
+	uint8_t* rx_data = data_;
+	int rx_maxlength = maxlength_;
 	int length;
 	int rval;
-	int endpoint = CBL82;
+	int endpoint;
 
 	if (!callback_init) {
 		return -1;
 	}
+
+	// With a pool, receive into a free slot. A variable's header and
+	// data arrive on separate ticks, so keep the slot until both have.
+	// Until the header is in, a packet lands at the start of the slot,
+	// where an RTS's variable header belongs; then the DATA goes after
+	// it. With none free, packets land in the setupCallbacks() buffers,
+	// and everything but a variable's DATA is still answered: EOT, and
+	// REQ, whose variable comes from the VarStore or callbacks. An RTS
+	// is ACKed, but its CTS is held back until a slot is free, so the
+	// calculator waits to send the DATA.
+	if (pool_) {
+		if (rx_buffer_ < 0) {
+			rx_buffer_ = pool_->acquire();
+			rx_named_ = false;
+		}
+		if (rx_buffer_ >= 0) {
+			rx_header = pool_->slot(rx_buffer_);
+			if (cts_endpoint_ >= 0) {
+				memcpy(rx_header, header_, CBL2_HEADER_LEN);	// The held RTS's variable header
+				rx_named_ = true;
+				msg_header[0] = cts_endpoint_;
+				msg_header[1] = CTS;
+				msg_header[2] = msg_header[3] = 0x00;
+				cts_endpoint_ = -1;
+				return 10*send(msg_header, NULL, 0);
+			}
+			rx_data = rx_named_ ? rx_header + CBL2_HEADER_LEN : rx_header;
+			rx_maxlength = pool_->slotSize() - (rx_named_ ? CBL2_HEADER_LEN : 0);
+		}
+	}
 	
-	// See if there's a message coming
-	rval = get(msg_header, data_, &length, maxlength_, quick_fail ? TIMEOUT : GET_ENTER_TIMEOUT);
+	// See if there's a message coming, asleep if we may be; ask for
+	// damaged ones again
+	if (idle_ != IDLE_NONE && waitForLink(quick_fail ? TIMEOUT : GET_ENTER_TIMEOUT)) {
+		return 0;			// No message coming
+	}
+	rval = get(msg_header, rx_data, &length, rx_maxlength, quick_fail ? TIMEOUT : GET_ENTER_TIMEOUT);
+	if (rval == ERR_BAD_CHECKSUM && (endpoint = endpointFor(msg_header[0])) >= 0) {
+		if (0 == (rval = requestResend(endpoint))) {
+			rval = getOrRetry(msg_header, rx_data, &length, rx_maxlength, endpoint);
+		}
+	}
 	if (rval) {
-		if (serial_) {
+		if (TICL_DEBUG && serial_) {
 			serial_->print("No msg: code ");
 			serial_->println(rval);
 		}
@@ -172,36 +287,32 @@ int CBL2::eventLoopTick(bool quick_fail) {
 	}
 
 	// Deduce what kind of operation is happening
-	// CBL2 responds to TI-82 as 0x12, "0x95" endpoint as 0x15
 	enum Endpoint model = (enum Endpoint)msg_header[0];
-	switch(model) {
-		case CALC82:
-			endpoint = CBL82;
-			break;
-		case CALC85a:
-		case CALC85b:
-			endpoint = CBL85;
-			break;
-		case CALC89:
-			endpoint = CBL89;
-			break;
-		case COMP83:
-			endpoint = CALC83;
-			break;
-		case COMP83P:
-			endpoint = CALC83P;
-			break;
-		default:
-			return -1;				// Unknown endpoint
-	};
+	endpoint = endpointFor(model);
+	if (endpoint < 0) {
+		return -1;				// Unknown endpoint
+	}
 	
+	// Whatever comes, a calculator waiting on a held CTS gave up on it
+	cts_endpoint_ = -1;
+
+	// DATA with no slot free wasn't asked for, since its CTS was held
+	// back; it gets no answer
+	if (pool_ && rx_buffer_ < 0 && msg_header[1] == DATA) {
+		return 0;
+	}
+
 	// Now deal with the message
 	switch(msg_header[1]) {
 		case ACK:
 			break;						// Drop ACKs on the floor
 
 		case RTS:
-			memcpy(header_, data_, length);		// Save the variable header
+			queueReceived();					// In case its EOT went missing
+			if (rx_data != rx_header) {
+				memcpy(rx_header, rx_data, min(length, CBL2_HEADER_LEN));	// Save the variable header
+			}
+			rx_named_ = true;
 			
 			// Send an ACK
 			msg_header[0] = endpoint;
@@ -212,6 +323,10 @@ int CBL2::eventLoopTick(bool quick_fail) {
 				// The send did not complete successfully
 				break;
 			}
+			if (pool_ && rx_buffer_ < 0) {
+				cts_endpoint_ = endpoint;		// No slot for the DATA yet
+				break;
+			}
 			
 			// Send a CTS
 			msg_header[0] = endpoint;
@@ -232,21 +347,34 @@ int CBL2::eventLoopTick(bool quick_fail) {
 				break;
 			}
 			
-			// Deliver the data to the callback
-			normalizeVariableHeader(model);			// Deal with all the wacky way headers can be constructed
-			rval = get_callback_(header_[2], model, length);	// Ignore rval for now	
+			// Queue the variable, or deliver it to the callback
+			normalizeVariableHeader(rx_header, model);	// Deal with all the wacky way headers can be constructed
+			if (pool_) {
+				if (!rx_named_) {
+					break;						// No header came
+				}
+				pool_->setLength(rx_buffer_, length);
+				models_[rx_buffer_] = model;
+				done_buffer_ = rx_buffer_;
+				rx_buffer_ = -1;
+			} else if (handler_) {
+				rval = handler_->onGet(this, header_[2], model, length);
+			} else if (get_callback_) {
+				rval = get_callback_(header_[2], model, length);	// Ignore rval for now
+			}
 			break;
 	
 		case EOT:
-			// Send an ACK
+			// Send an ACK; a pooled variable is now ready
 			msg_header[0] = endpoint;
 			msg_header[1] = ACK;
 			msg_header[2] = msg_header[3] = 0x00;
 			rval = send(msg_header, NULL, 0);
+			queueReceived();
 			break;
 		
 		case REQ: {
-			memcpy(header_, data_, length);		// Save the variable header
+			memcpy(header_, rx_data, min(length, CBL2_HEADER_LEN));		// Save the variable header
 
 			// Send an ACK
 			msg_header[0] = endpoint;
@@ -258,25 +386,55 @@ int CBL2::eventLoopTick(bool quick_fail) {
 				break;
 			}
 			
-			// Get the header and data from the callback
 			data_callback_ = NULL;
+			send_data_ = data_;
 			int headerlength = length;
-			uint8_t tmp_header[16];
-			normalizeVariableHeader(model);			// Deal with all the wacky way headers can be constructed
-			memcpy(tmp_header, header_, 16);		// Save it...
-			send_callback_(header_[2], model,
-			               &headerlength, &datalength_, &data_callback_);
-			// Copy in the size.
-			tmp_header[0] = header_[0];
-			tmp_header[1] = header_[1];
-			memcpy(header_, tmp_header, 16);		// ...and restore it
+			normalizeVariableHeader(header_, model);	// Deal with all the wacky way headers can be constructed
+
+			// Serve pre-encoded variables straight from the store
+			int handle = -1;
+			if (store_) {
+				handle = store_->find(header_[2], &header_[3],
+				                      min(headerlength - 3, VARSTORE_NAME_LEN));
+			}
+			if (handle >= 0 && 0 == store_->encoded(handle, model, &send_data_, &datalength_)) {
+				TIVar::intToSizeWord(datalength_, &header_[0]);
+
+			} else if (handler_ || send_callback_) {
+				// Not in the store, or it couldn't be encoded: ask the application
+				// Get the header and data from the handler or callback
+				uint8_t tmp_header[16];
+				memcpy(tmp_header, header_, 16);		// Save it...
+				if (handler_) {
+					handler_->onSend(this, header_[2], model,
+					                 &headerlength, &datalength_, &data_callback_);
+				} else {
+					send_callback_(header_[2], model,
+					               &headerlength, &datalength_, &data_callback_);
+				}
+				// Copy in the size.
+				tmp_header[0] = header_[0];
+				tmp_header[1] = header_[1];
+				memcpy(header_, tmp_header, 16);		// ...and restore it
+
+			} else {
+				// Nothing to send. Refuse, as a calculator does, so the
+				// one asking isn't left waiting for a VAR.
+				uint8_t reason = 0x01;
+				msg_header[0] = endpoint;
+				msg_header[1] = SKIP;
+				msg_header[2] = 1;
+				msg_header[3] = 0x00;
+				rval = send(msg_header, &reason, 1);
+				break;
+			}
 			
 			// Send the VAR message
 			msg_header[0] = endpoint;
 			msg_header[1] = VAR;
 			msg_header[2] = headerlength;
 			msg_header[3] = 0x00;
-			rval = send(msg_header, header_, headerlength);
+			rval = sendAwaitAck(msg_header, header_, headerlength);
 		  }
 		  break;
 			
@@ -296,7 +454,7 @@ int CBL2::eventLoopTick(bool quick_fail) {
 			msg_header[1] = DATA;
 			msg_header[2] = (datalength_ & 0x00ff);
 			msg_header[3] = (datalength_ >> 8);
-			rval = send(msg_header, data_, datalength_, data_callback_);
+			rval = sendAwaitAck(msg_header, send_data_, datalength_, data_callback_);
 			
 			break;
 	}
@@ -304,15 +462,35 @@ int CBL2::eventLoopTick(bool quick_fail) {
 	return rval;
 }
 
-void CBL2::normalizeVariableHeader(const int model) {
-	if ((model == CALC82 || model == CALC85b) && header_[2] == VarTypes82::VarString && header_[3] == VarTypes82::VarRList) {
+// The machine ID we answer a sender with: CBL2 responds to TI-82 as
+// 0x12, "0x95" endpoint as 0x15. Returns -1 for unknown senders.
+int CBL2::endpointFor(uint8_t sender) {
+	switch(sender) {
+		case CALC82:
+			return CBL82;
+		case CALC85a:
+		case CALC85b:
+			return CBL85;
+		case CALC89:
+			return CBL89;
+		case COMP83:
+			return CALC83;
+		case COMP83P:
+			return CALC83P;
+		default:
+			return -1;
+	};
+}
+
+void CBL2::normalizeVariableHeader(uint8_t* header, const int model) {
+	if ((model == CALC82 || model == CALC85b) && header[2] == VarTypes82::VarString && header[3] == VarTypes82::VarRList) {
 		// Real list from "TI-82" (could be TI-84+SE or TI-84+CSE , variable name encoded with some odd format
-		header_[2] = VarTypes82::VarRList;
-	} else if (model == CALC82 && header_[2] == VarTypes82::VarReal && header_[3] == 0xAA /* tVarStr */) {
-		header_[2] = VarTypes82::VarString;
-	} else if (model == CALC82 && header_[2] == VarTypes82::VarReal && header_[3] == 0x5E /* tVarYVar */) {
-        header_[2] = VarTypes82::VarYVar;
-    } else if (model == CALC82 && header_[2] == VarTypes82::VarReal && header_[3] == 0x60 /* tVarPic */) {
-        header_[2] = VarTypes82::VarPic;
+		header[2] = VarTypes82::VarRList;
+	} else if (model == CALC82 && header[2] == VarTypes82::VarReal && header[3] == 0xAA /* tVarStr */) {
+		header[2] = VarTypes82::VarString;
+	} else if (model == CALC82 && header[2] == VarTypes82::VarReal && header[3] == 0x5E /* tVarYVar */) {
+        header[2] = VarTypes82::VarYVar;
+    } else if (model == CALC82 && header[2] == VarTypes82::VarReal && header[3] == 0x60 /* tVarPic */) {
+        header[2] = VarTypes82::VarPic;
     }
 }
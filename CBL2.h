@@ -11,6 +11,8 @@
 
 #include "Arduino.h"
 #include "TICL.h"
+#include "PacketPool.h"
+#include "VarStore.h"
 
 namespace VarTypes82 { enum VarTypes82 {
 	VarReal = 0,
@@ -49,6 +51,25 @@ namespace VarTypes85 { enum VarTypes85 {
 
 typedef uint8_t(*data_callback)(int);
 
+#define CBL2_HEADER_LEN		16				// Variable header buffer size
+#define CBL2_MAX_BUFFERS	PACKETPOOL_MAX_SLOTS	// Largest receive buffer pool
+
+class CBL2;
+
+// Receives a CBL2's variables and provides the ones the calculator
+// asks for, like the callbacks given to setupCallbacks(), but told
+// which CBL2 is calling. Give each CBL2 a handler object of its own
+// to keep per-link state in it, or share one between several.
+class CBL2Handler {
+	public:
+		// A variable arrived in cbl->header() and cbl->data()
+		virtual int onGet(CBL2* cbl, uint8_t type, enum Endpoint model, int datalength) = 0;
+		// The calculator asked for a variable; put it in cbl->data()
+		// and its size word in cbl->header()
+		virtual int onSend(CBL2* cbl, uint8_t type, enum Endpoint model, int* headerlength,
+		                   int* datalength, data_callback* callback) = 0;
+};
+
 class CBL2: public TICL {
 	public:
 		CBL2();
@@ -62,6 +83,25 @@ class CBL2: public TICL {
 		int setupCallbacks(uint8_t* header, uint8_t* data, int maxlength,
 		                   int (*get_callback)(uint8_t, enum Endpoint, int),
 						   int (*send_callback)(uint8_t, enum Endpoint, int*, int*, data_callback*));
+		int setupHandler(uint8_t* header, uint8_t* data, int maxlength, CBL2Handler* handler);
+		int setupVarStore(VarStore* store);			// Answer Get( from pre-encoded variables
+		uint8_t* header();							// The buffers given to setupCallbacks()
+		uint8_t* data();							// or setupHandler()
+
+		// Receive into the slots of a pool, so each variable can be
+		// processed while the next ones arrive. A slot holds the variable
+		// header, CBL2_HEADER_LEN bytes, then up to slotSize() -
+		// CBL2_HEADER_LEN bytes of data, both received where they stay.
+		// Received variables queue up in arrival order once each exchange
+		// ends, instead of going to get_callback. Take the oldest with
+		// nextVariable(), which returns its slot or -1, and release() the
+		// slot when done with it. While every slot is taken, a
+		// calculator's Send( waits for its CTS; Get( is still answered.
+		// setupCallbacks() still provides the buffers for Get(, and
+		// for packets that arrive while no slot is free.
+		int setupBufferPool(PacketPool* pool);
+		int nextVariable(uint8_t** header, uint8_t** data, enum Endpoint* model, int* datalength);
+		void release(int buffer);
 		int eventLoopTick(bool quick_fail = false);				// Usually called in loop()
 
 	private:
@@ -69,13 +109,47 @@ class CBL2: public TICL {
 		bool callback_init;
 		uint8_t* header_;							// Variable header, not msg header, returned to callbacks!
 		uint8_t* data_;								// Variable data returned to callbacks
+		uint8_t* send_data_;						// Variable data sent on the next CTS
+		VarStore* store_;
+		CBL2Handler* handler_;
 		int datalength_;
 		int maxlength_;
 		data_callback data_callback_;
 		int (*get_callback_)(uint8_t, enum Endpoint, int);	// Called when data received from calculator
 		int (*send_callback_)(uint8_t, enum Endpoint, int*, int*, data_callback*);	// Called when calculator wants to get data
 		
-		void normalizeVariableHeader(const int model);
+		// Receive buffer pool
+		PacketPool* pool_;
+		int rx_buffer_;								// Being received into, or -1
+		bool rx_named_;								// Its variable header is in
+		int done_buffer_;							// Received, waiting for the EOT, or -1
+		int cts_endpoint_;							// RTS ACKed with no slot free, its CTS held back, or -1
+		uint8_t models_[CBL2_MAX_BUFFERS];
+
+		void queueReceived();
+		void normalizeVariableHeader(uint8_t* header, const int model);
+		static int endpointFor(uint8_t sender);
+};
+
+// A CBL2 that owns its header and data buffers, sized at compile time
+// for variables of up to MaxData bytes. Several can be declared side by
+// side, on their own lines, with no buffers of their own and no heap.
+template<int MaxData> class StaticCBL2: public CBL2 {
+	public:
+		StaticCBL2() : CBL2() {}
+		StaticCBL2(int tip, int ring) : CBL2(tip, ring) {}
+
+		int setupCallbacks(int (*get_callback)(uint8_t, enum Endpoint, int),
+		                   int (*send_callback)(uint8_t, enum Endpoint, int*, int*, data_callback*)) {
+			return CBL2::setupCallbacks(header_buffer_, data_buffer_, MaxData, get_callback, send_callback);
+		}
+		int setupHandler(CBL2Handler* handler) {
+			return CBL2::setupHandler(header_buffer_, data_buffer_, MaxData, handler);
+		}
+
+	private:
+		uint8_t header_buffer_[CBL2_HEADER_LEN];
+		uint8_t data_buffer_[MaxData];
 };
 
 #endif	// CBL2_H
\ No newline at end of file
@@ -0,0 +1,277 @@
+/*************************************************
+ *  DataLogger.cpp - Fixed-rate sampling into a  *
+ *           ring buffer, served to calculators  *
+ *           as lists in chunks.                 *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "DataLogger.h"
+#include "TIVar.h"
+
+// The buffer holds bufferlength samples, shared between the channels:
+// with N channels, it holds the last bufferlength / N records.
+DataLogger::DataLogger(int16_t* buffer, int bufferlength) {
+	buffer_ = buffer;
+	bufferlength_ = bufferlength;
+	capacity_ = 0;
+	channelcount_ = 0;
+	read_callback_ = NULL;
+	period_ = 1000;
+	decimation_ = 1;
+	trigger_ = TRIGGER_NONE;
+	triggerchannel_ = 0;
+	triggerlevel_ = 0;
+	pretrigger_ = 0;
+	posttrigger_ = 0;
+	state_ = LOGGER_IDLE;
+	written_ = 0;
+	head_ = 0;
+	triggerrecord_ = 0;
+}
+
+int DataLogger::setChannels(const int* pins, int count) {
+	if (count < 1 || count > LOGGER_MAX_CHANNELS || count > bufferlength_) {
+		return -1;
+	}
+	for(int i = 0; i < count; i++) {
+		pins_[i] = pins[i];
+	}
+	channelcount_ = count;
+	capacity_ = bufferlength_ / count;
+	return 0;
+}
+
+// Read channels through a function other than analogRead(), for
+// example an external ADC or a simulated one.
+void DataLogger::setReadCallback(int (*read_callback)(int)) {
+	read_callback_ = read_callback;
+}
+
+// Each record is the average of decimation samples taken
+// period_us microseconds apart.
+int DataLogger::setRate(unsigned long period_us, int decimation) {
+	if (period_us == 0 || decimation < 1) {
+		return -1;
+	}
+	period_ = period_us;
+	decimation_ = decimation;
+	return 0;
+}
+
+// Keep pretrigger records from before the trigger, and stop after
+// posttrigger records (counting the trigger record itself). With
+// posttrigger = 0 the logger keeps overwriting the oldest records.
+int DataLogger::setTrigger(enum TriggerMode mode, int channel, int level,
+                           int pretrigger, int posttrigger)
+{
+	if (channel < 0 || channel >= channelcount_ || pretrigger < 0 || posttrigger < 0 ||
+	    (posttrigger > 0 && pretrigger + posttrigger > capacity_))
+	{
+		return -1;
+	}
+	trigger_ = mode;
+	triggerchannel_ = channel;
+	triggerlevel_ = level;
+	pretrigger_ = (mode == TRIGGER_NONE) ? 0 : pretrigger;
+	posttrigger_ = posttrigger;
+	return 0;
+}
+
+void DataLogger::start(unsigned long now) {
+	noInterrupts();
+	written_ = 0;
+	head_ = 0;
+	triggerrecord_ = 0;
+	accumcount_ = 0;
+	for(int i = 0; i < channelcount_; i++) {
+		accum_[i] = 0;
+	}
+	next_ = now;
+	state_ = (channelcount_ > 0) ? LOGGER_ARMED : LOGGER_IDLE;
+	interrupts();
+}
+
+void DataLogger::stop() {
+	state_ = LOGGER_IDLE;
+}
+
+// Take one sample of every channel. This is short and bounded so that it
+// can run in a timer interrupt, which keeps the sample clock independent
+// of whatever the link is doing.
+void DataLogger::sample() {
+	if (state_ != LOGGER_ARMED && state_ != LOGGER_TRIGGERED) {
+		return;
+	}
+	for(int i = 0; i < channelcount_; i++) {
+		accum_[i] += readChannel(i);
+	}
+	if (++accumcount_ >= decimation_) {
+		store();
+	}
+}
+
+// Polling alternative to sample() from an interrupt: takes every sample
+// that has come due by now, and returns how many were taken.
+int DataLogger::tick(unsigned long now) {
+	int taken = 0;
+	while ((state_ == LOGGER_ARMED || state_ == LOGGER_TRIGGERED) &&
+	       (long)(now - next_) >= 0)
+	{
+		sample();
+		next_ += period_;
+		taken++;
+	}
+	return taken;
+}
+
+void DataLogger::store() {
+	int16_t* record = &buffer_[head_ * channelcount_];
+	for(int i = 0; i < channelcount_; i++) {
+		record[i] = (int16_t)(accum_[i] / decimation_);
+		accum_[i] = 0;
+	}
+	accumcount_ = 0;
+	if (++head_ >= capacity_) {
+		head_ = 0;
+	}
+	uint32_t index = written_++;
+
+	if (state_ == LOGGER_ARMED) {
+		int16_t value = record[triggerchannel_];
+		bool fired = (trigger_ == TRIGGER_NONE);
+		if (index > 0 && index >= (uint32_t)pretrigger_) {
+			if (trigger_ == TRIGGER_RISING) {
+				fired = (lastvalue_ < triggerlevel_ && value >= triggerlevel_);
+			} else if (trigger_ == TRIGGER_FALLING) {
+				fired = (lastvalue_ > triggerlevel_ && value <= triggerlevel_);
+			}
+		}
+		lastvalue_ = value;
+		if (fired) {
+			triggerrecord_ = index;
+			state_ = LOGGER_TRIGGERED;
+		}
+	}
+	if (state_ == LOGGER_TRIGGERED && posttrigger_ > 0 &&
+	    written_ - triggerrecord_ >= (uint32_t)posttrigger_)
+	{
+		state_ = LOGGER_DONE;
+	}
+}
+
+int16_t DataLogger::readChannel(int channel) {
+	if (read_callback_) {
+		return read_callback_(pins_[channel]);
+	}
+	return analogRead(pins_[channel]);
+}
+
+enum LoggerState DataLogger::state() {
+	return state_;
+}
+
+// Number of records available for readout: everything still in the
+// ring, minus anything older than the pre-trigger window.
+int DataLogger::records() {
+	uint32_t first, trigger;
+	return window(&first, &trigger);
+}
+
+// Snapshot the readout window, since the sampling interrupt keeps
+// moving it while the logger runs.
+int DataLogger::window(uint32_t* first, uint32_t* trigger) {
+	noInterrupts();
+	uint32_t written = written_;
+	enum LoggerState state = state_;
+	*trigger = triggerrecord_;
+	interrupts();
+
+	*first = (written > (uint32_t)capacity_) ? written - capacity_ : 0;
+	if ((state == LOGGER_TRIGGERED || state == LOGGER_DONE) &&
+	    *trigger >= (uint32_t)pretrigger_ && *trigger - pretrigger_ > *first)
+	{
+		*first = *trigger - pretrigger_;
+	}
+	return (int)(written - *first);
+}
+
+// Elements of a list that fit in one variable of maxlength bytes
+int DataLogger::chunkSize(int maxlength, enum Endpoint model) {
+	int realsize = TIVar::sizeOfReal(model);
+	if (realsize <= 0 || maxlength < 2 + realsize) {
+		return 0;
+	}
+	return (maxlength - 2) / realsize;
+}
+
+int DataLogger::chunkCount(int maxlength, enum Endpoint model) {
+	int size = chunkSize(maxlength, model);
+	if (size == 0) {
+		return 0;
+	}
+	return (records() + size - 1) / size;
+}
+
+// Encode up to count records of one column, starting at the first-th
+// oldest available record, as a real list. Returns the variable length
+// in bytes.
+int DataLogger::readList(int column, int first, int count, uint8_t* data, int maxlength, enum Endpoint model) {
+#if !TICL_REALS
+	return -1;
+#else
+	if (column < 0 || column > channelcount_ || first < 0) {
+		return -1;
+	}
+
+	uint32_t start, trigger;
+	int available = window(&start, &trigger);
+	int size = chunkSize(maxlength, model);
+	count = min(count, min(size, available - first));
+	if (count < 0) {
+		count = 0;
+	}
+	start += first;
+
+	// Times are relative to the trigger record, negative before it
+	double seconds = (double)period_ * decimation_ * 1e-6;
+
+	// A running logger overwrites the oldest records as this reads
+	// them. Each one is checked and copied with the sampling interrupt
+	// masked, and the list ends before the first one that's gone, so
+	// every column of a chunk stops at the same record.
+	int offset = 2;						// Offset past the count word
+	int i;
+	for(i = 0; i < count; i++) {
+		uint32_t index = start + i;
+		int slot = (int)(index % (uint32_t)capacity_);
+		noInterrupts();
+		bool kept = (written_ - index <= (uint32_t)capacity_);
+		int16_t value = (column == 0) ? 0 : buffer_[slot * channelcount_ + column - 1];
+		interrupts();
+		if (!kept) {
+			break;
+		}
+		int rval;
+		if (column == 0) {
+			rval = TIVar::floatToReal8x(((long)index - (long)trigger) * seconds,
+			                            &data[offset], model);
+		} else {
+			rval = TIVar::longToReal8x(value, &data[offset], model);
+		}
+		if (rval < 0) {
+			return -1;
+		}
+		offset += rval;
+	}
+	TIVar::intToSizeWord(i, &data[0]);
+	return offset;
+#endif	// TICL_REALS
+}
+
+int DataLogger::readChunk(int column, int chunk, uint8_t* data, int maxlength, enum Endpoint model) {
+	int size = chunkSize(maxlength, model);
+	return readList(column, chunk * size, size, data, maxlength, model);
+}
@@ -0,0 +1,91 @@
+/*************************************************
+ *  DataLogger.h - Fixed-rate sampling into a    *
+ *           ring buffer, served to calculators  *
+ *           as lists in chunks.                 *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef DATALOGGER_H
+#define DATALOGGER_H
+
+#include "Arduino.h"
+#include "TICL.h"
+
+#define LOGGER_MAX_CHANNELS 4
+
+enum TriggerMode {
+	TRIGGER_NONE = 0,				// Start capturing immediately
+	TRIGGER_RISING = 1,				// Channel crosses the level going up
+	TRIGGER_FALLING = 2,			// Channel crosses the level going down
+};
+
+enum LoggerState {
+	LOGGER_IDLE = 0,				// Not sampling
+	LOGGER_ARMED = 1,				// Filling pre-trigger samples, waiting for trigger
+	LOGGER_TRIGGERED = 2,			// Capturing post-trigger samples
+	LOGGER_DONE = 3,				// Capture complete, sampling stopped
+};
+
+class DataLogger {
+	public:
+		DataLogger(int16_t* buffer, int bufferlength);
+
+		// Configuration; call these while the logger is stopped
+		int setChannels(const int* pins, int count);
+		void setReadCallback(int (*read_callback)(int));
+		int setRate(unsigned long period_us, int decimation = 1);
+		int setTrigger(enum TriggerMode mode, int channel, int level,
+		               int pretrigger, int posttrigger);
+
+		void start(unsigned long now);
+		void stop();
+
+		// Sampling. Call sample() from a timer interrupt running at the
+		// configured period, or tick() with the current time if polling.
+		void sample();
+		int tick(unsigned long now);
+
+		// Readout. Column 0 is time in seconds relative to the trigger,
+		// columns 1 through the channel count hold the samples.
+		enum LoggerState state();
+		int records();
+		int chunkSize(int maxlength, enum Endpoint model);
+		int chunkCount(int maxlength, enum Endpoint model);
+		int readList(int column, int first, int count, uint8_t* data, int maxlength, enum Endpoint model);
+		int readChunk(int column, int chunk, uint8_t* data, int maxlength, enum Endpoint model);
+
+	private:
+		void store();
+		int16_t readChannel(int channel);
+		int window(uint32_t* first, uint32_t* trigger);
+
+		int16_t* buffer_;
+		int bufferlength_;
+		int capacity_;						// In records of channelcount_ samples
+		int pins_[LOGGER_MAX_CHANNELS];
+		int channelcount_;
+		int (*read_callback_)(int);
+
+		unsigned long period_;
+		int decimation_;
+		unsigned long next_;				// When tick() should take the next sample
+
+		enum TriggerMode trigger_;
+		int triggerchannel_;
+		int16_t triggerlevel_;
+		int pretrigger_;
+		int posttrigger_;
+
+		// Shared with the sampling interrupt
+		volatile enum LoggerState state_;
+		volatile uint32_t written_;			// Records stored since start()
+		int head_;							// Slot the next record goes into
+		volatile uint32_t triggerrecord_;	// Record index of the trigger
+		volatile int16_t lastvalue_;		// Previous trigger channel record
+		int32_t accum_[LOGGER_MAX_CHANNELS];	// Decimation accumulators
+		int accumcount_;
+};
+
+#endif	// DATALOGGER_H
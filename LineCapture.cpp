@@ -0,0 +1,97 @@
+/*************************************************
+ *  LineCapture.cpp - Records tip/ring           *
+ *           transitions for timing analysis,    *
+ *           and writes them out as a VCD        *
+ *           waveform file.                      *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "LineCapture.h"
+
+// One-character VCD identifiers for each signal
+static const char vcdSignals[4] = {'t', 'r', 'T', 'R'};
+static const char* const vcdNames[4] = {"tip", "ring", "tip_drive", "ring_drive"};
+
+LineCapture::LineCapture(struct LineEvent* buffer, int capacity) {
+	buffer_ = buffer;
+	capacity_ = capacity;
+	enabled_ = true;
+	clear();
+}
+
+void LineCapture::clear() {
+	head_ = count_ = 0;
+	state_ = CAPTURE_TIP | CAPTURE_RING;
+	overflowed_ = false;
+}
+
+void LineCapture::setEnabled(bool enabled) {
+	enabled_ = enabled;
+}
+
+int LineCapture::count() {
+	return count_;
+}
+
+bool LineCapture::overflowed() {
+	return overflowed_;
+}
+
+struct LineEvent* LineCapture::event(int idx) {
+	if (idx < 0 || idx >= count_) {
+		return NULL;
+	}
+	idx += head_ - count_;
+	if (idx < 0) {
+		idx += capacity_;
+	}
+	return &buffer_[idx];
+}
+
+int LineCapture::writeVCD(Print* out) {
+	out->println("$timescale 1us $end");
+	out->println("$scope module articl $end");
+	for(int i = 0; i < 4; i++) {
+		out->print("$var wire 1 ");
+		out->print(vcdSignals[i]);
+		out->print(' ');
+		out->print(vcdNames[i]);
+		out->println(" $end");
+	}
+	out->println("$var wire 8 b byte $end");
+	out->println("$upscope $end");
+	out->println("$enddefinitions $end");
+	if (count_ == 0) {
+		return 0;
+	}
+
+	// The first event sets every signal, the rest only what changed
+	uint32_t start = event(0)->time;
+	uint8_t last = 0;
+	for(int i = 0; i < count_; i++) {
+		struct LineEvent* e = event(i);
+		if (i == 0 || e->time != event(i - 1)->time) {
+			out->print('#');
+			out->println((unsigned long)(e->time - start));
+		}
+		uint8_t changed = (i == 0) ? 0x0f : (e->state ^ last);
+		for(int bit = 0; bit < 4; bit++) {
+			if ((changed >> bit) & 1) {
+				out->print((e->state >> bit) & 1 ? '1' : '0');
+				out->println(vcdSignals[bit]);
+			}
+		}
+		if (e->state & CAPTURE_BYTE) {
+			out->print('b');
+			for(int bit = 7; bit >= 0; bit--) {
+				out->print((e->byte >> bit) & 1 ? '1' : '0');
+			}
+			out->println(" b");
+		}
+		last = e->state;
+	}
+	return count_;
+}
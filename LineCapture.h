@@ -0,0 +1,98 @@
+/*************************************************
+ *  LineCapture.h - Records tip/ring transitions *
+ *           for timing analysis, and writes     *
+ *           them out as a VCD waveform file.    *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef LINECAPTURE_H
+#define LINECAPTURE_H
+
+#include "Arduino.h"
+
+// Bits of LineEvent::state
+#define CAPTURE_TIP			0x01		// Tip level
+#define CAPTURE_RING		0x02		// Ring level
+#define CAPTURE_TIP_DRIVE	0x04		// We are pulling tip low
+#define CAPTURE_RING_DRIVE	0x08		// We are pulling ring low
+#define CAPTURE_BYTE		0x10		// A byte starts (sent) or ends (received)
+
+struct LineEvent {
+	uint32_t time;						// micros()
+	uint8_t state;
+	uint8_t byte;						// With CAPTURE_BYTE, the byte
+};
+
+class LineCapture {
+	public:
+		// The buffer is a ring: once full, the oldest events are dropped
+		LineCapture(struct LineEvent* buffer, int capacity);
+		void clear();
+		void setEnabled(bool enabled);
+
+		// Called by TICL from the bit loop; they only store an event
+		// when something changed.
+		void observe(bool tip, bool ring) {
+			record((state_ & (CAPTURE_TIP_DRIVE | CAPTURE_RING_DRIVE)) |
+			       (tip ? CAPTURE_TIP : 0) | (ring ? CAPTURE_RING : 0), 0);
+		}
+		void drive(bool tip, bool ring) {
+			uint8_t state = state_ & (CAPTURE_TIP | CAPTURE_RING);
+			if (state_ & CAPTURE_TIP_DRIVE) {
+				state |= CAPTURE_TIP;			// Lines we let go of float up
+			}
+			if (state_ & CAPTURE_RING_DRIVE) {
+				state |= CAPTURE_RING;
+			}
+			if (tip) {
+				state = (state & ~CAPTURE_TIP) | CAPTURE_TIP_DRIVE;
+			}
+			if (ring) {
+				state = (state & ~CAPTURE_RING) | CAPTURE_RING_DRIVE;
+			}
+			record(state, 0);
+		}
+		void byte(uint8_t byte) {
+			record(state_ | CAPTURE_BYTE, byte);
+		}
+
+		int count();						// Events held
+		bool overflowed();					// Older events were dropped
+		struct LineEvent* event(int idx);	// Oldest first
+
+		// Write the events as a Value Change Dump, with times in
+		// microseconds from the first event
+		int writeVCD(Print* out);
+
+	private:
+		void record(uint8_t state, uint8_t byte) {
+			if (!enabled_ || (state == state_ && !(state & CAPTURE_BYTE))) {
+				return;
+			}
+			struct LineEvent* event = &buffer_[head_];
+			event->time = micros();
+			event->state = state;
+			event->byte = byte;
+			state_ = state & ~CAPTURE_BYTE;
+			if (++head_ == capacity_) {
+				head_ = 0;
+			}
+			if (count_ < capacity_) {
+				count_++;
+			} else {
+				overflowed_ = true;
+			}
+		}
+
+		struct LineEvent* buffer_;
+		int capacity_;
+		int head_;
+		int count_;
+		uint8_t state_;
+		bool enabled_;
+		bool overflowed_;
+};
+
+#endif	// LINECAPTURE_H
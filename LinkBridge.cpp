@@ -0,0 +1,194 @@
+/*************************************************
+ *  LinkBridge.cpp - Forwards TI link packets    *
+ *           between a serial host (a PC link    *
+ *           tool) and the attached device.      *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "LinkBridge.h"
+#include "TIVar.h"
+
+// Constructor with default communication lines
+LinkBridge::LinkBridge() :
+	TICL()
+{
+	init();
+}
+
+// Constructor with custom communication lines.
+LinkBridge::LinkBridge(int tip, int ring) :
+	TICL(tip, ring)
+{
+	init();
+}
+
+void LinkBridge::init() {
+	host_ = NULL;
+	memset(&tolink_, 0, sizeof(tolink_));
+	memset(&tohost_, 0, sizeof(tohost_));
+	tolinkframe_.reset();
+	tohostframe_.reset();
+	memset(counters_, 0, sizeof(counters_));
+	discarding_ = false;
+	statuspending_ = false;
+	hostbyteat_ = 0;
+}
+
+// The host port should already be running, at the fastest rate the
+// host tool supports: the link is usually the faster side.
+void LinkBridge::begin(HardwareSerial* host) {
+	host_ = host;
+	resetLines();
+}
+
+// Move as much data as can be moved without waiting on the host. The
+// link is half-duplex, so an incoming transfer always wins over an
+// outgoing one; the peer keeps waiting on its bit if the queue toward
+// the host is full, which is the link's flow control.
+int LinkBridge::bridgeTick() {
+	int rval = 0;
+
+	if (host_ == NULL) {
+		return ERR_INVALID;
+	}
+
+	while (host_->available() > 0 && tolink_.count < BRIDGE_QUEUE_SIZE) {
+		push(&tolink_, host_->read());
+		hostbyteat_ = millis();
+	}
+	if (tolink_.count == 0 && !tolinkframe_.idle() &&
+	    millis() - hostbyteat_ > BRIDGE_HOST_TIMEOUT)
+	{
+		// The host timed out partway through a packet and will resend
+		if (!discarding_) {
+			counters_[STATUS_DROPPED_PACKETS]++;
+		}
+		tolinkframe_.reset();
+		discarding_ = false;
+	}
+
+	while (rval == 0) {
+		if (!linesIdle()) {
+			if (tohost_.count >= BRIDGE_QUEUE_SIZE) {
+				break;
+			}
+			rval = receiveFromLink();
+		} else if (tolink_.count > 0) {
+			rval = forwardToLink();
+		} else {
+			break;
+		}
+		drainToHost();
+	}
+
+	if (statuspending_) {
+		queueStatus();
+	}
+	drainToHost();
+	return rval;
+}
+
+uint16_t LinkBridge::status(enum BridgeStatus item) {
+	switch(item) {
+		case STATUS_LINK_QUEUE_FREE:
+			return BRIDGE_QUEUE_SIZE - tolink_.count;
+		case STATUS_HOST_QUEUE_USED:
+			return tohost_.count;
+		default:
+			return counters_[item];
+	}
+}
+
+// Send the next queued host byte over the link, unless it belongs to a
+// packet for the bridge itself or to one being dropped after an error.
+int LinkBridge::forwardToLink() {
+	if (tolinkframe_.idle()) {
+		discarding_ = (tolink_.data[tolink_.head] == BRIDGE_ID);
+	}
+
+	uint8_t byte = pop(&tolink_);
+	int rval = 0;
+	if (!discarding_) {
+		rval = sendByte(byte);
+		if (rval) {
+			counters_[STATUS_LINK_ERRORS]++;
+			counters_[STATUS_DROPPED_PACKETS]++;
+			discarding_ = true;
+		}
+	}
+
+	enum PacketEvent event = tolinkframe_.push(byte);
+	if (event == PACKET_COMPLETE || event == PACKET_ERROR) {
+		if (tolinkframe_.header()[0] == BRIDGE_ID) {
+			statuspending_ = true;
+		} else if (!discarding_) {
+			counters_[STATUS_PACKETS_TO_LINK]++;
+		}
+		discarding_ = false;
+	}
+	return (rval == ERR_WRITE_TIMEOUT) ? 0 : rval;		// The host will time out and retry
+}
+
+int LinkBridge::receiveFromLink() {
+	uint8_t byte;
+	int rval = getByte(&byte, TIMEOUT);
+	if (rval) {
+		// Whatever the peer sends next starts a new packet
+		counters_[STATUS_LINK_ERRORS]++;
+		tohostframe_.reset();
+		return 0;
+	}
+	push(&tohost_, byte);
+	enum PacketEvent event = tohostframe_.push(byte);
+	if (event == PACKET_COMPLETE || event == PACKET_ERROR) {
+		counters_[STATUS_PACKETS_TO_HOST]++;
+	}
+	return 0;
+}
+
+// Write whatever the host port can take right now
+void LinkBridge::drainToHost() {
+	int room = host_->availableForWrite();
+	while (room-- > 0 && tohost_.count > 0) {
+		host_->write(pop(&tohost_));
+	}
+}
+
+// Status reports go between packets in the stream to the host
+void LinkBridge::queueStatus() {
+	if (!tohostframe_.idle() ||
+	    tohost_.count + PACKET_HEADER_LEN + BRIDGE_STATUS_LEN + 2 > BRIDGE_QUEUE_SIZE)
+	{
+		return;
+	}
+
+	uint8_t header[PACKET_HEADER_LEN] = {BRIDGE_ID, DATA, 0x00, 0x00};
+	uint8_t report[BRIDGE_STATUS_LEN];
+	TIVar::intToSizeWord(BRIDGE_STATUS_LEN, &header[2]);
+	for(int i = 0; i < BRIDGE_STATUS_LEN / 2; i++) {
+		TIVar::intToSizeWord(status((enum BridgeStatus)i), &report[2 * i]);
+	}
+
+	PacketSerializer packet;
+	packet.begin(header, report, BRIDGE_STATUS_LEN);
+	int byte;
+	while ((byte = packet.next()) >= 0) {
+		push(&tohost_, byte);
+	}
+	statuspending_ = false;
+}
+
+void LinkBridge::push(struct BridgeQueue* queue, uint8_t byte) {
+	queue->data[(queue->head + queue->count) % BRIDGE_QUEUE_SIZE] = byte;
+	queue->count++;
+}
+
+uint8_t LinkBridge::pop(struct BridgeQueue* queue) {
+	uint8_t byte = queue->data[queue->head];
+	queue->head = (queue->head + 1) % BRIDGE_QUEUE_SIZE;
+	queue->count--;
+	return byte;
+}
@@ -0,0 +1,77 @@
+/*************************************************
+ *  LinkBridge.h - Forwards TI link packets      *
+ *           between a serial host (a PC link    *
+ *           tool) and the attached device.      *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef LINKBRIDGE_H
+#define LINKBRIDGE_H
+
+#include "Arduino.h"
+#include "TICL.h"
+#include "TIPacket.h"
+
+#ifndef BRIDGE_QUEUE_SIZE
+#define BRIDGE_QUEUE_SIZE	128			// Bytes buffered in each direction
+#endif
+
+// A host packet that stops partway for this long (ms), with nothing
+// left queued, was given up on: whatever the host sends next starts a
+// new packet. Shorter than a host tool's own timeout.
+#ifndef BRIDGE_HOST_TIMEOUT
+#define BRIDGE_HOST_TIMEOUT	500
+#endif
+
+// Packets from the host with this machine ID are for the bridge itself
+// and are not forwarded. Any such packet asks for a status report, sent
+// back as a DATA packet from BRIDGE_ID carrying the BridgeStatus words.
+#define BRIDGE_ID			0x7F
+#define BRIDGE_STATUS_LEN	12
+
+enum BridgeStatus {
+	STATUS_LINK_QUEUE_FREE = 0,			// Bytes the host may send without waiting
+	STATUS_HOST_QUEUE_USED = 1,			// Bytes from the link not yet sent to the host
+	STATUS_PACKETS_TO_LINK = 2,
+	STATUS_PACKETS_TO_HOST = 3,
+	STATUS_LINK_ERRORS = 4,				// Bytes the link failed to send or receive
+	STATUS_DROPPED_PACKETS = 5,			// Host packets discarded after a link error
+};
+
+struct BridgeQueue {
+	uint8_t data[BRIDGE_QUEUE_SIZE];
+	uint16_t head;
+	uint16_t count;
+};
+
+class LinkBridge: public TICL {
+	public:
+		LinkBridge();
+		LinkBridge(int tip, int ring);
+		void begin(HardwareSerial* host);
+		int bridgeTick();				// Usually called in loop()
+		uint16_t status(enum BridgeStatus item);
+
+	private:
+		void init();
+		int forwardToLink();
+		int receiveFromLink();
+		void drainToHost();
+		void queueStatus();
+		static void push(struct BridgeQueue* queue, uint8_t byte);
+		static uint8_t pop(struct BridgeQueue* queue);
+
+		HardwareSerial* host_;
+		struct BridgeQueue tolink_;
+		struct BridgeQueue tohost_;
+		PacketParser tolinkframe_;			// Packet boundaries in each direction
+		PacketParser tohostframe_;
+		bool discarding_;				// Dropping the rest of a host packet
+		bool statuspending_;
+		unsigned long hostbyteat_;			// millis() of the last byte from the host
+		uint16_t counters_[BRIDGE_STATUS_LEN / 2];
+};
+
+#endif	// LINKBRIDGE_H
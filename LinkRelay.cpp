@@ -0,0 +1,190 @@
+/*************************************************
+ *  LinkRelay.cpp - Cut-through forwarding of TI *
+ *           link packets between two links.     *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "LinkRelay.h"
+
+// Both links should already be set up with begin()
+LinkRelay::LinkRelay(TICL* a, TICL* b) {
+	links_[RELAY_A_TO_B] = a;
+	links_[RELAY_B_TO_A] = b;
+	header_hook_ = NULL;
+	data_hook_ = NULL;
+	packets_[0] = packets_[1] = 0;
+	dropped_ = 0;
+	errors_ = 0;
+}
+
+void LinkRelay::setHooks(relay_header_hook header_hook, relay_data_hook data_hook) {
+	header_hook_ = header_hook;
+	data_hook_ = data_hook;
+}
+
+// Forward one packet from whichever link starts one within timeout
+// microseconds. Returns 0 when it was forwarded, 1 when the header hook
+// dropped it, ERR_INVALID when the hook changed whether it carries
+// data, ERR_READ_TIMEOUT when neither end sent anything, or the
+// error that stopped the transfer.
+int LinkRelay::relayTick(unsigned long timeout) {
+	PacketParser packet;
+	enum PacketEvent event;
+	uint8_t header[PACKET_HEADER_LEN];
+	uint8_t byte;
+	int rval;
+
+	unsigned long previousMicros = micros();
+	int side;
+	while (true) {
+		if (!links_[RELAY_A_TO_B]->linesIdle()) {
+			side = RELAY_A_TO_B;
+			break;
+		}
+		if (!links_[RELAY_B_TO_A]->linesIdle()) {
+			side = RELAY_B_TO_A;
+			break;
+		}
+		if (micros() - previousMicros > timeout) {
+			return ERR_READ_TIMEOUT;
+		}
+	}
+	TICL* from = links_[side];
+	TICL* to = links_[1 - side];
+	enum RelayDirection direction = (enum RelayDirection)side;
+
+	// The header is held back, so the hook can see it whole
+	do {
+		if ((rval = from->getByte(&byte, TIMEOUT))) {
+			errors_++;
+			return rval;
+		}
+		event = packet.push(byte);
+	} while (event == PACKET_NONE);
+	memcpy(header, packet.header(), PACKET_HEADER_LEN);
+	int remaining = (event == PACKET_HEADER) ? packet.dataLength() + 2 : 0;
+
+	// The sender sends its data whatever the hook does, and the receiver
+	// reads data if the command it's given carries data and the length
+	// bytes, which are passed on as sent, aren't zero. A rewrite can't
+	// change which of those it is. The length bytes of a command without
+	// data hold other information, so go by them rather than
+	// dataLength(), which is 0 for those commands.
+	bool drop = header_hook_ && header_hook_(direction, header);
+	int rawlength = (int)packet.header()[2] | ((int)packet.header()[3] << 8);
+	bool rewritten = rawlength > 0 &&
+	                 PacketParser::commandHasData(header[1]) != PacketParser::commandHasData(packet.header()[1]);
+	if (drop || rewritten) {
+		// Take the rest from the sender, and pass none of it on
+		while (remaining-- > 0) {
+			if ((rval = from->getByte(&byte, TIMEOUT))) {
+				errors_++;
+				return rval;
+			}
+		}
+		if (rewritten) {
+			errors_++;
+			return ERR_INVALID;
+		}
+		dropped_++;
+		return 1;
+	}
+	header[2] = packet.header()[2];			// The sender decides the length
+	header[3] = packet.header()[3];
+
+	// The sender waits on its next bit while the header goes out
+	for(int i = 0; i < PACKET_HEADER_LEN; i++) {
+		if ((rval = to->sendByte(header[i]))) {
+			errors_++;
+			return rval;
+		}
+	}
+	while (remaining-- > 0) {
+		if ((rval = relayByte(from, to, &byte))) {
+			errors_++;
+			return rval;
+		}
+		event = packet.push(byte);
+		if (event == PACKET_PAYLOAD && data_hook_) {
+			data_hook_(direction, packet.dataIndex(), byte);
+		} else if (event == PACKET_ERROR) {
+			errors_++;						// The receiver asks for a resend
+		}
+	}
+	packets_[side]++;
+	return 0;
+}
+
+// Pass one byte on a bit at a time. Each bit from the sender is driven
+// onto the receiver's lines at once; the sender's bit is acknowledged
+// when the receiver acknowledges ours, and both ends then release their
+// lines together.
+int LinkRelay::relayByte(TICL* from, TICL* to, uint8_t* byte) {
+	int rval;
+	if (TICL_FAST && (from->fast_ || to->fast_)) {
+		// Fast-mode bits can't be held up, so take the whole byte first
+		if ((rval = from->getByte(byte, TIMEOUT))) {
+			return rval;
+		}
+		return to->sendByte(*byte);
+	}
+
+	*byte = 0;
+	for(int bit = 0; bit < 8; bit++) {
+		int linevals;
+		unsigned long previousMicros = micros();
+		while ((linevals = ((digitalRead(from->ring_) << 1) | digitalRead(from->tip_))) == 0x03) {
+			if (micros() - previousMicros > TIMEOUT) {
+				from->resetLines();
+				return ERR_READ_TIMEOUT;
+			}
+		}
+		bool bitval = (linevals == 0x01);		// Ring low for a 1, tip low for a 0
+		*byte = (*byte >> 1) | (bitval ? 0x80 : 0x00);
+
+		// Send the bit once the receiver has released the last one
+		if (!to->waitLine(to->tip_, HIGH, TIMEOUT) || !to->waitLine(to->ring_, HIGH, TIMEOUT)) {
+			from->resetLines();
+			return ERR_WRITE_TIMEOUT;
+		}
+		int line = bitval ? to->ring_ : to->tip_;
+		pinMode(line, OUTPUT);
+		digitalWrite(line, LOW);
+		if (!to->waitLine(bitval ? to->tip_ : to->ring_, LOW, TIMEOUT)) {
+			from->resetLines();
+			return ERR_WRITE_TIMEOUT;
+		}
+
+		// Acknowledge the sender, and let the receiver release its line
+		line = bitval ? from->tip_ : from->ring_;
+		pinMode(line, OUTPUT);
+		digitalWrite(line, LOW);
+		to->resetLines();
+		if (!from->waitLine(bitval ? from->ring_ : from->tip_, HIGH, TIMEOUT)) {
+			return ERR_READ_TIMEOUT;
+		}
+		from->resetLines();
+	}
+	if (TICL_CAPTURE && from->capture_) {
+		from->capture_->byte(*byte);
+	}
+	if (TICL_CAPTURE && to->capture_) {
+		to->capture_->byte(*byte);
+	}
+	return 0;
+}
+
+uint16_t LinkRelay::packets(enum RelayDirection direction) {
+	return packets_[direction];
+}
+
+uint16_t LinkRelay::dropped() {
+	return dropped_;
+}
+
+uint16_t LinkRelay::errors() {
+	return errors_;
+}
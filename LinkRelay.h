@@ -0,0 +1,57 @@
+/*************************************************
+ *  LinkRelay.h - Cut-through forwarding of TI   *
+ *           link packets between two links.     *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef LINKRELAY_H
+#define LINKRELAY_H
+
+#include "Arduino.h"
+#include "TICL.h"
+#include "TIPacket.h"
+
+enum RelayDirection {
+	RELAY_A_TO_B = 0,
+	RELAY_B_TO_A = 1,
+};
+
+// Called with each packet header before it is passed on. It may change
+// the machine ID or command in place; the length is kept. A new
+// command must carry data if and only if the old one did, or the
+// packet is dropped as invalid. Returning nonzero drops the packet: it
+// is received, but not forwarded.
+typedef int(*relay_header_hook)(enum RelayDirection, uint8_t*);
+
+// Called with each data byte as it is passed on, with its index
+typedef void(*relay_data_hook)(enum RelayDirection, int, uint8_t);
+
+// Sits between two links, for example two calculators, and forwards
+// each packet from whichever starts one to the other. Only the 4-byte
+// header is held back, for the hook; data and checksum bits are passed
+// on as they arrive, and the sender's handshake for each bit waits for
+// the receiver's, so a packet takes about as long as on one link.
+// The peers' ACKs and CTSes are packets like any other.
+class LinkRelay {
+	public:
+		LinkRelay(TICL* a, TICL* b);
+		void setHooks(relay_header_hook header_hook, relay_data_hook data_hook = NULL);
+		int relayTick(unsigned long timeout = GET_ENTER_TIMEOUT);	// Usually called in loop()
+		uint16_t packets(enum RelayDirection direction);
+		uint16_t dropped();
+		uint16_t errors();					// Bad checksums passed on, and failed transfers
+
+	private:
+		int relayByte(TICL* from, TICL* to, uint8_t* byte);
+
+		TICL* links_[2];
+		relay_header_hook header_hook_;
+		relay_data_hook data_hook_;
+		uint16_t packets_[2];
+		uint16_t dropped_;
+		uint16_t errors_;
+};
+
+#endif	// LINKRELAY_H
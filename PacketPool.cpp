@@ -0,0 +1,112 @@
+/*************************************************
+ *  PacketPool.cpp - Fixed set of packet         *
+ *           buffers, handed between the link    *
+ *           and the application by slot number. *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "PacketPool.h"
+
+PacketPool::PacketPool(uint8_t* arena, int slots, int slotsize) {
+	arena_ = arena;
+	slots_ = min(max(slots, 0), PACKETPOOL_MAX_SLOTS);
+	slotsize_ = slotsize;
+	reset();
+}
+
+void PacketPool::reset() {
+	for(int i = 0; i < slots_; i++) {
+		next_[i] = (i + 1 < slots_) ? i + 1 : PACKETPOOL_NONE;
+		lengths_[i] = 0;
+	}
+	free_ = slots_ ? 0 : PACKETPOOL_NONE;
+	available_ = slots_;
+	head_ = tail_ = PACKETPOOL_NONE;
+	queued_ = 0;
+	owned_ = 0;
+}
+
+// The free list is a stack, so the slot just released, likely still
+// in the cache on a host, is the next one handed out
+int PacketPool::acquire() {
+	if (free_ == PACKETPOOL_NONE) {
+		return -1;
+	}
+	int slot = free_;
+	free_ = next_[slot];
+	available_--;
+	owned_ |= 1 << slot;
+	return slot;
+}
+
+// A slot that's free or queued isn't the caller's to release. Putting
+// it on the free list again would give it two owners.
+void PacketPool::release(int slot) {
+	if (!owned(slot)) {
+		return;
+	}
+	owned_ &= ~(1 << slot);
+	next_[slot] = free_;
+	free_ = slot;
+	available_++;
+}
+
+uint8_t* PacketPool::slot(int slot) {
+	return &arena_[slot * slotsize_];
+}
+
+int PacketPool::slotSize() {
+	return slotsize_;
+}
+
+int PacketPool::available() {
+	return available_;
+}
+
+void PacketPool::setLength(int slot, int length) {
+	lengths_[slot] = length;
+}
+
+int PacketPool::length(int slot) {
+	return lengths_[slot];
+}
+
+void PacketPool::queue(int slot) {
+	if (!owned(slot)) {
+		return;
+	}
+	owned_ &= ~(1 << slot);
+	next_[slot] = PACKETPOOL_NONE;
+	if (tail_ == PACKETPOOL_NONE) {
+		head_ = slot;
+	} else {
+		next_[tail_] = slot;
+	}
+	tail_ = slot;
+	queued_++;
+}
+
+int PacketPool::dequeue() {
+	if (head_ == PACKETPOOL_NONE) {
+		return -1;
+	}
+	int slot = head_;
+	head_ = next_[slot];
+	if (head_ == PACKETPOOL_NONE) {
+		tail_ = PACKETPOOL_NONE;
+	}
+	queued_--;
+	owned_ |= 1 << slot;
+	return slot;
+}
+
+bool PacketPool::owned(int slot) {
+	return slot >= 0 && slot < slots_ && (owned_ & (1 << slot));
+}
+
+int PacketPool::queued() {
+	return queued_;
+}
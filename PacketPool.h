@@ -0,0 +1,74 @@
+/*************************************************
+ *  PacketPool.h - Fixed set of packet buffers,  *
+ *           handed between the link and the     *
+ *           application by slot number.         *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef PACKETPOOL_H
+#define PACKETPOOL_H
+
+#include "Arduino.h"
+
+#define PACKETPOOL_MAX_SLOTS	8		// Largest number of slots in a pool
+#define PACKETPOOL_NONE			0xff	// End of the free list or queue
+
+// Splits one arena, set aside at startup, into equal slots, of which
+// at most PACKETPOOL_MAX_SLOTS are used. Whoever acquire()s a slot owns
+// it until it is queue()d for someone else or release()d; the bytes in
+// it never move. Taking and returning a slot and passing it through the
+// queue are constant time, so a packet can be received into a slot and
+// handled where it landed. Only CBL2's receive path uses a pool, with
+// CBL2::setupBufferPool(); TICL's get() and send(), the variables CBL2
+// sends for Get(, and the other link classes use the caller's buffers.
+class PacketPool {
+	public:
+		PacketPool(uint8_t* arena, int slots, int slotsize);
+		void reset();							// Every slot free, none queued
+
+		int acquire();							// A free slot, or -1 if none is
+		void release(int slot);					// Ignored unless the caller owns slot
+		uint8_t* slot(int slot);
+		int slotSize();
+		int available();						// Free slots
+
+		// What was put in a slot, kept with it
+		void setLength(int slot, int length);
+		int length(int slot);
+
+		// Filled slots waiting for their owner, oldest first. Only a slot
+		// someone owns can be queued. dequeue() returns -1 when none are.
+		void queue(int slot);
+		int dequeue();
+		int queued();
+
+	private:
+		bool owned(int slot);
+
+		uint8_t* arena_;
+		int slots_;
+		int slotsize_;
+		uint8_t next_[PACKETPOOL_MAX_SLOTS];	// Links of the free list or the queue
+		uint16_t lengths_[PACKETPOOL_MAX_SLOTS];
+		uint8_t free_;
+		uint8_t available_;
+		uint8_t head_;
+		uint8_t tail_;
+		uint8_t queued_;
+		uint8_t owned_;							// One bit per slot: acquired or dequeued
+};
+
+// A pool that holds its own arena of Slots slots of SlotSize bytes
+template<int Slots, int SlotSize> class StaticPacketPool: public PacketPool {
+	static_assert(Slots > 0 && Slots <= PACKETPOOL_MAX_SLOTS, "StaticPacketPool has 1 to PACKETPOOL_MAX_SLOTS slots");
+
+	public:
+		StaticPacketPool() : PacketPool(arena_, Slots, SlotSize) {}
+
+	private:
+		uint8_t arena_[Slots * SlotSize];
+};
+
+#endif	// PACKETPOOL_H
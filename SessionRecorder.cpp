@@ -0,0 +1,104 @@
+/*************************************************
+ *  SessionRecorder.cpp - Records a link session *
+ *           packet by packet, with the peer's   *
+ *           response times, for replay.         *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "TICL.h"
+#include "SessionRecorder.h"
+
+SessionRecorder::SessionRecorder() {
+	out_ = NULL;
+	in_packet_ = sent_ = pending_ = false;
+	last_end_ = 0;
+	packets_ = 0;
+}
+
+int SessionRecorder::begin(Print* out) {
+	out_ = out;
+	in_packet_ = pending_ = false;
+	parser_.reset();
+	last_end_ = 0;
+	packets_ = 0;
+	if (out_->write((const uint8_t*)SESSION_MAGIC, 4) != 4 || out_->write((uint8_t)SESSION_VERSION) != 1) {
+		return ERR_WRITE_TIMEOUT;
+	}
+	return 0;
+}
+
+void SessionRecorder::end() {
+	abortPacket();
+}
+
+// Bytes are written one behind, so the last one of each packet can be
+// marked. A byte going the other way mid-packet means the packet was
+// cut short.
+void SessionRecorder::byte(bool sent, uint8_t value, unsigned long started,
+                           unsigned long respond, unsigned long release)
+{
+	if (out_ == NULL) {
+		return;
+	}
+	if (in_packet_ && sent != sent_) {
+		abortPacket();
+	}
+
+	if (!in_packet_) {
+		out_->write((uint8_t)(sent ? SESSION_TO_PEER : SESSION_FROM_PEER));
+		writeVarint(last_end_ ? started - last_end_ : 0);
+		in_packet_ = true;
+		sent_ = sent;
+		packets_++;
+	} else {
+		flush(false);
+		if (!sent) {
+			respond += started - last_end_;		// The wait for the first bit
+		}
+	}
+
+	pending_ = true;
+	pending_value_ = value;
+	pending_respond_ = respond;
+	pending_release_ = release;
+	last_end_ = micros();
+
+	enum PacketEvent event = parser_.push(value);
+	if (event == PACKET_COMPLETE || event == PACKET_ERROR) {
+		flush(true);
+		in_packet_ = false;
+	}
+}
+
+void SessionRecorder::abortPacket() {
+	if (in_packet_) {
+		flush(true);
+		in_packet_ = false;
+		parser_.reset();
+	}
+}
+
+unsigned long SessionRecorder::packets() {
+	return packets_;
+}
+
+void SessionRecorder::flush(bool last) {
+	if (!pending_) {
+		return;
+	}
+	writeVarint((pending_respond_ << 1) | (last ? 1 : 0));
+	writeVarint(pending_release_);
+	out_->write(pending_value_);
+	pending_ = false;
+}
+
+void SessionRecorder::writeVarint(unsigned long value) {
+	while (value >= 0x80) {
+		out_->write((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out_->write((uint8_t)value);
+}
@@ -0,0 +1,61 @@
+/*************************************************
+ *  SessionRecorder.h - Records a link session   *
+ *           packet by packet, with the peer's   *
+ *           response times, for replay.         *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef SESSIONRECORDER_H
+#define SESSIONRECORDER_H
+
+#include "Arduino.h"
+#include "TIPacket.h"
+
+// Session files start with SESSION_MAGIC and a version byte. Then, for
+// each packet that got at least one byte through:
+//   direction (SESSION_FROM_PEER or SESSION_TO_PEER)
+//   varint: microseconds since the end of the previous packet
+//   for each byte: varint (respond << 1 | last), varint release, value
+// respond is the time the peer took to put each bit on the line (or to
+// acknowledge it, for bytes we sent), release the time it took to let
+// go afterwards, both summed over the byte's 8 bits. last marks the
+// final byte of the packet, which is where a packet cut short ends too.
+// Varints are little-endian base 128, as in LEB128.
+#define SESSION_MAGIC		"ARTS"
+#define SESSION_VERSION		1
+#define SESSION_FROM_PEER	'R'
+#define SESSION_TO_PEER		'S'
+
+class SessionRecorder {
+	public:
+		SessionRecorder();
+		int begin(Print* out);				// Writes the file header
+		void end();							// Writes out the last byte
+
+		// Called by TICL for each byte that made it across the link, and
+		// when a packet is abandoned part of the way through.
+		void byte(bool sent, uint8_t value, unsigned long started,
+		          unsigned long respond, unsigned long release);
+		void abortPacket();
+
+		unsigned long packets();
+
+	private:
+		void flush(bool last);
+		void writeVarint(unsigned long value);
+
+		Print* out_;
+		PacketParser parser_;
+		bool in_packet_;
+		bool sent_;
+		bool pending_;						// A byte is held back until we know if it's last
+		uint8_t pending_value_;
+		unsigned long pending_respond_;
+		unsigned long pending_release_;
+		unsigned long last_end_;			// micros() at the end of the last byte
+		unsigned long packets_;
+};
+
+#endif	// SESSIONRECORDER_H
@@ -0,0 +1,191 @@
+/*************************************************
+ *  SilentLink.cpp - Computer-side variable      *
+ *           transfers to and from calculators   *
+ *           that need no user interaction.      *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "SilentLink.h"
+#include "TIVar.h"
+
+// Constructor with default communication lines
+SilentLink::SilentLink() :
+	TICL()
+{
+	machine_id_ = COMP83P;
+}
+
+// Constructor with custom communication lines.
+SilentLink::SilentLink(int tip, int ring) :
+	TICL(tip, ring)
+{
+	machine_id_ = COMP83P;
+}
+
+// The machine ID we send as, which tells the calculator what kind of
+// computer it is talking to: COMP83P, COMP83, COMP82, ...
+void SilentLink::setMachineID(uint8_t machine_id) {
+	machine_id_ = machine_id;
+}
+
+int SilentLink::discover(LinkProfile* profile) {
+	int rval = TICL::discover(profile, machine_id_);
+	if (rval == 0) {
+		machine_id_ = profile->computer_id;
+	}
+	return rval;
+}
+
+void SilentLink::setProfile(LinkProfile* profile) {
+	TICL::setProfile(profile);
+	if (profile && profile->machine_id) {
+		machine_id_ = profile->computer_id;
+	}
+}
+
+int SilentLink::sendVariable(uint8_t* header, int headerlength, uint8_t* data, int datalength,
+                             uint8_t(*data_callback)(int))
+{
+	uint8_t msg_header[4];
+	int rval;
+
+	// Step 1: Send RTS, wait for ACK and CTS (or SKIP, if refused)
+	msg_header[0] = machine_id_;
+	msg_header[1] = RTS;
+	TIVar::intToSizeWord(headerlength, &msg_header[2]);
+	if ((rval = send(msg_header, header, headerlength)) || (rval = expect(ACK))) {
+		return rval;
+	}
+	if ((rval = expect(CTS))) {
+		return rval;
+	}
+
+	// Step 2: ACK the CTS, send DATA, wait for its ACK
+	if ((rval = reply(ACK))) {
+		return rval;
+	}
+	msg_header[0] = machine_id_;
+	msg_header[1] = DATA;
+	TIVar::intToSizeWord(datalength, &msg_header[2]);
+	if ((rval = send(msg_header, data, datalength, data_callback)) || (rval = expect(ACK))) {
+		return rval;
+	}
+
+	// Step 3: Send EOT, wait for its ACK
+	if ((rval = reply(EOT))) {
+		return rval;
+	}
+	return expect(ACK);
+}
+
+int SilentLink::getVariable(uint8_t* header, int* headerlength, uint8_t* data, int* datalength,
+                            int maxlength, void(*data_sink)(int, uint8_t))
+{
+	uint8_t msg_header[4];
+	int rval;
+
+	// Step 1: Send REQ, wait for ACK and VAR (or SKIP, if missing)
+	msg_header[0] = machine_id_;
+	msg_header[1] = REQ;
+	TIVar::intToSizeWord(*headerlength, &msg_header[2]);
+	if ((rval = send(msg_header, header, *headerlength)) || (rval = expect(ACK))) {
+		return rval;
+	}
+	if ((rval = expect(VAR, header, headerlength, SILENT_MAX_HEADER))) {
+		return rval;
+	}
+
+	// Step 2: ACK the VAR, send CTS, wait for its ACK
+	if ((rval = reply(ACK)) || (rval = reply(CTS)) || (rval = expect(ACK))) {
+		return rval;
+	}
+
+	// Step 3: Receive DATA and ACK it
+	rval = get(msg_header, data, datalength, maxlength, GET_ENTER_TIMEOUT, data_sink);
+	if (rval) {
+		return rval;
+	}
+	if (msg_header[1] != DATA) {
+		return ERR_INVALID;
+	}
+	return reply(ACK);
+}
+
+int SilentLink::beginDirectory(uint16_t* freemem) {
+	uint8_t msg_header[4];
+	uint8_t header[11];
+	uint8_t free[4];
+	int length;
+	int rval;
+
+	// Step 1: Send REQ for the directory, wait for ACK
+	memset(header, 0, sizeof(header));
+	header[2] = SILENT_DIRECTORY;
+	msg_header[0] = machine_id_;
+	msg_header[1] = REQ;
+	TIVar::intToSizeWord(sizeof(header), &msg_header[2]);
+	if ((rval = send(msg_header, header, sizeof(header))) || (rval = expect(ACK))) {
+		return rval;
+	}
+
+	// Step 2: Receive the free memory as DATA, and ACK it
+	if ((rval = expect(DATA, free, &length, sizeof(free)))) {
+		return rval;
+	}
+	if (freemem) {
+		*freemem = (length >= 2) ? TIVar::sizeWordToInt(free) : 0;
+	}
+	return reply(ACK);
+}
+
+// One VAR per variable, each ACKed, then an EOT that isn't
+int SilentLink::nextDirectoryEntry(uint8_t* header, int* headerlength) {
+	uint8_t msg_header[4];
+	int rval = get(msg_header, header, headerlength, SILENT_MAX_HEADER, GET_ENTER_TIMEOUT);
+	if (rval) {
+		return rval;
+	}
+	if (msg_header[1] == EOT) {
+		return 1;
+	}
+	if (msg_header[1] != VAR) {
+		return ERR_INVALID;
+	}
+	return reply(ACK);
+}
+
+// Send a packet with no data
+int SilentLink::reply(uint8_t command) {
+	uint8_t msg_header[4] = {machine_id_, command, 0x00, 0x00};
+	return send(msg_header, NULL, 0);
+}
+
+// Receive a packet and check that it's the one the protocol calls for.
+// A SKIP/EXIT instead means the calculator refused; it gets an ACK.
+int SilentLink::expect(uint8_t command, uint8_t* data, int* datalength, int maxlength) {
+	uint8_t msg_header[4];
+	uint8_t reason[1];
+	int length;
+	int rval;
+
+	if (data == NULL) {
+		data = reason;
+		datalength = &length;
+		maxlength = sizeof(reason);
+	}
+	rval = get(msg_header, data, datalength, maxlength, GET_ENTER_TIMEOUT);
+	if (rval) {
+		return rval;
+	}
+	if (msg_header[1] == command) {
+		return 0;
+	}
+	if (msg_header[1] == SKIP) {
+		reply(ACK);
+		return ERR_REJECTED;
+	}
+	return ERR_INVALID;
+}
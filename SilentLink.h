@@ -0,0 +1,58 @@
+/*************************************************
+ *  SilentLink.h - Computer-side variable        *
+ *           transfers to and from calculators   *
+ *           that need no user interaction.      *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef SILENTLINK_H
+#define SILENTLINK_H
+
+#include "Arduino.h"
+#include "TICL.h"
+
+#define SILENT_MAX_HEADER	16			// Largest VAR header accepted from a calculator
+#define SILENT_DIRECTORY	0x19		// Variable type that requests the directory
+
+class SilentLink: public TICL {
+	public:
+		SilentLink();
+		SilentLink(int tip, int ring);
+		void setMachineID(uint8_t machine_id);		// COMP83P by default
+
+		// Discover the calculator, or take a profile from an earlier
+		// discovery, and send as the computer it expects from then on
+		int discover(LinkProfile* profile);
+		void setProfile(LinkProfile* profile);
+
+		// Push a variable to the calculator (RTS). The header is a VAR
+		// header as sent by the calculator: size word, type, name, and
+		// on the TI-83+ family a version and flag byte. The data may come
+		// from a buffer or from data_callback, as with send().
+		int sendVariable(uint8_t* header, int headerlength, uint8_t* data, int datalength,
+		                 uint8_t(*data_callback)(int) = NULL);
+
+		// Fetch a variable from the calculator (REQ). The header names the
+		// variable; on success it holds the calculator's VAR header. The data
+		// goes into data, or to data_sink as it arrives if that is given.
+		int getVariable(uint8_t* header, int* headerlength, uint8_t* data, int* datalength,
+		                int maxlength, void(*data_sink)(int, uint8_t) = NULL);
+
+		// List the calculator's variables (REQ for the directory). After
+		// beginDirectory(), which can report the free RAM, each call to
+		// nextDirectoryEntry() returns 0 with one variable's VAR header,
+		// 1 after the last, or a TICLErrors value. Read to the end before
+		// anything else goes over the link.
+		int beginDirectory(uint16_t* freemem = NULL);
+		int nextDirectoryEntry(uint8_t* header, int* headerlength);
+
+	protected:
+		int reply(uint8_t command);
+		int expect(uint8_t command, uint8_t* data = NULL, int* datalength = NULL, int maxlength = 0);
+
+		uint8_t machine_id_;
+};
+
+#endif	// SILENTLINK_H
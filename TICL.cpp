@@ -1,308 +1,878 @@
-/*************************************************
- * TICL.cpp - Core of ArTICL library for linking *
- *            TI calculators and Arduinos.       *
- *            Created by Christopher Mitchell,   *
- *            2011-2019, all rights reserved.    *
- *************************************************/
-
-#include "Arduino.h"
-#include "TICL.h"
-
-// Constructor with default communication lines
-TICL::TICL() {
-	setLines(DEFAULT_TIP, DEFAULT_RING);
-	serial_ = NULL;
-}
-
-// Constructor with custom communication lines. Fun
-// fact: You can use this and multiple TICL objects to
-// talk to multiple endpoints at the same time.
-TICL::TICL(int tip, int ring) {
-	setLines(tip, ring);
-	serial_ = NULL;
-}
-
-// This should be called during the setup() function
-// to set the communication lines to their initial values
-void TICL::begin() {
-	resetLines();
-}
-
-// Determine whether debug printing is enabled
-void TICL::setVerbosity(bool verbose, HardwareSerial* serial) {
-	if (verbose) {
-		serial_ = serial;
-	} else {
-		serial_ = NULL;
-	}
-}
-
-// Change the lines after construction
-void TICL::setLines(int tip, int ring) {
-	tip_ = tip;
-	ring_ = ring;
-}
-
-// Send an entire message from the Arduino to
-// the attached TI device, byte by byte
-int TICL::send(uint8_t* header, uint8_t* data, int datalength, uint8_t(*data_callback)(int)) {
-	if (serial_) {
-		serial_->print("snd type 0x");
-		serial_->print(header[1], HEX);
-		serial_->print(" as EP 0x");
-		serial_->print(header[0], HEX);
-		serial_->print(" len ");
-		serial_->println(datalength);
-	}
-
-	// Send all of the bytes in the header
-	for(int idx = 0; idx < 4; idx++) {
-		int rval = sendByte(header[idx]);
-		if (rval != 0) {
-			return rval;
-		}
-	}
-	
-	// If no data, we're done
-	if (datalength == 0) {
-		return 0;
-	}
-	
-	// These  also indicate that there are 
-	// no data bytes to be sent
-	if (header[1] == CTS ||
-		header[1] == VER ||
-		header[1] == ACK ||
-		header[1] == ERR ||
-		header[1] == RDY ||
-		header[1] == SCR ||
-		header[1] == KEY ||
-		header[1] == EOT)
-	{
-		return 0;
-	}
-	
-	// Send all of the bytes in the data buffer
-	uint16_t checksum = 0;
-	for(int idx = 0; idx < datalength; idx++) {
-		uint8_t outbyte;
-		// Get a byte if we need
-		if (data_callback != NULL) {
-			outbyte = data_callback(idx);
-		} else {
-			outbyte = data[idx];
-		}
-		// Try to send this byte
-		int rval = sendByte(outbyte);
-		if (rval != 0) {
-			return rval;
-		}
-		checksum += outbyte;
-	}
-	
-	// Send the checksum
-	int rval = sendByte(checksum & 0x00ff);
-	if (rval != 0) {
-		return rval;
-	}
-	rval = sendByte((checksum >> 8) & 0x00ff);
-	return rval;
-}
-
-// Send a single byte from the Arduino to the attached
-// TI device, returning nonzero if a failure occurred.
-int TICL::sendByte(uint8_t byte) {
-	unsigned long previousMicros;
-	if (serial_) {
-		serial_->print("Sending byte ");
-		serial_->println(byte);
-	}
-
-	// Send all of the bits in this byte
-	for(int bit = 0; bit < 8; bit++) {
-		
-		// Wait for both lines to be high before sending the bit
-		previousMicros = micros();
-		while (digitalRead(ring_) == LOW || digitalRead(tip_) == LOW) {
-			if (micros() - previousMicros > TIMEOUT) {
-				resetLines();
-				return ERR_WRITE_TIMEOUT;
-			}
-		}
-		
-		// Pull one line low to indicate a new bit is going out
-		bool bitval = (byte & 1);
-		int line = (bitval)?ring_:tip_;
-		pinMode(line, OUTPUT);
-		digitalWrite(line, LOW);
-		
-		// Wait for peer to acknowledge by pulling opposite line low
-		line = (bitval)?tip_:ring_;
-		previousMicros = micros();
-		while (digitalRead(line) == HIGH) {
-			if (micros() - previousMicros > TIMEOUT) {
-				resetLines();
-				return ERR_WRITE_TIMEOUT;
-			}
-		}
-
-		// Wait for peer to indicate readiness by releasing that line
-		resetLines();
-		previousMicros = micros();
-		while (digitalRead(line) == LOW) {
-			if (micros() - previousMicros > TIMEOUT) {
-				resetLines();
-				return ERR_WRITE_TIMEOUT;
-			}
-		}
-		resetLines();
-		
-		// Rotate the next bit to send into the low bit of the byte
-		byte >>= 1;
-	}
-
-	return 0;
-}
-
-// Returns 0 for a successfully-read message or non-zero
-// for failure. If return value is 0 and datalength is zero,
-// then the message is just a 4-byte message in the header
-// buffer. If the 
-int TICL::get(uint8_t* header, uint8_t* data, int* datalength,
-              int maxlength, int timeout)
-{
-	int rval;
-
-	// Get the 4-byte header: sender, message, length
-	for(int idx = 0; idx < 4; idx++) {
-		rval = getByte(&header[idx], timeout);
-		if (rval) {
-			return rval;
-		}
-	}
-	*datalength = (int)header[2] | ((int)header[3] << 8);
-	
-	if (serial_) {
-		serial_->print("Recv typ 0x");
-		serial_->print(header[1], HEX);
-		serial_->print(" from EP 0x");
-		serial_->print(header[0], HEX);
-		serial_->print(" len ");
-		serial_->println(*datalength);
-	}
-
-	if (*datalength == 0) {
-		return 0;
-	}
-
-	// These  also indicate that there are 
-	// no data bytes to be received
-	if (header[1] == CTS ||
-		header[1] == VER ||
-		header[1] == ACK ||
-		header[1] == ERR ||
-		header[1] == RDY ||
-		header[1] == SCR ||
-		header[1] == KEY ||
-		header[1] == EOT)
-	{
-		return 0;
-	}
-	
-	// Check if this is a data-free message
-	if (*datalength > maxlength) {
-		if (serial_) {
-			serial_->print("Msg buf ovfl: ");
-			serial_->print(*datalength);
-			serial_->print(" > ");
-			serial_->println(maxlength);
-		}
-		return ERR_BUFFER_OVERFLOW;
-	}
-	
-	// Get the data bytes, if there are any.
-	uint16_t checksum = 0;
-	for(int idx = 0; idx < *datalength; idx++) {
-		// Try to get all the bytes, or fail if any of the
-		// individual byte reads fail
-		rval = getByte(&data[idx]);
-		if (rval != 0) {
-			return rval;
-		}
-			
-		// Update checksum
-		checksum += data[idx];
-	}
-	
-	// Receive and check the checksum
-	uint8_t recv_checksum[2];
-	for(int idx = 0; idx < 2; idx++) {
-		rval = getByte(&recv_checksum[idx]);
-		if (rval)
-			return rval;
-	}
-	
-	// Die on a bad checksum
-	if (checksum !=
-	   (uint16_t)(((int)recv_checksum[1] << 8) | (int)recv_checksum[0]))
-	{
-		return ERR_BAD_CHECKSUM;
-	}
-	
-	return 0;
-}
-
-// Receive a single byte from the attached TI device,
-// returning nonzero if a failure occurred.
-int TICL::getByte(uint8_t* byte, int timeout) {
-	unsigned long previousMicros = 0;
-	*byte = 0;
-	
-	// Pull down each bit and store it
-	for (int bit = 0; bit < 8; bit++) {
-		int linevals;
-
-		previousMicros = micros();
-		while ((linevals = ((digitalRead(ring_) << 1) | digitalRead(tip_))) == 0x03) {
-			if (micros() - previousMicros > timeout) {
-				resetLines();
-				if (serial_) {
-					serial_->print("died waiting for bit "); serial_->println(bit);
-				}
-				return ERR_READ_ENTER_TIMEOUT;
-			}
-		}
-		
-		// Store the bit, then acknowledge it
-		*byte = (*byte >> 1) | ((linevals == 0x01)?0x80:0x00);
-		int line = (linevals == 0x01)?tip_:ring_;
-		pinMode(line, OUTPUT);
-		digitalWrite(line, LOW);
-		
-		// Wait for the peer to indicate readiness
-		line = (linevals == 0x01)?ring_:tip_;		
-		previousMicros = micros();
-		while (digitalRead(line) == LOW) {            //wait for the other one to go high again
-			if (micros() - previousMicros > TIMEOUT) {
-				resetLines();
-				if (serial_) {
-					serial_->print("died waiting for bit ack "); serial_->println(bit);
-				}
-				return ERR_READ_TIMEOUT;
-			}
-		}
-
-		// Now set them both high and to input
-		resetLines();
-	}
-	if (serial_) {
-		serial_->print("Got byte ");
-		serial_->println(*byte);
-	}
-	return 0;
-}
-
-void TICL::resetLines(void) {
-	pinMode(ring_, INPUT_PULLUP);           // set pin to input with pullups
-	pinMode(tip_, INPUT_PULLUP);            // set pin to input with pullups
-}
+/*************************************************
+ * TICL.cpp - Core of ArTICL library for linking *
+ *            TI calculators and Arduinos.       *
+ *            Created by Christopher Mitchell,   *
+ *            2011-2019, all rights reserved.    *
+ *************************************************/
+
+#include "Arduino.h"
+#include "TICL.h"
+#include "TIPacket.h"
+
+#if defined(__AVR__)
+#include <avr/sleep.h>
+#endif
+
+// Set by the wake interrupt. Only one link sleeps at a time.
+static volatile bool idleWoke;
+static volatile unsigned long idleWokeAt;
+#if defined(__AVR__)
+static int idlePins[2];
+#endif
+
+// Constructor with default communication lines
+TICL::TICL() {
+	setLines(DEFAULT_TIP, DEFAULT_RING);
+	serial_ = NULL;
+	capture_ = NULL;
+	recorder_ = NULL;
+	profile_ = NULL;
+	retries_ = DEFAULT_RETRIES;
+	idle_ = IDLE_NONE;
+	wake_ = NULL;
+	wake_micros_ = 0;
+	fast_ = false;
+}
+
+// Constructor with custom communication lines. Fun
+// fact: You can use this and multiple TICL objects to
+// talk to multiple endpoints at the same time.
+TICL::TICL(int tip, int ring) {
+	setLines(tip, ring);
+	serial_ = NULL;
+	capture_ = NULL;
+	recorder_ = NULL;
+	profile_ = NULL;
+	retries_ = DEFAULT_RETRIES;
+	idle_ = IDLE_NONE;
+	wake_ = NULL;
+	wake_micros_ = 0;
+	fast_ = false;
+}
+
+// This should be called during the setup() function
+// to set the communication lines to their initial values
+void TICL::begin() {
+	resetLines();
+}
+
+// Determine whether debug printing is enabled
+void TICL::setVerbosity(bool verbose, HardwareSerial* serial) {
+	if (TICL_DEBUG && verbose) {
+		serial_ = serial;
+	} else {
+		serial_ = NULL;
+	}
+}
+
+// Record line transitions into capture, or stop with NULL
+void TICL::setCapture(LineCapture* capture) {
+	capture_ = TICL_CAPTURE ? capture : NULL;
+}
+
+// Record whole sessions for replay, or stop with NULL
+void TICL::setRecorder(SessionRecorder* recorder) {
+	recorder_ = TICL_RECORDER ? recorder : NULL;
+}
+
+// Change the lines after construction
+void TICL::setLines(int tip, int ring) {
+	tip_ = tip;
+	ring_ = ring;
+}
+
+// Send an entire message from the Arduino to
+// the attached TI device, byte by byte
+int TICL::send(uint8_t* header, uint8_t* data, int datalength, uint8_t(*data_callback)(int)) {
+	if (TICL_DEBUG && serial_) {
+		serial_->print("snd type 0x");
+		serial_->print(header[1], HEX);
+		serial_->print(" as EP 0x");
+		serial_->print(header[0], HEX);
+		serial_->print(" len ");
+		serial_->println(datalength);
+	}
+
+	// Send the header, then any data and its checksum
+	PacketSerializer packet;
+	packet.begin(header, data, datalength, data_callback);
+	int outbyte;
+	while ((outbyte = packet.next()) >= 0) {
+		int rval = sendByte(outbyte);
+		if (rval != 0) {
+			if (TICL_RECORDER && recorder_) {
+				recorder_->abortPacket();
+			}
+			return rval;
+		}
+	}
+	return 0;
+}
+
+// Send a single byte from the Arduino to the attached
+// TI device, returning nonzero if a failure occurred.
+int TICL::sendByte(uint8_t byte) {
+	unsigned long previousMicros;
+	unsigned long started = 0, respond = 0, release = 0;
+	uint8_t value = byte;
+	if (TICL_DEBUG && serial_) {
+		serial_->print("Sending byte ");
+		serial_->println(byte);
+	}
+	if (TICL_CAPTURE && capture_) {
+		capture_->byte(byte);
+	}
+	if (TICL_FAST && fast_) {
+		return sendByteFast(byte);
+	}
+	if (TICL_RECORDER && recorder_) {
+		started = micros();
+	}
+
+	// Send all of the bits in this byte
+	for(int bit = 0; bit < 8; bit++) {
+		
+		// Wait for both lines to be high before sending the bit
+		previousMicros = micros();
+		while (digitalRead(ring_) == LOW || digitalRead(tip_) == LOW) {
+			if (micros() - previousMicros > TIMEOUT) {
+				resetLines();
+				return ERR_WRITE_TIMEOUT;
+			}
+		}
+		if (TICL_CAPTURE && capture_) {
+			capture_->observe(true, true);
+		}
+		if (TICL_RECORDER && recorder_) {
+			respond += micros() - previousMicros;
+		}
+		
+		// Pull one line low to indicate a new bit is going out
+		bool bitval = (byte & 1);
+		int line = (bitval)?ring_:tip_;
+		pinMode(line, OUTPUT);
+		digitalWrite(line, LOW);
+		if (TICL_CAPTURE && capture_) {
+			capture_->drive(!bitval, bitval);
+		}
+		
+		// Wait for peer to acknowledge by pulling opposite line low
+		line = (bitval)?tip_:ring_;
+		previousMicros = micros();
+		while (digitalRead(line) == HIGH) {
+			if (micros() - previousMicros > TIMEOUT) {
+				resetLines();
+				return ERR_WRITE_TIMEOUT;
+			}
+		}
+		if (TICL_CAPTURE && capture_) {
+			capture_->observe(false, false);
+		}
+		if (TICL_RECORDER && recorder_) {
+			respond += micros() - previousMicros;
+		}
+
+		// Wait for peer to indicate readiness by releasing that line
+		resetLines();
+		previousMicros = micros();
+		while (digitalRead(line) == LOW) {
+			if (micros() - previousMicros > TIMEOUT) {
+				resetLines();
+				return ERR_WRITE_TIMEOUT;
+			}
+		}
+		if (TICL_CAPTURE && capture_) {
+			capture_->observe(true, true);
+		}
+		if (TICL_RECORDER && recorder_) {
+			release += micros() - previousMicros;
+		}
+		resetLines();
+		
+		// Rotate the next bit to send into the low bit of the byte
+		byte >>= 1;
+	}
+
+	if (TICL_RECORDER && recorder_) {
+		recorder_->byte(true, value, started, respond, release);
+	}
+	return 0;
+}
+
+// Returns 0 for a successfully-read message or non-zero
+// for failure. If return value is 0 and datalength is zero,
+// then the message is just a 4-byte message in the header
+// buffer. If data_sink is given, data bytes are handed to it
+// as they arrive instead of being stored, so messages larger
+// than any buffer can be received; the sink has to discard
+// them itself if the checksum turns out bad.
+int TICL::get(uint8_t* header, uint8_t* data, int* datalength,
+              int maxlength, int timeout, void(*data_sink)(int, uint8_t))
+{
+	PacketParser packet;
+	enum PacketEvent event;
+	uint8_t inbyte;
+	int rval;
+
+	// Get the 4-byte header: sender, message, length
+	do {
+		rval = getByte(&inbyte, timeout);
+		if (rval) {
+			if (TICL_RECORDER && recorder_) {
+				recorder_->abortPacket();
+			}
+			return rval;
+		}
+		event = packet.push(inbyte);
+	} while (event == PACKET_NONE);
+	memcpy(header, packet.header(), PACKET_HEADER_LEN);
+	*datalength = (int)header[2] | ((int)header[3] << 8);
+	
+	if (TICL_DEBUG && serial_) {
+		serial_->print("Recv typ 0x");
+		serial_->print(header[1], HEX);
+		serial_->print(" from EP 0x");
+		serial_->print(header[0], HEX);
+		serial_->print(" len ");
+		serial_->println(*datalength);
+	}
+
+	// No data bytes to be received, either because the length is
+	// zero or because the command never carries any
+	if (event == PACKET_COMPLETE) {
+		return 0;
+	}
+	
+	// Check if this is a data-free message
+	if (data_sink == NULL && *datalength > maxlength) {
+		if (TICL_DEBUG && serial_) {
+			serial_->print("Msg buf ovfl: ");
+			serial_->print(*datalength);
+			serial_->print(" > ");
+			serial_->println(maxlength);
+		}
+		if (TICL_RECORDER && recorder_) {
+			recorder_->abortPacket();
+		}
+		return ERR_BUFFER_OVERFLOW;
+	}
+	
+	// Get the data bytes and the checksum, or fail if any of the
+	// individual byte reads fail
+	do {
+		rval = getByte(&inbyte);
+		if (rval != 0) {
+			if (TICL_RECORDER && recorder_) {
+				recorder_->abortPacket();
+			}
+			return rval;
+		}
+		event = packet.push(inbyte);
+		if (event != PACKET_PAYLOAD) {
+			continue;
+		}
+		if (data_sink != NULL) {
+			data_sink(packet.dataIndex(), inbyte);
+		} else {
+			data[packet.dataIndex()] = inbyte;
+		}
+	} while (event == PACKET_NONE || event == PACKET_PAYLOAD);
+	
+	// Die on a bad checksum
+	if (event == PACKET_ERROR) {
+		return ERR_BAD_CHECKSUM;
+	}
+	
+	return 0;
+}
+
+void TICL::setRetries(int retries) {
+	retries_ = retries;
+}
+
+// Like get(), but a packet with a bad checksum is answered with ERR
+// from machine_id and received again, waiting up to timeout for each
+// resend as for the first. A data_sink sees the bytes of every
+// attempt, starting again from index 0.
+int TICL::getOrRetry(uint8_t* header, uint8_t* data, int* datalength, int maxlength, uint8_t machine_id,
+                     int timeout, void(*data_sink)(int, uint8_t))
+{
+	int rval = get(header, data, datalength, maxlength, timeout, data_sink);
+	for(int retry = 0; rval == ERR_BAD_CHECKSUM && retry < retries_; retry++) {
+		if (TICL_DEBUG && serial_) {
+			serial_->println("Bad checksum, requesting resend");
+		}
+		if ((rval = requestResend(machine_id))) {
+			return rval;
+		}
+		rval = get(header, data, datalength, maxlength, timeout, data_sink);
+	}
+	return rval;
+}
+
+// Send a packet and wait for its ACK, sending it again each time the
+// peer answers ERR. A data_callback is called again from index 0 for
+// each resend, so it must be able to produce the same bytes again.
+int TICL::sendAwaitAck(uint8_t* header, uint8_t* data, int datalength, uint8_t(*data_callback)(int)) {
+	uint8_t reply[4];
+	uint8_t reason[1];
+	int length;
+	int rval;
+
+	for(int retry = 0; ; retry++) {
+		if ((rval = send(header, data, datalength, data_callback)) ||
+		    (rval = get(reply, reason, &length, sizeof(reason))))
+		{
+			return rval;
+		}
+		if (reply[1] != ERR || retry >= retries_) {
+			break;
+		}
+		if (TICL_DEBUG && serial_) {
+			serial_->println("Peer asked for a resend");
+		}
+	}
+
+	switch(reply[1]) {
+		case ACK:
+			return 0;
+		case ERR:
+			return ERR_BAD_CHECKSUM;
+		case SKIP:
+			return ERR_REJECTED;
+		default:
+			return ERR_INVALID;
+	}
+}
+
+// Ask the peer to send its last packet again
+int TICL::requestResend(uint8_t machine_id) {
+	uint8_t msg_header[4] = {machine_id, ERR, 0x00, 0x00};
+	return send(msg_header, NULL, 0);
+}
+
+// Receive a single byte from the attached TI device,
+// returning nonzero if a failure occurred.
+int TICL::getByte(uint8_t* byte, int timeout) {
+	unsigned long previousMicros = 0;
+	unsigned long started = 0, respond = 0, release = 0;
+	*byte = 0;
+	if (TICL_FAST && fast_) {
+		return getByteFast(byte, timeout);
+	}
+	
+	// Pull down each bit and store it
+	for (int bit = 0; bit < 8; bit++) {
+		int linevals;
+
+		previousMicros = micros();
+		while ((linevals = ((digitalRead(ring_) << 1) | digitalRead(tip_))) == 0x03) {
+			if (micros() - previousMicros > (unsigned long)timeout) {
+				resetLines();
+				if (TICL_DEBUG && serial_) {
+					serial_->print("died waiting for bit "); serial_->println(bit);
+				}
+				return ERR_READ_ENTER_TIMEOUT;
+			}
+		}
+		
+		if (TICL_CAPTURE && capture_) {
+			capture_->observe(linevals & 0x01, linevals & 0x02);
+		}
+		if (TICL_RECORDER && recorder_) {
+			if (bit == 0) {
+				started = micros();
+			} else {
+				respond += micros() - previousMicros;
+			}
+		}
+		
+		// Store the bit, then acknowledge it
+		*byte = (*byte >> 1) | ((linevals == 0x01)?0x80:0x00);
+		int line = (linevals == 0x01)?tip_:ring_;
+		pinMode(line, OUTPUT);
+		digitalWrite(line, LOW);
+		if (TICL_CAPTURE && capture_) {
+			capture_->drive(line == tip_, line == ring_);
+		}
+		
+		// Wait for the peer to indicate readiness
+		line = (linevals == 0x01)?ring_:tip_;		
+		previousMicros = micros();
+		while (digitalRead(line) == LOW) {            //wait for the other one to go high again
+			if (micros() - previousMicros > TIMEOUT) {
+				resetLines();
+				if (TICL_DEBUG && serial_) {
+					serial_->print("died waiting for bit ack "); serial_->println(bit);
+				}
+				return ERR_READ_TIMEOUT;
+			}
+		}
+		if (TICL_CAPTURE && capture_) {
+			capture_->observe(line != ring_, line != tip_);
+		}
+		if (TICL_RECORDER && recorder_) {
+			release += micros() - previousMicros;
+		}
+
+		// Now set them both high and to input
+		resetLines();
+	}
+	if (TICL_DEBUG && serial_) {
+		serial_->print("Got byte ");
+		serial_->println(*byte);
+	}
+	if (TICL_CAPTURE && capture_) {
+		capture_->byte(*byte);
+	}
+	if (TICL_RECORDER && recorder_) {
+		recorder_->byte(false, *byte, started, respond, release);
+	}
+	return 0;
+}
+
+// Offer fast mode to the peer, which enables it on both ends if the
+// peer answers in kind. Anything else, including silence, leaves the
+// link in the standard protocol and returns nonzero. Offer it before
+// any other traffic, as a calculator may not expect the packet.
+int TICL::negotiateFast(uint8_t machine_id) {
+	uint8_t msg_header[4] = {machine_id, FST, 1, 0};
+	uint8_t offer[1] = {FAST_VERSION};
+	uint8_t reply[4];
+	uint8_t answer[1];
+	int length;
+	int rval;
+
+	fast_ = false;
+	if (!TICL_FAST) {
+		return ERR_REJECTED;
+	}
+	if ((rval = send(msg_header, offer, sizeof(offer))) ||
+	    (rval = get(reply, answer, &length, sizeof(answer), FAST_NEGOTIATE_TIMEOUT)))
+	{
+		resetLines();
+		return rval;
+	}
+	if (reply[1] != FST || length != 1 || answer[0] != FAST_VERSION) {
+		return ERR_REJECTED;
+	}
+	fast_ = true;
+	if (TICL_DEBUG && serial_) {
+		serial_->println("Fast mode");
+	}
+	return 0;
+}
+
+// Answer an FST packet received with get(): tell the peer we agree,
+// and switch to fast mode.
+int TICL::acceptFast(uint8_t* header, uint8_t* data, int datalength, uint8_t machine_id) {
+	uint8_t msg_header[4] = {machine_id, FST, 1, 0};
+	uint8_t answer[1] = {FAST_VERSION};
+	int rval;
+
+	if (!TICL_FAST || header[1] != FST || datalength != 1 || data[0] != FAST_VERSION) {
+		msg_header[1] = SKIP;
+		answer[0] = 0;
+		return send(msg_header, answer, 1);
+	}
+	if ((rval = send(msg_header, answer, sizeof(answer)))) {
+		return rval;
+	}
+	fast_ = true;
+	return 0;
+}
+
+// Go back to the standard protocol. Both ends have to do this.
+void TICL::endFast() {
+	fast_ = false;
+}
+
+bool TICL::fast() {
+	return fast_;
+}
+
+// Fill in what a peer's machine ID says about it. Returns false for
+// machine IDs we don't know.
+static bool describePeer(LinkProfile* profile, uint8_t machine_id) {
+	profile->machine_id = machine_id;
+	profile->real_type = 0x00;
+	switch(machine_id) {
+		case CALC83P:
+			profile->computer_id = COMP83P;
+			profile->model = CALC83P;
+			profile->list_type = 0x01;
+			profile->string_type = 0x04;
+			return true;
+		case CALC83:
+			profile->computer_id = COMP83;
+			profile->model = CALC83;
+			profile->list_type = 0x01;
+			profile->string_type = 0x04;
+			return true;
+		case CALC82:
+			profile->computer_id = COMP82;
+			profile->model = CALC82;
+			profile->list_type = 0x01;
+			profile->string_type = 0xff;		// The TI-82 has no strings
+			return true;
+		case CALC85a:
+		case CALC85b:
+			profile->computer_id = COMP85;
+			profile->model = (enum Endpoint)machine_id;
+			profile->list_type = 0x04;
+			profile->string_type = 0x0C;
+			return true;
+		case CALC86:
+			profile->computer_id = COMP86;
+			profile->model = CALC86;
+			profile->list_type = 0x04;
+			profile->string_type = 0x0C;
+			return true;
+		case CALC89:
+			profile->computer_id = COMP89;
+			profile->model = CALC89;
+			profile->list_type = 0x04;
+			profile->string_type = 0x0C;
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Send a packet with no data and wait for the peer's ACK, whose
+// header is left in reply
+int TICL::command(uint8_t machine_id, uint8_t command, uint8_t* reply, int timeout) {
+	uint8_t msg_header[4] = {machine_id, command, 0, 0};
+	int length;
+	int rval;
+	if ((rval = send(msg_header, NULL, 0)) ||
+	    (rval = get(reply, NULL, &length, 0, timeout)))
+	{
+		return rval;
+	}
+	return (reply[1] == ACK) ? 0 : ERR_REJECTED;
+}
+
+// RDY's ACK tells us the peer's machine ID. On the TI-83+ family, VER
+// then tells a TI-83+ from a TI-84+: it's ACKed, we answer with a CTS,
+// which is ACKed too, and the version arrives as DATA. A calculator
+// without VER leaves the hardware byte unknown. Short timeouts keep
+// bring-up to milliseconds, even with nothing on the other end.
+int TICL::discover(LinkProfile* profile, uint8_t machine_id) {
+	uint8_t reply[4];
+	uint8_t version[VER_LENGTH];
+	int length;
+	int rval;
+
+	memset(profile, 0, sizeof(LinkProfile));
+	profile->hardware = 0xff;
+	unsigned long start = micros();
+	if ((rval = command(machine_id, RDY, reply, DISCOVER_TIMEOUT))) {
+		resetLines();
+		return rval;
+	}
+	// RDY and its ACK are 32 bits each
+	profile->bit_micros = min(micros() - start, 64 * 0xffffUL) / 64;
+	if (!describePeer(profile, reply[0])) {
+		return ERR_INVALID;
+	}
+
+	if (profile->machine_id == CALC83P) {
+		if (command(machine_id, VER, reply, DISCOVER_TIMEOUT) ||
+		    command(machine_id, CTS, reply, DISCOVER_TIMEOUT) ||
+		    get(reply, version, &length, sizeof(version), DISCOVER_TIMEOUT) || reply[1] != DATA)
+		{
+			resetLines();
+		} else {
+			uint8_t msg_header[4] = {machine_id, ACK, 0, 0};
+			send(msg_header, NULL, 0);
+			if (length > VER_HARDWARE) {
+				profile->hardware = version[VER_HARDWARE];
+			}
+		}
+	}
+
+	profile_ = profile;
+	if (TICL_DEBUG && serial_) {
+		serial_->print("Peer ");
+		serial_->print(profile->machine_id, HEX);
+		serial_->print(", hardware ");
+		serial_->print(profile->hardware, HEX);
+		serial_->print(", ");
+		serial_->print(profile->bit_micros);
+		serial_->println(" us/bit");
+	}
+	return 0;
+}
+
+// Use a profile from an earlier discover() instead of probing again
+void TICL::setProfile(LinkProfile* profile) {
+	profile_ = profile;
+}
+
+LinkProfile* TICL::profile() {
+	return profile_;
+}
+
+// Fast-mode byte out. Each bit is the standard protocol's handshake:
+// pull tip for a 0 or ring for a 1, wait for the peer to pull the
+// other line, let go, and wait for the peer to let go. Neither end can
+// lose a bit however late the other is. The saving is in what's left
+// out: a peer running ArTICL is never still holding a line when the
+// handshake ends, so both lines are checked once per byte rather than
+// once per bit, and each wait watches the one line it's waiting on.
+// A capture and recorder see the same events as in sendByte().
+int TICL::sendByteFast(uint8_t byte) {
+	unsigned long previousMicros = 0;
+	unsigned long started = 0, respond = 0, release = 0;
+	uint8_t value = byte;
+	if (TICL_RECORDER && recorder_) {
+		started = previousMicros = micros();
+	}
+	if (!waitLine(tip_, HIGH, TIMEOUT) || !waitLine(ring_, HIGH, TIMEOUT)) {
+		return ERR_WRITE_TIMEOUT;
+	}
+	if (TICL_CAPTURE && capture_) {
+		capture_->observe(true, true);
+	}
+	for(int bit = 0; bit < 8; bit++) {
+		int line = (byte & 1) ? ring_ : tip_;
+		int other = (byte & 1) ? tip_ : ring_;
+		pinMode(line, OUTPUT);
+		digitalWrite(line, LOW);
+		if (TICL_CAPTURE && capture_) {
+			capture_->drive(line == tip_, line == ring_);
+		}
+		if (!waitLine(other, LOW, TIMEOUT)) {
+			return ERR_WRITE_TIMEOUT;
+		}
+		if (TICL_CAPTURE && capture_) {
+			capture_->observe(false, false);
+		}
+		if (TICL_RECORDER && recorder_) {
+			unsigned long now = micros();
+			respond += now - previousMicros;
+			previousMicros = now;
+		}
+		pinMode(line, INPUT_PULLUP);
+		if (TICL_CAPTURE && capture_) {
+			capture_->drive(false, false);
+		}
+		if (!waitLine(other, HIGH, TIMEOUT)) {
+			return ERR_WRITE_TIMEOUT;
+		}
+		if (TICL_CAPTURE && capture_) {
+			capture_->observe(true, true);
+		}
+		if (TICL_RECORDER && recorder_) {
+			unsigned long now = micros();
+			release += now - previousMicros;
+			previousMicros = now;
+		}
+		byte >>= 1;
+	}
+	if (TICL_RECORDER && recorder_) {
+		recorder_->byte(true, value, started, respond, release);
+	}
+	return 0;
+}
+
+// Fast-mode byte in; see sendByteFast()
+int TICL::getByteFast(uint8_t* byte, int timeout) {
+	unsigned long started = 0, respond = 0, release = 0;
+	*byte = 0;
+	for(int bit = 0; bit < 8; bit++) {
+		unsigned long previousMicros = micros();
+		unsigned long limit = (bit == 0) ? (unsigned long)timeout : TIMEOUT;
+		int line;
+		while (true) {
+			if (digitalRead(tip_) == LOW) {
+				line = tip_;
+				break;
+			}
+			if (digitalRead(ring_) == LOW) {
+				line = ring_;
+				break;
+			}
+			if (micros() - previousMicros > limit) {
+				if (TICL_DEBUG && serial_) {
+					serial_->print("died waiting for fast bit "); serial_->println(bit);
+				}
+				return (bit == 0) ? ERR_READ_ENTER_TIMEOUT : ERR_READ_TIMEOUT;
+			}
+		}
+		int other = (line == tip_) ? ring_ : tip_;
+		if (TICL_CAPTURE && capture_) {
+			capture_->observe(line != tip_, line != ring_);
+		}
+		if (TICL_RECORDER && recorder_) {
+			if (bit == 0) {
+				started = micros();
+			} else {
+				respond += micros() - previousMicros;
+			}
+		}
+		*byte = (*byte >> 1) | ((line == ring_) ? 0x80 : 0x00);
+		pinMode(other, OUTPUT);
+		digitalWrite(other, LOW);
+		if (TICL_CAPTURE && capture_) {
+			capture_->drive(other == tip_, other == ring_);
+		}
+		if (TICL_RECORDER && recorder_) {
+			previousMicros = micros();
+		}
+		if (!waitLine(line, HIGH, TIMEOUT)) {
+			return ERR_READ_TIMEOUT;
+		}
+		if (TICL_CAPTURE && capture_) {
+			capture_->observe(other != tip_, other != ring_);
+		}
+		if (TICL_RECORDER && recorder_) {
+			release += micros() - previousMicros;
+		}
+		pinMode(other, INPUT_PULLUP);
+		if (TICL_CAPTURE && capture_) {
+			capture_->drive(false, false);
+		}
+	}
+	if (TICL_DEBUG && serial_) {
+		serial_->print("Got byte ");
+		serial_->println(*byte);
+	}
+	if (TICL_CAPTURE && capture_) {
+		capture_->byte(*byte);
+	}
+	if (TICL_RECORDER && recorder_) {
+		recorder_->byte(false, *byte, started, respond, release);
+	}
+	return 0;
+}
+
+// Wait for pin to reach level, resetting the lines on a timeout
+bool TICL::waitLine(int pin, int level, unsigned long timeout) {
+	unsigned long previousMicros = micros();
+	while (digitalRead(pin) != level) {
+		if (micros() - previousMicros > timeout) {
+			resetLines();
+			return false;
+		}
+	}
+	return true;
+}
+
+#if defined(__AVR__)
+// A low level on either line. The interrupt keeps firing for as long
+// as the line is low, so it turns itself off.
+static void idleWake() {
+	idleWokeAt = micros();
+	idleWoke = true;
+	detachInterrupt(digitalPinToInterrupt(idlePins[0]));
+	detachInterrupt(digitalPinToInterrupt(idlePins[1]));
+}
+
+// Arm or disarm the wake interrupt on both lines. Only the low-level
+// external interrupts can wake an AVR from power-down, and they're the
+// only ones that don't clash with other libraries' pin-change
+// handlers. Returns false if either line has none.
+static bool idleInterrupts(int tip, int ring, bool arm) {
+	if (digitalPinToInterrupt(tip) == NOT_AN_INTERRUPT ||
+	    digitalPinToInterrupt(ring) == NOT_AN_INTERRUPT)
+	{
+		return false;
+	}
+	if (arm) {
+		idlePins[0] = tip;
+		idlePins[1] = ring;
+		attachInterrupt(digitalPinToInterrupt(tip), idleWake, LOW);
+		attachInterrupt(digitalPinToInterrupt(ring), idleWake, LOW);
+	} else {
+		detachInterrupt(digitalPinToInterrupt(tip));
+		detachInterrupt(digitalPinToInterrupt(ring));
+	}
+	return true;
+}
+#endif
+
+// Only here is the wake interrupt code referenced, so a sketch that
+// never calls this doesn't link attachInterrupt() and its handlers.
+void TICL::setIdleMode(enum IdleMode mode) {
+	idle_ = mode;
+	wake_micros_ = 0;
+#if defined(__AVR__)
+	wake_ = (mode == IDLE_NONE) ? NULL : idleInterrupts;
+#endif
+}
+
+unsigned long TICL::wakeMicros() {
+	return wake_micros_;
+}
+
+// Wait for the peer to pull a line low, the start of its next packet,
+// sleeping as setIdleMode() allows. Returns 0 once a line is low, or
+// ERR_READ_ENTER_TIMEOUT; IDLE_DEEP with a wake interrupt armed has
+// no timeout, since the timers stop with the CPU.
+int TICL::waitForLink(unsigned long timeout) {
+	unsigned long previousMicros = micros();
+	idleWoke = false;
+	while (linesIdle()) {
+		bool armed = wake_ && wake_(tip_, ring_, true);
+		bool deep = armed && idle_ == IDLE_DEEP;
+		if (!deep && micros() - previousMicros > timeout) {
+			disarmWake();
+			return ERR_READ_ENTER_TIMEOUT;
+		}
+		if (idle_ != IDLE_NONE) {
+			idleSleep(deep);
+		}
+	}
+	if (idleWoke) {
+		wake_micros_ = max(wake_micros_, micros() - idleWokeAt);
+		if (TICL_DEBUG && serial_ && wake_micros_ > IDLE_WAKE_BUDGET) {
+			serial_->print("Slow wake, us: ");
+			serial_->println(wake_micros_);
+		}
+	}
+	disarmWake();
+	return 0;
+}
+
+void TICL::disarmWake() {
+	if (wake_) {
+		wake_(tip_, ring_, false);
+	}
+}
+
+// Sleep until the next interrupt: the wake interrupt, or unless deep,
+// the millisecond timer tick. The lines are checked with interrupts
+// off, since a line that falls after that wakes us straight away. On
+// the MSP432, Energia's delay() idles the CPU in a low-power mode, so
+// both modes sleep a millisecond at a time. Elsewhere this polls.
+void TICL::idleSleep(bool deep) {
+#if defined(__AVR__)
+	noInterrupts();
+	if (linesIdle()) {
+		set_sleep_mode(deep ? SLEEP_MODE_PWR_DOWN : SLEEP_MODE_IDLE);
+		sleep_enable();
+		interrupts();
+		sleep_cpu();
+		sleep_disable();
+	}
+	interrupts();
+#elif defined(__MSP432P401R__)
+	delay(1);
+#endif
+}
+
+// True if the peer isn't pulling either line low, i.e. it
+// isn't trying to send us a bit.
+bool TICL::linesIdle() {
+	return digitalRead(tip_) == HIGH && digitalRead(ring_) == HIGH;
+}
+
+void TICL::resetLines(void) {
+	pinMode(ring_, INPUT_PULLUP);           // set pin to input with pullups
+	pinMode(tip_, INPUT_PULLUP);            // set pin to input with pullups
+	if (TICL_CAPTURE && capture_) {
+		capture_->drive(false, false);
+	}
+}
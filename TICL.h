@@ -1,97 +1,192 @@
-/*************************************************
- *  TICL.h - Core of ArTICL library for linking  *
- *           TI calculators and Arduinos.        *
- *           Created by Christopher Mitchell,    *
- *           2011-2019, all rights reserved.     *
- *************************************************/
-
-#ifndef TICL_H
-#define TICL_H
-
-#include "Arduino.h"
-#include "HardwareSerial.h"
-
-#define TIMEOUT 100000l				// microseconds (100ms)
-#define GET_ENTER_TIMEOUT 1000000l	// microseconds (1s)
-
-#if defined(__MSP432P401R__)		// MSP432 target
-#define DEFAULT_TIP		17			// Tip = red wire (GPIO 5.7)
-#define	DEFAULT_RING	37			// Ring = white wire (GPIO 5.6)
-#else								// Arduino target
-#define DEFAULT_TIP		2			// Tip = red wire
-#define	DEFAULT_RING	3			// Ring = white wire
-#endif
-
-enum TICLErrors {
-	ERR_READ_TIMEOUT = -1,
-	ERR_WRITE_TIMEOUT = -2,
-	ERR_BAD_CHECKSUM = -3,
-	ERR_BUFFER_OVERFLOW = -4,
-	ERR_INVALID = -5,
-	ERR_READ_ENTER_TIMEOUT = -6
-};
-
-enum Endpoint {
-	COMP82	= 0x02,
-	COMP83	= 0x03,
-	COMP85  = 0x05,
-	COMP86  = 0x06,
-	COMP89  = 0x09,
-	COMP92  = 0x09,
-	CBL82   = 0x12,
-	CBL85   = 0x15,
-	CBL89   = 0x19,
-	CBL92   = 0x19,
-	COMP83P	= 0x23,
-	CALC83P = 0x73,
-	CALC82	= 0x82,
-	CALC83	= 0x83,
-	CALC85a = 0x85,
-	CALC89  = 0x89,
-	CALC92  = 0x89,
-	CALC85b = 0x95,
-};
-
-enum CommandID {
-	VAR		= 0x06,
-	CTS		= 0x09,
-	DATA	= 0x15,
-	VER		= 0x2D,
-	SKIP	= 0x36,
-	EXIT	= 0x36,
-	ACK		= 0x56,
-	ERR		= 0x5A,
-	RDY		= 0x68,
-	SCR		= 0x6D,
-	KEY		= 0x87,
-	DEL		= 0x88,
-	EOT		= 0x92,
-	REQ		= 0xA2,
-	RTS		= 0xC9,
-};
-
-class TICL {
-	public:
-		TICL();
-		TICL(int tip, int ring);
-		void begin();
-		void setLines(int tip, int ring);
-		void setVerbosity(bool verbose, HardwareSerial* serial = NULL);
-
-		int send(uint8_t* header, uint8_t* data, int datalength, uint8_t(*data_callback)(int) = NULL);
-		int get(uint8_t* header, uint8_t* data, int* datalength, int maxlength, int timeout = GET_ENTER_TIMEOUT);
-		void resetLines();
-
-	protected:
-		HardwareSerial* serial_;
-
-	private:
-		int sendByte(uint8_t byte);
-		int getByte(uint8_t* byte, int timeout = GET_ENTER_TIMEOUT);
-		int digitalSafeRead(int pin);
-
-		int tip_;
-		int ring_;
-};
-
+/*************************************************
+ *  TICL.h - Core of ArTICL library for linking  *
+ *           TI calculators and Arduinos.        *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef TICL_H
+#define TICL_H
+
+#include "Arduino.h"
+#include "HardwareSerial.h"
+#include "TIConfig.h"
+#include "LineCapture.h"
+#include "SessionRecorder.h"
+
+#define TIMEOUT 100000l				// microseconds (100ms)
+#define GET_ENTER_TIMEOUT 1000000l	// microseconds (1s)
+#define DEFAULT_RETRIES 3			// Resends of a packet with a bad checksum
+#define FAST_VERSION 2				// Fast-mode framing revision, see negotiateFast()
+#define FAST_NEGOTIATE_TIMEOUT 200000l	// microseconds (200ms)
+#define DISCOVER_TIMEOUT 50000l		// microseconds (50ms)
+#define VER_LENGTH 11				// Data in a TI-83+ family VER reply
+#define IDLE_WAKE_BUDGET 10000l		// microseconds (10ms), a tenth of a sender's bit timeout
+#define VER_HARDWARE 5				// Hardware byte: 0-1 TI-83+, 2-3 TI-84+, more for later models
+
+#if defined(__MSP432P401R__)		// MSP432 target
+#define DEFAULT_TIP		17			// Tip = red wire (GPIO 5.7)
+#define	DEFAULT_RING	37			// Ring = white wire (GPIO 5.6)
+#else								// Arduino target
+#define DEFAULT_TIP		2			// Tip = red wire
+#define	DEFAULT_RING	3			// Ring = white wire
+#endif
+
+enum TICLErrors {
+	ERR_READ_TIMEOUT = -1,
+	ERR_WRITE_TIMEOUT = -2,
+	ERR_BAD_CHECKSUM = -3,
+	ERR_BUFFER_OVERFLOW = -4,
+	ERR_INVALID = -5,
+	ERR_READ_ENTER_TIMEOUT = -6,
+	ERR_REJECTED = -7
+};
+
+enum Endpoint {
+	COMP82	= 0x02,
+	COMP83	= 0x03,
+	COMP85  = 0x05,
+	COMP86  = 0x06,
+	COMP89  = 0x09,
+	COMP92  = 0x09,
+	CBL82   = 0x12,
+	CBL85   = 0x15,
+	CBL89   = 0x19,
+	CBL92   = 0x19,
+	COMP83P	= 0x23,
+	CALC83P = 0x73,
+	CALC82	= 0x82,
+	CALC83	= 0x83,
+	CALC85a = 0x85,
+	CALC86  = 0x86,
+	CALC89  = 0x89,
+	CALC92  = 0x89,
+	CALC85b = 0x95,
+};
+
+enum CommandID {
+	VAR		= 0x06,
+	CTS		= 0x09,
+	DATA	= 0x15,
+	VER		= 0x2D,
+	SKIP	= 0x36,
+	EXIT	= 0x36,
+	ACK		= 0x56,
+	ERR		= 0x5A,
+	RDY		= 0x68,
+	SCR		= 0x6D,
+	KEY		= 0x87,
+	DEL		= 0x88,
+	EOT		= 0x92,
+	REQ		= 0xA2,
+	RTS		= 0xC9,
+	FST		= 0xF3,					// Not TI: ArTICL-to-ArTICL fast mode offer
+};
+
+// How to wait for a peer to start a packet; see setIdleMode()
+enum IdleMode {
+	IDLE_NONE = 0,							// Poll the lines
+	IDLE_SLEEP = 1,							// Stop the CPU until a line falls or the timer ticks
+	IDLE_DEEP = 2,							// Power down until a line falls; no timeout
+};
+
+// What discover() learned about the device at the other end of a link.
+// Keep it, and hand it back with setProfile() after a reset or on the
+// next power-up, to skip the probe.
+struct LinkProfile {
+	uint8_t machine_id;						// Machine ID the peer answers as, 0 if unknown
+	uint8_t computer_id;					// Machine ID to send it silent-link packets as
+	enum Endpoint model;					// Model for TIVar conversions of its variables
+	uint8_t hardware;						// VER hardware byte, 0xff if it has none
+	uint8_t real_type;						// Variable types in its VAR headers, 0xff if
+	uint8_t list_type;						// it has no such type
+	uint8_t string_type;
+	uint16_t bit_micros;					// Measured time per bit, with the peer's turnaround
+};
+
+class TICL {
+	public:
+		TICL();
+		TICL(int tip, int ring);
+		void begin();
+		void setLines(int tip, int ring);
+		void setVerbosity(bool verbose, HardwareSerial* serial = NULL);
+		void setCapture(LineCapture* capture);
+		void setRecorder(SessionRecorder* recorder);
+
+		int send(uint8_t* header, uint8_t* data, int datalength, uint8_t(*data_callback)(int) = NULL);
+		int get(uint8_t* header, uint8_t* data, int* datalength, int maxlength, int timeout = GET_ENTER_TIMEOUT,
+		        void(*data_sink)(int, uint8_t) = NULL);
+		void resetLines();
+
+		// Packet exchanges that recover from bad checksums: the receiver
+		// answers a damaged packet with ERR, and the sender resends it,
+		// at most setRetries() times.
+		void setRetries(int retries);
+		int getOrRetry(uint8_t* header, uint8_t* data, int* datalength, int maxlength, uint8_t machine_id,
+		               int timeout = GET_ENTER_TIMEOUT, void(*data_sink)(int, uint8_t) = NULL);
+		int sendAwaitAck(uint8_t* header, uint8_t* data, int datalength, uint8_t(*data_callback)(int) = NULL);
+		int requestResend(uint8_t machine_id);
+
+		// Fast mode, for when both ends of the link run ArTICL. One end
+		// offers it with negotiateFast(); the other answers the FST packet
+		// it gets with acceptFast(). A calculator never answers, and the
+		// link stays in the standard protocol. In fast mode each bit is
+		// still a full handshake, so a slow end can't lose one, but with
+		// the line checks that only a calculator needs left out.
+		int negotiateFast(uint8_t machine_id);
+		int acceptFast(uint8_t* header, uint8_t* data, int datalength, uint8_t machine_id);
+		void endFast();
+		bool fast();
+
+		// Peer discovery: probe the device at the other end once, with
+		// RDY and on the TI-83+ family VER, and record what it is. Later
+		// transfers read the model, types and timing from the profile
+		// instead of working them out again.
+		int discover(LinkProfile* profile, uint8_t machine_id = COMP83P);
+		void setProfile(LinkProfile* profile);
+		LinkProfile* profile();
+
+		// Low-power idle, for battery-powered boards that mostly wait
+		// for a calculator: waitForLink(), and CBL2::eventLoopTick()
+		// between transfers, sleep instead of polling the lines. The
+		// peer holds its first bit until we answer it, so nothing is
+		// lost while we wake. IDLE_DEEP needs tip and ring on external
+		// interrupt pins (2 and 3 on an Uno); elsewhere it acts like
+		// IDLE_SLEEP. wakeMicros() is the longest time yet from a wake
+		// interrupt to reading the lines, to check against
+		// IDLE_WAKE_BUDGET.
+		void setIdleMode(enum IdleMode mode);
+		int waitForLink(unsigned long timeout);
+		unsigned long wakeMicros();
+
+	protected:
+		HardwareSerial* serial_;
+		LineCapture* capture_;
+		SessionRecorder* recorder_;
+		LinkProfile* profile_;
+		int retries_;
+		enum IdleMode idle_;
+		bool (*wake_)(int tip, int ring, bool arm);	// Wake interrupt, set by setIdleMode()
+		unsigned long wake_micros_;
+		bool fast_;
+
+		int sendByte(uint8_t byte);
+		int getByte(uint8_t* byte, int timeout = GET_ENTER_TIMEOUT);
+		bool linesIdle();
+
+	private:
+		int digitalSafeRead(int pin);
+		int sendByteFast(uint8_t byte);
+		int getByteFast(uint8_t* byte, int timeout);
+		bool waitLine(int pin, int level, unsigned long timeout);
+		int command(uint8_t machine_id, uint8_t command, uint8_t* reply, int timeout);
+		void disarmWake();
+		void idleSleep(bool deep);
+
+		friend class LinkRelay;			// Passes bits between two links' lines
+		int tip_;
+		int ring_;
+};
+
 #endif	// TICL_H
\ No newline at end of file
@@ -0,0 +1,71 @@
+/*************************************************
+ *  TIConfig.h - Build options that trim the     *
+ *           ArTICL library for small boards.    *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef TICONFIG_H
+#define TICONFIG_H
+
+// Every option defaults to on. Turn one off by editing it here, or
+// for a single build with a compiler flag such as -DTICL_DEBUG=0
+// (with arduino-cli, --build-property compiler.cpp.extra_flags=...),
+// since a #define in the sketch doesn't reach the library's own files.
+// Methods a sketch never calls, like CBL2::eventLoopTick(), are left
+// out by the linker anyway; these options cover the code it can't
+// tell is unused.
+
+// Messages printed by setVerbosity(). With this off, setVerbosity()
+// does nothing and none of the printing code is linked in.
+#ifndef TICL_DEBUG
+#define TICL_DEBUG 1
+#endif
+
+// TIVar's string codec, stringToStrVar8x() and strVarToString8x(),
+// and string variables in VarStore
+#ifndef TICL_STRINGS
+#define TICL_STRINGS 1
+#endif
+
+// TIVar's real number conversions, and the real numbers and lists in
+// VarStore and DataLogger. The double conversions bring in floating
+// point support, the largest piece of a small sketch.
+#ifndef TICL_REALS
+#define TICL_REALS 1
+#endif
+
+// LineCapture, set with TICL::setCapture(). With this off,
+// setCapture() does nothing and none of the capture calls in the bit
+// loops are linked in.
+#ifndef TICL_CAPTURE
+#define TICL_CAPTURE 1
+#endif
+
+// SessionRecorder, set with TICL::setRecorder(); off, as above, along
+// with the timing it takes on every byte
+#ifndef TICL_RECORDER
+#define TICL_RECORDER 1
+#endif
+
+// Fast mode for ArTICL-to-ArTICL links. With this off,
+// negotiateFast() returns ERR_REJECTED without offering it and
+// acceptFast() turns every offer down.
+#ifndef TICL_FAST
+#define TICL_FAST 1
+#endif
+
+// Constant tables live in flash on AVR, where anything else is
+// copied into RAM at startup
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#endif
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef pgm_read_word
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#endif
+
+#endif	// TICONFIG_H
@@ -0,0 +1,291 @@
+/*************************************************
+ *  TIFile.cpp - Streaming reader and writer for *
+ *           TI computer variable files (.8xp,   *
+ *           .8xl, .8xv, .83p, .82p, ...).       *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "TIFile.h"
+#include "TIVar.h"
+
+static const char* const tiFileSignatures[] = {
+	"**TI82**",
+	"**TI83**",
+	"**TI83F*",
+	"**TI73**",
+};
+
+static const uint8_t tiFileMarker[3] = {0x1A, 0x0A, 0x00};
+
+// Length of a variable entry header in each file family
+static int entryHeaderLength(enum TIFileFormat format) {
+	return (format == TIFILE_83F) ? 13 : 11;
+}
+
+TIFileReader::TIFileReader() {
+	source_ = NULL;
+	format_ = TIFILE_INVALID;
+	comment_[0] = '\0';
+	sectionleft_ = entryleft_ = 0;
+	checksum_ = 0;
+}
+
+int TIFileReader::begin(Stream* source) {
+	uint8_t header[TIFILE_HEADER_LEN];
+
+	source_ = source;
+	format_ = TIFILE_INVALID;
+	sectionleft_ = entryleft_ = 0;
+	checksum_ = 0;
+	if (source_->readBytes((char*)header, TIFILE_HEADER_LEN) != TIFILE_HEADER_LEN) {
+		return ERR_READ_TIMEOUT;
+	}
+
+	for(int i = 0; i < (int)(sizeof(tiFileSignatures) / sizeof(tiFileSignatures[0])); i++) {
+		if (0 == memcmp(header, tiFileSignatures[i], TIFILE_SIGNATURE_LEN)) {
+			format_ = (enum TIFileFormat)i;
+		}
+	}
+	if (format_ == TIFILE_INVALID ||
+	    0 != memcmp(&header[TIFILE_SIGNATURE_LEN], tiFileMarker, sizeof(tiFileMarker)))
+	{
+		format_ = TIFILE_INVALID;
+		return ERR_INVALID;
+	}
+
+	memcpy(comment_, &header[11], TIFILE_COMMENT_LEN);
+	comment_[TIFILE_COMMENT_LEN] = '\0';
+	sectionleft_ = TIVar::sizeWordToInt(&header[53]);
+	return 0;
+}
+
+enum TIFileFormat TIFileReader::format() {
+	return format_;
+}
+
+enum Endpoint TIFileReader::model() {
+	switch(format_) {
+		case TIFILE_82:
+			return CALC82;
+		case TIFILE_83F:
+			return CALC83P;
+		default:
+			return CALC83;
+	}
+}
+
+const char* TIFileReader::comment() {
+	return comment_;
+}
+
+int TIFileReader::nextEntry(uint8_t* header, int* headerlength, int* datalength) {
+	uint8_t word[2];
+	int rval;
+
+	if (format_ == TIFILE_INVALID) {
+		return ERR_INVALID;
+	}
+	if ((rval = skip(entryleft_))) {
+		return rval;
+	}
+	if (sectionleft_ == 0) {
+		return 1;							// No more entries
+	}
+
+	// Entry header length, then a header laid out like the link's
+	if ((rval = readRaw(word, 2))) {
+		return rval;
+	}
+	*headerlength = TIVar::sizeWordToInt(word);
+	if (*headerlength < 11 || *headerlength > TIFILE_MAX_VAR_HEADER) {
+		return ERR_INVALID;
+	}
+	if ((rval = readRaw(header, *headerlength)) || (rval = readRaw(word, 2))) {
+		return rval;
+	}
+
+	// The data length is repeated after the header
+	*datalength = TIVar::sizeWordToInt(word);
+	if (*datalength > sectionleft_) {
+		return ERR_INVALID;
+	}
+	entryleft_ = *datalength;
+	return 0;
+}
+
+int TIFileReader::read(uint8_t* buffer, int length) {
+	length = min(length, (int)entryleft_);
+	int rval = readRaw(buffer, length);
+	if (rval) {
+		return rval;
+	}
+	entryleft_ -= length;
+	return length;
+}
+
+// Returns the next data byte of the current entry, or -1
+// when the entry is exhausted or the source fails.
+int TIFileReader::readByte() {
+	uint8_t byte;
+	if (entryleft_ == 0 || readRaw(&byte, 1)) {
+		return -1;
+	}
+	entryleft_--;
+	return byte;
+}
+
+int TIFileReader::remaining() {
+	return entryleft_;
+}
+
+int TIFileReader::finish() {
+	uint8_t word[2];
+	int rval;
+
+	entryleft_ = 0;
+	if ((rval = skip(sectionleft_))) {
+		return rval;
+	}
+	if (source_->readBytes((char*)word, 2) != 2) {
+		return ERR_READ_TIMEOUT;
+	}
+	if (checksum_ != TIVar::sizeWordToInt(word)) {
+		return ERR_BAD_CHECKSUM;
+	}
+	return 0;
+}
+
+// Read bytes of the data section, keeping the checksum
+int TIFileReader::readRaw(uint8_t* buffer, int length) {
+	if (length > sectionleft_) {
+		return ERR_INVALID;
+	}
+	if ((int)source_->readBytes((char*)buffer, length) != length) {
+		return ERR_READ_TIMEOUT;
+	}
+	for(int i = 0; i < length; i++) {
+		checksum_ += buffer[i];
+	}
+	sectionleft_ -= length;
+	return 0;
+}
+
+int TIFileReader::skip(int length) {
+	uint8_t scratch[16];
+	while (length > 0) {
+		int chunk = min(length, (int)sizeof(scratch));
+		int rval = readRaw(scratch, chunk);
+		if (rval) {
+			return rval;
+		}
+		length -= chunk;
+	}
+	return 0;
+}
+
+TIFileWriter::TIFileWriter() {
+	sink_ = NULL;
+	format_ = TIFILE_INVALID;
+	sectionleft_ = entryleft_ = 0;
+	checksum_ = 0;
+}
+
+// Bytes one variable adds to the data section
+uint16_t TIFileWriter::entrySize(enum TIFileFormat format, int datalength) {
+	return 2 + entryHeaderLength(format) + 2 + datalength;
+}
+
+int TIFileWriter::begin(Print* sink, enum TIFileFormat format, uint16_t sectionlength,
+                        const char* comment)
+{
+	uint8_t header[TIFILE_HEADER_LEN];
+
+	if (format < TIFILE_82 || format > TIFILE_73) {
+		return ERR_INVALID;
+	}
+	sink_ = sink;
+	format_ = format;
+	sectionleft_ = sectionlength;
+	entryleft_ = 0;
+	checksum_ = 0;
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, tiFileSignatures[format], TIFILE_SIGNATURE_LEN);
+	memcpy(&header[TIFILE_SIGNATURE_LEN], tiFileMarker, sizeof(tiFileMarker));
+	if (comment) {
+		strncpy((char*)&header[11], comment, TIFILE_COMMENT_LEN);
+	}
+	TIVar::intToSizeWord(sectionlength, &header[53]);
+	if (sink_->write(header, TIFILE_HEADER_LEN) != TIFILE_HEADER_LEN) {
+		return ERR_WRITE_TIMEOUT;
+	}
+	return 0;
+}
+
+// Takes the VAR header as received over the link; an 11-byte header is
+// padded with a zero version and flag byte in TIFILE_83F files.
+int TIFileWriter::addEntry(const uint8_t* header, int headerlength) {
+	uint8_t entry[2 + TIFILE_MAX_VAR_HEADER + 2];
+	int length = entryHeaderLength(format_);
+	int rval;
+
+	if (format_ == TIFILE_INVALID || entryleft_ != 0 || headerlength < 11) {
+		return ERR_INVALID;
+	}
+
+	memset(entry, 0, sizeof(entry));
+	TIVar::intToSizeWord(length, &entry[0]);
+	memcpy(&entry[2], header, min(headerlength, length));
+	memcpy(&entry[2 + length], header, 2);		// Data length again
+	if ((rval = writeRaw(entry, 2 + length + 2))) {
+		return rval;
+	}
+	entryleft_ = TIVar::sizeWordToInt((uint8_t*)header);
+	return 0;
+}
+
+int TIFileWriter::write(const uint8_t* buffer, int length) {
+	if (length > entryleft_) {
+		return ERR_BUFFER_OVERFLOW;
+	}
+	int rval = writeRaw(buffer, length);
+	if (rval == 0) {
+		entryleft_ -= length;
+	}
+	return rval;
+}
+
+int TIFileWriter::writeByte(uint8_t byte) {
+	return write(&byte, 1);
+}
+
+int TIFileWriter::end() {
+	uint8_t word[2];
+	if (format_ == TIFILE_INVALID || entryleft_ != 0 || sectionleft_ != 0) {
+		return ERR_INVALID;
+	}
+	TIVar::intToSizeWord(checksum_, word);
+	if (sink_->write(word, 2) != 2) {
+		return ERR_WRITE_TIMEOUT;
+	}
+	format_ = TIFILE_INVALID;
+	return 0;
+}
+
+// Write bytes of the data section, keeping the checksum
+int TIFileWriter::writeRaw(const uint8_t* buffer, int length) {
+	if (length > sectionleft_) {
+		return ERR_BUFFER_OVERFLOW;
+	}
+	if ((int)sink_->write(buffer, length) != length) {
+		return ERR_WRITE_TIMEOUT;
+	}
+	for(int i = 0; i < length; i++) {
+		checksum_ += buffer[i];
+	}
+	sectionleft_ -= length;
+	return 0;
+}
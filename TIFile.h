@@ -0,0 +1,97 @@
+/*************************************************
+ *  TIFile.h - Streaming reader and writer for   *
+ *           TI computer variable files (.8xp,   *
+ *           .8xl, .8xv, .83p, .82p, ...).       *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef TIFILE_H
+#define TIFILE_H
+
+#include "Arduino.h"
+#include "TICL.h"
+
+#define TIFILE_SIGNATURE_LEN	8
+#define TIFILE_COMMENT_LEN		42
+#define TIFILE_HEADER_LEN		55		// Signature, 3 marker bytes, comment, data length
+#define TIFILE_MAX_VAR_HEADER	13		// Largest variable entry header
+
+// The file families this module understands. Each variable entry's
+// header is laid out exactly like the VAR header sent over the link:
+// size word, type, 8-byte name, and on TIFILE_83F a version and flag byte.
+enum TIFileFormat {
+	TIFILE_INVALID = -1,
+	TIFILE_82 = 0,						// **TI82**, .82p etc.
+	TIFILE_83 = 1,						// **TI83**, .83p etc.
+	TIFILE_83F = 2,						// **TI83F*, .8xp/.8xl/.8xv etc.
+	TIFILE_73 = 3,						// **TI73**, .73p etc.
+};
+
+class TIFileReader {
+	public:
+		TIFileReader();
+
+		// Read and check the file header from any byte source (an SD card
+		// File, a serial port, ...). Returns 0 or a TICLErrors value.
+		int begin(Stream* source);
+		enum TIFileFormat format();
+		enum Endpoint model();				// Model family for TIVar conversions
+		const char* comment();
+
+		// Advance to the next variable entry, skipping whatever is left of
+		// the current one. Returns 0 with the entry's link-format header,
+		// 1 at the end of the file, or a TICLErrors value.
+		int nextEntry(uint8_t* header, int* headerlength, int* datalength);
+
+		// Read the current entry's data, in pieces of any size
+		int read(uint8_t* buffer, int length);
+		int readByte();
+		int remaining();
+
+		// Consume the rest of the file and verify its checksum
+		int finish();
+
+	private:
+		int readRaw(uint8_t* buffer, int length);
+		int skip(int length);
+
+		Stream* source_;
+		enum TIFileFormat format_;
+		char comment_[TIFILE_COMMENT_LEN + 1];
+		uint16_t sectionleft_;				// Data section bytes not yet read
+		uint16_t entryleft_;				// Current entry's data bytes not yet read
+		uint16_t checksum_;
+};
+
+class TIFileWriter {
+	public:
+		TIFileWriter();
+
+		// The file header holds the length of the whole data section, so
+		// it must be known up front: sum entrySize() over the entries.
+		static uint16_t entrySize(enum TIFileFormat format, int datalength);
+		int begin(Print* sink, enum TIFileFormat format, uint16_t sectionlength,
+		          const char* comment = NULL);
+
+		// Start an entry from a link-format variable header, then write
+		// exactly the data length given in its size word.
+		int addEntry(const uint8_t* header, int headerlength);
+		int write(const uint8_t* buffer, int length);
+		int writeByte(uint8_t byte);
+
+		// Write the checksum; fails if any declared bytes are missing
+		int end();
+
+	private:
+		int writeRaw(const uint8_t* buffer, int length);
+
+		Print* sink_;
+		enum TIFileFormat format_;
+		uint16_t sectionleft_;
+		uint16_t entryleft_;
+		uint16_t checksum_;
+};
+
+#endif	// TIFILE_H
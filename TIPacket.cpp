@@ -0,0 +1,181 @@
+/*************************************************
+ *  TIPacket.cpp - Framing of TI link packets,   *
+ *           independent of how the bytes are    *
+ *           moved.                              *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "TICL.h"
+#include "TIPacket.h"
+
+PacketParser::PacketParser() {
+	reset();
+}
+
+void PacketParser::reset() {
+	memset(header_, 0, sizeof(header_));
+	pos_ = 0;
+	in_data_ = in_checksum_ = false;
+	length_ = received_ = 0;
+	checksum_ = 0;
+}
+
+// A packet without data is done with its header, so its last header
+// byte reports PACKET_COMPLETE rather than PACKET_HEADER.
+enum PacketEvent PacketParser::push(uint8_t byte) {
+	if (in_data_) {
+		checksum_ += byte;
+		if (++received_ == length_) {
+			in_data_ = false;
+			in_checksum_ = true;
+		}
+		return PACKET_PAYLOAD;
+	}
+
+	if (in_checksum_) {
+		checksum_bytes_[pos_++] = byte;
+		if (pos_ < 2) {
+			return PACKET_NONE;
+		}
+		pos_ = 0;
+		in_checksum_ = false;
+		uint16_t expected = (uint16_t)checksum_bytes_[0] | ((uint16_t)checksum_bytes_[1] << 8);
+		return (checksum_ == expected) ? PACKET_COMPLETE : PACKET_ERROR;
+	}
+
+	header_[pos_++] = byte;
+	if (pos_ < PACKET_HEADER_LEN) {
+		return PACKET_NONE;
+	}
+	pos_ = 0;
+	received_ = 0;
+	checksum_ = 0;
+	length_ = (uint16_t)header_[2] | ((uint16_t)header_[3] << 8);
+	if (length_ == 0 || !commandHasData(header_[1])) {
+		length_ = 0;
+		return PACKET_COMPLETE;
+	}
+	in_data_ = true;
+	return PACKET_HEADER;
+}
+
+void PacketParser::feed(const uint8_t* bytes, int length, packet_handler handler) {
+	int idx = 0;
+	while (idx < length) {
+		// Data goes out in runs, straight from the caller's buffer
+		if (in_data_) {
+			int run = min(length - idx, (int)(length_ - received_));
+			for(int i = 0; i < run; i++) {
+				checksum_ += bytes[idx + i];
+			}
+			received_ += run;
+			if (received_ == length_) {
+				in_data_ = false;
+				in_checksum_ = true;
+			}
+			handler(PACKET_PAYLOAD, &bytes[idx], run);
+			idx += run;
+			continue;
+		}
+
+		enum PacketEvent event = push(bytes[idx++]);
+		if (event != PACKET_NONE) {
+			handler(event, header_, PACKET_HEADER_LEN);
+		}
+	}
+}
+
+bool PacketParser::idle() {
+	return pos_ == 0 && !in_data_ && !in_checksum_;
+}
+
+// The header of the packet being received, or of the last one
+const uint8_t* PacketParser::header() {
+	return header_;
+}
+
+int PacketParser::dataLength() {
+	return length_;
+}
+
+int PacketParser::dataIndex() {
+	return received_ - 1;
+}
+
+// Some commands never carry data, whatever their length field
+// says: the length bytes hold other information instead.
+bool PacketParser::commandHasData(uint8_t command) {
+	return !(command == CTS ||
+	         command == VER ||
+	         command == ACK ||
+	         command == ERR ||
+	         command == RDY ||
+	         command == SCR ||
+	         command == KEY ||
+	         command == EOT);
+}
+
+PacketSerializer::PacketSerializer() {
+	begin(NULL, NULL, 0);
+}
+
+void PacketSerializer::begin(const uint8_t* header, const uint8_t* data, int datalength,
+                             uint8_t(*data_callback)(int))
+{
+	header_ = header;
+	data_ = data;
+	data_callback_ = data_callback;
+	pos_ = 0;
+	checksum_ = 0;
+	if (header == NULL) {
+		datalength_ = total_ = 0;
+		return;
+	}
+	datalength_ = (datalength > 0 && PacketParser::commandHasData(header[1])) ? datalength : 0;
+	total_ = PACKET_HEADER_LEN + (datalength_ ? datalength_ + 2 : 0);
+}
+
+int PacketSerializer::next() {
+	if (pos_ >= total_) {
+		return -1;
+	}
+
+	int idx = pos_++;
+	if (idx < PACKET_HEADER_LEN) {
+		return header_[idx];
+	}
+	idx -= PACKET_HEADER_LEN;
+	if (idx < datalength_) {
+		uint8_t byte = data_callback_ ? data_callback_(idx) : data_[idx];
+		checksum_ += byte;
+		return byte;
+	}
+	return (idx == datalength_) ? (checksum_ & 0x00ff) : (checksum_ >> 8);
+}
+
+int PacketSerializer::read(uint8_t* out, int maxlength) {
+	int count = 0;
+	while (count < maxlength && pos_ < total_) {
+		// Buffered data can be copied in one run
+		int idx = pos_ - PACKET_HEADER_LEN;
+		if (data_callback_ == NULL && idx >= 0 && idx < datalength_) {
+			int run = min(maxlength - count, datalength_ - idx);
+			memcpy(&out[count], &data_[idx], run);
+			for(int i = 0; i < run; i++) {
+				checksum_ += out[count + i];
+			}
+			pos_ += run;
+			count += run;
+			continue;
+		}
+		out[count++] = next();
+	}
+	return count;
+}
+
+int PacketSerializer::remaining() {
+	return total_ - pos_;
+}
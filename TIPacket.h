@@ -0,0 +1,88 @@
+/*************************************************
+ *  TIPacket.h - Framing of TI link packets,     *
+ *           independent of how the bytes are    *
+ *           moved.                              *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef TIPACKET_H
+#define TIPACKET_H
+
+#include "Arduino.h"
+
+// A packet is a 4-byte header (machine ID, command, little-endian
+// length), then for commands that carry data, the data and a
+// little-endian 16-bit sum of the data bytes.
+#define PACKET_HEADER_LEN	4
+
+enum PacketEvent {
+	PACKET_NONE = 0,				// Byte taken, nothing to report yet
+	PACKET_HEADER = 1,				// header() and dataLength() are valid
+	PACKET_PAYLOAD = 2,				// Data bytes of the current packet
+	PACKET_COMPLETE = 3,			// Checksum matched
+	PACKET_ERROR = 4,				// Checksum did not match
+};
+
+typedef void(*packet_handler)(enum PacketEvent, const uint8_t*, int);
+
+// Push-style parser: hand it bytes as they arrive, one at a time or
+// in chunks of any size, and it reports where each packet's parts are.
+// A packet without data reports only PACKET_COMPLETE, on its last
+// header byte; header() is valid from then on, as after PACKET_HEADER.
+class PacketParser {
+	public:
+		PacketParser();
+		void reset();
+
+		// Take one byte, returning what it completed. For PACKET_PAYLOAD,
+		// the byte itself is data byte dataIndex() of the packet.
+		enum PacketEvent push(uint8_t byte);
+
+		// Take a chunk, calling handler for each event push() would
+		// return. Payload is reported in runs that point into bytes, not
+		// copied.
+		void feed(const uint8_t* bytes, int length, packet_handler handler);
+
+		bool idle();						// Between packets
+		const uint8_t* header();
+		int dataLength();					// Data bytes the current packet carries
+		int dataIndex();					// Index of the last data byte taken
+		static bool commandHasData(uint8_t command);
+
+	private:
+		uint8_t header_[PACKET_HEADER_LEN];
+		uint8_t checksum_bytes_[2];
+		uint8_t pos_;						// Header or checksum bytes taken
+		bool in_data_;
+		bool in_checksum_;
+		uint16_t length_;
+		uint16_t received_;
+		uint16_t checksum_;
+};
+
+// Pull-style serializer: produces the bytes of one packet on demand
+class PacketSerializer {
+	public:
+		PacketSerializer();
+
+		// The data comes from data, or from data_callback if given, as
+		// with TICL::send(). Commands without data never send any.
+		void begin(const uint8_t* header, const uint8_t* data, int datalength,
+		           uint8_t(*data_callback)(int) = NULL);
+		int next();							// Next byte, or -1 at the end
+		int read(uint8_t* out, int maxlength);	// Returns bytes written
+		int remaining();
+
+	private:
+		const uint8_t* header_;
+		const uint8_t* data_;
+		uint8_t(*data_callback_)(int);
+		int datalength_;
+		int pos_;
+		int total_;
+		uint16_t checksum_;
+};
+
+#endif	// TIPACKET_H
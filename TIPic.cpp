@@ -0,0 +1,283 @@
+/*************************************************
+ *  TIPic.cpp - Library for encoding and         *
+ *           decoding TI-OS picture variables,   *
+ *           a row at a time.                    *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "TIPic.h"
+
+// RGB values of the TI-84+CSE picture palette, indexed by PicColor
+static const uint8_t picPalette[16][3] = {
+	{255, 255, 255},		// Transparent, shown as white
+	{  0,   0, 255},		// Blue
+	{255,   0,   0},		// Red
+	{  0,   0,   0},		// Black
+	{255,   0, 255},		// Magenta
+	{  0, 159,   0},		// Green
+	{255, 143,  32},		// Orange
+	{182,  32,   0},		// Brown
+	{  0,   0, 134},		// Navy
+	{  0, 147, 255},		// Light blue
+	{255, 255,   0},		// Yellow
+	{255, 255, 255},		// White
+	{231, 227, 231},		// Light gray
+	{189, 190, 189},		// Medium gray
+	{148, 150, 148},		// Gray
+	{ 82,  85,  82},		// Dark gray
+};
+
+// The grays of the palette, darkest first, for grayscale color pictures
+static const uint8_t picGrays[6] = {
+	PIC_BLACK, PIC_DARKGRAY, PIC_GRAY, PIC_MEDGRAY, PIC_LTGRAY, PIC_WHITE
+};
+
+// 4x4 Bayer threshold matrix for ordered dithering
+static const uint8_t bayer4[4][4] = {
+	{ 0,  8,  2, 10},
+	{12,  4, 14,  6},
+	{ 3, 11,  1,  9},
+	{15,  7, 13,  5},
+};
+
+PicEncoder::PicEncoder() {
+	format_ = PIC_MONO;
+	dither_ = DITHER_NONE;
+	rgb_ = false;
+	errors_ = NULL;
+	x_ = y_ = 0;
+	gray_callback_ = NULL;
+	rgb_callback_ = NULL;
+}
+
+int PicEncoder::begin(enum PicFormat format, enum DitherMode dither, bool rgb, int16_t* errors) {
+	if (dither == DITHER_DIFFUSION && errors == NULL) {
+		return -1;
+	}
+	format_ = format;
+	dither_ = dither;
+	rgb_ = rgb;
+	errors_ = errors;
+	x_ = y_ = 0;
+	if (dither_ == DITHER_DIFFUSION) {
+		memset(errors_, 0, errorBufferSize(format_, rgb_) * sizeof(int16_t));
+	}
+	return 0;
+}
+
+// Error diffusion keeps one error per channel for this row and the next,
+// with a guard pixel at each end. Monochrome pictures diffuse gray only.
+int PicEncoder::errorBufferSize(enum PicFormat format, bool rgb) {
+	int channels = (format == PIC_COLOR && rgb) ? 3 : 1;
+	int width = (format == PIC_COLOR) ? PIC_COLOR_WIDTH : PIC_MONO_WIDTH;
+	return 2 * (width + 2) * channels;
+}
+
+int PicEncoder::width() {
+	return (format_ == PIC_COLOR) ? PIC_COLOR_WIDTH : PIC_MONO_WIDTH;
+}
+
+int PicEncoder::height() {
+	return (format_ == PIC_COLOR) ? PIC_COLOR_HEIGHT : PIC_MONO_HEIGHT;
+}
+
+int PicEncoder::rowBytes() {
+	return (format_ == PIC_COLOR) ? PIC_COLOR_ROW_BYTES : PIC_MONO_ROW_BYTES;
+}
+
+int PicEncoder::dataLength() {
+	return 2 + TIPic::sizeOfPic(format_);
+}
+
+void PicEncoder::setSource(uint8_t (*gray_callback)(int, int)) {
+	gray_callback_ = gray_callback;
+	rgb_callback_ = NULL;
+}
+
+void PicEncoder::setSourceRGB(void (*rgb_callback)(int, int, uint8_t*)) {
+	rgb_callback_ = rgb_callback;
+	gray_callback_ = NULL;
+}
+
+int PicEncoder::encodeRow(const uint8_t* pixels, uint8_t* out) {
+	if (y_ >= height()) {
+		return -1;
+	}
+	int stride = rgb_ ? 3 : 1;
+	int pixelsPerByte = (format_ == PIC_COLOR) ? 2 : 8;
+	for(x_ = 0; x_ < width(); x_++) {
+		uint8_t q = quantize(&pixels[x_ * stride]);
+		int byteIdx = x_ / pixelsPerByte;
+		if (format_ == PIC_COLOR) {
+			out[byteIdx] = (x_ & 1) ? (out[byteIdx] | q) : (q << 4);
+		} else {
+			out[byteIdx] = (out[byteIdx] << 1) | q;
+		}
+	}
+	x_ = 0;
+	y_++;
+	return rowBytes();
+}
+
+// Bytes 0 and 1 are the picture size word, the rest are the picture,
+// generated in order. The pixel source is not re-read, so the bytes
+// must be requested sequentially; asking for byte 0 again (as a
+// resend does) starts the picture over.
+uint8_t PicEncoder::dataByte(int idx) {
+	if (idx < 2) {
+		if (idx == 0) {
+			begin(format_, dither_, rgb_, errors_);
+		}
+		uint16_t size = TIPic::sizeOfPic(format_);
+		return (idx == 0) ? (size & 0x00ff) : (size >> 8);
+	}
+	if (y_ >= height()) {
+		return 0;
+	}
+
+	uint8_t outbyte = 0;
+	int pixelsPerByte = (format_ == PIC_COLOR) ? 2 : 8;
+	for(int i = 0; i < pixelsPerByte; i++) {
+		uint8_t pixel[3];
+		if (rgb_callback_) {
+			rgb_callback_(x_, y_, pixel);
+		} else if (gray_callback_) {
+			pixel[0] = pixel[1] = pixel[2] = gray_callback_(x_, y_);
+		} else {
+			pixel[0] = pixel[1] = pixel[2] = 255;
+		}
+		outbyte = (outbyte << ((format_ == PIC_COLOR) ? 4 : 1)) | quantize(pixel);
+		if (++x_ >= width()) {
+			x_ = 0;
+			y_++;
+		}
+	}
+	return outbyte;
+}
+
+// Turn one pixel at (x_, y_) into a picture bit or palette entry,
+// applying and spreading the dither error.
+uint8_t PicEncoder::quantize(const uint8_t* pixel) {
+	int channels = (format_ == PIC_COLOR && rgb_) ? 3 : 1;
+	int16_t v[3];
+	uint8_t q;
+
+	if (channels == 1 && rgb_) {
+		v[0] = ((uint16_t)pixel[0] * 77 + (uint16_t)pixel[1] * 150 + (uint16_t)pixel[2] * 29) >> 8;
+	} else {
+		for(int i = 0; i < channels; i++) {
+			v[i] = pixel[i];
+		}
+	}
+
+	int rowlength = (width() + 2) * channels;
+	int16_t* cur = NULL;
+	int16_t* next = NULL;
+	if (dither_ == DITHER_DIFFUSION) {
+		cur = &errors_[(y_ & 1) ? rowlength : 0];
+		next = &errors_[(y_ & 1) ? 0 : rowlength];
+		if (x_ == 0) {
+			memset(next, 0, rowlength * sizeof(int16_t));
+		}
+	}
+
+	for(int i = 0; i < channels; i++) {
+		if (dither_ == DITHER_ORDERED) {
+			// Spread thresholds over the gap between output levels
+			int spread = (format_ == PIC_COLOR) ? 64 : 256;
+			v[i] += ((int16_t)bayer4[y_ & 3][x_ & 3] * 2 - 15) * spread / 32;
+		} else if (dither_ == DITHER_DIFFUSION) {
+			v[i] += cur[(x_ + 1) * channels + i];
+		}
+		v[i] = constrain(v[i], 0, 255);
+	}
+
+	// Pick the output and the value it really shows
+	int16_t shown[3];
+	if (format_ == PIC_MONO) {
+		q = (v[0] < 128) ? 1 : 0;
+		shown[0] = q ? 0 : 255;
+	} else if (channels == 1) {
+		uint8_t best = 0;
+		for(uint8_t i = 1; i < sizeof(picGrays); i++) {
+			if (abs(v[0] - picPalette[picGrays[i]][0]) < abs(v[0] - picPalette[picGrays[best]][0])) {
+				best = i;
+			}
+		}
+		q = picGrays[best];
+		shown[0] = picPalette[q][0];
+	} else {
+		long bestDist = 0x7fffffffL;
+		q = PIC_WHITE;
+		for(uint8_t c = PIC_BLUE; c <= PIC_DARKGRAY; c++) {
+			long dist = 0;
+			for(int i = 0; i < 3; i++) {
+				long d = v[i] - picPalette[c][i];
+				dist += d * d;
+			}
+			if (dist < bestDist) {
+				bestDist = dist;
+				q = c;
+			}
+		}
+		for(int i = 0; i < 3; i++) {
+			shown[i] = picPalette[q][i];
+		}
+	}
+
+	// Floyd-Steinberg: 7/16 right, 3/16 down-left, 5/16 down, 1/16 down-right
+	if (dither_ == DITHER_DIFFUSION) {
+		for(int i = 0; i < channels; i++) {
+			int16_t err = v[i] - shown[i];
+			cur[(x_ + 2) * channels + i] += (err * 7) / 16;
+			next[x_ * channels + i] += (err * 3) / 16;
+			next[(x_ + 1) * channels + i] += (err * 5) / 16;
+			next[(x_ + 2) * channels + i] += err / 16;
+		}
+	}
+	return q;
+}
+
+bool TIPic::monoPixel(const uint8_t* pic, int x, int y) {
+	return (pic[y * PIC_MONO_ROW_BYTES + (x >> 3)] & (0x80 >> (x & 7))) != 0;
+}
+
+uint8_t TIPic::colorPixel(const uint8_t* pic, int x, int y) {
+	uint8_t b = pic[y * PIC_COLOR_ROW_BYTES + (x >> 1)];
+	return (x & 1) ? (b & 0x0f) : (b >> 4);
+}
+
+// Decode one row of picture data into gray levels (0 = black),
+// returning the number of pixels produced.
+int TIPic::decodeRow(enum PicFormat format, const uint8_t* row, uint8_t* gray) {
+	if (format == PIC_MONO) {
+		for(int x = 0; x < PIC_MONO_WIDTH; x++) {
+			gray[x] = monoPixel(row, x, 0) ? 0 : 255;
+		}
+		return PIC_MONO_WIDTH;
+	}
+	for(int x = 0; x < PIC_COLOR_WIDTH; x++) {
+		const uint8_t* rgb = picPalette[colorPixel(row, x, 0)];
+		gray[x] = ((uint16_t)rgb[0] * 77 + (uint16_t)rgb[1] * 150 + (uint16_t)rgb[2] * 29) >> 8;
+	}
+	return PIC_COLOR_WIDTH;
+}
+
+void TIPic::colorToRGB(uint8_t color, uint8_t* rgb) {
+	for(int i = 0; i < 3; i++) {
+		rgb[i] = picPalette[color & 0x0f][i];
+	}
+}
+
+uint16_t TIPic::colorToRGB565(uint8_t color) {
+	const uint8_t* rgb = picPalette[color & 0x0f];
+	return ((uint16_t)(rgb[0] & 0xf8) << 8) | ((uint16_t)(rgb[1] & 0xfc) << 3) | (rgb[2] >> 3);
+}
+
+// Picture size in bytes, not counting the size word
+int TIPic::sizeOfPic(enum PicFormat format) {
+	return (format == PIC_COLOR) ? PIC_COLOR_SIZE : PIC_MONO_SIZE;
+}
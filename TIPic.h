@@ -0,0 +1,109 @@
+/*************************************************
+ *  TIPic.h - Library for encoding and decoding  *
+ *           TI-OS picture variables, a row at   *
+ *           a time.                             *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef TIPIC_H
+#define TIPIC_H
+
+#include "Arduino.h"
+
+// TI-83+/TI-84+ monochrome pictures: 1 bit per pixel, MSB leftmost, 1 = dark
+#define PIC_MONO_WIDTH		96
+#define PIC_MONO_HEIGHT		63
+#define PIC_MONO_ROW_BYTES	12
+#define PIC_MONO_SIZE		756
+
+// TI-84+CSE color pictures: 4 bits per pixel, high nibble leftmost
+#define PIC_COLOR_WIDTH		266
+#define PIC_COLOR_HEIGHT	165
+#define PIC_COLOR_ROW_BYTES	133
+#define PIC_COLOR_SIZE		21945
+
+// TI-84+CSE picture palette entries (TI-OS color number minus 9)
+enum PicColor {
+	PIC_TRANSPARENT = 0,
+	PIC_BLUE = 1,
+	PIC_RED = 2,
+	PIC_BLACK = 3,
+	PIC_MAGENTA = 4,
+	PIC_GREEN = 5,
+	PIC_ORANGE = 6,
+	PIC_BROWN = 7,
+	PIC_NAVY = 8,
+	PIC_LTBLUE = 9,
+	PIC_YELLOW = 10,
+	PIC_WHITE = 11,
+	PIC_LTGRAY = 12,
+	PIC_MEDGRAY = 13,
+	PIC_GRAY = 14,
+	PIC_DARKGRAY = 15,
+};
+
+enum PicFormat {
+	PIC_MONO = 0,
+	PIC_COLOR = 1,
+};
+
+enum DitherMode {
+	DITHER_NONE = 0,				// Nearest color
+	DITHER_ORDERED = 1,				// 4x4 Bayer matrix, no working memory
+	DITHER_DIFFUSION = 2,			// Floyd-Steinberg, needs a two-row error buffer
+};
+
+class PicEncoder {
+	public:
+		PicEncoder();
+
+		// Start a new picture. Error diffusion needs errorBufferSize()
+		// int16_t's of working memory; the other modes need none.
+		int begin(enum PicFormat format, enum DitherMode dither,
+		          bool rgb = false, int16_t* errors = NULL);
+		static int errorBufferSize(enum PicFormat format, bool rgb);
+
+		// Push interface: encode one row of width() gray (or RGB
+		// triplet) pixels into rowBytes() bytes of picture data.
+		int encodeRow(const uint8_t* pixels, uint8_t* out);
+
+		// Pull interface: produce the variable data (size word, then
+		// picture) one byte at a time from a pixel source that is called
+		// exactly once per pixel in raster order, e.g. from the
+		// data_callback passed to TICL::send.
+		void setSource(uint8_t (*gray_callback)(int, int));
+		void setSourceRGB(void (*rgb_callback)(int, int, uint8_t*));
+		uint8_t dataByte(int idx);
+
+		int width();
+		int height();
+		int rowBytes();
+		int dataLength();					// Variable data length, including the size word
+
+	private:
+		uint8_t quantize(const uint8_t* pixel);
+
+		enum PicFormat format_;
+		enum DitherMode dither_;
+		bool rgb_;
+		int16_t* errors_;					// This row's errors, then the next row's
+		int x_;
+		int y_;
+		uint8_t (*gray_callback_)(int, int);
+		void (*rgb_callback_)(int, int, uint8_t*);
+};
+
+class TIPic {
+	public:
+		// Decoding received pictures; data points past the size word
+		static bool monoPixel(const uint8_t* pic, int x, int y);
+		static uint8_t colorPixel(const uint8_t* pic, int x, int y);
+		static int decodeRow(enum PicFormat format, const uint8_t* row, uint8_t* gray);
+		static void colorToRGB(uint8_t color, uint8_t* rgb);
+		static uint16_t colorToRGB565(uint8_t color);
+		static int sizeOfPic(enum PicFormat format);
+};
+
+#endif	// TIPIC_H
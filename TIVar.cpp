@@ -8,6 +8,7 @@
 
 #include "TIVar.h"
 
+#if TICL_REALS
 // Convert a TI real variable into a long long int
 long long int TIVar::realToLong8x(uint8_t* real, enum Endpoint model) {
 	long long int rval = 0;
@@ -191,6 +192,25 @@ int TIVar::floatToReal8x(double f, uint8_t* real, enum Endpoint model) {
 
 	return TIVar::sizeOfReal(model);		// Success: inserted data length
 }
+#endif	// TICL_REALS
+
+#if TICL_STRINGS
+// TI-83 family token for each printable ASCII character, 0x20 to 0x7e.
+// The TI-82 has the one-byte tokens, and no lowercase letters.
+static const uint16_t asciiTokens83[] PROGMEM = {
+	0x0029, 0x002d, 0x002a, 0xbbd2, 0xbbd3, 0xbbda, 0xbbd4, 0x00ae,		//  !"#$%&'
+	0x0010, 0x0011, 0x0082, 0x0070, 0x002b, 0x0071, 0x003a, 0x0083,		// ()*+,-./
+	0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,		// 01234567
+	0x0038, 0x0039, 0x003e, 0xbbd6, 0x006b, 0x006a, 0x006c, 0x00af,		// 89:;<=>?
+	0xbbd1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,		// @ABCDEFG
+	0x0048, 0x0049, 0x004a, 0x004b, 0x004c, 0x004d, 0x004e, 0x004f,		// HIJKLMNO
+	0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,		// PQRSTUVW
+	0x0058, 0x0059, 0x005a, 0x0006, 0xbbd7, 0x0007, 0x00f0, 0xbbd9,		// XYZ[\]^_
+	0xbbd5, 0xbbb0, 0xbbb1, 0xbbb2, 0xbbb3, 0xbbb4, 0xbbb5, 0xbbb6,		// `abcdefg
+	0xbbb7, 0xbbb8, 0xbbb9, 0xbbba, 0xbbbc, 0xbbbd, 0xbbbe, 0xbbbf,		// hijklmno
+	0xbbc0, 0xbbc1, 0xbbc2, 0xbbc3, 0xbbc4, 0xbbc5, 0xbbc6, 0xbbc7,		// pqrstuvw
+	0xbbc8, 0xbbc9, 0xbbca, 0x0008, 0xbbd8, 0x0009, 0xbbcf,				// xyz{|}~
+};
 
 // Convert a printable 7-bit ASCII String into a TI string variable
 int TIVar::stringToStrVar8x(String s, uint8_t* strVar, enum Endpoint model) {
@@ -213,89 +233,14 @@ int TIVar::stringToStrVar8x(String s, uint8_t* strVar, enum Endpoint model) {
 			continue;
 		}
 
-		if (type == STR_83) {
-			if ((c >= '0' && c <= '9') ||
-					   (c >= 'A' && c <= 'Z')) {
-				// Map basic characters (0-9, A-Z) directly
-				t = c;
-			} else if (c >= 'a' && c <= 'k') {
-				// Map lowercase letters (group 1)
-				t = (uint16_t)(c - 'a') + 0xbbb0;
-			} else if (c >= 'l' && c <= 'z') {
-				// Map lowercase letters (group 2)
-				t = (uint16_t)(c - 'l') + 0xbbbc;
-			} else {
-				// Map punctuation
-				switch (c) {
-					case ' ':	t = 0x29; break;
-					case '!':	t = 0x2d; break;
-					case '\"':	t = 0x2a; break;
-					case '#':	t = 0xbbd2; break;
-					case '$':	t = 0xbbd3; break;
-					case '%':	t = 0xbbda; break;
-					case '&':	t = 0xbbd4; break;
-					case '\'':	t = 0xae; break;
-					case '(':	t = 0x10; break;
-					case ')':	t = 0x11; break;
-					case '*':	t = 0x82; break;
-					case '+':	t = 0x70; break;
-					case ',':	t = 0x2b; break;
-					case '-':	t = 0x71; break;
-					case '.':	t = 0x3a; break;
-					case '/':	t = 0x83; break;
-					case ':':	t = 0x3e; break;
-					case ';':	t = 0xbbd6; break;
-					case '<':	t = 0x6b; break;
-					case '=':	t = 0x6a; break;
-					case '>':	t = 0x6c; break;
-					case '?':	t = 0xaf; break;
-					case '@':	t = 0xbbd1; break;
-					case '[':	t = 0x06; break;
-					case '\\':	t = 0xbbd7; break;
-					case ']':	t = 0x07; break;
-					case '^':	t = 0xf0; break;
-					case '_':	t = 0xbbd9; break;
-					case '`':	t = 0xbbd5; break;
-					case '{':	t = 0x08; break;
-					case '|':	t = 0xbbd8; break;
-					case '}':	t = 0x09; break;
-					case '~':	t = 0xbbcf; break;
-				}
-			}
-		} else if (type == STR_82) {
-			if ((c >= '0' && c <= '9') ||
-					   (c >= 'A' && c <= 'Z')) {
-				// Map basic characters (0-9, A-Z) directly
-				t = c;
-			} else if (c >= 'a' && c <= 'z') {
+		if (type == STR_83 || type == STR_82) {
+			if (type == STR_82 && c >= 'a' && c <= 'z') {
 				// Turn lowercase letters into uppercase letters
-				t = (c - ('a' - 'A'));
-			} else {
-				// Map punctuation
-				switch (c) {
-					case ' ':	t = 0x29; break;
-					case '!':	t = 0x2d; break;
-					case '\"':	t = 0x2a; break;
-					case '\'':	t = 0xae; break;
-					case '(':	t = 0x10; break;
-					case ')':	t = 0x11; break;
-					case '*':	t = 0x82; break;
-					case '+':	t = 0x70; break;
-					case ',':	t = 0x2b; break;
-					case '-':	t = 0x71; break;
-					case '.':	t = 0x3a; break;
-					case '/':	t = 0x83; break;
-					case ':':	t = 0x3e; break;
-					case '<':	t = 0x6b; break;
-					case '=':	t = 0x6a; break;
-					case '>':	t = 0x6c; break;
-					case '?':	t = 0xaf; break;
-					case '[':	t = 0x06; break;
-					case ']':	t = 0x07; break;
-					case '^':	t = 0xf0; break;
-					case '{':	t = 0x08; break;
-					case '}':	t = 0x09; break;
-				}
+				c -= ('a' - 'A');
+			}
+			t = pgm_read_word(&asciiTokens83[c - 0x20]);
+			if (type == STR_82 && (t & 0xff00)) {
+				continue;				// No such character on the TI-82
 			}
 		} else { // Non-83-type mapping
 			// Map all printable characters directly
@@ -356,53 +301,12 @@ String TIVar::strVarToString8x(uint8_t* strVar, enum Endpoint model) {
 				t  = strVar[pos++];
 			}
 
-			if ((t >= 0x30 && t <= 0x39) ||
-				(t >= 0x41 && t <= 0x5a)) {
-				// Map basic tokens (0-9, A-Z) directly
-				c = t;
-			} else if (t >= 0xbbb0 && t <= 0xbbba) {
-				// Map lowercase letters (group 1)
-				c = t + 'a' - 0xbbb0;
-			} else if (t >= 0xbbbc && t <= 0xbbca) {
-				// Map lowercase letters (group 2)
-				c = t + 'l' - 0xbbbc;
-			} else {
-				// Map punctuation
-				switch (t) {
-					case 0x29:		c = ' '; break;
-					case 0x2d:		c = '!'; break;
-					case 0x2a:		c = '\"'; break;
-					case 0xbbd2:	c = '#'; break;
-					case 0xbbd3:	c = '$'; break;
-					case 0xbbda:	c = '%'; break;
-					case 0xbbd4:	c = '&'; break;
-					case 0xae:		c = '\''; break;
-					case 0x10:		c = '('; break;
-					case 0x11:		c = ')'; break;
-					case 0x82:		c = '*'; break;
-					case 0x70:		c = '+'; break;
-					case 0x2b:		c = ','; break;
-					case 0x71:		c = '-'; break;
-					case 0x3a:		c = '.'; break;
-					case 0x83:		c = '/'; break;
-					case 0x3e:		c = ':'; break;
-					case 0xbbd6:	c = ';'; break;
-					case 0x6b:		c = '<'; break;
-					case 0x6a:		c = '='; break;
-					case 0x6c:		c = '>'; break;
-					case 0xaf:		c = '?'; break;
-					case 0xbbd1:	c = '@'; break;
-					case 0x06:		c = '['; break;
-					case 0xbbd7:	c = '\\'; break;
-					case 0x07:		c = ']'; break;
-					case 0xf0:		c = '^'; break;
-					case 0xbbd9:	c = '_'; break;
-					case 0xbbd5:	c = '`'; break;
-					case 0x08:		c = '{'; break;
-					case 0xbbd8:	c = '|'; break;
-					case 0x09:		c = '}'; break;
-					case 0xbbcf:	c = '~'; break;
-					default:		c = '?'; break; // Non-ASCII tokens
+			// Find the token in the table; anything else isn't ASCII
+			c = '?';
+			for (uint8_t j = 0; j < sizeof(asciiTokens83) / sizeof(asciiTokens83[0]); j++) {
+				if (pgm_read_word(&asciiTokens83[j]) == t) {
+					c = j + 0x20;
+					break;
 				}
 			}
 		}
@@ -426,6 +330,7 @@ bool TIVar::isA2ByteTok(uint8_t a) {
 		a == 0xbb ||
 		a == 0xef);
 }
+#endif	// TICL_STRINGS
 
 // Return the type of real variable used on each model
 enum RealType TIVar::modelToType(enum Endpoint model) {
@@ -448,6 +353,7 @@ enum RealType TIVar::modelToType(enum Endpoint model) {
 			return REAL_85;
 			break;
 		case COMP86:
+		case CALC86:
 			return REAL_86;
 			break;
 		case COMP89:
@@ -477,6 +383,7 @@ enum StringType TIVar::modelToTypeStr(enum Endpoint model) {
 			return STR_85;
 			break;
 		case COMP86:
+		case CALC86:
 			return STR_86;
 			break;
 		case COMP89:
@@ -501,6 +408,7 @@ enum StringType TIVar::modelToTypeStr(enum Endpoint model) {
 	}
 }
 
+#if TICL_REALS
 // Extract the exponent from a real
 int32_t TIVar::extractExponent(uint8_t* real, enum RealType type) {
 	if (type == REAL_82) {
@@ -508,10 +416,11 @@ int32_t TIVar::extractExponent(uint8_t* real, enum RealType type) {
 	} else if (type == REAL_85) {
 		int32_t raw_exp = (int32_t)TIVar::sizeWordToInt(&real[1]);
 		raw_exp -= 0x00fc00;
-		return (int16_t)raw_exp;
+		return (int16_t)raw_exp - 13;				// As above
 	}
     return 0;
 }
+#endif	// TICL_REALS
 
 uint16_t TIVar::sizeWordToInt(uint8_t* ptr) {
 	return ((uint16_t)ptr[0]) | (((uint16_t)ptr[1]) << 8);
@@ -540,4 +449,10 @@ int TIVar::sizeOfReal(enum Endpoint model) {
 			break;
 	}
 	return -1;
-}
\ No newline at end of file
+}
+
+// True if two models encode reals and strings identically
+bool TIVar::sameFormat(enum Endpoint a, enum Endpoint b) {
+	return (modelToType(a) == modelToType(b) &&
+	        modelToTypeStr(a) == modelToTypeStr(b));
+}
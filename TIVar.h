@@ -41,6 +41,7 @@ class TIVar {
 	static uint16_t sizeWordToInt(uint8_t* ptr);
 	static void intToSizeWord(uint16_t size, uint8_t* ptr);
 	static int sizeOfReal(enum Endpoint model);
+	static bool sameFormat(enum Endpoint a, enum Endpoint b);
 
   private:
 	static bool isA2ByteTok(uint8_t a);
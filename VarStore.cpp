@@ -0,0 +1,457 @@
+/*************************************************
+ *  VarStore.cpp - Registry of named variables   *
+ *           held in pre-encoded wire format,    *
+ *           served to calculators by CBL2.      *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "VarStore.h"
+#include "TIVar.h"
+
+#define VARSTORE_REAL_SIZE	10		// Largest real on any supported model
+
+// The buffer holds the encoding of every registered variable, so
+// it must be large enough for all of them at their largest size.
+VarStore::VarStore(uint8_t* buffer, int bufferlength, enum Endpoint model) {
+	buffer_ = buffer;
+	bufferlength_ = bufferlength;
+	used_ = 0;
+	entrycount_ = 0;
+	model_ = model;
+	storagesize_ = 0;
+	reader_ = NULL;
+	writer_ = NULL;
+	bank_ = -1;
+	sequence_ = 0;
+}
+
+int VarStore::addReal(uint8_t type, const uint8_t* name, int namelength, const double* value) {
+	return add(type, name, namelength, SOURCE_REAL_FLOAT, value, 1, VARSTORE_REAL_SIZE);
+}
+
+int VarStore::addReal(uint8_t type, const uint8_t* name, int namelength, const long* value) {
+	return add(type, name, namelength, SOURCE_REAL_LONG, value, 1, VARSTORE_REAL_SIZE);
+}
+
+int VarStore::addList(uint8_t type, const uint8_t* name, int namelength, const double* values, int count) {
+	return add(type, name, namelength, SOURCE_LIST_FLOAT, values, count,
+	           2 + count * VARSTORE_REAL_SIZE);
+}
+
+int VarStore::addList(uint8_t type, const uint8_t* name, int namelength, const long* values, int count) {
+	return add(type, name, namelength, SOURCE_LIST_LONG, values, count,
+	           2 + count * VARSTORE_REAL_SIZE);
+}
+
+// Strings can need two bytes per character (two-byte tokens),
+// plus the length word and the TI-89/TI-92 framing.
+int VarStore::addString(uint8_t type, const uint8_t* name, int namelength, const char* value, int maxlength) {
+	return add(type, name, namelength, SOURCE_STRING, value, maxlength,
+	           2 * maxlength + 5);
+}
+
+// Raw variables are already in wire format, so they are
+// served straight from the caller's buffer, and can't grow
+// past the length they were added with.
+int VarStore::addRaw(uint8_t type, const uint8_t* name, int namelength, const uint8_t* data, int length) {
+	int handle = add(type, name, namelength, SOURCE_RAW, data, length, 0);
+	if (handle >= 0) {
+		entries_[handle].capacity = length;
+		entries_[handle].length = length;
+		entries_[handle].dirty = false;
+	}
+	return handle;
+}
+
+int VarStore::add(uint8_t type, const uint8_t* name, int namelength,
+                  enum VarSource source, const void* value, int count, int capacity)
+{
+	if (entrycount_ >= VARSTORE_MAX_VARS || namelength > VARSTORE_NAME_LEN ||
+	    used_ + capacity > bufferlength_)
+	{
+		return -1;
+	}
+
+	struct VarStoreEntry* entry = &entries_[entrycount_];
+	entry->type = type;
+	memcpy(entry->name, name, namelength);
+	entry->namelength = namelength;
+	entry->source = source;
+	entry->value = value;
+	entry->count = count;
+	entry->offset = used_;
+	entry->capacity = capacity;
+	entry->length = 0;
+	entry->model = model_;
+	entry->dirty = true;
+	entry->unsaved = false;
+	used_ += capacity;
+	return entrycount_++;
+}
+
+int VarStore::markDirty(int handle) {
+	if (handle < 0 || handle >= entrycount_) {
+		return -1;
+	}
+	if (entries_[handle].source != SOURCE_RAW) {
+		entries_[handle].dirty = true;
+	} else {
+		entries_[handle].unsaved = true;
+	}
+	return 0;
+}
+
+// Lists can shrink or grow up to the element count they were added with;
+// raw variables take a new length in bytes.
+int VarStore::setCount(int handle, int count) {
+	if (handle < 0 || handle >= entrycount_) {
+		return -1;
+	}
+	struct VarStoreEntry* entry = &entries_[handle];
+	if (entry->source == SOURCE_LIST_FLOAT || entry->source == SOURCE_LIST_LONG) {
+		if (2 + count * VARSTORE_REAL_SIZE > entry->capacity) {
+			return -1;
+		}
+	} else if (entry->source == SOURCE_RAW) {
+		if (count > entry->capacity) {
+			return -1;
+		}
+		entry->length = count;
+	} else {
+		return -1;							// Reals and strings have a fixed size
+	}
+	entry->count = count;
+	return markDirty(handle);
+}
+
+void VarStore::markAllDirty() {
+	for(int i = 0; i < entrycount_; i++) {
+		markDirty(i);
+	}
+}
+
+// Select the model family that refresh() encodes for. Encodings
+// for another family are redone when that family asks for them.
+void VarStore::setModel(enum Endpoint model) {
+	if (!TIVar::sameFormat(model, model_)) {
+		markAllDirty();
+	}
+	model_ = model;
+}
+
+int VarStore::refresh() {
+	for(int i = 0; i < entrycount_; i++) {
+		if (entries_[i].dirty) {
+			if (encode(&entries_[i], model_) < 0) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+// Find the variable matching a calculator's VAR header type and name.
+// Entries added without a name match any variable of their type. The
+// requested name is zero-padded, so it matches only if it has nothing
+// after the entry's name: a stored "A" doesn't answer for "AB".
+int VarStore::find(uint8_t type, const uint8_t* name, int namelength) {
+	for(int i = 0; i < entrycount_; i++) {
+		struct VarStoreEntry* entry = &entries_[i];
+		if (entry->type != type) {
+			continue;
+		}
+		if (entry->namelength == 0) {
+			return i;
+		}
+		if (entry->namelength > namelength || memcmp(entry->name, name, entry->namelength)) {
+			continue;
+		}
+		int j = entry->namelength;
+		while (j < namelength && name[j] == 0) {
+			j++;
+		}
+		if (j == namelength) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Get the wire-format bytes of a variable for the given model. This only
+// encodes if the value changed since the last refresh() or the model
+// family differs from the one the store was prepared for; in the latter
+// case later refresh() calls prepare for the requesting family instead.
+int VarStore::encoded(int handle, enum Endpoint model, uint8_t** data, int* length) {
+	if (handle < 0 || handle >= entrycount_) {
+		return -1;
+	}
+	if (!TIVar::sameFormat(model, model_)) {
+		model_ = model;
+	}
+
+	struct VarStoreEntry* entry = &entries_[handle];
+	if (entry->source == SOURCE_RAW) {
+		*data = (uint8_t*)entry->value;
+		*length = entry->length;
+		return 0;
+	}
+	if (entry->dirty || !TIVar::sameFormat(model, entry->model)) {
+		if (encode(entry, model) < 0) {
+			return -1;
+		}
+	}
+	*data = &buffer_[entry->offset];
+	*length = entry->length;
+	return 0;
+}
+
+int VarStore::encode(struct VarStoreEntry* entry, enum Endpoint model) {
+#if TICL_REALS || TICL_STRINGS
+	uint8_t* out = &buffer_[entry->offset];
+#endif
+	int rval = 0;
+#if TICL_REALS
+	int offset;
+#endif
+
+	switch(entry->source) {
+#if TICL_REALS
+		case SOURCE_REAL_FLOAT:
+			rval = TIVar::floatToReal8x(*(const double*)entry->value, out, model);
+			break;
+
+		case SOURCE_REAL_LONG:
+			rval = TIVar::longToReal8x(*(const long*)entry->value, out, model);
+			break;
+
+		case SOURCE_LIST_FLOAT:
+		case SOURCE_LIST_LONG:
+			TIVar::intToSizeWord(entry->count, out);
+			offset = 2;						// Offset past the count word
+			for(int i = 0; i < entry->count && rval >= 0; i++) {
+				if (entry->source == SOURCE_LIST_FLOAT) {
+					rval = TIVar::floatToReal8x(((const double*)entry->value)[i], &out[offset], model);
+				} else {
+					rval = TIVar::longToReal8x(((const long*)entry->value)[i], &out[offset], model);
+				}
+				offset += rval;
+			}
+			if (rval >= 0) {
+				rval = offset;
+			}
+			break;
+#endif	// TICL_REALS
+
+#if TICL_STRINGS
+		case SOURCE_STRING: {
+			const char* s = (const char*)entry->value;
+			if ((int)strlen(s) > entry->count) {
+				return -1;					// Would overflow the reserved space
+			}
+			rval = TIVar::stringToStrVar8x(String(s), out, model);
+			break;
+		  }
+#endif	// TICL_STRINGS
+
+		default:
+			return -1;
+	}
+
+	if (rval < 0) {
+		return -1;
+	}
+	entry->length = rval;
+	entry->model = model;
+	entry->dirty = false;
+	entry->unsaved = true;
+	return 0;
+}
+
+enum Endpoint VarStore::encodedModel(int handle) {
+	if (handle < 0 || handle >= entrycount_) {
+		return model_;
+	}
+	return entries_[handle].model;
+}
+
+// Storage holds as many banks as fit, each with one complete image:
+//   'V' 'S', sequence number, layout hash, checksum of the rest
+//   model and length word of each variable
+//   each variable's encoding, at the size it was registered with
+// load() takes the valid image with the newest sequence number.
+int VarStore::setupStorage(int size, storage_reader reader, storage_writer writer) {
+	if (size < imageSize() || reader == NULL || writer == NULL) {
+		return -1;
+	}
+	storagesize_ = size;
+	reader_ = reader;
+	writer_ = writer;
+	bank_ = -1;
+	return 0;
+}
+
+// Returns 0 if every saved variable was restored, or -1 if storage
+// has no image for this exact set of variables, in which case they
+// are encoded by refresh() as usual.
+int VarStore::load() {
+	int size = imageSize();
+	uint16_t hash = layoutHash();
+
+	if (reader_ == NULL || storagesize_ < size) {
+		return -1;						// Or variables were added since setupStorage()
+	}
+	bank_ = -1;
+	for(int bank = 0; bank < storagesize_ / size; bank++) {
+		int base = bank * size;
+		if (reader_(base) != 'V' || reader_(base + 1) != 'S' ||
+		    readWord(base + 4) != hash)
+		{
+			continue;						// Blank, or saved by another sketch
+		}
+		uint16_t sequence = readWord(base + 2);
+		if (bank_ >= 0 && (int16_t)(sequence - sequence_) <= 0) {
+			continue;
+		}
+		if (imageSum(bank) != readWord(base + 6)) {
+			continue;						// Cut short by a reset
+		}
+		bank_ = bank;
+		sequence_ = sequence;
+	}
+	if (bank_ < 0) {
+		return -1;
+	}
+
+	// Copy the encodings back; there is nothing to convert
+	int index = bank_ * size + VARSTORE_IMAGE_HEADER;
+	int address = index + entrycount_ * VARSTORE_INDEX_LEN;
+	for(int i = 0; i < entrycount_; i++, index += VARSTORE_INDEX_LEN) {
+		struct VarStoreEntry* entry = &entries_[i];
+		int length = readWord(index + 1);
+		if (length > 0 && length <= entry->capacity) {
+			uint8_t* out = (entry->source == SOURCE_RAW) ? (uint8_t*)entry->value
+			                                              : &buffer_[entry->offset];
+			for(int j = 0; j < length; j++) {
+				out[j] = reader_(address + j);
+			}
+			entry->model = (enum Endpoint)reader_(index);
+			entry->length = length;
+			entry->dirty = false;
+			entry->unsaved = false;
+		}
+		address += entry->capacity;
+	}
+	return 0;
+}
+
+// Write the current encodings to the bank after the newest image,
+// if anything changed since the last load() or save(). The header
+// goes last, so a reset part way through leaves the previous image
+// to be loaded. Variables not yet encoded are saved as empty.
+int VarStore::save() {
+	int size = imageSize();
+	bool changed = (bank_ < 0);
+
+	if (writer_ == NULL || storagesize_ < size) {
+		return -1;						// Or variables were added since setupStorage()
+	}
+	for(int i = 0; i < entrycount_; i++) {
+		changed |= entries_[i].unsaved;
+	}
+	if (!changed) {
+		return 0;
+	}
+
+	int bank = (bank_ + 1) % (storagesize_ / size);
+	int base = bank * size;
+	int index = base + VARSTORE_IMAGE_HEADER;
+	int address = index + entrycount_ * VARSTORE_INDEX_LEN;
+	for(int i = 0; i < entrycount_; i++, index += VARSTORE_INDEX_LEN) {
+		struct VarStoreEntry* entry = &entries_[i];
+		int length = (entry->source == SOURCE_RAW || !entry->dirty) ? entry->length : 0;
+		const uint8_t* in = (entry->source == SOURCE_RAW) ? (const uint8_t*)entry->value
+		                                                   : &buffer_[entry->offset];
+		update(index, (uint8_t)entry->model);
+		update(index + 1, length & 0xff);
+		update(index + 2, length >> 8);
+		for(int j = 0; j < length; j++) {
+			update(address + j, in[j]);
+		}
+		address += entry->capacity;
+	}
+
+	uint16_t sequence = sequence_ + 1;
+	uint16_t hash = layoutHash();
+	uint16_t sum = imageSum(bank);
+	update(base, 'V');
+	update(base + 1, 'S');
+	update(base + 2, sequence & 0xff);
+	update(base + 3, sequence >> 8);
+	update(base + 4, hash & 0xff);
+	update(base + 5, hash >> 8);
+	update(base + 6, sum & 0xff);
+	update(base + 7, sum >> 8);
+
+	bank_ = bank;
+	sequence_ = sequence;
+	for(int i = 0; i < entrycount_; i++) {
+		entries_[i].unsaved = false;
+	}
+	return 0;
+}
+
+int VarStore::imageSize() {
+	int size = VARSTORE_IMAGE_HEADER + entrycount_ * VARSTORE_INDEX_LEN;
+	for(int i = 0; i < entrycount_; i++) {
+		size += entries_[i].capacity;
+	}
+	return size;
+}
+
+// Changes whenever the sketch registers different variables, so an
+// image saved for them is never loaded into these.
+uint16_t VarStore::layoutHash() {
+	uint8_t a = entrycount_;
+	uint8_t b = a;
+	for(int i = 0; i < entrycount_; i++) {
+		const struct VarStoreEntry* entry = &entries_[i];
+		uint8_t fields[4] = {entry->type, (uint8_t)entry->source,
+		                     (uint8_t)(entry->capacity & 0xff), (uint8_t)(entry->capacity >> 8)};
+		for(int j = 0; j < 4; j++) {
+			a += fields[j];
+			b += a;
+		}
+		for(int j = 0; j < entry->namelength; j++) {
+			a += entry->name[j];
+			b += a;
+		}
+	}
+	return ((uint16_t)b << 8) | a;
+}
+
+// Fletcher checksum of everything in a bank after its header
+uint16_t VarStore::imageSum(int bank) {
+	int size = imageSize();
+	int base = bank * size;
+	uint8_t a = 0;
+	uint8_t b = 0;
+	for(int i = VARSTORE_IMAGE_HEADER; i < size; i++) {
+		a += reader_(base + i);
+		b += a;
+	}
+	return ((uint16_t)b << 8) | a;
+}
+
+uint16_t VarStore::readWord(int address) {
+	return reader_(address) | ((uint16_t)reader_(address + 1) << 8);
+}
+
+// EEPROM cells wear out with writes, not reads
+void VarStore::update(int address, uint8_t value) {
+	if (reader_(address) != value) {
+		writer_(address, value);
+	}
+}
@@ -0,0 +1,117 @@
+/*************************************************
+ *  VarStore.h - Registry of named variables     *
+ *           held in pre-encoded wire format,    *
+ *           served to calculators by CBL2.      *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef VARSTORE_H
+#define VARSTORE_H
+
+#include "Arduino.h"
+#include "TICL.h"
+
+#define VARSTORE_MAX_VARS	8		// Number of variables a VarStore can hold
+#define VARSTORE_NAME_LEN	8		// Longest variable name that can be matched
+#define VARSTORE_IMAGE_HEADER	8	// Magic, sequence number, layout hash, checksum
+#define VARSTORE_INDEX_LEN	3		// Per variable in a saved image: model, length
+
+// Where the application keeps the value of a variable
+enum VarSource {
+	SOURCE_INVALID = -1,
+	SOURCE_REAL_FLOAT,				// One double
+	SOURCE_REAL_LONG,				// One long
+	SOURCE_LIST_FLOAT,				// Array of doubles
+	SOURCE_LIST_LONG,				// Array of longs
+	SOURCE_STRING,					// NUL-terminated 7-bit ASCII
+	SOURCE_RAW,						// Bytes already in wire format
+};
+
+struct VarStoreEntry {
+	uint8_t type;					// Variable type requested by the calculator
+	uint8_t name[VARSTORE_NAME_LEN];	// Name bytes following the type in a VAR header
+	uint8_t namelength;				// 0 matches any variable of this type
+	enum VarSource source;
+	const void* value;				// Application-owned value, see VarSource
+	int count;						// List elements or string characters
+	int offset;						// Offset of the encoding in the store buffer
+	int capacity;					// Bytes reserved for the encoding
+	int length;						// Bytes currently encoded
+	enum Endpoint model;			// Model family the encoding was made for
+	bool dirty;
+	bool unsaved;					// Changed since the last save()
+};
+
+// Byte access to EEPROM, FRAM, or flash behind an emulation layer
+typedef uint8_t(*storage_reader)(int);
+typedef void(*storage_writer)(int, uint8_t);
+
+class VarStore {
+	public:
+		VarStore(uint8_t* buffer, int bufferlength, enum Endpoint model = CALC83P);
+
+		// Register an application-owned value. Returns a handle, or -1 if
+		// the store is full or the buffer is too small.
+		int addReal(uint8_t type, const uint8_t* name, int namelength, const double* value);
+		int addReal(uint8_t type, const uint8_t* name, int namelength, const long* value);
+		int addList(uint8_t type, const uint8_t* name, int namelength, const double* values, int count);
+		int addList(uint8_t type, const uint8_t* name, int namelength, const long* values, int count);
+		int addString(uint8_t type, const uint8_t* name, int namelength, const char* value, int maxlength);
+		int addRaw(uint8_t type, const uint8_t* name, int namelength, const uint8_t* data, int length);
+
+		// Tell the store that the application changed a value
+		int markDirty(int handle);
+		int setCount(int handle, int count);
+		void markAllDirty();
+
+		// Re-encode every dirty variable; call this from loop(), not while
+		// the calculator is waiting on the link.
+		int refresh();
+		void setModel(enum Endpoint model);
+
+		// Look up a variable for a calculator request, and get its encoding
+		int find(uint8_t type, const uint8_t* name, int namelength);
+		int encoded(int handle, enum Endpoint model, uint8_t** data, int* length);
+		enum Endpoint encodedModel(int handle);
+
+		// Keep the encodings across resets in size bytes of storage. Once
+		// every variable is registered, set up storage and load() the
+		// encodings saved last time, so Get( is answered without encoding
+		// anything; raw variables are copied back into their buffers.
+		// save() writes what changed since. Each save goes to the next of
+		// as many image-sized banks as fit, and only bytes that differ
+		// are written, to spread the wear. encodedModel() tells which
+		// model a restored encoding was made for, to decode it. Both
+		// return -1 if variables added after setupStorage() made the
+		// image larger than the storage.
+		int setupStorage(int size, storage_reader reader, storage_writer writer);
+		int load();
+		int save();
+
+	private:
+		int add(uint8_t type, const uint8_t* name, int namelength,
+		        enum VarSource source, const void* value, int count, int capacity);
+		int encode(struct VarStoreEntry* entry, enum Endpoint model);
+		int imageSize();
+		uint16_t layoutHash();
+		uint16_t imageSum(int bank);
+		uint16_t readWord(int address);
+		void update(int address, uint8_t value);
+
+		uint8_t* buffer_;
+		int bufferlength_;
+		int used_;
+		int entrycount_;
+		enum Endpoint model_;
+		struct VarStoreEntry entries_[VARSTORE_MAX_VARS];
+
+		int storagesize_;
+		storage_reader reader_;
+		storage_writer writer_;
+		int bank_;							// Holds the newest saved image, or -1
+		uint16_t sequence_;
+};
+
+#endif	// VARSTORE_H
@@ -0,0 +1,192 @@
+/*************************************************
+ *  VarSync.cpp - Brings a calculator's          *
+ *           variables up to date with a         *
+ *           manifest, sending only the ones     *
+ *           that changed.                       *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "Arduino.h"
+#include "VarSync.h"
+#include "TIVar.h"
+
+#define RECORD_MAX	(2 + VARSYNC_MAX_VARS * VARSYNC_RECORD_ITEM)
+
+VarSync::VarSync() {
+	entrycount_ = 0;
+	skipped_ = 0;
+	forced_ = 0;
+}
+
+int VarSync::add(uint8_t type, const uint8_t* name, int namelength, uint8_t* data, int datalength,
+                 uint8_t(*data_callback)(int))
+{
+	if (entrycount_ >= VARSYNC_MAX_VARS || namelength > VARSYNC_NAME_LEN ||
+	    (data == NULL && data_callback == NULL))
+	{
+		return -1;
+	}
+	struct VarSyncEntry* entry = &entries_[entrycount_];
+	uint8_t header[13];
+	entry->type = type;
+	memset(entry->name, 0, VARSYNC_NAME_LEN);
+	memcpy(entry->name, name, namelength);
+	entry->data = data;
+	entry->data_callback = data_callback;
+	nameHeader(header, type, entry->name, 0);
+	entry->key = checksum(&header[2], 1 + VARSYNC_NAME_LEN);
+	entry->datalength = datalength;
+	entry->sum = checksum(data, datalength, data_callback);
+	return entrycount_++;
+}
+
+int VarSync::changed(int handle, int datalength) {
+	if (handle < 0 || handle >= entrycount_) {
+		return -1;
+	}
+	struct VarSyncEntry* entry = &entries_[handle];
+	entry->datalength = datalength;
+	entry->sum = checksum(entry->data, datalength, entry->data_callback);
+	return 0;
+}
+
+void VarSync::markChanged(int handle) {
+	if (handle >= 0 && handle < entrycount_) {
+		forced_ |= (1 << handle);
+	}
+}
+
+int VarSync::skipped() {
+	return skipped_;
+}
+
+int VarSync::sync(SilentLink* link) {
+	uint8_t header[SILENT_MAX_HEADER];
+	uint8_t record_header[13];
+	uint8_t record[RECORD_MAX];
+	uint8_t synced[RECORD_MAX];
+	uint8_t current = 0;				// Bit per entry: on the calculator, the same size
+	int recordlength = -1;				// Size of the record on the calculator, if it has one
+	int headerlength;
+	int sent = 0;
+	int rval;
+
+	// Step 1: Go through the directory once
+	nameHeader(record_header, VARSYNC_RECORD_TYPE, (const uint8_t*)VARSYNC_RECORD_NAME, 0);
+	if ((rval = link->beginDirectory())) {
+		return rval;
+	}
+	while (0 == (rval = link->nextDirectoryEntry(header, &headerlength))) {
+		if (headerlength < 11) {
+			continue;
+		}
+		int length = TIVar::sizeWordToInt(header);
+		if (0 == memcmp(&header[2], &record_header[2], 1 + VARSYNC_NAME_LEN)) {
+			recordlength = length;
+			continue;
+		}
+		for(int i = 0; i < entrycount_; i++) {
+			const struct VarSyncEntry* entry = &entries_[i];
+			if (entry->type == header[2] && entry->datalength == length &&
+			    0 == memcmp(entry->name, &header[3], VARSYNC_NAME_LEN))
+			{
+				current |= (1 << i);
+			}
+		}
+	}
+	if (rval < 0) {
+		return rval;
+	}
+
+	// Step 2: Find out what was sent last time, if it can matter
+	if (recordlength < 2 || recordlength > RECORD_MAX || !current) {
+		recordlength = 0;
+	} else if ((rval = readRecord(link, record, &recordlength))) {
+		return rval;
+	}
+
+	// Step 3: Send whatever isn't the same
+	skipped_ = 0;
+	for(int i = 0; i < entrycount_; i++) {
+		struct VarSyncEntry* entry = &entries_[i];
+		uint8_t* item = &synced[2 + i * VARSYNC_RECORD_ITEM];
+		TIVar::intToSizeWord(entry->key, &item[0]);
+		TIVar::intToSizeWord(entry->sum, &item[2]);
+
+		bool same = false;
+		if ((current & (1 << i)) && !(forced_ & (1 << i))) {
+			for(int j = 2; j + VARSYNC_RECORD_ITEM <= recordlength; j += VARSYNC_RECORD_ITEM) {
+				if (0 == memcmp(&record[j], item, VARSYNC_RECORD_ITEM)) {
+					same = true;
+				}
+			}
+		}
+		if (same) {
+			skipped_++;
+			continue;
+		}
+		if ((rval = sendEntry(link, entry))) {
+			return rval;				// What was sent is sent again next time
+		}
+		forced_ &= ~(1 << i);
+		sent++;
+	}
+
+	// Step 4: Record what the calculator now has, unless it's recorded
+	int length = 2 + entrycount_ * VARSYNC_RECORD_ITEM;
+	TIVar::intToSizeWord(length - 2, synced);
+	if (length != recordlength || memcmp(synced, record, length)) {
+		if ((rval = writeRecord(link, synced, length))) {
+			return rval;
+		}
+	}
+	return sent;
+}
+
+int VarSync::readRecord(SilentLink* link, uint8_t* record, int* length) {
+	uint8_t header[SILENT_MAX_HEADER];
+	int headerlength = 11;
+	nameHeader(header, VARSYNC_RECORD_TYPE, (const uint8_t*)VARSYNC_RECORD_NAME, 0);
+	int rval = link->getVariable(header, &headerlength, record, length, RECORD_MAX);
+	if (rval == 0 && TIVar::sizeWordToInt(record) != *length - 2) {
+		*length = 0;					// Not one of ours
+	}
+	return rval;
+}
+
+int VarSync::writeRecord(SilentLink* link, uint8_t* record, int length) {
+	uint8_t header[13];
+	nameHeader(header, VARSYNC_RECORD_TYPE, (const uint8_t*)VARSYNC_RECORD_NAME, length);
+	return link->sendVariable(header, sizeof(header), record, length);
+}
+
+int VarSync::sendEntry(SilentLink* link, struct VarSyncEntry* entry) {
+	uint8_t header[13];
+	nameHeader(header, entry->type, entry->name, entry->datalength);
+	return link->sendVariable(header, sizeof(header), entry->data, entry->datalength, entry->data_callback);
+}
+
+// A TI-83+ family VAR header: size word, type, zero-padded name, and
+// a version and flag byte, both zero. The name is read up to its
+// first zero.
+void VarSync::nameHeader(uint8_t* header, uint8_t type, const uint8_t* name, int datalength) {
+	memset(header, 0, 13);
+	TIVar::intToSizeWord(datalength, header);
+	header[2] = type;
+	for(int i = 0; i < VARSYNC_NAME_LEN && name[i]; i++) {
+		header[3 + i] = name[i];
+	}
+}
+
+// Fletcher checksum, of a buffer or of what data_callback returns
+uint16_t VarSync::checksum(const uint8_t* data, int length, uint8_t(*data_callback)(int)) {
+	uint8_t a = 0;
+	uint8_t b = 0;
+	for(int i = 0; i < length; i++) {
+		a += data ? data[i] : data_callback(i);
+		b += a;
+	}
+	return ((uint16_t)b << 8) | a;
+}
@@ -0,0 +1,75 @@
+/*************************************************
+ *  VarSync.h - Brings a calculator's variables  *
+ *           up to date with a manifest, sending *
+ *           only the ones that changed.         *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef VARSYNC_H
+#define VARSYNC_H
+
+#include "Arduino.h"
+#include "TICL.h"
+#include "SilentLink.h"
+
+#define VARSYNC_MAX_VARS	8		// Number of variables a manifest can hold
+#define VARSYNC_NAME_LEN	8		// Variable names in TI-83+ family VAR headers
+#define VARSYNC_RECORD_TYPE	0x15	// AppVar that records what was synced
+#define VARSYNC_RECORD_NAME	"ARTICL"
+#define VARSYNC_RECORD_ITEM	4		// Per variable in the record: name sum, content sum
+
+struct VarSyncEntry {
+	uint8_t type;
+	uint8_t name[VARSYNC_NAME_LEN];	// Zero-padded, as in a VAR header
+	uint8_t* data;					// Variable data as sent in DATA, or NULL
+	uint8_t(*data_callback)(int);	// Where the data comes from if there's no buffer
+	int datalength;
+	uint16_t key;					// Checksum of the type and name
+	uint16_t sum;					// Checksum of the data
+};
+
+// Keeps a calculator's copies of up to VARSYNC_MAX_VARS variables the
+// same as ours. sync() lists the calculator's variables once, and sends
+// only those that are missing, are a different size, or have changed
+// here since they were last sent. The checksum of each variable sent is
+// kept on the calculator itself, in a small AppVar, so any calculator
+// can be synced by any board without keeping track of which is which.
+// Variables changed on the calculator without changing size are not
+// noticed; markChanged() the entry to send it anyway.
+class VarSync {
+	public:
+		VarSync();
+
+		// Add a variable. The data is what DATA carries, with the size word
+		// first for programs, lists and AppVars. It comes from data, or
+		// from data_callback if data is NULL, and is read once here for
+		// its checksum. Returns a handle, or -1 if the manifest is full.
+		int add(uint8_t type, const uint8_t* name, int namelength, uint8_t* data, int datalength,
+		        uint8_t(*data_callback)(int) = NULL);
+
+		// Tell the manifest the data changed, and may have changed size
+		int changed(int handle, int datalength);
+		void markChanged(int handle);				// Send it next time, even if it looks the same
+
+		// Bring the calculator up to date. Returns the number of variables
+		// sent, or a TICLErrors value.
+		int sync(SilentLink* link);
+		int skipped();								// Variables found up to date by the last sync()
+
+		static uint16_t checksum(const uint8_t* data, int length, uint8_t(*data_callback)(int) = NULL);
+
+	private:
+		struct VarSyncEntry entries_[VARSYNC_MAX_VARS];
+		int entrycount_;
+		int skipped_;
+		uint8_t forced_;							// Bit per entry: send whatever sync() finds
+
+		int readRecord(SilentLink* link, uint8_t* record, int* length);
+		int writeRecord(SilentLink* link, uint8_t* record, int length);
+		int sendEntry(SilentLink* link, struct VarSyncEntry* entry);
+		static void nameHeader(uint8_t* header, uint8_t type, const uint8_t* name, int datalength);
+};
+
+#endif	// VARSYNC_H
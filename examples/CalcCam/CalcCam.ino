@@ -16,8 +16,9 @@
  *    or a 96x64 monochrome image to a TI-83+/   *
  *    TI-84+.                                    *
  *  - Send(L1): Sends an 8-element list          *
- *    containing the camera settings. Reset to   *
- *    defaults if the Arduino loses power.       *
+ *    containing the camera settings. They are   *
+ *    kept in EEPROM, ready to be sent back      *
+ *    as soon as the Arduino powers up again.    *
  *  - Get(L1): Gets the 8-element list           *
  *    containing the camera settings.            *
  *                                               *
@@ -41,6 +42,7 @@
 
 // Includes
 #include <Wire.h>
+#include <EEPROM.h>
 
 #include <avr/interrupt.h>
 #include <avr/io.h>
@@ -48,6 +50,8 @@
 
 #include "CBL2.h"
 #include "TIVar.h"
+#include "TIPic.h"
+#include "VarStore.h"
 
 // Defines
 #define CAM_DATA_PORT     PORTB
@@ -100,12 +104,20 @@ uint8_t data[MAXDATALEN];
 // no edge detection, exposure=0,30, offset=-27, vref=+1.0, gain = 1
 unsigned char camReg[8]={ 155, 1, 0, 30, 1, 0, 1, 7 };
 
+// The registers as a list for Get(L1), saved encoded in EEPROM
+long camSettings[8];
+uint8_t storeBuffer[2 + 10 * 8];
+VarStore store(storeBuffer, sizeof(storeBuffer));
+int settingsHandle;
+
 CamMode camMode             = CAM_MODE_STANDARD;
 unsigned char camClockSpeed = 0x07; // was 0x0A
 
-int x, y;                // the current x,y coordinate we're working on
 int cx, cy;
 
+// Turns camera pixels into picture data as the calculator receives it
+PicEncoder picEncoder;
+
 /* ------------------------------------------------------------------------ */
 /* MACROS                                                                   */
 /* ------------------------------------------------------------------------ */
@@ -137,6 +149,7 @@ void setup()
   //cbl.setVerbosity(true, &Serial);			// Comment this in for message information
   cbl.setupCallbacks(header, data, MAXDATALEN,
                       onGetAsCBL2, onSendAsCBL2);
+  setupSettings();
 
   Serial.println("Ready.");
 }
@@ -151,8 +164,42 @@ void loop() {
     Serial.print("Failed to run eventLoopTick: code ");
     Serial.println(rval);
   }  
+
+  // Save settings the calculator sent, outside the transfer
+  store.refresh();
+  store.save();
 } // loop
 
+uint8_t eepromRead(int address) {
+  return EEPROM.read(address);
+}
+
+void eepromWrite(int address, uint8_t value) {
+  EEPROM.write(address, value);
+}
+
+// Bring back the settings saved before the last reset. The list's
+// encoding is restored as-is, so Get(L1) needs no conversion; the
+// registers are decoded from it once, here.
+void setupSettings() {
+  for(int i = 0; i < 8; i++) {
+    camSettings[i] = camReg[i];
+  }
+  settingsHandle = store.addList(VarTypes82::VarRList, NULL, 0, camSettings, 8);
+  store.setupStorage(EEPROM.length(), eepromRead, eepromWrite);
+  if (store.load() == 0) {
+    enum Endpoint model = store.encodedModel(settingsHandle);
+    uint8_t* list;
+    int length;
+    store.encoded(settingsHandle, model, &list, &length);
+    for(int i = 0; i < 8; i++) {
+      camSettings[i] = TIVar::realToLong8x(&list[2 + TIVar::sizeOfReal(model) * i], model);
+      camStoreReg(i, camSettings[i]);
+    }
+  }
+  cbl.setupVarStore(&store);
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // PRIVATE FUNCTIONS
 ///////////////////////////////////////////////////////////////////////////
@@ -374,67 +421,32 @@ inline uint8_t camGetPixel(void) {
   return pixel;
 }
 
-uint8_t sendPicDataByte(int idx) {
-  uint8_t outbyte;
-  if (x < 0) {
-    uint16_t length = (camMode == CAM_MODE_STANDARD)?21945:756;
-	if (x == -2) {
-	  outbyte = (uint8_t)(length & 0x0ff);
-	} else {
-	  outbyte = (uint8_t)(length >> 8);
-	}
-	x++;
-	return outbyte;
-  }
+// Pixel source for the picture encoder, called once per picture pixel
+// in raster order. The 128x128 camera image is centered in a color
+// picture, or downscaled to 64x63 in a monochrome one.
+uint8_t camPixel(int px, int py) {
   if (camMode == CAM_MODE_STANDARD) {
-    outbyte = 0xbb;    // all white
-    if (y >= 17 && y < 145 && x >= 68 && x < 196) {
-      for(uint8_t i = 0; i < 2; i++) {
-        uint8_t pixel = camGetPixel();
-        outbyte <<= 4;
-        if (pixel < 25) {
-        outbyte |= 0x03;
-        } else if (pixel < 76) {
-          outbyte |= 0x0f;
-        } else if (pixel < 127) {
-          outbyte |= 0x0e;
-        } else if (pixel < 178) {
-          outbyte |= 0x0d;
-        } else if (pixel < 229) {
-          outbyte |= 0x0c;
-        } else {
-          outbyte |= 0x0b;
-        }
-      }
-    }
-    x += 2;
-    // Update coordinates
-    if (x >= 266) {
-      x = 0;
-      y++;
-    }
-  } else {
-    outbyte = 0x00;	// 8 white pixels;
-    if (x >= 16 && x < 80) {
-      for(uint8_t i = 0; i < 8; i++) {
-        uint8_t pixel = camGetPixel();
-        outbyte <<= 1;
-        outbyte |= (pixel >= 128)?0:1;
-        camGetPixel();			// Skip one pixel
-      }
+    if (py >= 17 && py < 145 && px >= 68 && px < 196) {
+      return camGetPixel();
     }
+    return 255;                 // White border
+  }
 
-    x += 8;
-    if (x >= 96) {
-      x = 0;
-      y++;
-      for(uint8_t i = 0; i < 128; i++) {
-        camGetPixel();		// Throw out one row
-      }
-	}
+  uint8_t pixel = 255;
+  if (px >= 16 && px < 80) {
+    pixel = camGetPixel();
+    camGetPixel();              // Skip one pixel
   }
-  
-  return outbyte;
+  if (px == PIC_MONO_WIDTH - 1) {
+    for(uint8_t i = 0; i < 128; i++) {
+      camGetPixel();            // Throw out one row
+    }
+  }
+  return pixel;
+}
+
+uint8_t sendPicDataByte(int idx) {
+  return picEncoder.dataByte(idx);
 }
 
 int onGetAsCBL2(uint8_t type, enum Endpoint model, int datalen) {
@@ -458,7 +470,9 @@ int onGetAsCBL2(uint8_t type, enum Endpoint model, int datalen) {
     //Serial.print(" has value ");
     //Serial.println(value, HEX);
     camStoreReg(i, value);
+    camSettings[i] = value;
   }
+  store.markDirty(settingsHandle);
   return 0;
 }
 
@@ -499,21 +513,22 @@ int onSendAsCBL2(uint8_t type, enum Endpoint model, int* headerlen,
 	
     // Compose the VAR header
     if (*headerlen == 13 && header[11] == 0x0A) {  
-      *datalen = 21945 + 2;                             // 165 * 266 / 2 (4 bits per pixel)
+      picEncoder.begin(PIC_COLOR, DITHER_ORDERED);  // 165 * 266 / 2 (4 bits per pixel)
+      *datalen = picEncoder.dataLength();
       // Leave the pic portion of the header as-is
       header[11] = 0x0A;      // Version
       header[12] = 0x80;      // Archived
       camMode = CAM_MODE_STANDARD;
     } else {
-      *datalen = 756 + 2;
+      picEncoder.begin(PIC_MONO, DITHER_ORDERED);
+      *datalen = picEncoder.dataLength();
       TIVar::intToSizeWord(*datalen, &header[0]);	// Two bytes for the element count, 6 Reals
 	  header[2] = 0x07;		// Because the TI-OS makes no sense
       camMode = CAM_MODE_DOWNSCALE;
     }
+    picEncoder.setSource(camPixel);
 	
 	// Initialize the camera
-    x = -2;
-    y = 0;
     camReset();
     camSetRegisters();
     camStartPicture();
@@ -0,0 +1,58 @@
+/*************************************************
+ *  CaptureTiming.ino                            *
+ *  Example from the ArTICL library              *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *                                               *
+ *  This demo records every tip/ring transition  *
+ *  of a short exchange with a calculator (a     *
+ *  "ready?" check, as computer link software    *
+ *  does) and prints it over serial as a VCD     *
+ *  file, which waveform viewers like GTKWave    *
+ *  can open. Short digital pin 4 to gnd to run. *
+ *************************************************/
+
+#include "TICL.h"
+#include "LineCapture.h"
+
+#define TRIGGER_PRESSED LOW
+#define TRIGGER_BUTTON 4
+#define MAX_EVENTS 120
+
+TICL ticl(DEFAULT_TIP, DEFAULT_RING);
+struct LineEvent events[MAX_EVENTS];
+LineCapture capture(events, MAX_EVENTS);
+
+void setup() {
+  pinMode(TRIGGER_BUTTON, INPUT_PULLUP);
+  Serial.begin(115200);
+  ticl.resetLines();
+  ticl.setCapture(&capture);
+}
+
+void loop() {
+  if (TRIGGER_PRESSED != digitalRead(TRIGGER_BUTTON)) {
+    return;
+  }
+
+  uint8_t header[4] = {COMP83P, RDY, 0x00, 0x00};
+  int length;
+  capture.clear();
+  int rval = ticl.send(header, NULL, 0);
+  if (rval == 0) {
+    rval = ticl.get(header, NULL, &length, 0);
+  }
+
+  // Printing is slow, so don't record while doing it
+  capture.setEnabled(false);
+  capture.writeVCD(&Serial);
+  if (rval) {
+    Serial.print("Exchange failed: ");
+    Serial.println(rval);
+  }
+  if (capture.overflowed()) {
+    Serial.println("Capture buffer too small, oldest events lost");
+  }
+  capture.setEnabled(true);
+  delay(1000);
+}
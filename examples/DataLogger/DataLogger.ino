@@ -0,0 +1,150 @@
+/*************************************************
+ *  DataLogger.ino                               *
+ *  Example from the ArTICL library              *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *                                               *
+ *  This demo records two analog channels at a   *
+ *  fixed rate, like a real CBL2, and lets the   *
+ *  calculator fetch the capture as lists. The   *
+ *  following commands are interpreted:          *
+ *  - Send({1,P,D}): Record continuously, one    *
+ *    sample every P ms, averaging D samples     *
+ *    into each record.                          *
+ *  - Send({2,P,L,B,A}): Record every P ms, and  *
+ *    capture B records before and A records     *
+ *    after channel 1 rises through level L.     *
+ *  - Send({3,C,K}): Select chunk K of column C  *
+ *    (0 = time in seconds, 1-2 = channels).     *
+ *  - Get(L1): Gets the selected chunk, then     *
+ *    selects the next chunk of that column.     *
+ *  - Send({0}): Stop recording.                 *
+ *  On AVR boards the samples are taken from a   *
+ *  Timer1 interrupt, so link traffic doesn't    *
+ *  disturb the sample rate.                     *
+ *************************************************/
+
+#include "CBL2.h"
+#include "TIVar.h"
+#include "DataLogger.h"
+
+CBL2 cbl;
+const int lineRed = DEFAULT_TIP;
+const int lineWhite = DEFAULT_RING;
+
+#define MAXDATALEN 255
+uint8_t header[16];
+uint8_t data[MAXDATALEN];
+
+#define CHANNEL_COUNT 2
+#define SAMPLE_COUNT 600
+const int channelPins[CHANNEL_COUNT] = {0, 1};
+int16_t samples[SAMPLE_COUNT];
+DataLogger logger(samples, SAMPLE_COUNT);
+
+int column = 0;
+int chunk = 0;
+
+// Forward function definitions.
+int onGetAsCBL2(uint8_t type, enum Endpoint model, int datalen);
+int onSendAsCBL2(uint8_t type, enum Endpoint model, int* headerlen,
+                 int* datalen, data_callback* data_callback);
+
+#if defined(__AVR__)
+ISR(TIMER1_COMPA_vect) {
+  logger.sample();
+}
+
+// Run Timer1 in CTC mode with a /64 prescaler (4 us per count at 16 MHz,
+// so periods up to 262 ms)
+void startSampleTimer(unsigned long period_us) {
+  noInterrupts();
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS11) | _BV(CS10);
+  OCR1A = (period_us * (F_CPU / 1000000L) / 64) - 1;
+  TCNT1 = 0;
+  TIMSK1 |= _BV(OCIE1A);
+  interrupts();
+}
+#endif
+
+void setup() {
+  Serial.begin(9600);
+  cbl.setLines(lineRed, lineWhite);
+  cbl.resetLines();
+  cbl.setIdleMode(IDLE_SLEEP);        // Sleep between samples and transfers
+  // cbl.setVerbosity(true, &Serial);			// Comment this in for message information
+  cbl.setupCallbacks(header, data, MAXDATALEN,
+                     onGetAsCBL2, onSendAsCBL2);
+  logger.setChannels(channelPins, CHANNEL_COUNT);
+}
+
+void loop() {
+  int rval;
+#if !defined(__AVR__)
+  // Without a timer interrupt, catch up on any samples due since the
+  // last pass. This is only as regular as the link allows.
+  logger.tick(micros());
+#endif
+  rval = cbl.eventLoopTick(true);
+  if (rval && rval != ERR_READ_TIMEOUT) {
+    Serial.print("Failed to run eventLoopTick: code ");
+    Serial.println(rval);
+  }
+}
+
+long listElement(int index, enum Endpoint model) {
+  return TIVar::realToLong8x(&data[2 + TIVar::sizeOfReal(model) * index], model);
+}
+
+void startLogging(unsigned long period_ms, int decimation) {
+  logger.setRate(period_ms * 1000, decimation);
+  logger.start(micros());
+#if defined(__AVR__)
+  startSampleTimer(period_ms * 1000);
+#endif
+  column = 0;
+  chunk = 0;
+}
+
+int onGetAsCBL2(uint8_t type, enum Endpoint model, int datalen) {
+  if (type != VarTypes82::VarRList)
+    return -1;
+
+  int count = TIVar::sizeWordToInt(&data[0]);
+  int command = (count >= 1) ? listElement(0, model) : -1;
+  if (command == 0 && count == 1) {
+    logger.stop();
+  } else if (command == 1 && count == 3) {
+    logger.stop();
+    logger.setTrigger(TRIGGER_NONE, 0, 0, 0, 0);
+    startLogging(listElement(1, model), listElement(2, model));
+  } else if (command == 2 && count == 5) {
+    logger.stop();
+    logger.setTrigger(TRIGGER_RISING, 0, listElement(2, model),
+                      listElement(3, model), listElement(4, model));
+    startLogging(listElement(1, model), 1);
+  } else if (command == 3 && count == 3) {
+    column = listElement(1, model);
+    chunk = listElement(2, model);
+  } else {
+    Serial.println("Unknown command");
+    return -1;
+  }
+  return 0;
+}
+
+int onSendAsCBL2(uint8_t type, enum Endpoint model, int* headerlen,
+                 int* datalen, data_callback* data_callback)
+{
+  if (type != VarTypes82::VarRList)
+    return -1;
+
+  *datalen = logger.readChunk(column, chunk, data, MAXDATALEN, model);
+  if (*datalen < 0) {
+    return -1;
+  }
+  TIVar::intToSizeWord(*datalen, &header[0]);
+  chunk++;
+  return 0;
+}
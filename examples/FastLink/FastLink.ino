@@ -0,0 +1,79 @@
+/*************************************************
+ *  FastLink.ino                                 *
+ *  Example from the ArTICL library              *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *                                               *
+ *  This demo links two Arduinos, tip to tip and *
+ *  ring to ring with a common ground, and times *
+ *  the same transfer in the standard protocol   *
+ *  and in fast mode. Load it on both boards,    *
+ *  and short digital pin 4 to gnd on the one    *
+ *  that should send.                            *
+ *************************************************/
+
+#include "TICL.h"
+
+#define SENDER_SELECTED LOW
+#define SENDER_PIN 4
+#define PACKET_SIZE 256
+#define PACKETS 20
+
+TICL ticl(DEFAULT_TIP, DEFAULT_RING);
+uint8_t data[PACKET_SIZE];
+bool sender;
+
+void setup() {
+  pinMode(SENDER_PIN, INPUT_PULLUP);
+  Serial.begin(115200);
+  ticl.resetLines();
+  sender = (SENDER_SELECTED == digitalRead(SENDER_PIN));
+  for (int i = 0; i < PACKET_SIZE; i++) {
+    data[i] = i * 37 + 11;
+  }
+}
+
+// Send PACKETS DATA packets and return the bytes/s, or 0 on failure
+unsigned long timeTransfer() {
+  uint8_t header[4] = {COMP83P, DATA, PACKET_SIZE & 0xff, PACKET_SIZE >> 8};
+  unsigned long start = millis();
+  for (int i = 0; i < PACKETS; i++) {
+    if (ticl.sendAwaitAck(header, data, PACKET_SIZE)) {
+      return 0;
+    }
+  }
+  unsigned long elapsed = max(millis() - start, 1ul);
+  return 1000ul * PACKETS * PACKET_SIZE / elapsed;
+}
+
+void loop() {
+  if (!sender) {
+    // Acknowledge whatever arrives, and agree to fast mode
+    uint8_t header[4];
+    int length;
+    if (ticl.getOrRetry(header, data, &length, PACKET_SIZE, CALC83P) == 0) {
+      if (header[1] == FST) {
+        ticl.acceptFast(header, data, length, CALC83P);
+      } else {
+        uint8_t ack[4] = {CALC83P, ACK, 0x00, 0x00};
+        ticl.send(ack, NULL, 0);
+      }
+    }
+    return;
+  }
+
+  delay(2000);
+  Serial.print("Standard: ");
+  Serial.print(timeTransfer());
+  Serial.println(" bytes/s");
+  if (ticl.negotiateFast(COMP83P)) {
+    Serial.println("Peer refused fast mode");
+    return;
+  }
+  Serial.print("Fast: ");
+  Serial.print(timeTransfer());
+  Serial.println(" bytes/s");
+
+  // Both ends have to leave fast mode, so start over from reset
+  while (true);
+}
@@ -0,0 +1,26 @@
+/*************************************************
+ *  LinkBridge.ino                               *
+ *  Example from the ArTICL library              *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *                                               *
+ *  This demo makes the Arduino a serial link    *
+ *  cable: packets from the PC on the USB        *
+ *  serial port go to the calculator, and the    *
+ *  calculator's packets go back to the PC.      *
+ *  Keep verbose output off; the serial port     *
+ *  carries raw packets.                         *
+ *************************************************/
+
+#include "LinkBridge.h"
+
+LinkBridge bridge(DEFAULT_TIP, DEFAULT_RING);
+
+void setup() {
+  Serial.begin(115200);
+  bridge.begin(&Serial);
+}
+
+void loop() {
+  bridge.bridgeTick();
+}
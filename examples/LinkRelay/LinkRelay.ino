@@ -0,0 +1,45 @@
+/*************************************************
+ *  LinkRelay.ino                                *
+ *  Example from the ArTICL library              *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *                                               *
+ *  This demo sits between two calculators, one  *
+ *  on pins 2 and 3 and one on pins 4 and 5, and *
+ *  passes everything one sends on to the other. *
+ *  The header of each packet is printed to the  *
+ *  serial port, and silent-link screenshot      *
+ *  requests are dropped.                        *
+ *************************************************/
+
+#include "LinkRelay.h"
+
+TICL linkA(DEFAULT_TIP, DEFAULT_RING);
+TICL linkB(4, 5);
+LinkRelay relay(&linkA, &linkB);
+
+// Keep this short: the sender is waiting on its next bit
+int onHeader(enum RelayDirection direction, uint8_t* header) {
+  Serial.print(direction == RELAY_A_TO_B ? "A>B " : "B>A ");
+  Serial.print(header[0], HEX);
+  Serial.print(' ');
+  Serial.print(header[1], HEX);
+  Serial.print(' ');
+  Serial.println(header[2] | (header[3] << 8));
+  return (header[1] == SCR) ? 1 : 0;
+}
+
+void setup() {
+  Serial.begin(115200);
+  linkA.begin();
+  linkB.begin();
+  relay.setHooks(onHeader);
+}
+
+void loop() {
+  int rval = relay.relayTick();
+  if (rval < 0 && rval != ERR_READ_TIMEOUT) {
+    Serial.print("Relay failed: code ");
+    Serial.println(rval);
+  }
+}
@@ -5,15 +5,19 @@
  *           2011-2014, all rights reserved.     *
  *                                               *
  *  This demo reads the Arduino's six analog     *
- *  pins whenever the calculator requests a      *
- *  list, and returns the results as a six-      *
- *  element list with values between 0 and 1023. *
+ *  pins in the background and returns the       *
+ *  latest results as a six-element list with    *
+ *  values between 0 and 1023 whenever the       *
+ *  calculator requests a list. The list is kept *
+ *  pre-encoded in a VarStore, so Get( is        *
+ *  answered without any conversion work.        *
  *  On the MSP432 Launchpad, it returns the      *
  *  values of A0, A1, A3, A4, A5, A6 instead.    *
  *************************************************/
 
 #include "CBL2.h"
 #include "TIVar.h"
+#include "VarStore.h"
 
 CBL2 cbl;
 const int lineRed = DEFAULT_TIP;
@@ -33,6 +37,12 @@ const int analogPins[ANALOG_PIN_COUNT] = {0, 1, 2, 3, 4, 5};
 
 #endif
 
+// Latest readings, and room for their encoding as a list
+long values[ANALOG_PIN_COUNT];
+uint8_t storeBuffer[2 + 10 * ANALOG_PIN_COUNT];
+VarStore store(storeBuffer, sizeof(storeBuffer));
+int valuesHandle;
+
 // Forward function definitions.
 int onGetAsCBL2(uint8_t type, enum Endpoint model, int datalen);
 int onSendAsCBL2(uint8_t type, enum Endpoint model, int* headerlen,
@@ -45,10 +55,23 @@ void setup() {
   cbl.setVerbosity(true, &Serial);			// Comment this in for mesage information
   cbl.setupCallbacks(header, data, MAXDATALEN,
                      onGetAsCBL2, onSendAsCBL2);
+
+  // Any request for a real list is answered with the readings
+  valuesHandle = store.addList(VarTypes82::VarRList, NULL, 0,
+                               values, ANALOG_PIN_COUNT);
+  cbl.setupVarStore(&store);
 }
 
 void loop() {
   int rval;
+
+  // Sample and encode while the calculator isn't waiting on us
+  for(int i = 0; i < ANALOG_PIN_COUNT; i++) {
+    values[i] = analogRead(analogPins[i]);
+  }
+  store.markDirty(valuesHandle);
+  store.refresh();
+
   rval = cbl.eventLoopTick();
   if (rval && rval != ERR_READ_TIMEOUT) {
     Serial.print("Failed to run eventLoopTick: code ");
@@ -64,6 +87,7 @@ int onGetAsCBL2(uint8_t type, enum Endpoint model, int datalen) {
   return 0;
 }
 
+// Only called for requests the VarStore can't answer
 int onSendAsCBL2(uint8_t type, enum Endpoint model, int* headerlen,
                  int* datalen, data_callback* data_callback)
 {
@@ -71,38 +95,5 @@ int onSendAsCBL2(uint8_t type, enum Endpoint model, int* headerlen,
   Serial.print(type);
   Serial.print(" from endpoint of type ");
   Serial.println((int)model);
-  
-  if (type != VarTypes82::VarRList)
-    return -1;
-  
-  // Compose the VAR header
-  *datalen = 2 + TIVar::sizeOfReal(model) * ANALOG_PIN_COUNT;
-  TIVar::intToSizeWord(*datalen, &header[0]);	// Two bytes for the element count, ANALOG_PIN_COUNT Reals
-                                                // This sets header[0] and header[1]
-  header[2] = VarTypes85::VarRList;             // RealList (if you're a TI-85. Bleh.)
-  header[3] = 0x01;	               // Name length
-  header[4] = 0x41;                // "A", as per "standard" See http://www.cemetech.net/forum/viewtopic.php?p=224739#224739
-  header[5] = 0x00;                // Zero terminator (remainder of header is ignored)
-  *headerlen = 11;
-  
-  // Compose the body of the variable
-  data[0] = ANALOG_PIN_COUNT;		// Little-endian word for number of
-  data[1] = 0;						// elements in this list
-  int offset = 2;					// Offset past the count word
-  for(int i = 0; i < ANALOG_PIN_COUNT; i++) {
-	long value = analogRead(analogPins[i]);
-	// Convert the value, get the length of the inserted data or -1 for failure
-	int rval = TIVar::longToReal8x(value, &data[offset], model);
-	if (rval < 0) {
-		return -1;
-	}
-	offset += rval;
-  }
-  for(int i = 0; i < *datalen; i++) {
-    Serial.print(data[i], HEX);
-	Serial.print(" ");
-  }
-  Serial.println("]]");
-
-  return 0;
-}
\ No newline at end of file
+  return -1;
+}
@@ -7,7 +7,7 @@
 #include "CBL2.h"
 #include "TIVar.h"
 
-#define MAXDATALEN 255
+#define MAXDATALEN 16  // A real, or the header of a request for one
 
 uint8_t header[16];
 uint8_t data[MAXDATALEN];
@@ -21,6 +21,7 @@
 #endif
 
 TICL ticl = TICL(DEFAULT_TIP, DEFAULT_RING);
+LinkProfile calc;
 
 void setup() {
   pinMode(TRIGGER_BUTTON, INPUT_PULLUP);
@@ -34,9 +35,24 @@ void loop() {
     Serial.println("Starting transfer...");
     uint8_t screen[768 + 2];
     int rlen = 0, rval = 0;
+
+    // Find out what's attached, once
+    if (ticl.profile() == NULL) {
+      rval = ticl.discover(&calc);
+      if (rval) {
+        Serial.print("No calculator found: ");
+        Serial.println(rval);
+        return;
+      }
+      if (calc.machine_id != CALC83P || calc.hardware > 3) {
+        Serial.println("Only monochrome TI-83+ and TI-84+ screens are supported");
+        ticl.setProfile(NULL);
+        return;
+      }
+    }
     
     // Request the screen image
-    uint8_t msg[4] = {CALC83P, SCR, 0x00, 0x00};
+    uint8_t msg[4] = {calc.computer_id, SCR, 0x00, 0x00};
     rval = ticl.send(msg, NULL, 0);
     if (rval) {
       Serial.print("Failed to send SCR request: ");
@@ -55,7 +71,7 @@ void loop() {
     }
     
     // Wait for screen image
-    rval == ticl.get(msg, screen, &rlen, 768+2);
+    rval = ticl.get(msg, screen, &rlen, 768+2);
     if (rval) {
       Serial.print("Failed to get SCR: ");
       Serial.println(rval);
@@ -63,6 +79,9 @@ void loop() {
     }
     
     // Send an ack
+    msg[0] = calc.computer_id;
+    msg[1] = ACK;
+    msg[2] = msg[3] = 0x00;
     rval = ticl.send(msg, NULL, 0);
     if (rval) {
       Serial.print("Failed to send ack: ");
@@ -0,0 +1,113 @@
+/*************************************************
+ *  SendFile.ino                                 *
+ *  Example from the ArTICL library              *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *                                               *
+ *  This demo pushes every variable in a TI      *
+ *  computer file (.8xp, .8xl, ...) on an SD     *
+ *  card to a connected TI-83+/TI-84+ with the   *
+ *  silent-linking commands, without loading     *
+ *  the file into memory. It then fetches the    *
+ *  first variable back into a second file.      *
+ *  Short digital pin 4 to gnd to start.         *
+ *************************************************/
+
+#include <SPI.h>
+#include <SD.h>
+#include "SilentLink.h"
+#include "TIFile.h"
+#include "TIVar.h"
+
+#define TRIGGER_PRESSED LOW
+#define TRIGGER_BUTTON 4
+#define SD_CHIP_SELECT 10
+
+#define SEND_FILE "HELLO.8XP"
+#define RECEIVE_FILE "BACK.8XP"
+
+SilentLink link(DEFAULT_TIP, DEFAULT_RING);
+TIFileReader reader;
+TIFileWriter writer;
+File outFile;
+uint8_t varHeader[SILENT_MAX_HEADER];
+int varHeaderlen;
+
+// Feeds TICL::send straight from the file
+uint8_t fileByte(int idx) {
+  return (uint8_t)reader.readByte();
+}
+
+// Stores bytes from TICL::get straight into the file. By the time the
+// first byte arrives, getVariable() has filled in the VAR header.
+void fileSink(int idx, uint8_t byte) {
+  if (idx == 0) {
+    int datalen = TIVar::sizeWordToInt(varHeader);
+    writer.begin(&outFile, TIFILE_83F, TIFileWriter::entrySize(TIFILE_83F, datalen));
+    writer.addEntry(varHeader, varHeaderlen);
+  }
+  writer.writeByte(byte);
+}
+
+void setup() {
+  pinMode(TRIGGER_BUTTON, INPUT_PULLUP);
+  Serial.begin(9600);
+  link.resetLines();
+  // link.setVerbosity(true, &Serial);
+  if (!SD.begin(SD_CHIP_SELECT)) {
+    Serial.println("No SD card");
+  }
+}
+
+void loop() {
+  if (TRIGGER_PRESSED != digitalRead(TRIGGER_BUTTON)) {
+    return;
+  }
+
+  File inFile = SD.open(SEND_FILE);
+  int rval = reader.begin(&inFile);
+  if (rval) {
+    Serial.print("Not a TI file: ");
+    Serial.println(rval);
+    inFile.close();
+    return;
+  }
+
+  uint8_t header[SILENT_MAX_HEADER];
+  int headerlen, datalen;
+  varHeaderlen = 0;
+  while (0 == (rval = reader.nextEntry(header, &headerlen, &datalen))) {
+    Serial.print("Sending ");
+    Serial.print(datalen);
+    Serial.println(" bytes");
+    if (varHeaderlen == 0) {
+      memcpy(varHeader, header, headerlen);
+      varHeaderlen = headerlen;
+    }
+    rval = link.sendVariable(header, headerlen, NULL, datalen, fileByte);
+    if (rval) {
+      Serial.print("Failed to send variable: ");
+      Serial.println(rval);
+      break;
+    }
+  }
+  if (rval == 1) {
+    rval = reader.finish();
+    Serial.println(rval ? "Bad file checksum" : "Done sending");
+  }
+  inFile.close();
+  if (varHeaderlen == 0) {
+    return;
+  }
+
+  // Ask for the first variable back by type and name
+  SD.remove(RECEIVE_FILE);
+  outFile = SD.open(RECEIVE_FILE, FILE_WRITE);
+  varHeader[0] = varHeader[1] = 0;
+  rval = link.getVariable(varHeader, &varHeaderlen, NULL, &datalen, 0, fileSink);
+  if (rval == 0) {
+    rval = writer.end();
+  }
+  Serial.println(rval ? "Failed to receive variable" : "Done receiving");
+  outFile.close();
+}
@@ -0,0 +1,72 @@
+/*************************************************
+ *  SyncPrograms.ino                             *
+ *  Example from the ArTICL library              *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *                                               *
+ *  This demo keeps a program and a real         *
+ *  variable up to date on each TI-83+/TI-84+    *
+ *  plugged into it, for a classroom. Short      *
+ *  digital pin 4 to gnd to sync. A calculator   *
+ *  that already has both is only asked for      *
+ *  its variable list; nothing is sent again.    *
+ *  Change the real with pin 5 to gnd, and only  *
+ *  it is sent on the next sync.                 *
+ *************************************************/
+
+#include "SilentLink.h"
+#include "TIVar.h"
+#include "VarSync.h"
+
+#define TRIGGER_PRESSED LOW
+#define SYNC_BUTTON 4
+#define CHANGE_BUTTON 5
+
+// prgmHELLO: Disp "HELLO". Programs start with their size word.
+uint8_t hello[] = {0x08, 0x00, 0xDE, 0x2A, 'H', 'E', 'L', 'L', 'O', 0x2A};
+const uint8_t helloName[] = "HELLO";
+
+// The real variable N
+uint8_t number[9];
+long value = 1;
+
+SilentLink link(DEFAULT_TIP, DEFAULT_RING);
+VarSync manifest;
+int numberHandle;
+
+void setup() {
+  pinMode(SYNC_BUTTON, INPUT_PULLUP);
+  pinMode(CHANGE_BUTTON, INPUT_PULLUP);
+  Serial.begin(9600);
+  link.resetLines();
+
+  manifest.add(0x05, helloName, 5, hello, sizeof(hello));     // Program
+  int length = TIVar::longToReal8x(value, number, CALC83P);
+  numberHandle = manifest.add(0x00, (const uint8_t*)"N", 1, number, length);
+}
+
+void loop() {
+  if (TRIGGER_PRESSED == digitalRead(CHANGE_BUTTON)) {
+    value++;
+    int length = TIVar::longToReal8x(value, number, CALC83P);
+    manifest.changed(numberHandle, length);
+    Serial.print("N is now ");
+    Serial.println(value);
+    delay(300);
+  }
+  if (TRIGGER_PRESSED != digitalRead(SYNC_BUTTON)) {
+    return;
+  }
+
+  int rval = manifest.sync(&link);
+  if (rval < 0) {
+    Serial.print("Failed to sync: ");
+    Serial.println(rval);
+  } else {
+    Serial.print("Sent ");
+    Serial.print(rval);
+    Serial.print(", up to date ");
+    Serial.println(manifest.skipped());
+  }
+  delay(300);
+}
@@ -0,0 +1,84 @@
+/*************************************************
+ *  TwoCalculators.ino                           *
+ *  Example from the ArTICL library              *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *                                               *
+ *  This demo is a CBL2 for two calculators at   *
+ *  once, each on its own pair of lines. Send(   *
+ *  a real from either calculator to turn its    *
+ *  LED on (nonzero) or off (0). Get( a real to  *
+ *  find out how many values that calculator     *
+ *  has sent. Each link has a StaticCBL2, which  *
+ *  owns its buffers, and a handler object that  *
+ *  holds its state, so there are no buffers or  *
+ *  callbacks to share.                          *
+ *************************************************/
+
+#include "CBL2.h"
+#include "TIVar.h"
+
+// Reals are the largest variables we exchange
+#define MAXDATALEN 16
+
+class LedLink: public CBL2Handler {
+  public:
+    LedLink(int led) : led_(led), count_(0) {}
+
+    void begin() {
+      pinMode(led_, OUTPUT);
+      digitalWrite(led_, LOW);
+    }
+
+    // A variable arrived from this link's calculator
+    int onGet(CBL2* cbl, uint8_t type, enum Endpoint model, int datalength) {
+      if (type != VarTypes82::VarReal) {
+        return -1;
+      }
+      long value = TIVar::realToLong8x(cbl->data(), model);
+      digitalWrite(led_, value ? HIGH : LOW);
+      count_++;
+      return 0;
+    }
+
+    // This link's calculator asked for a variable
+    int onSend(CBL2* cbl, uint8_t type, enum Endpoint model, int* headerlength,
+               int* datalength, data_callback* callback) {
+      if (type != VarTypes82::VarReal) {
+        return -1;
+      }
+      *datalength = TIVar::longToReal8x(count_, cbl->data(), model);
+      TIVar::intToSizeWord(*datalength, cbl->header());
+      *headerlength = 13;
+      return 0;
+    }
+
+  private:
+    int led_;
+    long count_;
+};
+
+StaticCBL2<MAXDATALEN> cbl1(DEFAULT_TIP, DEFAULT_RING);
+StaticCBL2<MAXDATALEN> cbl2(4, 5);
+LedLink link1(8);
+LedLink link2(9);
+
+void setup() {
+  link1.begin();
+  link2.begin();
+  cbl1.resetLines();
+  cbl2.resetLines();
+  cbl1.setupHandler(&link1);
+  cbl2.setupHandler(&link2);
+}
+
+// A calculator holds its first bit until it's answered, so look at
+// each link in turn, and only tick one that has a message coming.
+void loop() {
+  if (0 == cbl1.waitForLink(0)) {
+    cbl1.eventLoopTick(true);
+  }
+  if (0 == cbl2.waitForLink(0)) {
+    cbl2.eventLoopTick(true);
+  }
+}
@@ -18,10 +18,13 @@
 
 //#define VERBOSE
 
-CBL2* cbl;
 const int lineRed = 4;
 const int lineWhite = 3;
 
+// The CBL2 keeps a header buffer and a data buffer of this size itself
+#define MAXDATALEN 255
+StaticCBL2<MAXDATALEN> cbl(lineRed, lineWhite);
+
 #define ANALOG_PIN_COUNT 9
 const int analogPins[ANALOG_PIN_COUNT] = {30, 29, 28, 27, 26, 25, 24, 23, 2};
 
@@ -31,10 +34,6 @@ const int analogPins[ANALOG_PIN_COUNT] = {30, 29, 28, 27, 26, 25, 24, 23, 2};
 #define MULTIPLEXER_PIN_COUNT 9
 const int multiplexer_pins[MULTIPLEXER_PIN_COUNT] = {37, 36, 35, 34, 33, 32, 31, 11, 12};
 
-#define MAXDATALEN 255
-uint8_t header[16];
-uint8_t data[MAXDATALEN];
-
 // Forward function definitions.
 int onGetAsCBL2(uint8_t type, enum Endpoint model, int datalen);
 int onSendAsCBL2(uint8_t type, enum Endpoint model, int* headerlen,
@@ -43,18 +42,17 @@ int onSendAsCBL2(uint8_t type, enum Endpoint model, int* headerlen,
 // Set up serial for debugging, and CBL2 for communication
 void setup() {
 	Serial.begin(9600);
-	cbl = new CBL2(lineRed, lineWhite);
-	cbl->resetLines();
+	cbl.resetLines();
 #ifdef VERBOSE
-	cbl->setVerbosity(true, &Serial);  // Comment this in for message information
+	cbl.setVerbosity(true, &Serial);  // Comment this in for message information
 #endif
-	cbl->setupCallbacks(header, data, MAXDATALEN, onGetAsCBL2, onSendAsCBL2);                      
+	cbl.setupCallbacks(onGetAsCBL2, onSendAsCBL2);
 }
 
 // Main loop: Let CBL2 event handler do the work
 void loop() {
 	int rval;
-	rval = cbl->eventLoopTick();
+	rval = cbl.eventLoopTick();
 	if (rval && rval != ERR_READ_TIMEOUT) {
 		Serial.print("Failed to run eventLoopTick: code ");
 		Serial.println(rval);
@@ -75,6 +73,7 @@ void turnOffAllRGBLEDs() {
 }
 
 int onGetAsCBL2(uint8_t type, enum Endpoint model, int datalen) {
+	uint8_t* data = cbl.data();
 #ifdef VERBOSE
 	Serial.print("Got variable of type ");
 	Serial.print(type);
@@ -147,6 +146,8 @@ int onGetAsCBL2(uint8_t type, enum Endpoint model, int datalen) {
 int onSendAsCBL2(uint8_t type, enum Endpoint model, int* headerlen,
                  int* datalen, data_callback* data_callback)
 {
+	uint8_t* header = cbl.header();
+	uint8_t* data = cbl.data();
 	Serial.print("Got request for variable of type ");
 	Serial.print(type);
 	Serial.print(" from endpoint of type ");
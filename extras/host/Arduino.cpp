@@ -0,0 +1,277 @@
+/*************************************************
+ *  Arduino.cpp - The parts of the Arduino core  *
+ *           API that ArTICL uses, for building  *
+ *           the library on Linux hosts.         *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <mutex>
+
+#include "Arduino.h"
+#include "HardwareSerial.h"
+#include "HostGPIO.h"
+
+static uint64_t monotonicMicros() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+unsigned long micros() {
+	return (unsigned long)monotonicMicros();
+}
+
+unsigned long millis() {
+	return (unsigned long)(monotonicMicros() / 1000);
+}
+
+void delay(unsigned long ms) {
+	struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+	}
+}
+
+// Short delays spin, as on the Arduino: sleeping would oversleep
+// by far more than the delay itself.
+void delayMicroseconds(unsigned int us) {
+	uint64_t start = monotonicMicros();
+	while (monotonicMicros() - start < us) {
+	}
+}
+
+static std::mutex interruptLock;
+static thread_local bool masked;
+
+// As on the Arduino, masking twice and unmasking once unmasks
+void noInterrupts() {
+	if (!masked) {
+		interruptLock.lock();
+		masked = true;
+	}
+}
+
+void interrupts() {
+	if (masked) {
+		masked = false;
+		interruptLock.unlock();
+	}
+}
+
+void hostInterrupt(void (*handler)(void*), void* context) {
+	std::lock_guard<std::mutex> guard(interruptLock);
+	handler(context);
+}
+
+int analogRead(int pin) {
+	return 0;
+}
+
+void pinMode(int pin, int mode) {
+	PinBackend* backend = hostPinBackend();
+	if (backend) {
+		backend->mode(pin, mode);
+	}
+}
+
+// Lines with no backend read as released
+int digitalRead(int pin) {
+	PinBackend* backend = hostPinBackend();
+	return backend ? backend->read(pin) : HIGH;
+}
+
+void digitalWrite(int pin, int value) {
+	PinBackend* backend = hostPinBackend();
+	if (backend) {
+		backend->write(pin, value);
+	}
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+	size_t n = 0;
+	while (size--) {
+		n += write(*buffer++);
+	}
+	return n;
+}
+
+size_t Print::print(const char* s) {
+	return write((const uint8_t*)s, strlen(s));
+}
+
+size_t Print::print(char c) {
+	return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char n, int base) {
+	return printNumber(n, base);
+}
+
+size_t Print::print(int n, int base) {
+	return print((long)n, base);
+}
+
+size_t Print::print(unsigned int n, int base) {
+	return printNumber(n, base);
+}
+
+// Negative numbers are only signed in decimal, as on the Arduino
+size_t Print::print(long n, int base) {
+	if (base == DEC && n < 0) {
+		return print('-') + printNumber(-(unsigned long)n, base);
+	}
+	return printNumber((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+	return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits) {
+	char buffer[48];
+	snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+	return print(buffer);
+}
+
+size_t Print::println() {
+	return print("\r\n");
+}
+
+size_t Print::printNumber(unsigned long n, int base) {
+	char buffer[8 * sizeof(long) + 1];
+	char* p = &buffer[sizeof(buffer) - 1];
+	*p = '\0';
+	if (base < 2) {
+		base = DEC;
+	}
+	do {
+		int digit = n % base;
+		*--p = (digit < 10) ? ('0' + digit) : ('A' + digit - 10);
+		n /= base;
+	} while (n);
+	return print(p);
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+	size_t count = 0;
+	unsigned long start = millis();
+	while (count < length) {
+		int c = read();
+		if (c >= 0) {
+			buffer[count++] = (char)c;
+			start = millis();
+		} else if (millis() - start >= timeout_) {
+			break;
+		}
+	}
+	return count;
+}
+
+String::String(const char* s) {
+	length_ = strlen(s);
+	buffer_ = (char*)malloc(length_ + 1);
+	memcpy(buffer_, s, length_ + 1);
+}
+
+String::String(const String& other) {
+	length_ = other.length_;
+	buffer_ = (char*)malloc(length_ + 1);
+	memcpy(buffer_, other.buffer_, length_ + 1);
+}
+
+String::~String() {
+	free(buffer_);
+}
+
+String& String::operator=(const String& other) {
+	if (this != &other) {
+		char* buffer = (char*)malloc(other.length_ + 1);
+		memcpy(buffer, other.buffer_, other.length_ + 1);
+		free(buffer_);
+		buffer_ = buffer;
+		length_ = other.length_;
+	}
+	return *this;
+}
+
+bool String::concat(char c) {
+	char* buffer = (char*)realloc(buffer_, length_ + 2);
+	if (buffer == NULL) {
+		return false;
+	}
+	buffer_ = buffer;
+	buffer_[length_++] = c;
+	buffer_[length_] = '\0';
+	return true;
+}
+
+HardwareSerial Serial(STDIN_FILENO, STDOUT_FILENO);
+
+HardwareSerial::HardwareSerial(int infd, int outfd) {
+	infd_ = infd;
+	outfd_ = outfd;
+	peeked_ = -1;
+}
+
+int HardwareSerial::available() {
+	int count = 0;
+	if (ioctl(infd_, FIONREAD, &count) < 0) {
+		count = 0;
+	}
+	return count + (peeked_ >= 0 ? 1 : 0);
+}
+
+// Never blocks: returns -1 when nothing is waiting
+int HardwareSerial::read() {
+	if (peeked_ >= 0) {
+		int c = peeked_;
+		peeked_ = -1;
+		return c;
+	}
+	struct pollfd pfd = {infd_, POLLIN, 0};
+	uint8_t byte;
+	if (poll(&pfd, 1, 0) <= 0 || ::read(infd_, &byte, 1) != 1) {
+		return -1;
+	}
+	return byte;
+}
+
+int HardwareSerial::peek() {
+	if (peeked_ < 0) {
+		peeked_ = read();
+	}
+	return peeked_;
+}
+
+size_t HardwareSerial::write(uint8_t byte) {
+	return write(&byte, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = ::write(outfd_, buffer + done, size - done);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		done += n;
+	}
+	return done;
+}
+
+// Writes are only accepted while they won't block
+int HardwareSerial::availableForWrite() {
+	struct pollfd pfd = {outfd_, POLLOUT, 0};
+	return (poll(&pfd, 1, 0) > 0) ? 64 : 0;
+}
@@ -0,0 +1,114 @@
+/*************************************************
+ *  Arduino.h - The parts of the Arduino core    *
+ *           API that ArTICL uses, for building  *
+ *           the library on Linux hosts.         *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define HIGH			1
+#define LOW				0
+#define INPUT			0x0
+#define OUTPUT			0x1
+#define INPUT_PULLUP	0x2
+
+#define DEC				10
+#define HEX				16
+
+typedef bool boolean;
+
+// Functions rather than the AVR core's macros, so they can't clash
+// with the C++ standard library
+template<class T, class U> inline T min(T a, U b) { return (a < b) ? a : (T)b; }
+template<class T, class U> inline T max(T a, U b) { return (a > b) ? a : (T)b; }
+template<class T, class U, class V> inline T constrain(T x, U low, V high) {
+	return (x < low) ? (T)low : ((x > high) ? (T)high : x);
+}
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// There are no interrupts on the host. A thread standing in for an
+// interrupt handler runs it through hostInterrupt(), which waits while
+// another thread has them masked with noInterrupts().
+void noInterrupts();
+void interrupts();
+void hostInterrupt(void (*handler)(void*), void* context);
+
+// No ADC either: analog pins read 0. DataLogger's read callback can
+// stand in for one.
+int analogRead(int pin);
+
+// Pin numbers are mapped to GPIO lines by the PinBackend set with
+// hostSetPinBackend(); see HostGPIO.h.
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+void digitalWrite(int pin, int value);
+
+class Print {
+	public:
+		virtual ~Print() {}
+		virtual size_t write(uint8_t byte) = 0;
+		virtual size_t write(const uint8_t* buffer, size_t size);
+		virtual int availableForWrite() { return 0; }
+
+		size_t print(const char* s);
+		size_t print(char c);
+		size_t print(unsigned char n, int base = DEC);
+		size_t print(int n, int base = DEC);
+		size_t print(unsigned int n, int base = DEC);
+		size_t print(long n, int base = DEC);
+		size_t print(unsigned long n, int base = DEC);
+		size_t print(double n, int digits = 2);
+		size_t println();
+		template<class T> size_t println(T value) { return print(value) + println(); }
+		template<class T> size_t println(T value, int format) { return print(value, format) + println(); }
+
+	private:
+		size_t printNumber(unsigned long n, int base);
+};
+
+class Stream: public Print {
+	public:
+		virtual int available() = 0;
+		virtual int read() = 0;
+		virtual int peek() = 0;
+		size_t readBytes(char* buffer, size_t length);
+		size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+		void setTimeout(unsigned long timeout) { timeout_ = timeout; }
+
+	protected:
+		unsigned long timeout_ = 1000;
+};
+
+class String {
+	public:
+		String(const char* s = "");
+		String(const String& other);
+		~String();
+		String& operator=(const String& other);
+
+		unsigned int length() const { return length_; }
+		char operator[](unsigned int idx) const { return (idx < length_) ? buffer_[idx] : 0; }
+		bool concat(char c);
+		const char* c_str() const { return buffer_; }
+		bool operator==(const char* s) const { return strcmp(buffer_, s) == 0; }
+
+	private:
+		char* buffer_;
+		unsigned int length_;
+};
+
+#endif	// ARDUINO_H
@@ -0,0 +1,395 @@
+/*************************************************
+ *  AsyncLink.cpp - Coroutine versions of the    *
+ *           link operations for Linux hosts:    *
+ *           one thread drives many links.       *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "AsyncLink.h"
+#include "TIPacket.h"
+#include "TIVar.h"
+
+std::coroutine_handle<> LinkTask::promise_type::FinalAwaiter::await_suspend(
+	std::coroutine_handle<promise_type> handle) noexcept
+{
+	promise_type& promise = handle.promise();
+	if (promise.continuation) {
+		return promise.continuation;
+	}
+	if (promise.scheduler) {
+		promise.scheduler->finished(handle);
+	}
+	return std::noop_coroutine();
+}
+
+LinkTask::~LinkTask() {
+	if (handle_) {
+		handle_.destroy();
+	}
+}
+
+std::coroutine_handle<> LinkTask::await_suspend(std::coroutine_handle<> awaiter) {
+	handle_.promise().continuation = awaiter;
+	return handle_;
+}
+
+LinkScheduler::LineWait::LineWait(LinkScheduler* scheduler, int tip, int ring, uint8_t states,
+                                  unsigned long timeout)
+{
+	scheduler_ = scheduler;
+	tip_ = tip;
+	ring_ = ring;
+	states_ = states;
+	start_ = micros();
+	timeout_ = timeout;
+	state_ = 0x03;
+	met_ = false;
+}
+
+// No need to suspend if the lines are already where we want them
+bool LinkScheduler::LineWait::await_ready() {
+	return check();
+}
+
+void LinkScheduler::LineWait::await_suspend(std::coroutine_handle<> handle) {
+	handle_ = handle;
+	scheduler_->waiting_.push_back(this);
+}
+
+// True once the wait is over, either way
+bool LinkScheduler::LineWait::check() {
+	if (states_ != LINES_NEVER) {
+		state_ = (digitalRead(ring_) << 1) | digitalRead(tip_);
+		if (states_ & (1 << state_)) {
+			met_ = true;
+			return true;
+		}
+	}
+	return micros() - start_ > timeout_;
+}
+
+LinkScheduler::~LinkScheduler() {
+	for(size_t i = 0; i < spawned_.size(); i++) {
+		spawned_[i].handle.destroy();
+	}
+}
+
+void LinkScheduler::spawn(LinkTask&& task, void (*done)(int result, void* arg), void* arg) {
+	std::coroutine_handle<LinkTask::promise_type> handle = task.handle_;
+	task.handle_ = nullptr;
+	handle.promise().scheduler = this;
+	spawned_.push_back({handle, done, arg});
+	ready_.push_back(handle);
+}
+
+LinkScheduler::LineWait LinkScheduler::waitLines(int tip, int ring, uint8_t states, unsigned long timeout) {
+	return LineWait(this, tip, ring, states, timeout);
+}
+
+LinkScheduler::LineWait LinkScheduler::sleep(unsigned long us) {
+	return LineWait(this, -1, -1, LINES_NEVER, us);
+}
+
+bool LinkScheduler::runOnce() {
+	while (!ready_.empty()) {
+		std::coroutine_handle<> handle = ready_.front();
+		ready_.pop_front();
+		handle.resume();
+	}
+
+	// Resumed coroutines may start new waits, which go on the next round
+	std::vector<LineWait*> current;
+	current.swap(waiting_);
+	for(size_t i = 0; i < current.size(); i++) {
+		if (current[i]->check()) {
+			current[i]->handle_.resume();
+		} else {
+			waiting_.push_back(current[i]);
+		}
+	}
+
+	for(size_t i = 0; i < finished_.size(); i++) {
+		for(size_t j = 0; j < spawned_.size(); j++) {
+			if (spawned_[j].handle != finished_[i]) {
+				continue;
+			}
+			Spawned task = spawned_[j];
+			spawned_.erase(spawned_.begin() + j);
+			int result = task.handle.promise().result;
+			task.handle.destroy();
+			if (task.done) {
+				task.done(result, task.arg);
+			}
+			break;
+		}
+	}
+	finished_.clear();
+	return !spawned_.empty() || !ready_.empty();
+}
+
+void LinkScheduler::run() {
+	while (runOnce()) {
+	}
+}
+
+int LinkScheduler::pending() {
+	return spawned_.size();
+}
+
+void LinkScheduler::finished(std::coroutine_handle<LinkTask::promise_type> handle) {
+	finished_.push_back(handle);
+}
+
+AsyncLink::AsyncLink(LinkScheduler* scheduler, int tip, int ring) {
+	scheduler_ = scheduler;
+	tip_ = tip;
+	ring_ = ring;
+	retries_ = DEFAULT_RETRIES;
+}
+
+void AsyncLink::begin() {
+	resetLines();
+}
+
+void AsyncLink::resetLines() {
+	pinMode(ring_, INPUT_PULLUP);
+	pinMode(tip_, INPUT_PULLUP);
+}
+
+void AsyncLink::setRetries(int retries) {
+	retries_ = retries;
+}
+
+LinkTask AsyncLink::send(const uint8_t* header, const uint8_t* data, int datalength,
+                         uint8_t(*data_callback)(int))
+{
+	PacketSerializer packet;
+	packet.begin(header, data, datalength, data_callback);
+	int outbyte;
+	while ((outbyte = packet.next()) >= 0) {
+		int rval = co_await sendByte(outbyte);
+		if (rval) {
+			co_return rval;
+		}
+	}
+	co_return 0;
+}
+
+LinkTask AsyncLink::get(uint8_t* header, uint8_t* data, int* datalength, int maxlength,
+                        unsigned long timeout, void(*data_sink)(int, uint8_t))
+{
+	PacketParser packet;
+	enum PacketEvent event;
+	uint8_t inbyte;
+	int rval;
+
+	do {
+		if ((rval = co_await getByte(&inbyte, timeout))) {
+			co_return rval;
+		}
+		event = packet.push(inbyte);
+	} while (event == PACKET_NONE);
+	memcpy(header, packet.header(), PACKET_HEADER_LEN);
+	*datalength = (int)header[2] | ((int)header[3] << 8);
+	if (event == PACKET_COMPLETE) {
+		co_return 0;
+	}
+	if (data_sink == NULL && *datalength > maxlength) {
+		co_return ERR_BUFFER_OVERFLOW;
+	}
+
+	do {
+		if ((rval = co_await getByte(&inbyte))) {
+			co_return rval;
+		}
+		event = packet.push(inbyte);
+		if (event != PACKET_PAYLOAD) {
+			continue;
+		}
+		if (data_sink != NULL) {
+			data_sink(packet.dataIndex(), inbyte);
+		} else {
+			data[packet.dataIndex()] = inbyte;
+		}
+	} while (event == PACKET_NONE || event == PACKET_PAYLOAD);
+	co_return (event == PACKET_ERROR) ? ERR_BAD_CHECKSUM : 0;
+}
+
+// The same handshake as TICL::sendByte()
+LinkTask AsyncLink::sendByte(uint8_t byte) {
+	for(int bit = 0; bit < 8; bit++) {
+		if (!co_await scheduler_->waitLines(tip_, ring_, LINES_BOTH_HIGH, TIMEOUT)) {
+			resetLines();
+			co_return ERR_WRITE_TIMEOUT;
+		}
+
+		// Pull one line low, wait for the peer to pull the other low
+		// to acknowledge, then for it to release that line again
+		bool bitval = (byte & 1);
+		int line = bitval ? ring_ : tip_;
+		pinMode(line, OUTPUT);
+		digitalWrite(line, LOW);
+		if (!co_await scheduler_->waitLines(tip_, ring_, bitval ? LINES_TIP_LOW : LINES_RING_LOW, TIMEOUT)) {
+			resetLines();
+			co_return ERR_WRITE_TIMEOUT;
+		}
+		resetLines();
+		if (!co_await scheduler_->waitLines(tip_, ring_, bitval ? LINES_TIP_HIGH : LINES_RING_HIGH, TIMEOUT)) {
+			resetLines();
+			co_return ERR_WRITE_TIMEOUT;
+		}
+		resetLines();
+		byte >>= 1;
+	}
+	co_return 0;
+}
+
+// The same handshake as TICL::getByte()
+LinkTask AsyncLink::getByte(uint8_t* byte, unsigned long timeout) {
+	*byte = 0;
+	for(int bit = 0; bit < 8; bit++) {
+		LinkScheduler::LineWait bitwait = scheduler_->waitLines(tip_, ring_, LINES_EITHER_LOW, timeout);
+		if (!co_await bitwait) {
+			resetLines();
+			co_return ERR_READ_ENTER_TIMEOUT;
+		}
+
+		// Store the bit, acknowledge it, and wait for the peer to release
+		int linevals = bitwait.state();
+		*byte = (*byte >> 1) | ((linevals == 0x01) ? 0x80 : 0x00);
+		int line = (linevals == 0x01) ? tip_ : ring_;
+		pinMode(line, OUTPUT);
+		digitalWrite(line, LOW);
+		if (!co_await scheduler_->waitLines(tip_, ring_, (linevals == 0x01) ? LINES_RING_HIGH : LINES_TIP_HIGH,
+		                                    TIMEOUT))
+		{
+			resetLines();
+			co_return ERR_READ_TIMEOUT;
+		}
+		resetLines();
+	}
+	co_return 0;
+}
+
+LinkTask AsyncLink::getOrRetry(uint8_t* header, uint8_t* data, int* datalength, int maxlength,
+                               uint8_t machine_id, unsigned long timeout)
+{
+	int rval = co_await get(header, data, datalength, maxlength, timeout);
+	for(int retry = 0; rval == ERR_BAD_CHECKSUM && retry < retries_; retry++) {
+		if ((rval = co_await reply(machine_id, ERR))) {
+			co_return rval;
+		}
+		rval = co_await get(header, data, datalength, maxlength, timeout);
+	}
+	co_return rval;
+}
+
+LinkTask AsyncLink::sendAwaitAck(const uint8_t* header, const uint8_t* data, int datalength,
+                                 uint8_t(*data_callback)(int))
+{
+	uint8_t response[4];
+	uint8_t reason[1];
+	int length;
+	int rval;
+
+	for(int retry = 0; ; retry++) {
+		if ((rval = co_await send(header, data, datalength, data_callback)) ||
+		    (rval = co_await get(response, reason, &length, sizeof(reason))))
+		{
+			co_return rval;
+		}
+		if (response[1] != ERR || retry >= retries_) {
+			break;
+		}
+	}
+
+	switch(response[1]) {
+		case ACK:
+			co_return 0;
+		case ERR:
+			co_return ERR_BAD_CHECKSUM;
+		case SKIP:
+			co_return ERR_REJECTED;
+		default:
+			co_return ERR_INVALID;
+	}
+}
+
+// The same steps as CBL2::getFromCBL2()
+LinkTask AsyncLink::getFromCBL2(uint8_t type, uint8_t* header, uint8_t* data, int* datalength, int maxlength) {
+	uint8_t msg_header[4];
+	uint8_t endpoint = (type == 0x01) ? CALC85b : CALC82;
+	int length;
+
+	// Step 1: Send REQ, wait for ACK and VAR
+	msg_header[0] = endpoint;
+	msg_header[1] = REQ;
+	TIVar::intToSizeWord(11, &msg_header[2]);
+	if (co_await sendAwaitAck(msg_header, header, 11)) {
+		co_return -1;
+	}
+	if (co_await getOrRetry(msg_header, header, &length, 11, endpoint) || msg_header[1] != VAR) {
+		co_return -1;
+	}
+
+	// Step 2: ACK VAR, send CTS and wait for its ACK
+	if (co_await reply(endpoint, ACK)) {
+		co_return -1;
+	}
+	msg_header[0] = endpoint;
+	msg_header[1] = CTS;
+	msg_header[2] = msg_header[3] = 0;
+	if (co_await sendAwaitAck(msg_header, NULL, 0)) {
+		co_return -1;
+	}
+
+	// Step 3: Receive DATA and ACK it (do NOT perform EOT)
+	if (co_await getOrRetry(msg_header, data, datalength, maxlength, endpoint) || msg_header[1] != DATA) {
+		co_return -1;
+	}
+	co_return co_await reply(endpoint, ACK);
+}
+
+// The same steps as CBL2::sendToCBL2()
+LinkTask AsyncLink::sendToCBL2(uint8_t type, uint8_t* header, uint8_t* data, int datalength) {
+	uint8_t msg_header[4];
+	uint8_t endpoint = (type == 0x01) ? CALC85b : CALC82;
+	int length;
+
+	// Step 1: Send RTS, wait for ACK
+	msg_header[0] = endpoint;
+	msg_header[1] = RTS;
+	TIVar::intToSizeWord(11, &msg_header[2]);
+	if (co_await sendAwaitAck(msg_header, header, 11)) {
+		co_return -1;
+	}
+
+	// Step 2: Wait for CTS, ACK it
+	if (co_await get(msg_header, NULL, &length, 0) || msg_header[1] != CTS) {
+		co_return -1;
+	}
+	if (co_await reply(endpoint, ACK)) {
+		co_return -1;
+	}
+
+	// Step 3: Send DATA, wait for ACK
+	msg_header[0] = endpoint;
+	msg_header[1] = DATA;
+	TIVar::intToSizeWord(datalength, &msg_header[2]);
+	if (co_await sendAwaitAck(msg_header, data, datalength)) {
+		co_return -1;
+	}
+
+	// Step 4: Send EOT, wait for ACK
+	msg_header[0] = endpoint;
+	msg_header[1] = EOT;
+	msg_header[2] = msg_header[3] = 0;
+	co_return (co_await sendAwaitAck(msg_header, NULL, 0)) ? -1 : 0;
+}
+
+LinkTask AsyncLink::reply(uint8_t machine_id, uint8_t command) {
+	uint8_t msg_header[4] = {machine_id, command, 0x00, 0x00};
+	co_return co_await send(msg_header, NULL, 0);
+}
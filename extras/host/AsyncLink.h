@@ -0,0 +1,161 @@
+/*************************************************
+ *  AsyncLink.h - Coroutine versions of the link *
+ *           operations for Linux hosts: one     *
+ *           thread drives many links.           *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef ASYNCLINK_H
+#define ASYNCLINK_H
+
+#include <coroutine>
+#include <deque>
+#include <vector>
+
+#include "Arduino.h"
+#include "TICL.h"
+
+class LinkScheduler;
+
+// An operation on a link that finishes with a TICLErrors value (or 0),
+// like the blocking methods it mirrors. Starts when first awaited, or
+// when handed to LinkScheduler::spawn().
+class LinkTask {
+	public:
+		struct promise_type {
+			int result = 0;
+			std::coroutine_handle<> continuation;
+			LinkScheduler* scheduler = nullptr;		// Set for spawned tasks
+
+			LinkTask get_return_object() {
+				return LinkTask(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			struct FinalAwaiter {
+				bool await_ready() noexcept { return false; }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+				void await_resume() noexcept {}
+			};
+			FinalAwaiter final_suspend() noexcept { return {}; }
+			void return_value(int value) { result = value; }
+			void unhandled_exception() { abort(); }
+		};
+
+		LinkTask(LinkTask&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+		LinkTask(const LinkTask&) = delete;
+		~LinkTask();
+
+		// Awaiting a task runs it and resumes the awaiter when it's done
+		bool await_ready() { return false; }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter);
+		int await_resume() { return handle_.promise().result; }
+
+	private:
+		friend class LinkScheduler;
+		explicit LinkTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+		std::coroutine_handle<promise_type> handle_;
+};
+
+// Line states, as (ring << 1) | tip, that a waiting coroutine accepts
+#define LINES_BOTH_HIGH		(1 << 3)
+#define LINES_EITHER_LOW	((1 << 0) | (1 << 1) | (1 << 2))
+#define LINES_TIP_LOW		((1 << 0) | (1 << 2))
+#define LINES_TIP_HIGH		((1 << 1) | (1 << 3))
+#define LINES_RING_LOW		((1 << 0) | (1 << 1))
+#define LINES_RING_HIGH		((1 << 2) | (1 << 3))
+#define LINES_NEVER			0
+
+// Resumes each waiting coroutine when its lines reach a state it
+// accepts, or when its timeout expires. Not thread-safe: one thread
+// runs the scheduler and everything spawned on it.
+class LinkScheduler {
+	public:
+		class LineWait {
+			public:
+				LineWait(LinkScheduler* scheduler, int tip, int ring, uint8_t states, unsigned long timeout);
+				bool await_ready();
+				void await_suspend(std::coroutine_handle<> handle);
+				bool await_resume() { return met_; }	// False on timeout
+				int state() { return state_; }			// Lines when the wait ended
+
+			private:
+				friend class LinkScheduler;
+				bool check();
+
+				LinkScheduler* scheduler_;
+				int tip_;
+				int ring_;
+				uint8_t states_;
+				unsigned long start_;
+				unsigned long timeout_;
+				int state_;
+				bool met_;
+				std::coroutine_handle<> handle_;
+		};
+
+		~LinkScheduler();
+
+		// Run a task to completion in the background. done, if given, is
+		// called with its result.
+		void spawn(LinkTask&& task, void (*done)(int result, void* arg) = nullptr, void* arg = nullptr);
+		LineWait waitLines(int tip, int ring, uint8_t states, unsigned long timeout);
+		LineWait sleep(unsigned long us);
+
+		bool runOnce();						// Returns false once nothing is left
+		void run();
+		int pending();						// Spawned tasks not yet finished
+
+	private:
+		friend struct LinkTask::promise_type::FinalAwaiter;
+		struct Spawned {
+			std::coroutine_handle<LinkTask::promise_type> handle;
+			void (*done)(int, void*);
+			void* arg;
+		};
+
+		void finished(std::coroutine_handle<LinkTask::promise_type> handle);
+
+		std::deque<std::coroutine_handle<>> ready_;
+		std::vector<LineWait*> waiting_;
+		std::vector<Spawned> spawned_;
+		std::vector<std::coroutine_handle<LinkTask::promise_type> > finished_;
+};
+
+// The link operations of TICL and CBL2 as coroutines. The bit protocol
+// and timeouts are the same; waits suspend instead of spinning.
+class AsyncLink {
+	public:
+		AsyncLink(LinkScheduler* scheduler, int tip = DEFAULT_TIP, int ring = DEFAULT_RING);
+		void begin();
+		void resetLines();
+		void setRetries(int retries);
+
+		LinkTask send(const uint8_t* header, const uint8_t* data, int datalength,
+		              uint8_t(*data_callback)(int) = NULL);
+		LinkTask get(uint8_t* header, uint8_t* data, int* datalength, int maxlength,
+		             unsigned long timeout = GET_ENTER_TIMEOUT, void(*data_sink)(int, uint8_t) = NULL);
+		LinkTask sendByte(uint8_t byte);
+		LinkTask getByte(uint8_t* byte, unsigned long timeout = GET_ENTER_TIMEOUT);
+
+		LinkTask getOrRetry(uint8_t* header, uint8_t* data, int* datalength, int maxlength,
+		                    uint8_t machine_id, unsigned long timeout = GET_ENTER_TIMEOUT);
+		LinkTask sendAwaitAck(const uint8_t* header, const uint8_t* data, int datalength,
+		                      uint8_t(*data_callback)(int) = NULL);
+
+		// CBL2 transactions, as a calculator talking to a CBL2
+		LinkTask getFromCBL2(uint8_t type, uint8_t* header, uint8_t* data, int* datalength, int maxlength);
+		LinkTask sendToCBL2(uint8_t type, uint8_t* header, uint8_t* data, int datalength);
+
+	private:
+		LinkTask reply(uint8_t machine_id, uint8_t command);
+
+		LinkScheduler* scheduler_;
+		int tip_;
+		int ring_;
+		int retries_;
+};
+
+#endif	// ASYNCLINK_H
@@ -0,0 +1,231 @@
+/*************************************************
+ *  BridgePort.cpp - The computer's end of a     *
+ *           LinkBridge on a serial port, on     *
+ *           Linux hosts.                        *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "BridgePort.h"
+#include "TIVar.h"
+
+BridgePort::BridgePort() :
+	fd_(-1), owned_(false), start_(0), end_(0)
+{
+}
+
+BridgePort::~BridgePort() {
+	close();
+}
+
+static speed_t baudConstant(int baud) {
+	switch(baud) {
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 921600: return B921600;
+		default: return B115200;
+	}
+}
+
+int BridgePort::open(const char* path, int baud) {
+	close();
+	int fd = ::open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (fd < 0) {
+		return -errno;
+	}
+	struct termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, baudConstant(baud));
+		cfsetospeed(&tio, baudConstant(baud));
+		tio.c_cflag |= CLOCAL | CREAD;
+		if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+			int rval = -errno;
+			::close(fd);
+			return rval;
+		}
+	}
+	attach(fd);
+	owned_ = true;
+	return 0;
+}
+
+void BridgePort::attach(int fd) {
+	close();
+	fd_ = fd;
+	owned_ = false;
+	flush();
+}
+
+void BridgePort::close() {
+	if (owned_ && fd_ >= 0) {
+		::close(fd_);
+	}
+	fd_ = -1;
+	owned_ = false;
+}
+
+bool BridgePort::isOpen() {
+	return fd_ >= 0;
+}
+
+// Anything still on its way in is dropped too, so a calculator that
+// is late with the last answer can't be mistaken for the next one
+void BridgePort::flush() {
+	start_ = end_ = 0;
+	parser_.reset();
+	if (fd_ < 0) {
+		return;
+	}
+	struct pollfd pfd = {fd_, POLLIN, 0};
+	while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN)) {
+		if (::read(fd_, buffer_, sizeof(buffer_)) <= 0) {
+			break;
+		}
+	}
+}
+
+int BridgePort::write(const uint8_t* bytes, int length) {
+	int done = 0;
+	if (fd_ < 0) {
+		return -EBADF;
+	}
+	while (done < length) {
+		ssize_t n = ::write(fd_, bytes + done, length - done);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			return -errno;
+		}
+		done += n;
+	}
+	return 0;
+}
+
+int BridgePort::send(uint8_t machine, uint8_t command, const uint8_t* data, int datalength) {
+	uint8_t header[PACKET_HEADER_LEN] = {machine, command, 0x00, 0x00};
+	uint8_t packet[PACKET_HEADER_LEN + PORT_BUFFER_SIZE + 2];
+	TIVar::intToSizeWord(datalength, &header[2]);
+
+	PacketSerializer serializer;
+	serializer.begin(header, data, datalength);
+	int length;
+	while ((length = serializer.read(packet, sizeof(packet))) > 0) {
+		int rval = write(packet, length);
+		if (rval) {
+			return rval;
+		}
+	}
+	return 0;
+}
+
+// Read whatever has arrived, waiting until the deadline for some
+int BridgePort::fill(unsigned long deadline) {
+	unsigned long now = millis();
+	int wait = (deadline > now) ? deadline - now : 0;
+	struct pollfd pfd = {fd_, POLLIN, 0};
+	int ready = poll(&pfd, 1, wait);
+	if (ready < 0) {
+		return (errno == EINTR) ? 0 : -errno;
+	}
+	if (ready == 0) {
+		return ERR_READ_TIMEOUT;
+	}
+	ssize_t n = ::read(fd_, buffer_, sizeof(buffer_));
+	if (n < 0) {
+		return (errno == EINTR || errno == EAGAIN) ? 0 : -errno;
+	}
+	if (n == 0) {
+		return -EIO;						// The other end hung up
+	}
+	start_ = 0;
+	end_ = n;
+	return 0;
+}
+
+int BridgePort::get(uint8_t* header, uint8_t* data, int* datalength, int maxlength, int timeout) {
+	unsigned long deadline = millis() + timeout;
+	bool overflow = false;
+	if (fd_ < 0) {
+		return -EBADF;
+	}
+
+	while (true) {
+		while (start_ < end_) {
+			uint8_t byte = buffer_[start_++];
+			enum PacketEvent event = parser_.push(byte);
+			if (event == PACKET_PAYLOAD) {
+				int index = parser_.dataIndex();
+				if (data != NULL && index < maxlength) {
+					data[index] = byte;
+				} else {
+					overflow = true;
+				}
+			} else if (event == PACKET_ERROR) {
+				return ERR_BAD_CHECKSUM;
+			} else if (event == PACKET_COMPLETE) {
+				memcpy(header, parser_.header(), PACKET_HEADER_LEN);
+				if (datalength != NULL) {
+					*datalength = parser_.dataLength();
+				}
+				return overflow ? ERR_BUFFER_OVERFLOW : 0;
+			}
+		}
+		int rval = fill(deadline);
+		if (rval) {
+			return rval;
+		}
+	}
+}
+
+int BridgePort::expect(uint8_t command, uint8_t machine, int timeout) {
+	uint8_t header[PACKET_HEADER_LEN];
+	uint8_t reason[1];
+	int length;
+	int rval = get(header, reason, &length, sizeof(reason), timeout);
+	if (rval) {
+		return rval;
+	}
+	if (header[1] == command) {
+		return 0;
+	}
+	if (header[1] == SKIP) {
+		send(machine, ACK);
+		return ERR_REJECTED;
+	}
+	return ERR_INVALID;
+}
+
+int BridgePort::bridgeStatus(uint16_t* counters, int timeout) {
+	uint8_t header[PACKET_HEADER_LEN];
+	uint8_t report[BRIDGE_STATUS_LEN];
+	int length;
+	int rval = send(BRIDGE_ID, RDY);
+	if (rval || (rval = get(header, report, &length, sizeof(report), timeout))) {
+		return rval;
+	}
+	if (header[0] != BRIDGE_ID || header[1] != DATA || length != BRIDGE_STATUS_LEN) {
+		return ERR_INVALID;
+	}
+	for(int i = 0; i < BRIDGE_STATUS_LEN / 2; i++) {
+		counters[i] = TIVar::sizeWordToInt(&report[2 * i]);
+	}
+	return 0;
+}
+
+int BridgePort::ready(uint8_t machine, int timeout) {
+	int rval = send(machine, RDY);
+	return rval ? rval : expect(ACK, machine, timeout);
+}
@@ -0,0 +1,71 @@
+/*************************************************
+ *  BridgePort.h - The computer's end of a       *
+ *           LinkBridge on a serial port, on     *
+ *           Linux hosts.                        *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef BRIDGEPORT_H
+#define BRIDGEPORT_H
+
+#include "Arduino.h"
+#include "LinkBridge.h"
+#include "TICL.h"
+#include "TIPacket.h"
+
+#define PORT_TIMEOUT_MS		2000		// A calculator's answer, through the bridge
+#define PORT_BUFFER_SIZE	256			// Bytes read from the port at once
+
+// Speaks the silent link through a LinkBridge: whole packets go to the
+// serial port, and whatever the calculator sends comes back framed
+// the same way. Functions return 0, a TICLErrors value, or a negative
+// errno if the port itself failed. Timeouts are in milliseconds, as the
+// bridge adds the serial port's latency to every packet.
+class BridgePort {
+	public:
+		BridgePort();
+		~BridgePort();
+
+		// A serial port is put in raw mode at the given rate. A
+		// descriptor that's already open, such as a pseudo-terminal,
+		// is used as it is and left open by close().
+		int open(const char* path, int baud = 115200);
+		void attach(int fd);
+		void close();
+		bool isOpen();
+
+		// Drop whatever hasn't been read, to start over after an error
+		void flush();
+
+		// Packets that are already serialized, as PacketSerializer
+		// makes them, go out unchanged
+		int write(const uint8_t* bytes, int length);
+		int send(uint8_t machine, uint8_t command, const uint8_t* data = NULL, int datalength = 0);
+		int get(uint8_t* header, uint8_t* data, int* datalength, int maxlength,
+		        int timeout = PORT_TIMEOUT_MS);
+
+		// The next packet should be command. A SKIP instead means the
+		// calculator refused, and is ACKed from machine.
+		int expect(uint8_t command, uint8_t machine, int timeout = PORT_TIMEOUT_MS);
+
+		// Whether a bridge is on the port: its BridgeStatus words, in
+		// order, if it answers
+		int bridgeStatus(uint16_t* counters, int timeout = PORT_TIMEOUT_MS);
+
+		// Whether a calculator is on the bridge: RDY, answered with ACK
+		int ready(uint8_t machine, int timeout = PORT_TIMEOUT_MS);
+
+	private:
+		int fill(unsigned long deadline);
+
+		int fd_;
+		bool owned_;
+		PacketParser parser_;
+		uint8_t buffer_[PORT_BUFFER_SIZE];
+		int start_;							// Bytes read but not yet parsed are start_ to end_
+		int end_;
+};
+
+#endif	// BRIDGEPORT_H
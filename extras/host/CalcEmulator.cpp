@@ -0,0 +1,364 @@
+/*************************************************
+ *  CalcEmulator.cpp - A TI-83+/84+ calculator   *
+ *           for the other end of a simulated    *
+ *           link, at the packet level, on Linux *
+ *           hosts.                              *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include "CalcEmulator.h"
+#include "CBL2.h"
+#include "SilentLink.h"
+#include "TIVar.h"
+
+CalcEmulator::CalcEmulator(int tip, int ring, enum EmulatedModel model) :
+	TICL(tip, ring)
+{
+	model_ = model;
+	for(int i = 0; i < EMU_SCREEN_SIZE; i++) {
+		screen_[i] = (i & 1) ? 0xAA : 0x55;		// A checkerboard, so a bad copy shows
+	}
+}
+
+enum EmulatedModel CalcEmulator::model() {
+	return model_;
+}
+
+int CalcEmulator::setVar(uint8_t type, const char* name, const uint8_t* data, int datalength) {
+	uint8_t padded[EMU_NAME_LEN];
+	memset(padded, 0, sizeof(padded));
+	for(int i = 0; i < EMU_NAME_LEN && name[i]; i++) {
+		padded[i] = name[i];
+	}
+
+	struct EmulatedVar* var = findVar(type, padded);
+	if (var == NULL) {
+		struct EmulatedVar added;
+		added.type = type;
+		memcpy(added.name, padded, EMU_NAME_LEN);
+		vars_.push_back(added);
+		var = &vars_.back();
+	}
+	var->data.assign(data, data + datalength);
+	return 0;
+}
+
+struct EmulatedVar* CalcEmulator::findVar(uint8_t type, const uint8_t* name) {
+	for(size_t i = 0; i < vars_.size(); i++) {
+		if (vars_[i].type == type && 0 == strncmp((const char*)vars_[i].name, (const char*)name, EMU_NAME_LEN)) {
+			return &vars_[i];
+		}
+	}
+	return NULL;
+}
+
+void CalcEmulator::clearVars() {
+	vars_.clear();
+}
+
+uint8_t* CalcEmulator::screen() {
+	return screen_;
+}
+
+const std::vector<uint16_t>& CalcEmulator::keys() {
+	return keys_;
+}
+
+int CalcEmulator::programSendReal(double value) {
+	uint8_t real[16];
+	int length = TIVar::floatToReal8x(value, real, CALC82);
+	return programSend(VarTypes82::VarReal, real, length);
+}
+
+// Lists go to the CBL2 from the TI-85 machine ID, so their elements
+// are TI-85 reals
+int CalcEmulator::programSendList(const double* values, int count) {
+	int size = TIVar::sizeOfReal(CALC85b);
+	if (2 + count * size > EMU_MAX_DATA) {
+		return ERR_BUFFER_OVERFLOW;
+	}
+	uint8_t list[EMU_MAX_DATA];
+	TIVar::intToSizeWord(count, list);
+	for(int i = 0; i < count; i++) {
+		TIVar::floatToReal8x(values[i], &list[2 + i * size], CALC85b);
+	}
+	return programSend(VarTypes82::VarRList, list, 2 + count * size);
+}
+
+int CalcEmulator::programSendString(const char* str) {
+	uint8_t strvar[EMU_MAX_DATA];
+	int length = TIVar::stringToStrVar8x(String(str), strvar, CALC82);
+	if (length < 0) {
+		return ERR_INVALID;
+	}
+	return programSend(VarTypes82::VarString, strvar, length);
+}
+
+// Send( as the calculator really labels it: lists go from the 85
+// machine ID, and the 84+ family disguises lists and strings.
+int CalcEmulator::programSend(uint8_t type, const uint8_t* data, int datalength) {
+	uint8_t name[EMU_NAME_LEN];
+	uint8_t machine = CALC82;
+	memset(name, 0, sizeof(name));
+
+	switch(type) {
+		case VarTypes82::VarRList:
+			machine = CALC85b;
+			name[0] = 0x5D;						// tVarLst, L1
+			if (model_ == EMU_TI84P) {
+				type = VarTypes82::VarString;
+				name[0] = VarTypes82::VarRList;
+			} else if (model_ == EMU_TI84PCSE) {
+				type = VarTypes84PCSE::VarRList;
+			}
+			break;
+		case VarTypes82::VarString:
+			name[0] = 0xAA;						// tVarStr, Str1
+			if (model_ != EMU_TI83P) {
+				type = VarTypes82::VarReal;
+			}
+			break;
+		default:
+			name[0] = 'A';
+			break;
+	}
+
+	// RTS, wait for its ACK and the CTS, and ACK that
+	uint8_t msg_header[4] = {machine, RTS, 11, 0};
+	uint8_t header[11];
+	int rval;
+	TIVar::intToSizeWord(datalength, header);
+	header[2] = type;
+	memcpy(&header[3], name, EMU_NAME_LEN);
+	if ((rval = sendAwaitAck(msg_header, header, sizeof(header))) || (rval = expect(CTS)) ||
+	    (rval = reply(ACK, machine)))
+	{
+		return rval;
+	}
+
+	// DATA, then EOT
+	msg_header[1] = DATA;
+	TIVar::intToSizeWord(datalength, &msg_header[2]);
+	if ((rval = sendAwaitAck(msg_header, (uint8_t*)data, datalength)) || (rval = reply(EOT, machine))) {
+		return rval;
+	}
+	return expect(ACK);
+}
+
+// Get( from the CBL2. The answer's variable header may be the long
+// TI-83+ form.
+int CalcEmulator::programGet(uint8_t type, const char* name, uint8_t* data, int* datalength, int maxlength) {
+	uint8_t machine = (type == VarTypes82::VarRList) ? CALC85b : CALC82;
+	uint8_t msg_header[4] = {machine, REQ, 11, 0};
+	uint8_t header[EMU_VAR_HEADER_LEN + 3];
+	int length;
+	int rval;
+
+	memset(header, 0, sizeof(header));
+	header[2] = type;
+	for(int i = 0; i < EMU_NAME_LEN && name[i]; i++) {
+		header[3 + i] = name[i];
+	}
+	if ((rval = sendAwaitAck(msg_header, header, 11))) {
+		return rval;
+	}
+	if ((rval = getOrRetry(msg_header, header, &length, sizeof(header), machine))) {
+		return rval;
+	}
+	if (msg_header[1] == SKIP) {
+		reply(ACK, machine);
+		return ERR_REJECTED;			// The CBL2 has no such variable
+	}
+	if (msg_header[1] != VAR) {
+		return ERR_INVALID;
+	}
+	if ((rval = reply(ACK, machine)) || (rval = reply(CTS, machine)) || (rval = expect(ACK))) {
+		return rval;
+	}
+	if ((rval = getOrRetry(msg_header, data, datalength, maxlength, machine))) {
+		return rval;
+	}
+	if (msg_header[1] != DATA) {
+		return ERR_INVALID;
+	}
+	setVar(type, name, data, *datalength);
+	return reply(ACK, machine);
+}
+
+int CalcEmulator::serviceTick(int timeout) {
+	uint8_t header[4];
+	int length;
+	int rval = getOrRetry(header, buffer_, &length, sizeof(buffer_), CALC83P, timeout);
+	if (rval == ERR_READ_ENTER_TIMEOUT) {
+		return 1;
+	}
+	if (rval) {
+		return rval;
+	}
+
+	switch(header[1]) {
+		case RDY:
+			return reply(ACK, CALC83P);
+		case SCR:
+			return answerScreen();
+		case VER:
+			return answerVersion();
+		case KEY:
+			// Acknowledged once on receipt and again when the key is done
+			if ((rval = reply(ACK, CALC83P))) {
+				return rval;
+			}
+			keys_.push_back(header[2] | (header[3] << 8));
+			return reply(ACK, CALC83P);
+		case RTS:
+			return answerSend(buffer_, length);
+		case REQ:
+			return answerRequest(buffer_, length);
+		default:
+			return ERR_INVALID;
+	}
+}
+
+// A variable from the computer: ACK and CTS, then its ACK, the
+// DATA, and the EOT that ends the exchange
+int CalcEmulator::answerSend(const uint8_t* header, int length) {
+	uint8_t msg_header[4];
+	uint8_t var_header[EMU_VAR_HEADER_LEN];
+	int datalength;
+	int rval;
+
+	if (length < 11) {
+		return ERR_INVALID;
+	}
+	memcpy(var_header, header, 11);
+	if ((rval = reply(ACK, CALC83P)) || (rval = reply(CTS, CALC83P)) || (rval = expect(ACK))) {
+		return rval;
+	}
+	if ((rval = getOrRetry(msg_header, buffer_, &datalength, sizeof(buffer_), CALC83P))) {
+		return rval;
+	}
+	if (msg_header[1] != DATA) {
+		return ERR_INVALID;
+	}
+
+	char name[EMU_NAME_LEN + 1];
+	memcpy(name, &var_header[3], EMU_NAME_LEN);
+	name[EMU_NAME_LEN] = '\0';
+	setVar(var_header[2], name, buffer_, datalength);
+	if ((rval = reply(ACK, CALC83P)) || (rval = expect(EOT))) {
+		return rval;
+	}
+	return reply(ACK, CALC83P);
+}
+
+// A request for a variable: ACK, then the VAR with the long header
+// (or SKIP if there's no such variable), its ACK and CTS, and DATA
+int CalcEmulator::answerRequest(const uint8_t* header, int length) {
+	int rval;
+	if (length < 11) {
+		return ERR_INVALID;
+	}
+	if ((rval = reply(ACK, CALC83P))) {
+		return rval;
+	}
+	if (header[2] == SILENT_DIRECTORY) {
+		return answerDirectory();
+	}
+
+	struct EmulatedVar* var = findVar(header[2], &header[3]);
+	if (var == NULL) {
+		uint8_t msg_header[4] = {CALC83P, SKIP, 1, 0};
+		uint8_t reason = 0x01;
+		return send(msg_header, &reason, 1);
+	}
+
+	uint8_t msg_header[4] = {CALC83P, VAR, EMU_VAR_HEADER_LEN, 0};
+	uint8_t var_header[EMU_VAR_HEADER_LEN];
+	memset(var_header, 0, sizeof(var_header));
+	TIVar::intToSizeWord(var->data.size(), var_header);
+	var_header[2] = var->type;
+	memcpy(&var_header[3], var->name, EMU_NAME_LEN);
+	if ((rval = sendAwaitAck(msg_header, var_header, sizeof(var_header))) || (rval = expect(CTS)) ||
+	    (rval = reply(ACK, CALC83P)))
+	{
+		return rval;
+	}
+
+	msg_header[1] = DATA;
+	TIVar::intToSizeWord(var->data.size(), &msg_header[2]);
+	return sendAwaitAck(msg_header, var->data.data(), var->data.size());
+}
+
+// The directory: free RAM as DATA, then a VAR for each variable, each
+// ACKed by the computer, and an EOT
+int CalcEmulator::answerDirectory() {
+	uint8_t msg_header[4] = {CALC83P, DATA, 2, 0};
+	uint8_t free[2];
+	int used = 0;
+	int rval;
+
+	for(size_t i = 0; i < vars_.size(); i++) {
+		used += vars_[i].data.size();
+	}
+	TIVar::intToSizeWord(max(EMU_RAM - used, 0), free);
+	if ((rval = sendAwaitAck(msg_header, free, sizeof(free)))) {
+		return rval;
+	}
+	for(size_t i = 0; i < vars_.size(); i++) {
+		uint8_t var_header[EMU_VAR_HEADER_LEN];
+		memset(var_header, 0, sizeof(var_header));
+		TIVar::intToSizeWord(vars_[i].data.size(), var_header);
+		var_header[2] = vars_[i].type;
+		memcpy(&var_header[3], vars_[i].name, EMU_NAME_LEN);
+		msg_header[1] = VAR;
+		TIVar::intToSizeWord(sizeof(var_header), &msg_header[2]);
+		if ((rval = sendAwaitAck(msg_header, var_header, sizeof(var_header)))) {
+			return rval;
+		}
+	}
+	return reply(EOT, CALC83P);
+}
+
+int CalcEmulator::answerScreen() {
+	int rval = reply(ACK, CALC83P);
+	if (rval) {
+		return rval;
+	}
+	uint8_t msg_header[4] = {CALC83P, DATA, 0, 0};
+	TIVar::intToSizeWord(EMU_SCREEN_SIZE, &msg_header[2]);
+	return sendAwaitAck(msg_header, screen_, EMU_SCREEN_SIZE);
+}
+
+// VER: ACK, the computer's CTS and its ACK, then the version as DATA.
+// OS 2.55, boot code 1.02, and the hardware byte of the model.
+int CalcEmulator::answerVersion() {
+	static const uint8_t hardware[] = {0x00, 0x02, 0x04};
+	uint8_t version[VER_LENGTH] = {2, 55, 1, 2, 0x01, 0, 0x09, 0, 0, 0, 0};
+	int rval;
+
+	version[VER_HARDWARE] = hardware[model_];
+	if ((rval = reply(ACK, CALC83P)) || (rval = expect(CTS)) || (rval = reply(ACK, CALC83P))) {
+		return rval;
+	}
+	uint8_t msg_header[4] = {CALC83P, DATA, VER_LENGTH, 0};
+	return sendAwaitAck(msg_header, version, VER_LENGTH);
+}
+
+int CalcEmulator::reply(uint8_t command, uint8_t machine) {
+	uint8_t msg_header[4] = {machine, command, 0, 0};
+	return send(msg_header, NULL, 0);
+}
+
+// Get a packet, which has to be the given command
+int CalcEmulator::expect(uint8_t command) {
+	uint8_t msg_header[4];
+	uint8_t data[16];
+	int length;
+	int rval = get(msg_header, data, &length, sizeof(data));
+	if (rval) {
+		return rval;
+	}
+	return (msg_header[1] == command) ? 0 : ERR_INVALID;
+}
@@ -0,0 +1,90 @@
+/*************************************************
+ *  CalcEmulator.h - A TI-83+/84+ calculator for *
+ *           the other end of a simulated link,  *
+ *           at the packet level, on Linux       *
+ *           hosts.                              *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef CALCEMULATOR_H
+#define CALCEMULATOR_H
+
+#include <vector>
+
+#include "Arduino.h"
+#include "TICL.h"
+
+#define EMU_SCREEN_SIZE		768				// 96x64 monochrome LCD, as SCR sends it
+#define EMU_MAX_DATA		4096			// Largest variable the emulator accepts
+#define EMU_VAR_HEADER_LEN	13				// TI-83+ silent-link variable header
+#define EMU_NAME_LEN		8
+#define EMU_RAM				24000			// User RAM, for the free memory in a directory
+
+// The models differ in how a program's Send( to a CBL2 labels its
+// variable, which is what CBL2::normalizeVariableHeader() undoes.
+enum EmulatedModel {
+	EMU_TI83P = 0,			// Lists and strings with their own types
+	EMU_TI84P = 1,			// Lists as "string" type named L, strings as reals named Str
+	EMU_TI84PCSE = 2,		// As the 84+, but lists with the CSE list type
+};
+
+struct EmulatedVar {
+	uint8_t type;
+	uint8_t name[EMU_NAME_LEN];
+	std::vector<uint8_t> data;				// As sent in DATA: size word first for lists and strings
+};
+
+// Plays a calculator on a pair of pins, for benchmarking and
+// checking the library without hardware. Both sides of a calculator's
+// link traffic are covered: programs running Send( and Get( against a
+// CBL2, and the silent link a computer (or a TICL) drives, with RDY,
+// SCR, KEY, VER, variable transfers and directory listings. Per-bit latency is a matter
+// for the pins: see DelayedPins.
+class CalcEmulator: public TICL {
+	public:
+		CalcEmulator(int tip, int ring, enum EmulatedModel model = EMU_TI84P);
+		enum EmulatedModel model();
+
+		// The calculator's memory
+		int setVar(uint8_t type, const char* name, const uint8_t* data, int datalength);
+		struct EmulatedVar* findVar(uint8_t type, const uint8_t* name);
+		void clearVars();
+		uint8_t* screen();
+		const std::vector<uint16_t>& keys();			// Keys pressed over the link
+
+		// A program's Send( and Get( to a CBL2. The value goes out with
+		// the header this model really uses; what comes back from Get(
+		// is stored under name too.
+		int programSendReal(double value);
+		int programSendList(const double* values, int count);
+		int programSendString(const char* str);
+		int programSend(uint8_t type, const uint8_t* data, int datalength);
+		int programGet(uint8_t type, const char* name, uint8_t* data, int* datalength, int maxlength);
+
+		// Answer one request from the computer side. Returns 0 after a
+		// complete exchange, 1 if nothing arrived, or a TICLErrors value.
+		// Packets a calculator doesn't understand, such as a fast-mode
+		// offer, are dropped without an answer.
+		int serviceTick(int timeout = GET_ENTER_TIMEOUT);
+
+	private:
+		int sendVarPacket(uint8_t machine, uint8_t type, const uint8_t* name, int headerlength,
+		                  const uint8_t* data, int datalength);
+		int reply(uint8_t command, uint8_t machine);
+		int expect(uint8_t command);
+		int answerRequest(const uint8_t* header, int length);
+		int answerSend(const uint8_t* header, int length);
+		int answerDirectory();
+		int answerScreen();
+		int answerVersion();
+
+		enum EmulatedModel model_;
+		std::vector<struct EmulatedVar> vars_;
+		std::vector<uint16_t> keys_;
+		uint8_t screen_[EMU_SCREEN_SIZE];
+		uint8_t buffer_[EMU_MAX_DATA];
+};
+
+#endif	// CALCEMULATOR_H
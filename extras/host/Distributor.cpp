@@ -0,0 +1,363 @@
+/*************************************************
+ *  Distributor.cpp - Sends one bundle of        *
+ *           variables to the calculators on     *
+ *           many LinkBridges at once, on Linux  *
+ *           hosts.                              *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <thread>
+
+#include "Distributor.h"
+#include "TIFile.h"
+#include "TIPacket.h"
+#include "TIVar.h"
+
+// A file as the Stream TIFileReader reads from
+class FileStream: public Stream {
+	public:
+		FileStream(FILE* file) : file_(file) {}
+		int available() { return feof(file_) ? 0 : 1; }
+		int read() { return fgetc(file_); }
+		int peek() {
+			int c = fgetc(file_);
+			if (c != EOF) {
+				ungetc(c, file_);
+			}
+			return c;
+		}
+		size_t write(uint8_t byte) { return 0; }
+
+	private:
+		FILE* file_;
+};
+
+Bundle::Bundle(uint8_t machine) :
+	machine_(machine)
+{
+}
+
+static void serialize(std::vector<uint8_t>* out, uint8_t machine, uint8_t command,
+                      const uint8_t* data, int datalength)
+{
+	uint8_t header[PACKET_HEADER_LEN] = {machine, command, 0x00, 0x00};
+	TIVar::intToSizeWord(datalength, &header[2]);
+	PacketSerializer serializer;
+	serializer.begin(header, data, datalength);
+	out->resize(serializer.remaining());
+	serializer.read(out->data(), out->size());
+}
+
+int Bundle::add(const uint8_t* header, int headerlength, const uint8_t* data, int datalength) {
+	if (headerlength < 11 || headerlength > TIFILE_MAX_VAR_HEADER || datalength < 0 ||
+	    datalength > 0xffff)
+	{
+		return ERR_INVALID;
+	}
+	struct Packed var;
+	serialize(&var.rts, machine_, RTS, header, headerlength);
+	serialize(&var.data, machine_, DATA, data, datalength);
+	var.datalength = datalength;
+	memset(var.name, 0, sizeof(var.name));
+	for(int i = 0; i < DIST_NAME_LEN && header[3 + i]; i++) {
+		var.name[i] = header[3 + i];
+	}
+	vars_.push_back(var);
+	return vars_.size() - 1;
+}
+
+int Bundle::addFile(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		return -errno;
+	}
+	FileStream stream(file);
+	TIFileReader reader;
+	uint8_t header[TIFILE_MAX_VAR_HEADER];
+	std::vector<uint8_t> data;
+	int headerlength;
+	int datalength;
+	int added = 0;
+	int rval = reader.begin(&stream);
+	while (rval == 0 && 0 == (rval = reader.nextEntry(header, &headerlength, &datalength))) {
+		data.resize(datalength);
+		if ((rval = reader.read(data.data(), datalength)) < 0 ||
+		    (rval = add(header, headerlength, data.data(), datalength)) < 0)
+		{
+			break;
+		}
+		added++;
+		rval = 0;
+	}
+	if (rval == 1) {
+		rval = reader.finish();
+	}
+	fclose(file);
+	return rval < 0 ? rval : added;
+}
+
+int Bundle::count() {
+	return vars_.size();
+}
+
+long Bundle::bytes() {
+	long total = 0;
+	for(size_t i = 0; i < vars_.size(); i++) {
+		total += vars_[i].datalength;
+	}
+	return total;
+}
+
+const char* Bundle::name(int index) {
+	return vars_[index].name;
+}
+
+Distributor::Distributor(Bundle* bundle) :
+	bundle_(bundle), progress_(NULL), context_(NULL), retries_(DIST_RETRIES),
+	timeout_(PORT_TIMEOUT_MS), steals_(0)
+{
+}
+
+Distributor::~Distributor() {
+	for(size_t i = 0; i < devices_.size(); i++) {
+		delete devices_[i];
+	}
+}
+
+int Distributor::addDevice(const char* path) {
+	struct Device* device = new Device();
+	snprintf(device->path, sizeof(device->path), "%s", path);
+	device->attached = false;
+	memset(&device->status, 0, sizeof(device->status));
+	device->status.index = devices_.size();
+	device->status.name = device->path;
+	devices_.push_back(device);
+	return device->status.index;
+}
+
+int Distributor::addDevice(int fd, const char* name) {
+	int index = addDevice(name);
+	devices_[index]->port.attach(fd);
+	devices_[index]->attached = true;
+	return index;
+}
+
+int Distributor::devices() {
+	return devices_.size();
+}
+
+void Distributor::setRetries(int retries) {
+	retries_ = retries;
+}
+
+void Distributor::setTimeout(int timeout) {
+	timeout_ = timeout;
+}
+
+void Distributor::setProgress(progress_callback progress, void* context) {
+	progress_ = progress;
+	context_ = context;
+}
+
+int Distributor::run(int threads) {
+	threads = constrain(threads, 1, max((int)devices_.size(), 1));
+	for(int i = 0; i < threads; i++) {
+		queues_.push_back(new WorkQueue());
+	}
+	for(size_t i = 0; i < devices_.size(); i++) {
+		struct DeviceStatus* status = &devices_[i]->status;
+		status->state = DEVICE_WAITING;
+		status->sent = 0;
+		status->bytes = 0;
+		status->attempts = 0;
+		status->error = 0;
+		status->step = NULL;
+		status->millis = 0;
+		status->retryat = 0;
+		queues_[i % threads]->jobs.push_back(i);
+	}
+	steals_ = 0;
+
+	std::vector<std::thread> workers;
+	for(int i = 0; i < threads; i++) {
+		workers.push_back(std::thread(&Distributor::work, this, i));
+	}
+	for(int i = 0; i < threads; i++) {
+		workers[i].join();
+	}
+	for(int i = 0; i < threads; i++) {
+		delete queues_[i];					// Only once no one can steal from it
+	}
+	queues_.clear();
+
+	int failed = 0;
+	for(size_t i = 0; i < devices_.size(); i++) {
+		failed += (devices_[i]->status.state != DEVICE_DONE);
+	}
+	return failed;
+}
+
+struct DeviceStatus Distributor::status(int device) {
+	std::lock_guard<std::mutex> guard(report_);
+	return devices_[device]->status;
+}
+
+unsigned long Distributor::steals() {
+	return steals_;
+}
+
+// Nothing is ever added to another worker's deque, so a worker whose
+// deque is empty and finds nothing to take is done: a device that
+// fails is put back by the worker that ran it, which is still busy.
+bool Distributor::take(int self, int* job) {
+	{
+		std::lock_guard<std::mutex> guard(queues_[self]->lock);
+		if (!queues_[self]->jobs.empty()) {
+			*job = queues_[self]->jobs.back();
+			queues_[self]->jobs.pop_back();
+			return true;
+		}
+	}
+	for(size_t i = 1; i < queues_.size(); i++) {
+		struct WorkQueue* victim = queues_[(self + i) % queues_.size()];
+		std::lock_guard<std::mutex> guard(victim->lock);
+		if (!victim->jobs.empty()) {
+			*job = victim->jobs.front();
+			victim->jobs.pop_front();
+			steals_++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void Distributor::work(int self) {
+	int job;
+	while (take(self, &job)) {
+		struct Device* device = devices_[job];
+		unsigned long now = millis();
+		if (device->status.retryat > now) {
+			delay(device->status.retryat - now);
+		}
+
+		unsigned long start = millis();
+		{
+			std::lock_guard<std::mutex> guard(report_);
+			device->status.state = DEVICE_RUNNING;
+			device->status.attempts++;
+		}
+		int rval = transfer(device);
+		readCounters(device);
+		{
+			std::lock_guard<std::mutex> guard(report_);
+			device->status.millis += millis() - start;
+			device->status.error = rval;
+			if (rval == 0) {
+				device->status.state = DEVICE_DONE;
+				device->status.step = NULL;
+			} else if (device->status.attempts <= retries_) {
+				device->status.state = DEVICE_WAITING;
+				device->status.retryat = millis() + DIST_RETRY_DELAY;
+			} else {
+				device->status.state = DEVICE_FAILED;
+			}
+		}
+		if (device->status.state == DEVICE_WAITING) {
+			if (!device->attached) {
+				device->port.close();		// Opened afresh, in case it was unplugged
+			}
+			std::lock_guard<std::mutex> guard(queues_[self]->lock);
+			queues_[self]->jobs.push_front(job);
+		}
+		report(device);
+	}
+}
+
+// Picks up after the last variable the calculator acknowledged
+int Distributor::transfer(struct Device* device) {
+	uint16_t counters[BRIDGE_STATUS_LEN / 2];
+	int rval;
+
+	setStep(device, "open");
+	if (!device->port.isOpen() && (rval = device->port.open(device->path))) {
+		return rval;
+	}
+	device->port.flush();
+	setStep(device, "bridge");
+	if ((rval = device->port.bridgeStatus(counters, timeout_))) {
+		return rval;
+	}
+	setStep(device, "calculator");
+	if ((rval = device->port.ready(bundle_->machine_, timeout_))) {
+		return rval;
+	}
+
+	for(int i = device->status.sent; i < bundle_->count(); i++) {
+		const struct Bundle::Packed* var = &bundle_->vars_[i];
+		setStep(device, var->name);
+		if ((rval = sendVar(device, var))) {
+			return rval;
+		}
+		{
+			std::lock_guard<std::mutex> guard(report_);
+			device->status.sent++;
+			device->status.bytes += var->datalength;
+		}
+		report(device);
+	}
+	return 0;
+}
+
+// What the bridge saw, whether or not the transfer worked
+void Distributor::readCounters(struct Device* device) {
+	uint16_t counters[BRIDGE_STATUS_LEN / 2];
+	if (!device->port.isOpen()) {
+		return;
+	}
+	device->port.flush();
+	if (0 == device->port.bridgeStatus(counters, timeout_)) {
+		std::lock_guard<std::mutex> guard(report_);
+		memcpy(device->status.bridge, counters, sizeof(counters));
+	}
+}
+
+void Distributor::setStep(struct Device* device, const char* step) {
+	std::lock_guard<std::mutex> guard(report_);
+	device->status.step = step;
+}
+
+// The silent-link send, as SilentLink::sendVariable() does it, with
+// the packets that were serialized in advance
+int Distributor::sendVar(struct Device* device, const struct Bundle::Packed* var) {
+	BridgePort* port = &device->port;
+	uint8_t machine = bundle_->machine_;
+	int rval;
+
+	if ((rval = port->write(var->rts.data(), var->rts.size())) ||
+	    (rval = port->expect(ACK, machine, timeout_)) || (rval = port->expect(CTS, machine, timeout_)))
+	{
+		return rval;
+	}
+	if ((rval = port->send(machine, ACK)) || (rval = port->write(var->data.data(), var->data.size())) ||
+	    (rval = port->expect(ACK, machine, timeout_)))
+	{
+		return rval;
+	}
+	if ((rval = port->send(machine, EOT))) {
+		return rval;
+	}
+	return port->expect(ACK, machine, timeout_);
+}
+
+void Distributor::report(struct Device* device) {
+	if (progress_ == NULL) {
+		return;
+	}
+	std::lock_guard<std::mutex> guard(report_);
+	struct DeviceStatus copy = device->status;
+	progress_(&copy, context_);
+}
@@ -0,0 +1,146 @@
+/*************************************************
+ *  Distributor.h - Sends one bundle of          *
+ *           variables to the calculators on     *
+ *           many LinkBridges at once, on Linux  *
+ *           hosts.                              *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef DISTRIBUTOR_H
+#define DISTRIBUTOR_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "BridgePort.h"
+#include "TICL.h"
+
+#define DIST_RETRIES		2			// Further attempts at a device after a failure
+#define DIST_RETRY_DELAY	1500		// ms a failed device rests, for both ends to give up
+#define DIST_NAME_LEN		8
+
+// The variables to hand out. Each one's RTS and DATA packets are
+// serialized, checksums and all, when it's added; every calculator is
+// then sent the same bytes.
+class Bundle {
+	public:
+		Bundle(uint8_t machine = COMP83P);
+
+		// header is a link-format VAR header: size word, type, name, and
+		// for the TI-83+ family a version and flag byte. Returns the
+		// variable's index or a TICLErrors value.
+		int add(const uint8_t* header, int headerlength, const uint8_t* data, int datalength);
+
+		// Every variable in a TI file (.8xp, .8xv, ...). Returns how many
+		// there were, a TICLErrors value, or a negative errno.
+		int addFile(const char* path);
+
+		int count();
+		long bytes();						// Variable data, without packet framing
+		const char* name(int index);
+
+	private:
+		friend class Distributor;
+		struct Packed {
+			std::vector<uint8_t> rts;
+			std::vector<uint8_t> data;
+			int datalength;
+			char name[DIST_NAME_LEN + 1];
+		};
+
+		uint8_t machine_;
+		std::vector<struct Packed> vars_;
+};
+
+enum DeviceState {
+	DEVICE_WAITING = 0,
+	DEVICE_RUNNING = 1,
+	DEVICE_DONE = 2,
+	DEVICE_FAILED = 3,
+};
+
+// Where one bridge and its calculator are. step says what failed:
+// "open", "bridge", "calculator", or a variable's name.
+struct DeviceStatus {
+	int index;
+	const char* name;
+	enum DeviceState state;
+	int sent;							// Bundle variables delivered so far
+	long bytes;
+	int attempts;
+	int error;							// Last TICLErrors value or negative errno
+	const char* step;
+	unsigned long millis;				// Spent on this device, over every attempt
+	unsigned long retryat;				// millis() before which it isn't tried again
+	uint16_t bridge[BRIDGE_STATUS_LEN / 2];	// The bridge's counters after the last attempt
+};
+
+typedef void(*progress_callback)(const struct DeviceStatus* device, void* context);
+
+// Each device is one job, and each worker thread has a deque of them.
+// A worker runs its own jobs newest first and, when it has none,
+// takes the oldest from another worker. A device that fails goes to
+// the old end of its worker's deque, so whichever worker is free next
+// retries it, from the first variable it didn't get.
+class Distributor {
+	public:
+		Distributor(Bundle* bundle);
+		~Distributor();
+
+		// A serial port, opened when its first job starts, or an open
+		// descriptor such as a pseudo-terminal. Returns the device index.
+		int addDevice(const char* path);
+		int addDevice(int fd, const char* name);
+		int devices();
+
+		void setRetries(int retries);
+		void setTimeout(int timeout);		// ms for each answer from a calculator
+
+		// Called after every variable and when a device is done or has
+		// failed, from the worker threads but one call at a time
+		void setProgress(progress_callback progress, void* context);
+
+		// Send the bundle to every device with this many threads, and
+		// return how many devices failed. May be called again, for the
+		// next set of calculators on the same bridges.
+		int run(int threads);
+
+		struct DeviceStatus status(int device);
+		unsigned long steals();				// Jobs taken from another worker, last run
+
+	private:
+		struct Device {
+			BridgePort port;
+			char path[64];
+			bool attached;
+			struct DeviceStatus status;
+		};
+		struct WorkQueue {
+			std::mutex lock;
+			std::deque<int> jobs;
+		};
+
+		void work(int self);
+		bool take(int self, int* job);
+		int transfer(struct Device* device);
+		int sendVar(struct Device* device, const struct Bundle::Packed* var);
+		void readCounters(struct Device* device);
+		void setStep(struct Device* device, const char* step);
+		void report(struct Device* device);
+
+		Bundle* bundle_;
+		std::vector<struct Device*> devices_;
+		std::vector<struct WorkQueue*> queues_;
+		std::mutex report_;					// Guards every DeviceStatus
+		progress_callback progress_;
+		void* context_;
+		int retries_;
+		int timeout_;
+		std::atomic<unsigned long> steals_;
+};
+
+#endif	// DISTRIBUTOR_H
@@ -0,0 +1,37 @@
+/*************************************************
+ *  HardwareSerial.h - Serial ports for Linux    *
+ *           hosts: any pair of file descriptors *
+ *           (a tty, a pty, stdin/stdout).       *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef HARDWARESERIAL_H
+#define HARDWARESERIAL_H
+
+#include "Arduino.h"
+
+class HardwareSerial: public Stream {
+	public:
+		HardwareSerial(int infd, int outfd);
+		void begin(unsigned long baud) {}
+		void end() {}
+
+		int available();
+		int read();
+		int peek();
+		size_t write(uint8_t byte);
+		size_t write(const uint8_t* buffer, size_t size);
+		int availableForWrite();
+		void flush() {}
+
+	private:
+		int infd_;
+		int outfd_;
+		int peeked_;
+};
+
+extern HardwareSerial Serial;				// stdin and stdout
+
+#endif	// HARDWARESERIAL_H
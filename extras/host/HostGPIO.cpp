@@ -0,0 +1,327 @@
+/*************************************************
+ *  HostGPIO.cpp - Pin backends for Linux hosts: *
+ *           GPIO character devices, and an      *
+ *           in-process fake chip for testing.   *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+
+#include "HostGPIO.h"
+
+static PinBackend* pinBackend = NULL;
+
+void hostSetPinBackend(PinBackend* backend) {
+	pinBackend = backend;
+}
+
+PinBackend* hostPinBackend() {
+	return pinBackend;
+}
+
+static bool validPin(int pin) {
+	return pin >= 0 && pin < HOST_MAX_PINS;
+}
+
+GpioChipBackend::GpioChipBackend() {
+	for(int pin = 0; pin < HOST_MAX_PINS; pin++) {
+		fd_[pin] = -1;
+		mode_[pin] = INPUT_PULLUP;
+		value_[pin] = HIGH;
+	}
+}
+
+GpioChipBackend::~GpioChipBackend() {
+	for(int pin = 0; pin < HOST_MAX_PINS; pin++) {
+		detach(pin);
+	}
+}
+
+int GpioChipBackend::attach(int pin, const char* chip, unsigned int offset) {
+	if (!validPin(pin)) {
+		return -EINVAL;
+	}
+	detach(pin);
+
+	int chipfd = open(chip, O_RDWR | O_CLOEXEC);
+	if (chipfd < 0) {
+		return -errno;
+	}
+
+	// Start out released, like resetLines()
+	struct gpio_v2_line_request request;
+	memset(&request, 0, sizeof(request));
+	request.offsets[0] = offset;
+	request.num_lines = 1;
+	strncpy(request.consumer, "articl", sizeof(request.consumer) - 1);
+	request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+	int rval = ioctl(chipfd, GPIO_V2_GET_LINE_IOCTL, &request);
+	int error = errno;
+	close(chipfd);
+	if (rval < 0) {
+		return -error;
+	}
+
+	fd_[pin] = request.fd;
+	mode_[pin] = INPUT_PULLUP;
+	value_[pin] = HIGH;
+	return 0;
+}
+
+void GpioChipBackend::detach(int pin) {
+	if (validPin(pin) && fd_[pin] >= 0) {
+		close(fd_[pin]);
+		fd_[pin] = -1;
+	}
+}
+
+void GpioChipBackend::mode(int pin, int mode) {
+	if (!validPin(pin) || fd_[pin] < 0) {
+		return;
+	}
+	mode_[pin] = mode;
+	if (mode == INPUT_PULLUP) {
+		value_[pin] = HIGH;				// As the AVR's output latch does
+	}
+	configure(pin);
+}
+
+int GpioChipBackend::read(int pin) {
+	if (!validPin(pin) || fd_[pin] < 0) {
+		return HIGH;
+	}
+	struct gpio_v2_line_values values;
+	values.bits = 0;
+	values.mask = 1;
+	if (ioctl(fd_[pin], GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+		return HIGH;
+	}
+	return (values.bits & 1) ? HIGH : LOW;
+}
+
+void GpioChipBackend::write(int pin, int value) {
+	if (!validPin(pin) || fd_[pin] < 0) {
+		return;
+	}
+	value_[pin] = value ? HIGH : LOW;
+	if (mode_[pin] != OUTPUT) {
+		return;
+	}
+	struct gpio_v2_line_values values;
+	values.bits = value_[pin];
+	values.mask = 1;
+	ioctl(fd_[pin], GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
+}
+
+int GpioChipBackend::configure(int pin) {
+	struct gpio_v2_line_config config;
+	memset(&config, 0, sizeof(config));
+	if (mode_[pin] == OUTPUT) {
+		config.flags = GPIO_V2_LINE_FLAG_OUTPUT | GPIO_V2_LINE_FLAG_OPEN_DRAIN |
+		               GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+		config.num_attrs = 1;
+		config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		config.attrs[0].attr.values = value_[pin];
+		config.attrs[0].mask = 1;
+	} else if (mode_[pin] == INPUT_PULLUP) {
+		config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+	} else {
+		config.flags = GPIO_V2_LINE_FLAG_INPUT;
+	}
+	return ioctl(fd_[pin], GPIO_V2_LINE_SET_CONFIG_IOCTL, &config);
+}
+
+FakeChip::FakeChip() {
+	for(int pin = 0; pin < HOST_MAX_PINS; pin++) {
+		mode_[pin] = INPUT_PULLUP;
+		value_[pin] = HIGH;
+		next_[pin] = pin;
+	}
+	yield_ = false;
+}
+
+void FakeChip::setYield(bool yield) {
+	yield_ = yield;
+}
+
+// Joins the two pins' wires into one
+void FakeChip::wire(int pin_a, int pin_b) {
+	if (!validPin(pin_a) || !validPin(pin_b)) {
+		return;
+	}
+	for(int pin = next_[pin_a]; pin != pin_a; pin = next_[pin]) {
+		if (pin == pin_b) {
+			return;							// Already on the same wire
+		}
+	}
+	int after_a = next_[pin_a];
+	next_[pin_a] = next_[pin_b];
+	next_[pin_b] = after_a;
+}
+
+void FakeChip::mode(int pin, int mode) {
+	if (validPin(pin)) {
+		if (mode == INPUT_PULLUP) {
+			value_[pin].store(HIGH, std::memory_order_relaxed);
+		}
+		mode_[pin].store(mode, std::memory_order_release);
+	}
+}
+
+// A wire is low if any pin on it drives it low
+int FakeChip::read(int pin) {
+	if (!validPin(pin)) {
+		return HIGH;
+	}
+	if (yield_) {
+		sched_yield();
+	}
+	int p = pin;
+	do {
+		if (mode_[p].load(std::memory_order_acquire) == OUTPUT &&
+		    value_[p].load(std::memory_order_acquire) == LOW)
+		{
+			return LOW;
+		}
+		p = next_[p];
+	} while (p != pin);
+	return HIGH;
+}
+
+void FakeChip::write(int pin, int value) {
+	if (validPin(pin)) {
+		value_[pin].store(value ? HIGH : LOW, std::memory_order_release);
+	}
+}
+
+DelayedPins::DelayedPins(PinBackend* inner) {
+	inner_ = inner;
+	for(int pin = 0; pin < HOST_MAX_PINS; pin++) {
+		delay_[pin] = 0;
+		mode_[pin] = INPUT_PULLUP;
+		value_[pin] = HIGH;
+	}
+}
+
+void DelayedPins::setDelay(int pin, unsigned long micros) {
+	if (validPin(pin)) {
+		delay_[pin] = micros;
+	}
+}
+
+void DelayedPins::mode(int pin, int mode) {
+	if (validPin(pin)) {
+		bool was_low = (mode_[pin] == OUTPUT && value_[pin] == LOW);
+		mode_[pin] = mode;
+		if (mode != OUTPUT) {
+			value_[pin] = HIGH;
+		}
+		settle(pin, was_low);
+	}
+	inner_->mode(pin, mode);
+}
+
+int DelayedPins::read(int pin) {
+	return inner_->read(pin);
+}
+
+void DelayedPins::write(int pin, int value) {
+	if (validPin(pin)) {
+		bool was_low = (mode_[pin] == OUTPUT && value_[pin] == LOW);
+		value_[pin] = value ? HIGH : LOW;
+		settle(pin, was_low);
+	}
+	inner_->write(pin, value);
+}
+
+// Wait out the pin's delay if it's about to change what it does to the line
+void DelayedPins::settle(int pin, bool was_low) {
+	bool is_low = (mode_[pin] == OUTPUT && value_[pin] == LOW);
+	if (delay_[pin] && is_low != was_low) {
+		delayMicroseconds(delay_[pin]);
+	}
+}
+
+NoisyPins::NoisyPins(PinBackend* inner) : flips_(0) {
+	inner_ = inner;
+	paircount_ = 0;
+	for(int pin = 0; pin < HOST_MAX_PINS; pin++) {
+		pair_[pin] = -1;
+	}
+}
+
+// Each link needs its own seed for the flips to be independent
+void NoisyPins::setErrorRate(int tip, int ring, double rate, unsigned int seed) {
+	if (!validPin(tip) || !validPin(ring)) {
+		return;
+	}
+	int index = pair_[tip];
+	if (index < 0) {
+		if (paircount_ >= HOST_MAX_PINS / 2) {
+			return;
+		}
+		index = paircount_++;
+	}
+	struct Pair* pair = &pairs_[index];
+	pair->tip = tip;
+	pair->ring = ring;
+	pair->rate = rate;
+	pair->seed = seed;
+	pair->swapped = pair->released = false;
+	pair_[tip] = pair_[ring] = index;
+}
+
+unsigned long NoisyPins::flips() {
+	return flips_;
+}
+
+int NoisyPins::map(int pin) {
+	if (!validPin(pin) || pair_[pin] < 0 || !pairs_[pair_[pin]].swapped) {
+		return pin;
+	}
+	struct Pair* pair = &pairs_[pair_[pin]];
+	return (pin == pair->tip) ? pair->ring : pair->tip;
+}
+
+// A link starts sending a bit by driving a line while both are high;
+// it answers one with a line already low
+void NoisyPins::mode(int pin, int mode) {
+	if (validPin(pin) && pair_[pin] >= 0) {
+		struct Pair* pair = &pairs_[pair_[pin]];
+		if (mode == OUTPUT && !pair->swapped && pair->rate > 0 &&
+		    inner_->read(pair->tip) == HIGH && inner_->read(pair->ring) == HIGH &&
+		    rand_r(&pair->seed) < pair->rate * ((double)RAND_MAX + 1))
+		{
+			pair->swapped = true;
+			pair->released = false;
+			flips_++;
+		} else if (mode != OUTPUT && pair->swapped) {
+			pair->released = true;
+		}
+	}
+	inner_->mode(map(pin), mode);
+}
+
+// The bit is over once the sender has let go and sees its peer do so
+int NoisyPins::read(int pin) {
+	int value = inner_->read(map(pin));
+	if (validPin(pin) && pair_[pin] >= 0) {
+		struct Pair* pair = &pairs_[pair_[pin]];
+		if (pair->swapped && pair->released && value == HIGH) {
+			pair->swapped = false;
+		}
+	}
+	return value;
+}
+
+void NoisyPins::write(int pin, int value) {
+	inner_->write(map(pin), value);
+}
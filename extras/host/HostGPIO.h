@@ -0,0 +1,135 @@
+/*************************************************
+ *  HostGPIO.h - Pin backends for Linux hosts:   *
+ *           GPIO character devices, and an      *
+ *           in-process fake chip for testing.   *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef HOSTGPIO_H
+#define HOSTGPIO_H
+
+#include <atomic>
+
+#include "Arduino.h"
+
+#define HOST_MAX_PINS	64				// Pin numbers 0 to HOST_MAX_PINS-1
+
+// Maps the pin numbers given to TICL onto real or simulated lines.
+// Pins must be set up before any link uses them; after that, each pin
+// may be used from one thread at a time.
+class PinBackend {
+	public:
+		virtual ~PinBackend() {}
+		virtual void mode(int pin, int mode) = 0;
+		virtual int read(int pin) = 0;
+		virtual void write(int pin, int value) = 0;
+};
+
+void hostSetPinBackend(PinBackend* backend);
+PinBackend* hostPinBackend();
+
+// Lines of /dev/gpiochipN, through the kernel's v2 character device
+// interface. Outputs are open-drain, so a pin set to OUTPUT and HIGH
+// releases the line rather than fighting the calculator over it.
+class GpioChipBackend: public PinBackend {
+	public:
+		GpioChipBackend();
+		~GpioChipBackend();
+
+		// Claim a line for a pin. Returns 0, or a negative errno.
+		int attach(int pin, const char* chip, unsigned int offset);
+		void detach(int pin);
+
+		void mode(int pin, int mode);
+		int read(int pin);
+		void write(int pin, int value);
+
+	private:
+		int configure(int pin);
+
+		int fd_[HOST_MAX_PINS];
+		uint8_t mode_[HOST_MAX_PINS];
+		uint8_t value_[HOST_MAX_PINS];
+};
+
+// Simulated open-drain wires with pull-ups, shared between pins of
+// the same process: two TICL objects on wired-together pins talk to
+// each other as a calculator and a cable would.
+class FakeChip: public PinBackend {
+	public:
+		FakeChip();
+		void wire(int pin_a, int pin_b);		// Put two pins on the same wire
+
+		// Give up the CPU on every read. The link's busy-waits then let
+		// the peer's thread run, for when links outnumber CPUs.
+		void setYield(bool yield);
+
+		void mode(int pin, int mode);
+		int read(int pin);
+		void write(int pin, int value);
+
+	private:
+		std::atomic<uint8_t> mode_[HOST_MAX_PINS];
+		std::atomic<uint8_t> value_[HOST_MAX_PINS];
+		int next_[HOST_MAX_PINS];				// Ring of the pins on each wire
+		bool yield_;
+};
+
+// Wraps another backend, making chosen pins slow to change: a pin
+// that starts or stops pulling its line low waits its delay first.
+// Each bit a peer on those pins sends or acknowledges costs it two
+// such changes, so a per-bit latency is twice the delay.
+class DelayedPins: public PinBackend {
+	public:
+		DelayedPins(PinBackend* inner);
+		void setDelay(int pin, unsigned long micros);
+
+		void mode(int pin, int mode);
+		int read(int pin);
+		void write(int pin, int value);
+
+	private:
+		void settle(int pin, bool was_low);
+
+		PinBackend* inner_;
+		unsigned long delay_[HOST_MAX_PINS];
+		uint8_t mode_[HOST_MAX_PINS];
+		uint8_t value_[HOST_MAX_PINS];
+};
+
+// Wraps another backend, flipping bits that chosen links send. At the
+// start of each bit a link's pins send, with the set probability, its
+// tip and ring trade places until the bit is over: it pulls the other
+// line, and watches the other one for the answer. The peer sees a
+// clean bit of the wrong value, as it would after a glitch on the wire.
+class NoisyPins: public PinBackend {
+	public:
+		NoisyPins(PinBackend* inner);
+		void setErrorRate(int tip, int ring, double rate, unsigned int seed = 1);
+		unsigned long flips();				// Bits flipped so far
+
+		void mode(int pin, int mode);
+		int read(int pin);
+		void write(int pin, int value);
+
+	private:
+		struct Pair {
+			int tip;
+			int ring;
+			double rate;
+			unsigned int seed;
+			bool swapped;					// This bit goes out flipped
+			bool released;					// and the link has let go of it
+		};
+		int map(int pin);
+
+		PinBackend* inner_;
+		int8_t pair_[HOST_MAX_PINS];			// Index into pairs_, or -1
+		struct Pair pairs_[HOST_MAX_PINS / 2];
+		int paircount_;
+		std::atomic<unsigned long> flips_;
+};
+
+#endif	// HOSTGPIO_H
@@ -0,0 +1,154 @@
+/*************************************************
+ *  LinkWorker.cpp - Runs each link on its own   *
+ *           thread on Linux hosts, fed by a     *
+ *           lock-free submission queue.         *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "LinkWorker.h"
+
+LinkWorker::LinkWorker(TICL* link) :
+	link_(link), idle_(NULL), head_(0), tail_(0), running_(false), jobs_done_(0), start_result_(0)
+{
+}
+
+LinkWorker::~LinkWorker() {
+	stop();
+}
+
+int LinkWorker::start(const struct WorkerOptions* options) {
+	struct WorkerOptions defaults = {-1, 0, false};
+	if (running_) {
+		return -EBUSY;
+	}
+	if (options == NULL) {
+		options = &defaults;
+	}
+
+	// The options are applied by the thread to itself before it
+	// touches the link, so start() waits until that's done
+	struct WorkerOptions copy = *options;
+	start_result_ = 1;
+	running_ = true;
+	thread_ = std::thread([this, copy]() {
+		start_result_ = applyOptions(&copy);
+		run();
+	});
+	while (start_result_ == 1) {
+		std::this_thread::yield();
+	}
+	return start_result_;
+}
+
+void LinkWorker::stop() {
+	running_ = false;
+	if (thread_.joinable()) {
+		thread_.join();
+	}
+
+	// With the worker gone, this is the queue's only reader
+	unsigned int head = head_.load(std::memory_order_relaxed);
+	while (head != tail_.load(std::memory_order_acquire)) {
+		struct LinkJob* job = queue_[head % WORKER_QUEUE_SIZE];
+		head_.store(++head, std::memory_order_release);
+		job->result = ERR_READ_TIMEOUT;
+		if (job->done) {
+			job->done(job);
+		}
+		job->finished.store(true, std::memory_order_release);
+	}
+}
+
+void LinkWorker::setIdle(int (*idle)(TICL* link)) {
+	idle_ = idle;
+}
+
+bool LinkWorker::submit(struct LinkJob* job) {
+	unsigned int tail = tail_.load(std::memory_order_relaxed);
+	if (tail - head_.load(std::memory_order_acquire) >= WORKER_QUEUE_SIZE) {
+		return false;
+	}
+	job->finished.store(false, std::memory_order_relaxed);
+	queue_[tail % WORKER_QUEUE_SIZE] = job;
+	tail_.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+// Block until the job has run, returning its result
+int LinkWorker::wait(struct LinkJob* job) {
+	while (!job->finished.load(std::memory_order_acquire)) {
+		struct timespec ts = {0, 20000};
+		nanosleep(&ts, NULL);
+	}
+	return job->result;
+}
+
+unsigned long LinkWorker::jobsDone() {
+	return jobs_done_.load(std::memory_order_relaxed);
+}
+
+void LinkWorker::run() {
+	int idle_rounds = 0;
+	while (running_.load(std::memory_order_relaxed)) {
+		unsigned int head = head_.load(std::memory_order_relaxed);
+		if (head == tail_.load(std::memory_order_acquire)) {
+			if (idle_) {
+				idle_(link_);
+				continue;
+			}
+			// Spin briefly in case more work is on its way, then sleep
+			if (++idle_rounds < 1000) {
+				std::this_thread::yield();
+			} else {
+				struct timespec ts = {0, 50000};
+				nanosleep(&ts, NULL);
+			}
+			continue;
+		}
+		idle_rounds = 0;
+
+		struct LinkJob* job = queue_[head % WORKER_QUEUE_SIZE];
+		head_.store(head + 1, std::memory_order_release);
+		job->result = job->run(link_, job->arg);
+		jobs_done_.fetch_add(1, std::memory_order_relaxed);
+		if (job->done) {
+			job->done(job);
+		}
+		job->finished.store(true, std::memory_order_release);
+	}
+}
+
+// Pinning the thread and raising its priority keeps the rest of the
+// system from stretching a bit past the peer's timeout.
+int LinkWorker::applyOptions(const struct WorkerOptions* options) {
+	int rval = 0;
+	if (options->cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(options->cpu, &cpus);
+		int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (error) {
+			rval = -error;
+		}
+	}
+	if (options->rt_priority > 0) {
+		struct sched_param param;
+		param.sched_priority = options->rt_priority;
+		int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (error) {
+			rval = -error;
+		}
+	}
+	if (options->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		rval = -errno;
+	}
+	return rval;
+}
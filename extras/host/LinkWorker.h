@@ -0,0 +1,76 @@
+/*************************************************
+ *  LinkWorker.h - Runs each link on its own     *
+ *           thread on Linux hosts, fed by a     *
+ *           lock-free submission queue.         *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef LINKWORKER_H
+#define LINKWORKER_H
+
+#include <atomic>
+#include <thread>
+
+#include "TICL.h"
+
+#define WORKER_QUEUE_SIZE	64			// Jobs waiting per link; a power of two
+
+// One operation on a link, such as a send() or a whole variable
+// transfer. run is called on the worker thread and its return value
+// is kept in result. The job must stay alive until it is finished.
+struct LinkJob {
+	int (*run)(TICL* link, void* arg);
+	void* arg;
+	void (*done)(struct LinkJob* job);	// Called on the worker thread before finished is set, may be NULL
+	int result;
+	std::atomic<bool> finished;
+};
+
+struct WorkerOptions {
+	int cpu;							// CPU to pin the thread to, or -1
+	int rt_priority;					// SCHED_FIFO priority 1-99, or 0 for normal
+	bool lock_memory;					// mlockall() so page faults can't stall a bit
+};
+
+class LinkWorker {
+	public:
+		LinkWorker(TICL* link);
+		~LinkWorker();
+
+		// Returns 0, or a negative errno if an option couldn't be applied;
+		// the thread runs either way.
+		int start(const struct WorkerOptions* options = NULL);
+		// Finishes the job in progress first. Jobs still queued don't
+		// run: each finishes with ERR_READ_TIMEOUT, its done called from
+		// here, so nothing waits on them forever.
+		void stop();
+
+		// Called between jobs when the queue is empty, e.g. to run a
+		// CBL2's eventLoopTick(true). Without one, the thread sleeps.
+		void setIdle(int (*idle)(TICL* link));
+
+		// Queue a job without blocking. One thread may submit to each
+		// worker. Returns false if the queue is full.
+		bool submit(struct LinkJob* job);
+		static int wait(struct LinkJob* job);
+
+		unsigned long jobsDone();
+
+	private:
+		void run();
+		int applyOptions(const struct WorkerOptions* options);
+
+		TICL* link_;
+		int (*idle_)(TICL*);
+		struct LinkJob* queue_[WORKER_QUEUE_SIZE];
+		std::atomic<unsigned int> head_;	// Next job to run, advanced by the worker
+		std::atomic<unsigned int> tail_;	// Next free slot, advanced by the submitter
+		std::atomic<bool> running_;
+		std::atomic<unsigned long> jobs_done_;
+		std::atomic<int> start_result_;
+		std::thread thread_;
+};
+
+#endif	// LINKWORKER_H
@@ -0,0 +1,445 @@
+/*************************************************
+ *  RealBatch.cpp - Conversion of whole arrays   *
+ *           of numbers to and from TI reals,    *
+ *           with SIMD kernels on Linux hosts.   *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+// The kernels are written once with GCC vector types, which the
+// compiler turns into SSE2 or NEON instructions, and into AVX2 ones in
+// the functions marked for it. Each group of values is BATCH_UNROLL
+// vectors worked on side by side, so the processor has independent
+// work to overlap. How often a value is scaled by ten depends on its
+// magnitude, and a group scales until its last lane is done, so the
+// values are first sorted into groups of similar magnitude.
+//
+// Every lane repeats TIVar's arithmetic exactly:
+// - floatToReal8x scales by 0.1f or 10 one step at a time, here
+//   masked to the lanes still out of range, until none are;
+// - its fmod(f, 10) is exact, and so is f - 10 * floor(f * 0.1) once
+//   floor is corrected by one either way, as 10 * floor(f * 0.1) is an
+//   integer below 2^53; f then becomes (f - fmod(f, 10)) / 10, which is
+//   that corrected floor exactly;
+// - its loop that counts a digit down by ones while it is above 0.5
+//   stops after ceil(digit - 0.5) steps, and every value involved is
+//   exact;
+// - realToFloat8x's 10 * acc + digit is an exact integer below 2^53 at
+//   every step, so the mantissa is its BCD digits converted to binary.
+
+#include <string.h>
+
+#include "RealBatch.h"
+#include "TIVar.h"
+
+#define BATCH_UNROLL	4			// Vectors worked on side by side
+#define BATCH_CHUNK		512			// Values sorted by magnitude at a time
+#define BATCH_BUCKETS	256
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+#define BATCH_VECTOR	1
+#else
+#define BATCH_VECTOR	0
+#endif
+
+#if BATCH_VECTOR
+// The helpers are always inlined, so no vector is passed by value
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+typedef double Lanes2 __attribute__((vector_size(16)));
+typedef long long Mask2 __attribute__((vector_size(16)));
+typedef double Lanes4 __attribute__((vector_size(32)));
+typedef long long Mask4 __attribute__((vector_size(32)));
+
+#define BATCH_INLINE	static inline __attribute__((always_inline))
+
+template<typename V> BATCH_INLINE V splat(double value) {
+	V zero = {};
+	return zero + value;
+}
+
+template<typename M> BATCH_INLINE bool anyLane(const M& mask) {
+	long long any = 0;
+	for(unsigned i = 0; i < sizeof(M) / sizeof(long long); i++) {
+		any |= mask[i];
+	}
+	return any != 0;
+}
+
+// Round to an integer by adding and taking away 2^52, which leaves no
+// fraction bits; valid for 0 <= x < 2^51
+template<typename V> BATCH_INLINE V roundLanes(const V& x) {
+	const V magic = splat<V>(4503599627370496.0);
+	return (x + magic) - magic;
+}
+
+// Sort the indices of a chunk of values so that values of similar
+// magnitude are next to each other
+static void sortByMagnitude(const uint8_t* keys, int count, uint16_t* order) {
+	uint16_t starts[BATCH_BUCKETS];
+	memset(starts, 0, sizeof(starts));
+	for(int i = 0; i < count; i++) {
+		starts[keys[i]]++;
+	}
+	int start = 0;
+	for(int b = 0; b < BATCH_BUCKETS; b++) {
+		int n = starts[b];
+		starts[b] = start;
+		start += n;
+	}
+	for(int i = 0; i < count; i++) {
+		order[starts[keys[i]]++] = i;
+	}
+}
+
+// The double's exponent field, 8 binary orders of magnitude per key
+BATCH_INLINE uint8_t floatKey(double f) {
+	uint64_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return (bits >> 55) & 0xff;
+}
+
+// Convert the values at order[0..count) of values, one group at a time;
+// a short last group repeats its first value to fill the lanes
+template<typename V, typename M>
+BATCH_INLINE bool fromFloatsChunk(const double* values, const uint16_t* order, int count,
+                                  uint8_t* reals, int size)
+{
+	const int lanes = sizeof(V) / sizeof(double);
+	const int group = lanes * BATCH_UNROLL;
+	const int mantissa_offset = (size == 9) ? 2 : 3;
+	const V zero = {};
+
+	// Lanes are filled and emptied through plain arrays: writing or
+	// reading one lane of a vector at a time is much slower
+	for(int base = 0; base < count; base += group) {
+		int index[group];
+		double in[group];
+		V f[BATCH_UNROLL], exp[BATCH_UNROLL], bytes[7][BATCH_UNROLL];
+		M sign[BATCH_UNROLL];
+		M any = {};
+
+		for(int k = 0; k < group; k++) {
+			index[k] = order[(base + k < count) ? base + k : base];
+			in[k] = values[index[k]];
+		}
+		memcpy(f, in, sizeof(f));
+		for(int u = 0; u < BATCH_UNROLL; u++) {
+			sign[u] = ~(f[u] >= 0.0);
+			f[u] = (f[u] > 0.0) ? f[u] : -f[u];
+			any |= (f[u] == __builtin_inf());
+			exp[u] = splat<V>(13.0);
+		}
+		if (anyLane(any)) {
+			return false;
+		}
+
+		// Bring large numbers down, then small numbers up
+		do {
+			any = (M){};
+			for(int u = 0; u < BATCH_UNROLL; u++) {
+				M scale = (f[u] != 0.0) & (f[u] >= 10.e13);
+				f[u] = scale ? f[u] * (double)0.1f : f[u];
+				exp[u] = scale ? exp[u] + 1.0 : exp[u];
+				any |= scale;
+			}
+		} while (anyLane(any));
+		do {
+			any = (M){};
+			for(int u = 0; u < BATCH_UNROLL; u++) {
+				M scale = (f[u] != 0.0) & (f[u] < 1.e13);
+				f[u] = scale ? f[u] * 10.0 : f[u];
+				exp[u] = scale ? exp[u] - 1.0 : exp[u];
+				any |= scale;
+			}
+		} while (anyLane(any));
+
+		// Extract the digits, lowest first, and pair them into bytes
+		for(int i = 13; i >= 0; i--) {
+			for(int u = 0; u < BATCH_UNROLL; u++) {
+				V t = f[u] * 0.1;
+				V q = roundLanes(t);
+				q = (q > t) ? q - 1.0 : q;
+				V odigit = f[u] - q * 10.0;
+				M low = (odigit < 0.0);
+				M high = (odigit >= 10.0);
+				odigit = low ? odigit + 10.0 : (high ? odigit - 10.0 : odigit);
+				f[u] = low ? q - 1.0 : (high ? q + 1.0 : q);
+
+				V cdigit = odigit - 0.5;
+				V c = roundLanes(cdigit);
+				cdigit = (c < cdigit) ? c + 1.0 : c;
+				cdigit = (odigit > 0.5) ? cdigit : zero;
+				bytes[i >> 1][u] = (i & 1) ? cdigit : bytes[i >> 1][u] + cdigit * 16.0;
+			}
+		}
+
+		double outbytes[7][group];
+		double outexp[group];
+		long long outsign[group];
+		memcpy(outbytes, bytes, sizeof(bytes));
+		memcpy(outexp, exp, sizeof(exp));
+		memcpy(outsign, sign, sizeof(sign));
+		for(int k = 0; k < group; k++) {
+			uint8_t* real = &reals[index[k] * size];
+			real[0] = outsign[k] ? 0x80 : 0x00;
+			for(int j = 0; j < 7; j++) {
+				real[mantissa_offset + j] = (uint8_t)(int)outbytes[j][k];
+			}
+			int16_t e = (int16_t)outexp[k];
+			if (size == 9) {
+				real[1] = (uint8_t)(e + 0x80);
+			} else {
+				int32_t temp_exp = (int32_t)e + 0x00fc00;
+				real[1] = (uint8_t)(temp_exp & 0x00ff);
+				real[2] = (uint8_t)((temp_exp >> 8) & 0x00ff);
+			}
+		}
+	}
+	return true;
+}
+
+template<typename V, typename M>
+BATCH_INLINE bool fromFloatsKernel(const double* values, int count, uint8_t* reals, int size) {
+	uint8_t keys[BATCH_CHUNK];
+	uint16_t order[BATCH_CHUNK];
+
+	for(int base = 0; base < count; base += BATCH_CHUNK) {
+		int n = min(count - base, BATCH_CHUNK);
+		for(int i = 0; i < n; i++) {
+			keys[i] = floatKey(values[base + i]);
+		}
+		sortByMagnitude(keys, n, order);
+		if (!fromFloatsChunk<V, M>(&values[base], order, n, &reals[base * size], size)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The exponent, as extractExponent() reads it
+BATCH_INLINE int realExponent(const uint8_t* real, int size) {
+	if (size == 9) {
+		return ((int16_t)real[1] - 0x80) - 13;
+	}
+	int32_t raw_exp = (int32_t)(real[1] | (real[2] << 8)) - 0x00fc00;
+	return (int16_t)raw_exp - 13;
+}
+
+// Fourteen BCD digits to binary: each byte to 0-99, then each pair of
+// bytes to 0-9999, and so on, taking away what the wider field counts
+// too much for its upper half
+BATCH_INLINE double realMantissa(const uint8_t* digits) {
+	uint64_t x = 0;
+	for(int j = 0; j < 7; j++) {
+		x = (x << 8) | digits[j];
+	}
+	x -= ((x >> 4) & 0x000f0f0f0f0f0f0full) * 6;
+	x -= ((x >> 8) & 0x00ff00ff00ff00ffull) * 156;
+	x -= ((x >> 16) & 0x0000ffff0000ffffull) * 55536;
+	x -= (x >> 32) * 4194967296ull;
+	return (double)x;
+}
+
+template<typename V, typename M>
+BATCH_INLINE void toFloatsChunk(const uint8_t* reals, const uint16_t* order, int count,
+                                double* values, int size)
+{
+	const int lanes = sizeof(V) / sizeof(double);
+	const int group = lanes * BATCH_UNROLL;
+	const int mantissa_offset = (size == 9) ? 2 : 3;
+
+	for(int base = 0; base < count; base += group) {
+		int index[group];
+		double lanevalues[3][group];
+		V acc[BATCH_UNROLL], exp[BATCH_UNROLL], sign[BATCH_UNROLL];
+		int most = 0;
+		int least = 0;
+
+		for(int k = 0; k < group; k++) {
+			index[k] = order[(base + k < count) ? base + k : base];
+			const uint8_t* real = &reals[index[k] * size];
+			int e = realExponent(real, size);
+			lanevalues[0][k] = realMantissa(&real[mantissa_offset]);
+			lanevalues[1][k] = e;
+			lanevalues[2][k] = (real[0] & 0x80) ? -1.0 : 1.0;
+			most = max(most, e);
+			least = min(least, e);
+		}
+		memcpy(acc, lanevalues[0], sizeof(acc));
+		memcpy(exp, lanevalues[1], sizeof(exp));
+		memcpy(sign, lanevalues[2], sizeof(sign));
+
+		// Raise or lower each lane by its own exponent
+		for(int i = 0; i < most; i++) {
+			for(int u = 0; u < BATCH_UNROLL; u++) {
+				acc[u] = (exp[u] > i) ? acc[u] * 10.0 : acc[u];
+			}
+		}
+		for(int i = 0; i > least; i--) {
+			for(int u = 0; u < BATCH_UNROLL; u++) {
+				acc[u] = (exp[u] < i) ? acc[u] * (double)0.1f : acc[u];
+			}
+		}
+		for(int u = 0; u < BATCH_UNROLL; u++) {
+			acc[u] = (sign[u] < 0.0) ? acc[u] * -1.0 : acc[u];
+		}
+		memcpy(lanevalues[0], acc, sizeof(acc));
+		for(int k = 0; k < group; k++) {
+			values[index[k]] = lanevalues[0][k];
+		}
+	}
+}
+
+template<typename V, typename M>
+BATCH_INLINE void toFloatsKernel(const uint8_t* reals, int count, double* values, int size) {
+	uint8_t keys[BATCH_CHUNK];
+	uint16_t order[BATCH_CHUNK];
+
+	for(int base = 0; base < count; base += BATCH_CHUNK) {
+		int n = min(count - base, BATCH_CHUNK);
+		for(int i = 0; i < n; i++) {
+			keys[i] = constrain(realExponent(&reals[(base + i) * size], size) + 128, 0, 255);
+		}
+		sortByMagnitude(keys, n, order);
+		toFloatsChunk<V, M>(&reals[base * size], order, n, &values[base], size);
+	}
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static bool fromFloatsAVX2(const double* values, int count, uint8_t* reals, int size) {
+	return fromFloatsKernel<Lanes4, Mask4>(values, count, reals, size);
+}
+
+__attribute__((target("avx2")))
+static void toFloatsAVX2(const uint8_t* reals, int count, double* values, int size) {
+	toFloatsKernel<Lanes4, Mask4>(reals, count, values, size);
+}
+#endif
+
+static bool fromFloatsVector(const double* values, int count, uint8_t* reals, int size) {
+	return fromFloatsKernel<Lanes2, Mask2>(values, count, reals, size);
+}
+
+static void toFloatsVector(const uint8_t* reals, int count, double* values, int size) {
+	toFloatsKernel<Lanes2, Mask2>(reals, count, values, size);
+}
+#endif	// BATCH_VECTOR
+
+static bool avx2Supported() {
+#if BATCH_VECTOR && defined(__x86_64__)
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+static enum BatchKernel bestKernel() {
+	if (avx2Supported()) {
+		return KERNEL_AVX2;
+	}
+	return BATCH_VECTOR ? KERNEL_VECTOR : KERNEL_SCALAR;
+}
+
+static enum BatchKernel kernel_ = bestKernel();
+
+bool RealBatch::setKernel(enum BatchKernel kernel) {
+	if ((kernel == KERNEL_VECTOR && !BATCH_VECTOR) || (kernel == KERNEL_AVX2 && !avx2Supported())) {
+		return false;
+	}
+	kernel_ = kernel;
+	return true;
+}
+
+enum BatchKernel RealBatch::kernel() {
+	return kernel_;
+}
+
+const char* RealBatch::kernelName(enum BatchKernel kernel) {
+	switch(kernel) {
+		case KERNEL_AVX2:
+			return "avx2";
+		case KERNEL_VECTOR:
+#if defined(__aarch64__)
+			return "neon";
+#else
+			return "sse2";
+#endif
+		default:
+			return "scalar";
+	}
+}
+
+int RealBatch::fromFloats(const double* values, int count, uint8_t* reals, enum Endpoint model) {
+	int size = TIVar::sizeOfReal(model);
+	if (size < 0) {
+		return -1;
+	}
+#if BATCH_VECTOR
+	if (kernel_ != KERNEL_SCALAR) {
+		bool converted;
+#if defined(__x86_64__)
+		if (kernel_ == KERNEL_AVX2) {
+			converted = fromFloatsAVX2(values, count, reals, size);
+		} else
+#endif
+		converted = fromFloatsVector(values, count, reals, size);
+		return converted ? count * size : -1;
+	}
+#endif
+	for(int i = 0; i < count; i++) {
+		if (values[i] == __builtin_inf() || values[i] == -__builtin_inf()) {
+			return -1;
+		}
+		TIVar::floatToReal8x(values[i], &reals[i * size], model);
+	}
+	return count * size;
+}
+
+int RealBatch::toFloats(const uint8_t* reals, int count, double* values, enum Endpoint model) {
+	int size = TIVar::sizeOfReal(model);
+	if (size < 0) {
+		return -1;
+	}
+#if BATCH_VECTOR
+	if (kernel_ != KERNEL_SCALAR) {
+#if defined(__x86_64__)
+		if (kernel_ == KERNEL_AVX2) {
+			toFloatsAVX2(reals, count, values, size);
+		} else
+#endif
+		toFloatsVector(reals, count, values, size);
+		return count * size;
+	}
+#endif
+	for(int i = 0; i < count; i++) {
+		values[i] = TIVar::realToFloat8x((uint8_t*)&reals[i * size], model);
+	}
+	return count * size;
+}
+
+// Integer conversions divide by 10 in 64 bits, which neither AVX2 nor
+// NEON can do across lanes, so these run TIVar's code in a tight loop
+int RealBatch::fromLongs(const long long* values, int count, uint8_t* reals, enum Endpoint model) {
+	int size = TIVar::sizeOfReal(model);
+	if (size < 0) {
+		return -1;
+	}
+	for(int i = 0; i < count; i++) {
+		TIVar::longToReal8x(values[i], &reals[i * size], model);
+	}
+	return count * size;
+}
+
+int RealBatch::toLongs(const uint8_t* reals, int count, long long* values, enum Endpoint model) {
+	int size = TIVar::sizeOfReal(model);
+	if (size < 0) {
+		return -1;
+	}
+	for(int i = 0; i < count; i++) {
+		values[i] = TIVar::realToLong8x((uint8_t*)&reals[i * size], model);
+	}
+	return count * size;
+}
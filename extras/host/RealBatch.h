@@ -0,0 +1,44 @@
+/*************************************************
+ *  RealBatch.h - Conversion of whole arrays of  *
+ *           numbers to and from TI reals, with  *
+ *           SIMD kernels on Linux hosts.        *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef REALBATCH_H
+#define REALBATCH_H
+
+#include "Arduino.h"
+#include "TICL.h"
+
+// Which code converts; see RealBatch::setKernel()
+enum BatchKernel {
+	KERNEL_SCALAR = 0,						// TIVar, one value at a time
+	KERNEL_VECTOR = 1,						// SSE2 on x86-64, NEON on AArch64
+	KERNEL_AVX2 = 2,						// x86-64 processors that have it
+};
+
+// Converts count values at once, to or from reals packed back to back,
+// TIVar::sizeOfReal(model) bytes each, as they are in a list after its
+// count word. The result is the same, bit for bit, as converting each
+// value with TIVar: the vector kernels do the same floating point
+// operations in the same order, several values at a time. Each call
+// returns the number of real bytes written or read, or -1 for a model
+// TIVar has no reals for, or an infinite double (which floatToReal8x
+// never returns from). Reals must hold BCD digits 0-9 to be read.
+class RealBatch {
+	public:
+		static int fromFloats(const double* values, int count, uint8_t* reals, enum Endpoint model);
+		static int toFloats(const uint8_t* reals, int count, double* values, enum Endpoint model);
+		static int fromLongs(const long long* values, int count, uint8_t* reals, enum Endpoint model);
+		static int toLongs(const uint8_t* reals, int count, long long* values, enum Endpoint model);
+
+		// The best kernel this processor has is used by default
+		static bool setKernel(enum BatchKernel kernel);
+		static enum BatchKernel kernel();
+		static const char* kernelName(enum BatchKernel kernel);
+};
+
+#endif	// REALBATCH_H
@@ -0,0 +1,189 @@
+/*************************************************
+ *  SessionReplay.cpp - Plays back the peer's    *
+ *           side of a recorded link session,    *
+ *           with its recorded timing, on Linux  *
+ *           hosts.                              *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#include <stdio.h>
+
+#include "SessionReplay.h"
+#include "TICL.h"
+
+static bool readVarint(const uint8_t* buffer, size_t length, size_t* pos, unsigned long* value) {
+	*value = 0;
+	for(int shift = 0; *pos < length && shift < 64; shift += 7) {
+		uint8_t b = buffer[(*pos)++];
+		*value |= (unsigned long)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int SessionReplay::load(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		return ERR_INVALID;
+	}
+	std::vector<uint8_t> buffer;
+	uint8_t chunk[4096];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+		buffer.insert(buffer.end(), chunk, chunk + n);
+	}
+	fclose(file);
+	return load(buffer.data(), buffer.size());
+}
+
+int SessionReplay::load(const uint8_t* buffer, size_t length) {
+	packets_.clear();
+	if (length < 5 || memcmp(buffer, SESSION_MAGIC, 4) != 0 || buffer[4] != SESSION_VERSION) {
+		return ERR_INVALID;
+	}
+
+	size_t pos = 5;
+	while (pos < length) {
+		struct ReplayPacket packet;
+		uint8_t direction = buffer[pos++];
+		if ((direction != SESSION_FROM_PEER && direction != SESSION_TO_PEER) ||
+		    !readVarint(buffer, length, &pos, &packet.gap))
+		{
+			return ERR_INVALID;
+		}
+		packet.from_peer = (direction == SESSION_FROM_PEER);
+
+		bool last = false;
+		while (!last) {
+			struct ReplayByte byte;
+			unsigned long respond;
+			if (!readVarint(buffer, length, &pos, &respond) ||
+			    !readVarint(buffer, length, &pos, &byte.release) || pos >= length)
+			{
+				return ERR_INVALID;
+			}
+			byte.respond = respond >> 1;
+			byte.value = buffer[pos++];
+			last = respond & 1;
+			packet.bytes.push_back(byte);
+		}
+		packets_.push_back(packet);
+	}
+	return 0;
+}
+
+int SessionReplay::run(int tip, int ring, struct ReplayStats* stats) {
+	tip_ = tip;
+	ring_ = ring;
+	memset(stats, 0, sizeof(*stats));
+	release();
+
+	unsigned long start = micros();
+	for(size_t p = 0; p < packets_.size() && stats->error == 0; p++) {
+		const struct ReplayPacket& packet = packets_[p];
+		for(size_t i = 0; i < packet.bytes.size(); i++) {
+			const struct ReplayByte& recorded = packet.bytes[i];
+			stats->peer_micros += recorded.respond + recorded.release;
+			if (packet.from_peer) {
+				unsigned long wait = (i == 0) ? packet.gap : 0;
+				stats->peer_micros += wait;
+				stats->error = sendByte(recorded, wait);
+			} else {
+				struct ReplayByte received;
+				stats->error = getByte(&received, recorded, (i == 0) ? REPLAY_FIRST_TIMEOUT : TIMEOUT);
+				if (stats->error == 0 && received.value != recorded.value) {
+					stats->mismatches++;
+				}
+			}
+			if (stats->error) {
+				break;
+			}
+		}
+		if (stats->error == 0) {
+			stats->packets++;
+		}
+	}
+	stats->total_micros = micros() - start;
+	release();
+	return stats->error;
+}
+
+// Our side of TICL::getByte(): put each bit on the line after the
+// recorded delay, then let go after the recorded delay once it's
+// acknowledged. wait comes first, for the gap before a packet.
+int SessionReplay::sendByte(const struct ReplayByte& byte, unsigned long wait) {
+	uint8_t value = byte.value;
+	delayMicroseconds(wait);
+	for(int bit = 0; bit < 8; bit++) {
+		if (!waitFor(tip_, HIGH, TIMEOUT) || !waitFor(ring_, HIGH, TIMEOUT)) {
+			return ERR_WRITE_TIMEOUT;
+		}
+		delayMicroseconds(byte.respond / 8);
+		int line = (value & 1) ? ring_ : tip_;
+		int other = (value & 1) ? tip_ : ring_;
+		pinMode(line, OUTPUT);
+		digitalWrite(line, LOW);
+		if (!waitFor(other, LOW, TIMEOUT)) {
+			release();
+			return ERR_WRITE_TIMEOUT;
+		}
+		delayMicroseconds(byte.release / 8);
+		release();
+		if (!waitFor(other, HIGH, TIMEOUT)) {
+			return ERR_WRITE_TIMEOUT;
+		}
+		value >>= 1;
+	}
+	return 0;
+}
+
+// Our side of TICL::sendByte(): acknowledge each bit after the recorded
+// delay, and let go of the acknowledgement after the recorded delay.
+int SessionReplay::getByte(struct ReplayByte* byte, const struct ReplayByte& recorded,
+                           unsigned long timeout)
+{
+	byte->value = 0;
+	for(int bit = 0; bit < 8; bit++) {
+		unsigned long start = micros();
+		int linevals;
+		while ((linevals = (digitalRead(ring_) << 1) | digitalRead(tip_)) == 0x03) {
+			if (micros() - start > timeout) {
+				return ERR_READ_TIMEOUT;
+			}
+		}
+		timeout = TIMEOUT;
+
+		delayMicroseconds(recorded.respond / 8);
+		byte->value = (byte->value >> 1) | ((linevals == 0x01) ? 0x80 : 0x00);
+		int line = (linevals == 0x01) ? tip_ : ring_;
+		int other = (linevals == 0x01) ? ring_ : tip_;
+		pinMode(line, OUTPUT);
+		digitalWrite(line, LOW);
+		if (!waitFor(other, HIGH, TIMEOUT)) {
+			release();
+			return ERR_READ_TIMEOUT;
+		}
+		delayMicroseconds(recorded.release / 8);
+		release();
+	}
+	return 0;
+}
+
+bool SessionReplay::waitFor(int pin, int level, unsigned long timeout) {
+	unsigned long start = micros();
+	while (digitalRead(pin) != level) {
+		if (micros() - start > timeout) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void SessionReplay::release() {
+	pinMode(ring_, INPUT_PULLUP);
+	pinMode(tip_, INPUT_PULLUP);
+}
@@ -0,0 +1,66 @@
+/*************************************************
+ *  SessionReplay.h - Plays back the peer's side *
+ *           of a recorded link session, with    *
+ *           its recorded timing, on Linux       *
+ *           hosts.                              *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+#ifndef SESSIONREPLAY_H
+#define SESSIONREPLAY_H
+
+#include <vector>
+
+#include "Arduino.h"
+#include "SessionRecorder.h"
+
+#define REPLAY_FIRST_TIMEOUT	5000000ul		// How long to wait for the library to start a packet
+
+struct ReplayByte {
+	uint8_t value;
+	unsigned long respond;					// Summed over the byte's bits, as recorded
+	unsigned long release;
+};
+
+struct ReplayPacket {
+	bool from_peer;
+	unsigned long gap;						// Microseconds after the previous packet
+	std::vector<struct ReplayByte> bytes;
+};
+
+struct ReplayStats {
+	unsigned long packets;					// Packets played through
+	unsigned long mismatches;				// Bytes from the library unlike the recording
+	unsigned long peer_micros;				// Time the recorded peer spent, gaps included
+	unsigned long total_micros;				// Wall time of the replay
+	int error;								// 0, or where the replay lost the library
+};
+
+// Load a session written by SessionRecorder, then run() it on the
+// peer's pins while the code under test runs against the other end of
+// the wires, on another thread. The peer waits, acknowledges and
+// releases bits with the recorded delays, spread evenly over each
+// byte's bits, so the replay's wall time less peer_micros is the time
+// the library itself took.
+class SessionReplay {
+	public:
+		int load(const char* path);
+		int load(const uint8_t* buffer, size_t length);
+		const std::vector<struct ReplayPacket>& packets() { return packets_; }
+
+		int run(int tip, int ring, struct ReplayStats* stats);
+
+	private:
+		int sendByte(const struct ReplayByte& byte, unsigned long wait);
+		int getByte(struct ReplayByte* byte, const struct ReplayByte& recorded, unsigned long timeout);
+		bool waitFor(int pin, int level, unsigned long timeout);
+		void release();
+
+		std::vector<struct ReplayPacket> packets_;
+		int tip_;
+		int ring_;
+};
+
+#endif	// SESSIONREPLAY_H
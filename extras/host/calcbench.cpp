@@ -0,0 +1,594 @@
+/*************************************************
+ *  calcbench.cpp - End-to-end benchmarks and    *
+ *           checks of the library against an    *
+ *           emulated calculator.                *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+// Each scenario runs -n times between a CalcEmulator on pins 0 and 1
+// and the library on pins 2 and 3, and checks every value that comes
+// across. The library side is a CBL2 in its event loop for the
+// calculator program's Send( and Get(, and a plain TICL acting as a
+// computer for the silent-link screenshot, key presses and discovery,
+// and a SilentLink that syncs a manifest of programs with VarSync: all
+// of them, then one changed, then none.
+// -b slows each bit the calculator sends or acknowledges by that many
+// microseconds. -w has the library spend that many milliseconds on
+// each variable it receives, and -g has the calculator's program run
+// that long after each Send(. With -p the CBL2 receives into a pool of
+// two buffers and does that work after the exchange, while the
+// calculator moves on, instead of in its callback. With -r a LinkRelay
+// on pins 4-7 sits between the two, to compare with a direct link.
+// -c runs that many StaticCBL2s instead, each with its own handler and
+// its own calculator, all ticked from one thread as one board would;
+// every value must reach the right CBL2, and come back from it. Each
+// emulated calculator needs CPU time too: with many more of them than
+// CPUs, one can miss its 100 ms bit timeout while the others run.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+#include "CalcEmulator.h"
+#include "CBL2.h"
+#include "HostGPIO.h"
+#include "LinkRelay.h"
+#include "TIVar.h"
+#include "VarSync.h"
+
+#define BENCH_MAX_DATA	1024
+#define BENCH_LIST_LEN	20
+#define BENCH_MAX_STATIONS	8				// CBL2s on pins 8 and up, four pins each
+#define BENCH_PROGRAMS		4				// Programs in the VarSync manifest
+#define BENCH_PROGRAM_LEN	400				// Bytes in each, with its size word
+
+struct Scenario {
+	const char* name;
+	bool silent;							// The library drives, the emulator answers
+	int (*run)(CalcEmulator* calc, CBL2* cbl, int iteration);
+	int bytes;								// Variable data moved per run
+};
+
+static CBL2* cbl;
+static uint8_t cblHeader[16];
+static uint8_t cblData[BENCH_MAX_DATA];
+static StaticPacketPool<2, CBL2_HEADER_LEN + BENCH_MAX_DATA> pool;
+static std::atomic<bool> running;
+static std::atomic<bool> relaying;
+static bool pooled;
+static unsigned long work;					// ms spent on each received variable
+static unsigned long gap;					// ms the calculator spends after each Send(
+
+// What the last CBL2 receive looked like, for the checks
+static uint8_t receivedType;
+static enum Endpoint receivedModel;
+static int receivedLength;
+static uint8_t* receivedData = cblData;
+static std::atomic<int> received;
+static long requestValue;
+
+static SilentLink* silentLink;
+static VarSync varSync;
+static uint8_t programs[BENCH_PROGRAMS][BENCH_PROGRAM_LEN];
+static int programHandles[BENCH_PROGRAMS];
+
+static int onReceived(uint8_t type, enum Endpoint model, int datalen) {
+	receivedType = type;
+	receivedModel = model;
+	receivedLength = datalen;
+	delay(work);
+	received++;
+	return 0;
+}
+
+static int onRequest(uint8_t type, enum Endpoint model, int* headerlen, int* datalen, data_callback* callback) {
+	*datalen = TIVar::longToReal8x(requestValue, cblData, model);
+	TIVar::intToSizeWord(*datalen, cblHeader);
+	*headerlen = 13;
+	return 0;
+}
+
+// Process a pooled variable, if one has arrived. The data stays in
+// its buffer for the checks until the next one is taken.
+static void takePooled() {
+	static int held = -1;
+	uint8_t* header;
+	uint8_t* data;
+	enum Endpoint model;
+	int length;
+	int buffer = cbl->nextVariable(&header, &data, &model, &length);
+	if (buffer < 0) {
+		return;
+	}
+	cbl->release(held);
+	held = buffer;
+	receivedType = header[2];
+	receivedModel = model;
+	receivedLength = length;
+	receivedData = data;
+	delay(work);
+	received++;
+}
+
+static void libraryLoop(bool silent) {
+	while (running) {
+		if (!silent) {
+			cbl->eventLoopTick(true);
+			if (pooled) {
+				takePooled();
+			}
+		}
+	}
+}
+
+// The calculator's program runs on after a Send(, then we wait for
+// the library to be done with the variable
+static void awaitReceived(int before) {
+	delay(gap);
+	while (received == before) {}
+}
+
+static int sendReal(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	int before = received;
+	int rval = calc->programSendReal(iteration);
+	if (rval) {
+		return rval;
+	}
+	awaitReceived(before);
+	if (receivedType != VarTypes82::VarReal || TIVar::realToLong8x(receivedData, receivedModel) != iteration) {
+		return ERR_INVALID;
+	}
+	return 0;
+}
+
+static int sendList(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	double values[BENCH_LIST_LEN];
+	for(int i = 0; i < BENCH_LIST_LEN; i++) {
+		values[i] = iteration + i;
+	}
+	int before = received;
+	int rval = calc->programSendList(values, BENCH_LIST_LEN);
+	if (rval) {
+		return rval;
+	}
+	awaitReceived(before);
+	uint8_t type = receivedType;
+	bool listType = (type == VarTypes82::VarRList || type == VarTypes84PCSE::VarRList);
+	if (!listType || TIVar::sizeWordToInt(receivedData) != BENCH_LIST_LEN) {
+		return ERR_INVALID;
+	}
+	int size = TIVar::sizeOfReal(receivedModel);
+	for(int i = 0; i < BENCH_LIST_LEN; i++) {
+		if (TIVar::realToLong8x(&receivedData[2 + size * i], receivedModel) != iteration + i) {
+			return ERR_INVALID;
+		}
+	}
+	return 0;
+}
+
+static int sendString(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	char str[16];
+	snprintf(str, sizeof(str), "HELLO%d", iteration % 1000);
+	int before = received;
+	int rval = calc->programSendString(str);
+	if (rval) {
+		return rval;
+	}
+	awaitReceived(before);
+	if (receivedType != VarTypes82::VarString ||
+	    !(TIVar::strVarToString8x(receivedData, receivedModel) == str))
+	{
+		return ERR_INVALID;
+	}
+	return 0;
+}
+
+static int getReal(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	uint8_t data[16];
+	int length;
+	requestValue = iteration;
+	int rval = calc->programGet(VarTypes82::VarReal, "A", data, &length, sizeof(data));
+	if (rval) {
+		return rval;
+	}
+	return (TIVar::realToLong8x(data, CALC82) == iteration) ? 0 : ERR_INVALID;
+}
+
+static int screenshot(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	uint8_t msg_header[4] = {COMP83P, SCR, 0, 0};
+	uint8_t screen[EMU_SCREEN_SIZE];
+	int length;
+	int rval;
+
+	calc->screen()[iteration % EMU_SCREEN_SIZE] ^= 0xFF;
+	if ((rval = cbl->send(msg_header, NULL, 0)) ||
+	    (rval = cbl->get(msg_header, NULL, &length, 0)) ||
+	    (rval = cbl->getOrRetry(msg_header, screen, &length, sizeof(screen), COMP83P)))
+	{
+		return rval;
+	}
+	msg_header[0] = COMP83P;
+	msg_header[1] = ACK;
+	msg_header[2] = msg_header[3] = 0;
+	if ((rval = cbl->send(msg_header, NULL, 0))) {
+		return rval;
+	}
+	return (length == EMU_SCREEN_SIZE && 0 == memcmp(screen, calc->screen(), length)) ? 0 : ERR_INVALID;
+}
+
+static int keyPress(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	uint16_t key = 0x80 + (iteration % 0x60);
+	uint8_t msg_header[4] = {COMP83P, KEY, (uint8_t)(key & 0xff), (uint8_t)(key >> 8)};
+	int length;
+	int rval;
+	if ((rval = cbl->send(msg_header, NULL, 0)) ||
+	    (rval = cbl->get(msg_header, NULL, &length, 0)) ||
+	    (rval = cbl->get(msg_header, NULL, &length, 0)))
+	{
+		return rval;
+	}
+	return (!calc->keys().empty() && calc->keys().back() == key) ? 0 : ERR_INVALID;
+}
+
+static int discover(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	static const uint8_t hardware[] = {0x00, 0x02, 0x04};
+	LinkProfile profile;
+	int rval = cbl->discover(&profile);
+	if (rval) {
+		return rval;
+	}
+	if (profile.model != CALC83P || profile.computer_id != COMP83P ||
+	    profile.hardware != hardware[calc->model()] || cbl->profile() != &profile)
+	{
+		return ERR_INVALID;
+	}
+	cbl->setProfile(NULL);
+	return 0;
+}
+
+static void setupPrograms() {
+	for(int i = 0; i < BENCH_PROGRAMS; i++) {
+		uint8_t name[2] = {(uint8_t)('A' + i), 0};
+		TIVar::intToSizeWord(BENCH_PROGRAM_LEN - 2, programs[i]);
+		for(int j = 2; j < BENCH_PROGRAM_LEN; j++) {
+			programs[i][j] = 0x30 + (i * 7 + j) % 10;
+		}
+		programHandles[i] = varSync.add(0x05, name, 1, programs[i], BENCH_PROGRAM_LEN);
+	}
+}
+
+// Sync, and check what was sent and that the calculator has every program
+static int syncPrograms(CalcEmulator* calc, int expected) {
+	int rval = varSync.sync(silentLink);
+	if (rval < 0) {
+		return rval;
+	}
+	if (rval != expected || varSync.skipped() != BENCH_PROGRAMS - expected) {
+		return ERR_INVALID;
+	}
+	for(int i = 0; i < BENCH_PROGRAMS; i++) {
+		uint8_t name[EMU_NAME_LEN] = {(uint8_t)('A' + i)};
+		struct EmulatedVar* var = calc->findVar(0x05, name);
+		if (var == NULL || var->data.size() != BENCH_PROGRAM_LEN ||
+		    memcmp(var->data.data(), programs[i], BENCH_PROGRAM_LEN))
+		{
+			return ERR_INVALID;
+		}
+	}
+	return 0;
+}
+
+static int syncAll(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	calc->clearVars();
+	return syncPrograms(calc, BENCH_PROGRAMS);
+}
+
+static int syncChanged(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	int program = iteration % BENCH_PROGRAMS;
+	programs[program][2 + iteration % (BENCH_PROGRAM_LEN - 2)] ^= 0x01;
+	varSync.changed(programHandles[program], BENCH_PROGRAM_LEN);
+	return syncPrograms(calc, 1);
+}
+
+static int resync(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	return syncPrograms(calc, 0);
+}
+
+static int directory(CalcEmulator* calc, CBL2* cbl, int iteration) {
+	uint8_t header[SILENT_MAX_HEADER];
+	int length;
+	int count = 0;
+	int rval = silentLink->beginDirectory();
+	while (rval == 0) {
+		if (0 == (rval = silentLink->nextDirectoryEntry(header, &length))) {
+			count++;
+		}
+	}
+	if (rval < 0) {
+		return rval;
+	}
+	return (count >= BENCH_PROGRAMS) ? 0 : ERR_INVALID;
+}
+
+static const struct Scenario scenarios[] = {
+	{"Send( real",	false,	sendReal,	9},
+	{"Send( list",	false,	sendList,	2 + 10 * BENCH_LIST_LEN},
+	{"Send( string",	false,	sendString,	10},
+	{"Get( real",	false,	getReal,	9},
+	{"screenshot",	true,	screenshot,	EMU_SCREEN_SIZE},
+	{"key press",	true,	keyPress,	0},
+	{"discover",	true,	discover,	0},
+	{"sync, all",	true,	syncAll,	BENCH_PROGRAMS * BENCH_PROGRAM_LEN},
+	{"sync, 1 new",	true,	syncChanged,	BENCH_PROGRAM_LEN},
+	{"re-sync",	true,	resync,	0},
+	{"directory",	true,	directory,	0},
+};
+
+static void serviceLoop(CalcEmulator* calc) {
+	while (running) {
+		calc->serviceTick(TIMEOUT);
+	}
+}
+
+static void relayLoop(LinkRelay* relay) {
+	while (relaying) {
+		relay->relayTick(TIMEOUT);
+	}
+}
+
+// One of several CBL2s on one board. Everything it knows is in here,
+// not in globals, so the handler can tell the stations apart.
+class Station final: public CBL2Handler {
+	public:
+		StaticCBL2<16> cbl;
+		int id;
+		long value;							// Last real received, sent back on Get(
+		std::atomic<int> received;
+
+		Station(int tip, int ring, int id) : cbl(tip, ring), id(id), value(-1), received(0) {}
+
+		int onGet(CBL2* from, uint8_t type, enum Endpoint model, int datalength) {
+			if (from != &cbl || type != VarTypes82::VarReal) {
+				return ERR_INVALID;
+			}
+			value = TIVar::realToLong8x(from->data(), model);
+			received++;
+			return 0;
+		}
+
+		int onSend(CBL2* from, uint8_t type, enum Endpoint model, int* headerlength, int* datalength,
+		           data_callback* callback) {
+			*datalength = TIVar::longToReal8x(value, from->data(), model);
+			TIVar::intToSizeWord(*datalength, from->header());
+			*headerlength = 13;
+			return 0;
+		}
+};
+
+static void stationsLoop(Station** stations, int count) {
+	while (running) {
+		bool idle = true;
+		for(int i = 0; i < count; i++) {
+			if (0 == stations[i]->cbl.waitForLink(0)) {
+				stations[i]->cbl.eventLoopTick(true);
+				idle = false;
+			}
+		}
+		if (idle) {
+			std::this_thread::yield();			// Let the calculators have the CPU
+		}
+	}
+}
+
+// Each calculator sends its station a real that says which station
+// and run it is for, then gets it back
+static void stationRuns(CalcEmulator* calc, Station* station, int runs, int* errors, int* lasterror) {
+	for(int i = 0; i < runs; i++) {
+		long expected = station->id * 100000l + i;
+		uint8_t data[16];
+		int length;
+		int before = station->received;
+		int rval = calc->programSendReal(expected);
+		if (!rval) {
+			while (station->received == before) {
+				std::this_thread::yield();
+			}
+			rval = calc->programGet(VarTypes82::VarReal, "A", data, &length, sizeof(data));
+		}
+		if (!rval && (station->value != expected || TIVar::realToLong8x(data, CALC82) != expected)) {
+			rval = ERR_INVALID;
+		}
+		if (rval) {
+			(*errors)++;
+			*lasterror = rval;
+			delay(2 * TIMEOUT / 1000);				// Let both ends give up on the exchange
+		}
+	}
+}
+
+static int runStations(int count, int runs, DelayedPins* pins, unsigned long latency) {
+	static const char* names[] = {"83p", "84p", "84pcse"};
+	CalcEmulator* calcs[BENCH_MAX_STATIONS];
+	Station* stations[BENCH_MAX_STATIONS];
+	std::thread threads[BENCH_MAX_STATIONS];
+	int errors[BENCH_MAX_STATIONS] = {};
+	int lasterrors[BENCH_MAX_STATIONS] = {};
+
+	for(int i = 0; i < count; i++) {
+		int pin = 8 + 4 * i;
+		calcs[i] = new CalcEmulator(pin, pin + 1, (enum EmulatedModel)(i % 3));
+		stations[i] = new Station(pin + 2, pin + 3, i + 1);
+		pins->setDelay(pin, latency / 2);
+		pins->setDelay(pin + 1, latency / 2);
+		calcs[i]->begin();
+		stations[i]->cbl.begin();
+		stations[i]->cbl.setupHandler(stations[i]);
+	}
+
+	running = true;
+	std::thread library(stationsLoop, stations, count);
+	unsigned long start = micros();
+	for(int i = 0; i < count; i++) {
+		threads[i] = std::thread(stationRuns, calcs[i], stations[i], runs, &errors[i], &lasterrors[i]);
+	}
+	int failed = 0;
+	for(int i = 0; i < count; i++) {
+		threads[i].join();
+	}
+	unsigned long elapsed = micros() - start;
+	running = false;
+	library.join();
+
+	for(int i = 0; i < count; i++) {
+		printf("CBL2 %d (%-6s) %4d runs, %2d failed", i + 1, names[i % 3], runs, errors[i]);
+		if (errors[i]) {
+			printf(" (last error %d)", lasterrors[i]);
+		}
+		printf("\n");
+		failed += errors[i];
+		delete stations[i];
+		delete calcs[i];
+	}
+	printf("%d CBL2s on one thread: %7.2f ms per Send( and Get( pair, %.0f pairs/s in all\n", count,
+	       elapsed / 1000.0 / runs, 1e6 * count * runs / elapsed);
+	return failed ? 1 : 0;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-n runs] [-b bit latency us] [-m 83p|84p|84pcse] [-w work ms] [-g gap ms] [-p] [-r]"
+	        " [-c CBL2s]\n", name);
+}
+
+int main(int argc, char** argv) {
+	int runs = 20;
+	unsigned long latency = 0;
+	enum EmulatedModel model = EMU_TI84P;
+	bool relayed = false;
+	int stations = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:b:m:w:g:prc:")) != -1) {
+		switch(opt) {
+			case 'n': runs = atoi(optarg); break;
+			case 'b': latency = strtoul(optarg, NULL, 0); break;
+			case 'w': work = strtoul(optarg, NULL, 0); break;
+			case 'g': gap = strtoul(optarg, NULL, 0); break;
+			case 'p': pooled = true; break;
+			case 'r': relayed = true; break;
+			case 'c': stations = atoi(optarg); break;
+			case 'm':
+				if (0 == strcmp(optarg, "83p")) {
+					model = EMU_TI83P;
+				} else if (0 == strcmp(optarg, "84p")) {
+					model = EMU_TI84P;
+				} else if (0 == strcmp(optarg, "84pcse")) {
+					model = EMU_TI84PCSE;
+				} else {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (runs < 1 || stations < 0 || stations > BENCH_MAX_STATIONS) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	FakeChip fake;
+	for(int i = 0; i < stations; i++) {
+		fake.wire(8 + 4 * i, 10 + 4 * i);
+		fake.wire(9 + 4 * i, 11 + 4 * i);
+	}
+	if (relayed) {
+		fake.wire(0, 4);
+		fake.wire(1, 5);
+		fake.wire(6, 2);
+		fake.wire(7, 3);
+	} else {
+		fake.wire(0, 2);
+		fake.wire(1, 3);
+	}
+	fake.setYield(std::thread::hardware_concurrency() < 2);
+	DelayedPins pins(&fake);
+	pins.setDelay(0, latency / 2);
+	pins.setDelay(1, latency / 2);
+	hostSetPinBackend(&pins);
+	if (stations) {
+		return runStations(stations, runs, &pins, latency);
+	}
+
+	CalcEmulator calc(0, 1, model);
+	CBL2 library(2, 3);
+	SilentLink link(2, 3);
+	cbl = &library;
+	silentLink = &link;
+	calc.begin();
+	library.begin();
+	setupPrograms();
+	library.setupCallbacks(cblHeader, cblData, sizeof(cblData), onReceived, onRequest);
+	if (pooled) {
+		library.setupBufferPool(&pool);
+	}
+
+	TICL relayA(4, 5);
+	TICL relayB(6, 7);
+	LinkRelay relay(&relayA, &relayB);
+	std::thread relayThread;
+	if (relayed) {
+		relayA.begin();
+		relayB.begin();
+		relaying = true;
+		relayThread = std::thread(relayLoop, &relay);
+	}
+
+	int failed = 0;
+	for(size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+		const struct Scenario* scenario = &scenarios[s];
+		running = true;
+		std::thread thread = scenario->silent ? std::thread(serviceLoop, &calc)
+		                                      : std::thread(libraryLoop, false);
+
+		int errors = 0;
+		int lasterror = 0;
+		unsigned long worst = 0;
+		unsigned long start = micros();
+		for(int i = 0; i < runs; i++) {
+			unsigned long began = micros();
+			int rval = scenario->run(&calc, &library, i);
+			worst = max(worst, micros() - began);
+			if (rval) {
+				errors++;
+				lasterror = rval;
+				delay(2 * TIMEOUT / 1000);			// Let both ends give up on the exchange
+			}
+		}
+		unsigned long elapsed = micros() - start;
+		running = false;
+		thread.join();
+
+		printf("%-13s %4d runs, %2d failed, %7.2f ms mean, %7.2f ms worst", scenario->name,
+		       runs, errors, elapsed / 1000.0 / runs, worst / 1000.0);
+		if (scenario->bytes) {
+			printf(", %6.0f data bytes/s", 1e6 * scenario->bytes * (runs - errors) / elapsed);
+		}
+		if (errors) {
+			printf(" (last error %d)", lasterror);
+		}
+		printf("\n");
+		failed += errors;
+	}
+	if (relayed) {
+		relaying = false;
+		relayThread.join();
+		printf("relay: %u packets to the library, %u back, %u errors\n", relay.packets(RELAY_A_TO_B),
+		       relay.packets(RELAY_B_TO_A), relay.errors());
+	}
+	return failed ? 1 : 0;
+}
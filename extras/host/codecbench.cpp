@@ -0,0 +1,387 @@
+/*************************************************
+ *  codecbench.cpp - Benchmarks of the variable  *
+ *           codecs, packet framing and picture  *
+ *           encoder, with no link involved.     *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+// Each benchmark runs its operation for at least -t milliseconds,
+// cycling through a fixed set of inputs drawn from one distribution,
+// and prints a CSV line: name, what one operation is, operations run,
+// nanoseconds and heap allocations per operation. The output is meant
+// to be kept per commit and compared; -f runs only the benchmarks
+// whose names contain a string. Allocations are counted by wrapping
+// malloc, which the host String and operator new both go through.
+// The RealBatch benchmarks first check that their kernel gives the
+// same bytes and doubles as TIVar, and stop the run if it doesn't.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "RealBatch.h"
+#include "TIPacket.h"
+#include "TIPic.h"
+#include "TIVar.h"
+
+#define BENCH_INPUTS		256				// Inputs each benchmark cycles through
+#define BENCH_MAX_STRING	256
+#define BENCH_MAX_PAYLOAD	4096
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+static unsigned long allocations;
+
+extern "C" void* malloc(size_t size) {
+	allocations++;
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+	allocations++;
+	return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+struct Benchmark {
+	const char* name;
+	const char* unit;						// What one operation is
+	bool (*setup)(int variant);				// False skips the benchmark
+	int (*run)(int i, int variant);			// Returns operations done
+	int variant;
+};
+
+static volatile long long sink;
+
+// Inputs, one set per benchmark, built by its setup()
+static double doubles[BENCH_INPUTS];
+static long long longs[BENCH_INPUTS];
+static uint8_t reals[BENCH_INPUTS][16];
+static String* strings[BENCH_INPUTS];
+static uint8_t strvars[BENCH_INPUTS][2 + 2 * BENCH_MAX_STRING];
+static uint8_t payload[BENCH_MAX_PAYLOAD];
+static uint8_t wire[PACKET_HEADER_LEN + BENCH_MAX_PAYLOAD + 2];
+static int wirelength;
+static uint8_t pixels[PIC_COLOR_WIDTH * 3];
+static uint8_t picrow[PIC_COLOR_ROW_BYTES];
+static int16_t picerrors[2 * (PIC_COLOR_WIDTH + 2) * 3];
+
+// TIVar has no TI-89 reals yet
+static const enum Endpoint models[] = {CALC83P, CALC85b};
+
+// Value distributions for the real number codecs
+enum Distribution {
+	DIST_SMALL = 0,							// Integers 0-99
+	DIST_LARGE = 1,							// Magnitudes 1e-90 to 1e90
+	DIST_NEGATIVE = 2,						// Negative, with fractions
+};
+
+static double draw(int distribution) {
+	switch(distribution) {
+		case DIST_SMALL:
+			return rand() % 100;
+		case DIST_LARGE:
+			return (1 + (rand() % 1000) / 1000.0) * pow(10, (rand() % 181) - 90);
+		default:
+			return -(rand() % 100000) / 7.0;
+	}
+}
+
+// variant: model index * 3 + distribution
+static bool setupReals(int variant) {
+	srand(variant);
+	for(int i = 0; i < BENCH_INPUTS; i++) {
+		doubles[i] = draw(variant % 3);
+		longs[i] = (variant % 3 == DIST_LARGE) ? (long long)(rand() % 1000) * 1000000000LL
+		                                       : (long long)doubles[i];
+		TIVar::floatToReal8x(doubles[i], reals[i], models[variant / 3]);
+	}
+	return true;
+}
+
+static int floatToReal(int i, int variant) {
+	uint8_t real[16];
+	sink += TIVar::floatToReal8x(doubles[i % BENCH_INPUTS], real, models[variant / 3]) + real[1];
+	return 1;
+}
+
+static int realToFloat(int i, int variant) {
+	sink += (long long)TIVar::realToFloat8x(reals[i % BENCH_INPUTS], models[variant / 3]);
+	return 1;
+}
+
+static int longToReal(int i, int variant) {
+	uint8_t real[16];
+	sink += TIVar::longToReal8x(longs[i % BENCH_INPUTS], real, models[variant / 3]) + real[1];
+	return 1;
+}
+
+static int realToLong(int i, int variant) {
+	sink += TIVar::realToLong8x(reals[i % BENCH_INPUTS], models[variant / 3]);
+	return 1;
+}
+
+// Values every batch kernel has to get right, besides the drawn ones
+static const double edgeValues[] = {
+	0.0, -0.0, NAN, -NAN, 0.5, -0.5, 9.5, 1e13, 1e14, 99999999999999.5, 1e-320, 5e-324,
+	1.7976931348623157e308, -2.2250738585072014e-308, 123456789.123456789, -1e99, 1e100,
+};
+
+static uint8_t batchReals[(BENCH_INPUTS + sizeof(edgeValues) / sizeof(edgeValues[0])) * 10];
+static double batchDoubles[BENCH_INPUTS + sizeof(edgeValues) / sizeof(edgeValues[0])];
+
+// floatToReal8x can round a digit up to 10, which realToFloat8x reads
+// from past the end of its table
+static bool validBCD(const uint8_t* real, int size) {
+	for(int i = size - 7; i < size; i++) {
+		if ((real[i] >> 4) > 9 || (real[i] & 0x0f) > 9) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Convert the inputs and the edge values with the kernel, both ways,
+// and compare with TIVar
+static bool checkBatch(enum Endpoint model) {
+	const int edges = sizeof(edgeValues) / sizeof(edgeValues[0]);
+	double values[BENCH_INPUTS + edges];
+	int size = TIVar::sizeOfReal(model);
+	memcpy(values, edgeValues, sizeof(edgeValues));
+	memcpy(&values[edges], doubles, sizeof(doubles));
+	RealBatch::fromFloats(values, BENCH_INPUTS + edges, batchReals, model);
+	RealBatch::toFloats(batchReals, BENCH_INPUTS + edges, batchDoubles, model);
+	for(int i = 0; i < BENCH_INPUTS + edges; i++) {
+		uint8_t real[16];
+		TIVar::floatToReal8x(values[i], real, model);
+		double value = TIVar::realToFloat8x(real, model);
+		if (memcmp(real, &batchReals[i * size], size) ||
+		    (validBCD(real, size) && memcmp(&value, &batchDoubles[i], sizeof(value))))
+		{
+			fprintf(stderr, "%s kernel differs from TIVar on %.17g\n",
+			        RealBatch::kernelName(RealBatch::kernel()), values[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+// variant: BatchKernel * 6 + model index * 3 + distribution. Each run
+// converts all the inputs at once, like the elements of one list.
+static bool setupBatch(int variant) {
+	setupReals(variant % 6);
+	if (!RealBatch::setKernel((enum BatchKernel)(variant / 6))) {
+		return false;
+	}
+	if (!checkBatch(models[(variant % 6) / 3])) {
+		exit(1);
+	}
+	return true;
+}
+
+static int batchFromFloats(int i, int variant) {
+	sink += RealBatch::fromFloats(doubles, BENCH_INPUTS, batchReals, models[(variant % 6) / 3]);
+	return BENCH_INPUTS;
+}
+
+static int batchToFloats(int i, int variant) {
+	sink += RealBatch::toFloats(batchReals, BENCH_INPUTS, batchDoubles, models[(variant % 6) / 3]);
+	return BENCH_INPUTS;
+}
+
+// variant: string length; strings mix capitals, digits and lowercase
+// letters, which are two-byte tokens on the TI-83+
+static bool setupStrings(int variant) {
+	static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 abcdefghijklmnopqrstuvwxyz";
+	char buffer[BENCH_MAX_STRING + 1];
+	srand(variant);
+	for(int i = 0; i < BENCH_INPUTS; i++) {
+		for(int j = 0; j < variant; j++) {
+			buffer[j] = chars[rand() % (sizeof(chars) - 1)];
+		}
+		buffer[variant] = '\0';
+		delete strings[i];
+		strings[i] = new String(buffer);
+		TIVar::stringToStrVar8x(*strings[i], strvars[i], CALC83P);
+	}
+	return true;
+}
+
+static int stringToStrVar(int i, int variant) {
+	sink += TIVar::stringToStrVar8x(*strings[i % BENCH_INPUTS], strvars[0], CALC83P);
+	return 1;
+}
+
+static int strVarToString(int i, int variant) {
+	sink += TIVar::strVarToString8x(strvars[i % BENCH_INPUTS], CALC83P).length();
+	return 1;
+}
+
+// variant: DATA payload length, as sent with its header and checksum
+static int serialize(int i, int variant) {
+	uint8_t header[4] = {COMP83P, DATA, (uint8_t)(variant & 0xff), (uint8_t)(variant >> 8)};
+	PacketSerializer packet;
+	packet.begin(header, payload, variant);
+	wirelength = packet.read(wire, sizeof(wire));
+	sink += wirelength;
+	return 1;
+}
+
+static bool setupPackets(int variant) {
+	for(int i = 0; i < variant; i++) {
+		payload[i] = i * 37;
+	}
+	serialize(0, variant);
+	return true;
+}
+
+// A byte at a time, as TICL::get() does
+static int parse(int i, int variant) {
+	PacketParser parser;
+	for(int j = 0; j < wirelength; j++) {
+		sink += parser.push(wire[j]);
+	}
+	return 1;
+}
+
+// variant: PicFormat * 3 + DitherMode; color pictures get RGB rows
+static bool setupPic(int variant) {
+	srand(variant);
+	for(size_t i = 0; i < sizeof(pixels); i++) {
+		pixels[i] = rand() & 0xff;
+	}
+	return true;
+}
+
+static int encodePicRow(int i, int variant) {
+	static PicEncoder encoder;
+	enum PicFormat format = (enum PicFormat)(variant / 3);
+	if (i == 0 || encoder.encodeRow(pixels, picrow) < 0) {
+		encoder.begin(format, (enum DitherMode)(variant % 3), format == PIC_COLOR, picerrors);
+		encoder.encodeRow(pixels, picrow);
+	}
+	sink += picrow[0];
+	return encoder.width();
+}
+
+static const struct Benchmark benchmarks[] = {
+	{"floatToReal8x/83/small",		"value",	setupReals,		floatToReal,	0},
+	{"floatToReal8x/83/large",		"value",	setupReals,		floatToReal,	1},
+	{"floatToReal8x/83/negative",	"value",	setupReals,		floatToReal,	2},
+	{"floatToReal8x/85/small",		"value",	setupReals,		floatToReal,	3},
+	{"floatToReal8x/85/large",		"value",	setupReals,		floatToReal,	4},
+	{"floatToReal8x/85/negative",	"value",	setupReals,		floatToReal,	5},
+	{"realToFloat8x/83/small",		"value",	setupReals,		realToFloat,	0},
+	{"realToFloat8x/83/large",		"value",	setupReals,		realToFloat,	1},
+	{"realToFloat8x/83/negative",	"value",	setupReals,		realToFloat,	2},
+	{"realToFloat8x/85/large",		"value",	setupReals,		realToFloat,	4},
+	{"longToReal8x/83/small",		"value",	setupReals,		longToReal,		0},
+	{"longToReal8x/83/large",		"value",	setupReals,		longToReal,		1},
+	{"longToReal8x/83/negative",	"value",	setupReals,		longToReal,		2},
+	{"longToReal8x/85/large",		"value",	setupReals,		longToReal,		4},
+	{"realToLong8x/83/small",		"value",	setupReals,		realToLong,		0},
+	{"realToLong8x/83/negative",	"value",	setupReals,		realToLong,		2},
+	{"RealBatch::fromFloats/scalar/83/large",	"value",	setupBatch,	batchFromFloats,	1},
+	{"RealBatch::fromFloats/vector/83/small",	"value",	setupBatch,	batchFromFloats,	6},
+	{"RealBatch::fromFloats/vector/83/large",	"value",	setupBatch,	batchFromFloats,	7},
+	{"RealBatch::fromFloats/vector/85/negative",	"value",	setupBatch,	batchFromFloats,	11},
+	{"RealBatch::fromFloats/avx2/83/small",		"value",	setupBatch,	batchFromFloats,	12},
+	{"RealBatch::fromFloats/avx2/83/large",		"value",	setupBatch,	batchFromFloats,	13},
+	{"RealBatch::fromFloats/avx2/85/negative",	"value",	setupBatch,	batchFromFloats,	17},
+	{"RealBatch::toFloats/scalar/83/large",		"value",	setupBatch,	batchToFloats,		1},
+	{"RealBatch::toFloats/vector/83/small",		"value",	setupBatch,	batchToFloats,		6},
+	{"RealBatch::toFloats/vector/83/large",		"value",	setupBatch,	batchToFloats,		7},
+	{"RealBatch::toFloats/vector/85/negative",	"value",	setupBatch,	batchToFloats,		11},
+	{"RealBatch::toFloats/avx2/83/small",		"value",	setupBatch,	batchToFloats,		12},
+	{"RealBatch::toFloats/avx2/83/large",		"value",	setupBatch,	batchToFloats,		13},
+	{"RealBatch::toFloats/avx2/85/negative",	"value",	setupBatch,	batchToFloats,		17},
+	{"stringToStrVar8x/83/8",		"string",	setupStrings,	stringToStrVar,	8},
+	{"stringToStrVar8x/83/255",		"string",	setupStrings,	stringToStrVar,	255},
+	{"strVarToString8x/83/8",		"string",	setupStrings,	strVarToString,	8},
+	{"strVarToString8x/83/255",		"string",	setupStrings,	strVarToString,	255},
+	{"serialize/0",					"packet",	setupPackets,	serialize,		0},
+	{"serialize/9",					"packet",	setupPackets,	serialize,		9},
+	{"serialize/768",				"packet",	setupPackets,	serialize,		768},
+	{"serialize/4096",				"packet",	setupPackets,	serialize,		4096},
+	{"parse/0",						"packet",	setupPackets,	parse,			0},
+	{"parse/9",						"packet",	setupPackets,	parse,			9},
+	{"parse/768",					"packet",	setupPackets,	parse,			768},
+	{"parse/4096",					"packet",	setupPackets,	parse,			4096},
+	{"PicEncoder/mono/none",		"pixel",	setupPic,		encodePicRow,	0},
+	{"PicEncoder/mono/ordered",		"pixel",	setupPic,		encodePicRow,	1},
+	{"PicEncoder/mono/diffusion",	"pixel",	setupPic,		encodePicRow,	2},
+	{"PicEncoder/color/none",		"pixel",	setupPic,		encodePicRow,	3},
+	{"PicEncoder/color/ordered",	"pixel",	setupPic,		encodePicRow,	4},
+	{"PicEncoder/color/diffusion",	"pixel",	setupPic,		encodePicRow,	5},
+};
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-t min ms per benchmark] [-f name filter]\n", name);
+}
+
+int main(int argc, char** argv) {
+	long minNanos = 200 * 1000000L;
+	const char* filter = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:f:")) != -1) {
+		switch(opt) {
+			case 't': minNanos = atol(optarg) * 1000000L; break;
+			case 'f': filter = optarg; break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (minNanos <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	printf("benchmark,unit,ops,ns_per_op,allocs_per_op\n");
+	for(size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+		const struct Benchmark* bench = &benchmarks[b];
+		if (filter && !strstr(bench->name, filter)) {
+			continue;
+		}
+		if (!bench->setup(bench->variant)) {
+			continue;
+		}
+
+		// Run in growing batches until the time is up, checking the
+		// clock only between batches
+		typedef std::chrono::steady_clock Clock;
+		long long ops = 0;
+		long long nanos = 0;
+		unsigned long allocs = 0;
+		int batch = 16;
+		int i = 0;
+		while (nanos < minNanos) {
+			unsigned long allocsBefore = allocations;
+			Clock::time_point start = Clock::now();
+			for(int j = 0; j < batch; j++, i++) {
+				ops += bench->run(i, bench->variant);
+			}
+			nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+			allocs += allocations - allocsBefore;
+			if (batch < (1 << 20)) {
+				batch *= 2;
+			}
+		}
+		printf("%s,%s,%lld,%.2f,%.3f\n", bench->name, bench->unit, ops, (double)nanos / ops,
+		       (double)allocs / ops);
+		fflush(stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*************************************************
+ *  corobench.cpp - Measures how many links one  *
+ *           thread can drive with AsyncLink.    *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+// Like linkbench, each link is a sending and a receiving AsyncLink
+// on wired-together FakeChip pins, but every link runs on the
+// calling thread, interleaved by one LinkScheduler.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+
+#include "AsyncLink.h"
+#include "HostGPIO.h"
+
+#define BENCH_MAX_LINKS	(HOST_MAX_PINS / 4)
+#define BENCH_MAX_DATA	4096
+
+struct LinkStats {
+	unsigned long deadline;
+	int size;
+	bool sending;
+	unsigned long packets;
+	unsigned long bytes;
+	unsigned long errors;
+	unsigned long elapsed_ms;
+};
+
+static uint8_t sendData[BENCH_MAX_DATA];
+
+static LinkTask sendPackets(AsyncLink* link, struct LinkStats* stats) {
+	uint8_t header[4] = {COMP83P, DATA, 0, 0};
+	header[2] = stats->size & 0xff;
+	header[3] = stats->size >> 8;
+	while (millis() < stats->deadline) {
+		co_await link->send(header, sendData, stats->size);
+	}
+	stats->sending = false;
+	co_return 0;
+}
+
+static LinkTask receivePackets(AsyncLink* link, struct LinkStats* stats) {
+	uint8_t header[4];
+	std::vector<uint8_t> data(BENCH_MAX_DATA);
+	int length;
+	unsigned long start = millis();
+	while (stats->sending) {
+		int rval = co_await link->get(header, data.data(), &length, BENCH_MAX_DATA, TIMEOUT);
+		if (rval == 0) {
+			stats->packets++;
+			stats->bytes += length;
+		} else if (rval != ERR_READ_ENTER_TIMEOUT) {
+			stats->errors++;
+		}
+	}
+	stats->elapsed_ms = millis() - start;
+	co_return 0;
+}
+
+int main(int argc, char** argv) {
+	int links = 1;
+	int size = 256;
+	int seconds = 5;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:s:t:")) != -1) {
+		switch(opt) {
+			case 'l': links = atoi(optarg); break;
+			case 's': size = atoi(optarg); break;
+			case 't': seconds = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-l links] [-s packet size] [-t seconds]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (links < 1 || links > BENCH_MAX_LINKS || size < 1 || size > BENCH_MAX_DATA) {
+		fprintf(stderr, "links must be 1-%d, size 1-%d\n", BENCH_MAX_LINKS, BENCH_MAX_DATA);
+		return 1;
+	}
+
+	FakeChip fake;
+	for(int i = 0; i < links; i++) {
+		fake.wire(4 * i, 4 * i + 2);
+		fake.wire(4 * i + 1, 4 * i + 3);
+	}
+	hostSetPinBackend(&fake);
+	for(int i = 0; i < BENCH_MAX_DATA; i++) {
+		sendData[i] = (uint8_t)(i * 37 + 11);
+	}
+
+	LinkScheduler scheduler;
+	std::vector<AsyncLink*> ends;
+	std::vector<struct LinkStats> stats(links);
+	unsigned long deadline = millis() + 1000ul * seconds;
+	for(int i = 0; i < links; i++) {
+		AsyncLink* sender = new AsyncLink(&scheduler, 4 * i, 4 * i + 1);
+		AsyncLink* receiver = new AsyncLink(&scheduler, 4 * i + 2, 4 * i + 3);
+		sender->begin();
+		receiver->begin();
+		ends.push_back(sender);
+		ends.push_back(receiver);
+
+		stats[i].deadline = deadline;
+		stats[i].size = size;
+		stats[i].sending = true;
+		stats[i].packets = stats[i].bytes = stats[i].errors = stats[i].elapsed_ms = 0;
+		scheduler.spawn(receivePackets(receiver, &stats[i]));
+		scheduler.spawn(sendPackets(sender, &stats[i]));
+	}
+	scheduler.run();
+
+	double total = 0;
+	for(int i = 0; i < links; i++) {
+		double rate = stats[i].elapsed_ms ? 1000.0 * stats[i].bytes / stats[i].elapsed_ms : 0;
+		total += rate;
+		printf("link %d: %lu packets, %lu bytes, %lu errors, %.0f bytes/s\n",
+		       i, stats[i].packets, stats[i].bytes, stats[i].errors, rate);
+	}
+	printf("total: %.0f bytes/s over %d link%s on one thread\n", total, links, (links == 1) ? "" : "s");
+
+	for(size_t i = 0; i < ends.size(); i++) {
+		delete ends[i];
+	}
+	return 0;
+}
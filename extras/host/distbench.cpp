@@ -0,0 +1,288 @@
+/*************************************************
+ *  distbench.cpp - Times and checks the         *
+ *           Distributor against emulated        *
+ *           calculators behind LinkBridges on   *
+ *           pseudo-terminals.                   *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+// -k LinkBridges each run on their own thread, reading and writing a
+// pseudo-terminal as they would a USB serial port, with a CalcEmulator
+// on the other end of each one's link. -n calculators are sent a
+// bundle of -p programs of -s bytes each: as many at a time as there
+// are bridges, with the emulated calculators on each bridge swapped
+// for new ones in between, as a teacher would. That's done once with
+// the Distributor on one thread, like one tool run per bridge, then
+// on -t threads, and every calculator must end up with every program.
+// -b slows each bit the calculators send or acknowledge by that many
+// microseconds, -v prints every progress report, and -x leaves the
+// last bridge without a calculator, to see it fail. The bridges and
+// calculators here spin on their pins: with fewer CPUs than bridges,
+// they take time from each other that real ones wouldn't.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "CalcEmulator.h"
+#include "Distributor.h"
+#include "HostGPIO.h"
+#include "LinkBridge.h"
+#include "TIVar.h"
+
+#define BENCH_MAX_BRIDGES	16			// Four pins each: calculator, then bridge
+#define BENCH_MAX_PROGRAMS	16
+
+struct Station {
+	int master;							// The host's end of the pseudo-terminal
+	int slave;							// The bridge's end
+	char name[32];
+	HardwareSerial* serial;
+	LinkBridge* bridge;
+	CalcEmulator* calc;
+	std::thread bridgeThread;
+	std::thread calcThread;
+};
+
+static std::atomic<bool> running;
+static bool verbose;
+static std::vector<std::vector<uint8_t> > programs;
+static const char* states[] = {"waiting", "running", "done", "FAILED"};
+
+static void bridgeLoop(struct Station* station) {
+	while (running) {
+		station->bridge->bridgeTick();
+		if (station->serial->available() == 0) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+static void calcLoop(CalcEmulator* calc) {
+	while (running) {
+		calc->serviceTick(TIMEOUT);
+	}
+}
+
+// A raw pseudo-terminal pair, so nothing is echoed or edited
+static int openPty(struct Station* station) {
+	station->master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (station->master < 0 || grantpt(station->master) || unlockpt(station->master)) {
+		return -1;
+	}
+	snprintf(station->name, sizeof(station->name), "%s", ptsname(station->master));
+	station->slave = open(station->name, O_RDWR | O_NOCTTY);
+	if (station->slave < 0) {
+		return -1;
+	}
+	struct termios tio;
+	tcgetattr(station->slave, &tio);
+	cfmakeraw(&tio);
+	return tcsetattr(station->slave, TCSANOW, &tio);
+}
+
+static void onProgress(const struct DeviceStatus* device, void* context) {
+	if (!verbose) {
+		return;
+	}
+	Bundle* bundle = (Bundle*)context;
+	printf("  %-12s %-7s %d/%d", device->name, states[device->state], device->sent, bundle->count());
+	if (device->error) {
+		printf(" at %s: error %d, attempt %d", device->step, device->error, device->attempts);
+	}
+	printf("\n");
+}
+
+static void makePrograms(Bundle* bundle, int count, int size) {
+	for(int p = 0; p < count; p++) {
+		uint8_t header[13] = {0};
+		std::vector<uint8_t> data(size);
+		TIVar::intToSizeWord(size - 2, &data[0]);
+		for(int i = 2; i < size; i++) {
+			data[i] = (uint8_t)(p * 37 + i * 11);
+		}
+		TIVar::intToSizeWord(size, header);
+		header[2] = 0x05;				// Program
+		snprintf((char*)&header[3], 9, "DIST%d", p + 1);
+		bundle->add(header, sizeof(header), data.data(), size);
+		programs.push_back(data);
+	}
+}
+
+// Whether a calculator got every program, byte for byte
+static bool delivered(CalcEmulator* calc, Bundle* bundle) {
+	for(int p = 0; p < bundle->count(); p++) {
+		uint8_t name[EMU_NAME_LEN] = {0};
+		memcpy(name, bundle->name(p), strlen(bundle->name(p)));
+		struct EmulatedVar* var = calc->findVar(0x05, name);
+		if (var == NULL || var->data != programs[p]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Every calculator, a round of as many as there are bridges at a time.
+// Returns how many didn't get the whole bundle, not counting the
+// bridge left empty on purpose.
+static int distribute(struct Station* stations, int bridges, int calcs, int threads, bool empty,
+                      Bundle* bundle, unsigned long* elapsed)
+{
+	int failed = 0;
+	int round = 0;
+	*elapsed = 0;
+	for(int done = 0; done < calcs; done += bridges, round++) {
+		int count = min(bridges, calcs - done);
+		Distributor distributor(bundle);
+		distributor.setProgress(onProgress, bundle);
+		if (empty) {
+			distributor.setRetries(1);
+		}
+		for(int i = 0; i < count; i++) {
+			stations[i].calc->clearVars();		// A new calculator on each bridge
+			distributor.addDevice(stations[i].master, stations[i].name);
+		}
+
+		unsigned long start = millis();
+		distributor.run(threads);
+		*elapsed += millis() - start;
+
+		for(int i = 0; i < count; i++) {
+			struct DeviceStatus status = distributor.status(i);
+			bool ok = (status.state == DEVICE_DONE) && delivered(stations[i].calc, bundle);
+			bool expected = empty && i == bridges - 1;
+			printf("  calc %3d on %-12s %-7s %2d/%d vars, %6ld bytes, attempts %d, %6lu ms, "
+			       "bridge %u packets out, %u in, %u errors", done + i + 1, status.name,
+			       ok ? "ok" : states[status.state], status.sent, bundle->count(), status.bytes,
+			       status.attempts, status.millis,
+			       status.bridge[STATUS_PACKETS_TO_LINK], status.bridge[STATUS_PACKETS_TO_HOST],
+			       status.bridge[STATUS_LINK_ERRORS]);
+			if (status.error) {
+				printf(" (%s: error %d)", status.step, status.error);
+			}
+			printf("\n");
+			if (!ok && !expected) {
+				failed++;
+			}
+		}
+		if (threads > 1 && distributor.steals()) {
+			printf("  round %d: %lu jobs stolen\n", round + 1, distributor.steals());
+		}
+	}
+	return failed;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-n calculators] [-k bridges] [-t threads] [-p programs] [-s bytes]"
+	        " [-b bit latency us] [-v] [-x]\n", name);
+}
+
+int main(int argc, char** argv) {
+	int calcs = 8;
+	int bridges = 0;
+	int threads = 0;
+	int count = 4;
+	int size = 400;
+	unsigned long latency = 0;
+	bool empty = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:k:t:p:s:b:vx")) != -1) {
+		switch(opt) {
+			case 'n': calcs = atoi(optarg); break;
+			case 'k': bridges = atoi(optarg); break;
+			case 't': threads = atoi(optarg); break;
+			case 'p': count = atoi(optarg); break;
+			case 's': size = atoi(optarg); break;
+			case 'b': latency = strtoul(optarg, NULL, 0); break;
+			case 'v': verbose = true; break;
+			case 'x': empty = true; break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (bridges == 0) {
+		bridges = min(calcs, BENCH_MAX_BRIDGES);
+	}
+	if (threads == 0) {
+		threads = bridges;
+	}
+	if (calcs < 1 || bridges < 1 || bridges > BENCH_MAX_BRIDGES || threads < 1 || count < 1 ||
+	    count > BENCH_MAX_PROGRAMS || size < 3 || size > EMU_MAX_DATA)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	FakeChip fake;
+	for(int i = 0; i < bridges; i++) {
+		fake.wire(4 * i, 4 * i + 2);
+		fake.wire(4 * i + 1, 4 * i + 3);
+	}
+	fake.setYield(std::thread::hardware_concurrency() < 2 * (unsigned)bridges);
+	DelayedPins pins(&fake);
+	hostSetPinBackend(&pins);
+
+	Bundle bundle;
+	makePrograms(&bundle, count, size);
+
+	struct Station stations[BENCH_MAX_BRIDGES];
+	running = true;
+	for(int i = 0; i < bridges; i++) {
+		struct Station* station = &stations[i];
+		if (openPty(station)) {
+			perror("pseudo-terminal");
+			return 1;
+		}
+		station->serial = new HardwareSerial(station->slave, station->slave);
+		station->bridge = new LinkBridge(4 * i + 2, 4 * i + 3);
+		station->calc = new CalcEmulator(4 * i, 4 * i + 1, EMU_TI84P);
+		pins.setDelay(4 * i, latency / 2);
+		pins.setDelay(4 * i + 1, latency / 2);
+		station->bridge->begin(station->serial);
+		station->calc->begin();
+		station->bridgeThread = std::thread(bridgeLoop, station);
+		if (!(empty && i == bridges - 1)) {
+			station->calcThread = std::thread(calcLoop, station->calc);
+		}
+	}
+
+	printf("%d calculators, %d bridges, %d programs of %d bytes\n", calcs, bridges, count, size);
+	unsigned long serial;
+	unsigned long parallel;
+	printf("1 thread:\n");
+	int failed = distribute(stations, bridges, calcs, 1, empty, &bundle, &serial);
+	printf("%d threads:\n", threads);
+	failed += distribute(stations, bridges, calcs, threads, empty, &bundle, &parallel);
+
+	long bytes = bundle.bytes() * calcs;
+	printf("1 thread:    %7lu ms, %7.0f data bytes/s\n", serial, 1e3 * bytes / max(serial, 1ul));
+	printf("%2d threads:  %7lu ms, %7.0f data bytes/s, %.2fx\n", threads, parallel,
+	       1e3 * bytes / max(parallel, 1ul), (double)serial / max(parallel, 1ul));
+
+	running = false;
+	for(int i = 0; i < bridges; i++) {
+		struct Station* station = &stations[i];
+		station->bridgeThread.join();
+		if (station->calcThread.joinable()) {
+			station->calcThread.join();
+		}
+		close(station->slave);
+		close(station->master);
+		delete station->calc;
+		delete station->bridge;
+		delete station->serial;
+	}
+	if (failed) {
+		printf("%d calculators didn't get the bundle\n", failed);
+	}
+	return failed ? 1 : 0;
+}
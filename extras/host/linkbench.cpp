@@ -0,0 +1,222 @@
+/*************************************************
+ *  linkbench.cpp - Measures sustained link      *
+ *           throughput on a Linux host, per     *
+ *           link and across links.              *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+// Each link is a pair of TICL objects on wired-together pins, one
+// sending DATA packets and one receiving them, each on its own
+// LinkWorker. Wires are simulated with a FakeChip unless -g names a
+// GPIO chip, whose four lines (-o) must be wired tip to tip and ring
+// to ring. With -f, each sender offers fast mode before it starts.
+// -e flips that fraction of the bits each end sends on a FakeChip, and
+// -a has each packet acknowledged and resent on a bad checksum, as
+// getOrRetry() and sendAwaitAck() do: together they give the goodput
+// at that bit error rate.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+
+#include "HostGPIO.h"
+#include "LinkWorker.h"
+#include "TICL.h"
+
+#define BENCH_MAX_LINKS	(HOST_MAX_PINS / 4)
+#define BENCH_MAX_DATA	4096
+
+struct LinkStats {
+	unsigned long deadline;				// millis() at which the sender stops
+	int size;
+	bool fast;							// Negotiate fast mode first
+	bool acked;							// Exchange ACKs, resend damaged packets
+	std::atomic<bool> sending;
+	unsigned long packets;
+	unsigned long bytes;				// Data bytes received with good checksums
+	unsigned long errors;
+	unsigned long elapsed_ms;
+};
+
+static uint8_t sendData[BENCH_MAX_DATA];
+
+static int sendPackets(TICL* link, void* arg) {
+	struct LinkStats* stats = (struct LinkStats*)arg;
+	uint8_t header[4] = {COMP83P, DATA, 0, 0};
+	header[2] = stats->size & 0xff;
+	header[3] = stats->size >> 8;
+	if (stats->fast && link->negotiateFast(COMP83P)) {
+		fprintf(stderr, "Fast mode refused, measuring the standard protocol\n");
+	}
+	while (millis() < stats->deadline) {
+		int rval = stats->acked ? link->sendAwaitAck(header, sendData, stats->size) :
+		                          link->send(header, sendData, stats->size);
+		if (rval) {
+			link->resetLines();
+		}
+	}
+	stats->sending = false;
+	return 0;
+}
+
+static int receivePackets(TICL* link, void* arg) {
+	struct LinkStats* stats = (struct LinkStats*)arg;
+	uint8_t header[4];
+	uint8_t data[BENCH_MAX_DATA];
+	int length;
+	unsigned long start = millis();
+	uint8_t ack[4] = {CALC83P, ACK, 0, 0};
+	while (stats->sending) {
+		int rval = stats->acked ? link->getOrRetry(header, data, &length, sizeof(data), CALC83P, TIMEOUT) :
+		                          link->get(header, data, &length, sizeof(data), TIMEOUT);
+		if (rval == 0 && header[1] == FST) {
+			link->acceptFast(header, data, length, CALC83P);
+		} else if (rval == 0 && header[1] == DATA) {
+			if (stats->acked) {
+				link->send(ack, NULL, 0);
+			}
+			stats->packets++;
+			stats->bytes += length;
+		} else if (rval != 0 && rval != ERR_READ_ENTER_TIMEOUT) {
+			stats->errors++;
+		}
+	}
+	stats->elapsed_ms = millis() - start;
+	return 0;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-l links] [-s packet size] [-t seconds] [-c first cpu]\n"
+	                "       [-r realtime priority] [-m] [-f] [-e bit error rate] [-a]\n"
+	                "       [-g /dev/gpiochipN -o tip,ring,tip,ring]\n", name);
+}
+
+int main(int argc, char** argv) {
+	int links = 1;
+	int size = 256;
+	int seconds = 5;
+	int cpu = -1;
+	int priority = 0;
+	bool lock = false;
+	bool fast = false;
+	bool acked = false;
+	double errors = 0;
+	const char* chip = NULL;
+	unsigned int offsets[4] = {0, 1, 2, 3};
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:s:t:c:r:mfe:ag:o:")) != -1) {
+		switch(opt) {
+			case 'l': links = atoi(optarg); break;
+			case 's': size = atoi(optarg); break;
+			case 't': seconds = atoi(optarg); break;
+			case 'c': cpu = atoi(optarg); break;
+			case 'r': priority = atoi(optarg); break;
+			case 'm': lock = true; break;
+			case 'f': fast = true; break;
+			case 'e': errors = atof(optarg); break;
+			case 'a': acked = true; break;
+			case 'g': chip = optarg; break;
+			case 'o':
+				if (sscanf(optarg, "%u,%u,%u,%u", &offsets[0], &offsets[1], &offsets[2], &offsets[3]) != 4) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (links < 1 || links > BENCH_MAX_LINKS || size < 1 || size > BENCH_MAX_DATA || (chip && links != 1) ||
+	    errors < 0 || errors > 1 || (chip && errors > 0))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	FakeChip fake;
+	NoisyPins noisy(&fake);
+	GpioChipBackend gpio;
+	if (chip) {
+		for(int i = 0; i < 4; i++) {
+			int rval = gpio.attach(i, chip, offsets[i]);
+			if (rval) {
+				fprintf(stderr, "Can't claim line %u of %s: %s\n", offsets[i], chip, strerror(-rval));
+				return 1;
+			}
+		}
+		hostSetPinBackend(&gpio);
+	} else {
+		for(int i = 0; i < links; i++) {
+			fake.wire(4 * i, 4 * i + 2);
+			fake.wire(4 * i + 1, 4 * i + 3);
+		}
+		fake.setYield(std::thread::hardware_concurrency() < 2u * links);
+		for(int i = 0; i < 2 * links; i++) {
+			noisy.setErrorRate(2 * i, 2 * i + 1, errors, i + 1);
+		}
+		hostSetPinBackend(&noisy);
+	}
+	for(int i = 0; i < BENCH_MAX_DATA; i++) {
+		sendData[i] = (uint8_t)(i * 37 + 11);
+	}
+
+	std::vector<TICL*> ticls;
+	std::vector<LinkWorker*> workers;
+	std::vector<struct LinkStats> stats(links);
+	std::vector<struct LinkJob> jobs(2 * links);
+	for(int i = 0; i < 2 * links; i++) {
+		TICL* ticl = new TICL(2 * i, 2 * i + 1);
+		ticl->begin();
+		ticls.push_back(ticl);
+
+		struct WorkerOptions options = {cpu < 0 ? -1 : cpu + i, priority, lock};
+		LinkWorker* worker = new LinkWorker(ticl);
+		int rval = worker->start(&options);
+		if (rval) {
+			fprintf(stderr, "Worker %d options not applied: %s\n", i, strerror(-rval));
+		}
+		workers.push_back(worker);
+	}
+
+	unsigned long deadline = millis() + 1000ul * seconds;
+	for(int i = 0; i < links; i++) {
+		stats[i].deadline = deadline;
+		stats[i].size = size;
+		stats[i].fast = fast;
+		stats[i].acked = acked;
+		stats[i].sending = true;
+		stats[i].packets = stats[i].bytes = stats[i].errors = stats[i].elapsed_ms = 0;
+		jobs[2 * i].run = receivePackets;
+		jobs[2 * i + 1].run = sendPackets;
+		for(int j = 2 * i; j < 2 * i + 2; j++) {
+			jobs[j].arg = &stats[i];
+			jobs[j].done = NULL;
+		}
+		workers[2 * i + 1]->submit(&jobs[2 * i]);		// Receiver pins are 4i+2, 4i+3
+		workers[2 * i]->submit(&jobs[2 * i + 1]);
+	}
+
+	double total = 0;
+	for(int i = 0; i < links; i++) {
+		LinkWorker::wait(&jobs[2 * i]);
+		LinkWorker::wait(&jobs[2 * i + 1]);
+		double rate = stats[i].elapsed_ms ? 1000.0 * stats[i].bytes / stats[i].elapsed_ms : 0;
+		total += rate;
+		printf("link %d: %lu packets, %lu bytes, %lu errors, %.0f bytes/s\n",
+		       i, stats[i].packets, stats[i].bytes, stats[i].errors, rate);
+	}
+	printf("total: %.0f bytes/s over %d link%s\n", total, links, (links == 1) ? "" : "s");
+	if (errors > 0) {
+		printf("%lu bits flipped\n", noisy.flips());
+	}
+
+	for(int i = 0; i < 2 * links; i++) {
+		delete workers[i];
+		delete ticls[i];
+	}
+	return 0;
+}
@@ -0,0 +1,1047 @@
+/*************************************************
+ *  linktest.cpp - Checks of library behaviour   *
+ *           that the benchmarks don't cover,    *
+ *           run by make check.                  *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+// Each test prints what it checked when it fails and counts toward
+// the exit status. Run a few by name: ./linktest varstore cbl2skip
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Arduino.h"
+#include "BridgePort.h"
+#include "CalcEmulator.h"
+#include "CBL2.h"
+#include "DataLogger.h"
+#include "HardwareSerial.h"
+#include "HostGPIO.h"
+#include "LineCapture.h"
+#include "LinkBridge.h"
+#include "LinkRelay.h"
+#include "LinkWorker.h"
+#include "PacketPool.h"
+#include "SessionRecorder.h"
+#include "TIFile.h"
+#include "TIPacket.h"
+#include "TIVar.h"
+#include "VarStore.h"
+
+struct Test {
+	const char* name;
+	void (*run)();
+};
+
+static int failures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("  %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+// A stored name answers only for itself, padded with zeros; an entry
+// without a name answers for any variable of its type
+static void testVarStoreNames() {
+	uint8_t buffer[64];
+	VarStore store(buffer, sizeof(buffer));
+	long one = 1;
+	int a = store.addReal(0x00, (const uint8_t*)"A", 1, &one);
+	int str = store.addString(0x04, NULL, 0, "HI", 2);
+	CHECK(a >= 0 && str >= 0);
+
+	uint8_t name[8] = {'A', 0, 0, 0, 0, 0, 0, 0};
+	CHECK(store.find(0x00, name, 8) == a);
+	CHECK(store.find(0x00, name, 1) == a);
+	name[1] = 'B';
+	CHECK(store.find(0x00, name, 8) == -1);
+	CHECK(store.find(0x00, (const uint8_t*)"B", 1) == -1);
+	CHECK(store.find(0x04, name, 8) == str);
+}
+
+// TI-85 reals, as a TI-84+ sends list elements under the TI-85 machine
+// ID: a two-byte exponent biased by 0xFC00, then 14 BCD digits. They
+// used to decode 1e13 times too large. realToFloat8x() scales by a
+// float 0.1, so doubles only come back to about six digits.
+// Variables added after setupStorage() can make the image larger than
+// the storage, leaving no bank to save to or load from
+static uint8_t eeprom[64];
+
+static uint8_t eepromRead(int address) {
+	return eeprom[address];
+}
+
+static void eepromWrite(int address, uint8_t value) {
+	eeprom[address] = value;
+}
+
+static void testVarStoreGrow() {
+	uint8_t buffer[64];
+	VarStore store(buffer, sizeof(buffer), CALC82);
+	long one = 1;
+	store.addReal(0x00, (const uint8_t*)"A", 1, &one);
+	int size = 1;
+	while (size < (int)sizeof(eeprom) && store.setupStorage(size, eepromRead, eepromWrite)) {
+		size++;								// The smallest that fits one image
+	}
+	CHECK(size < (int)sizeof(eeprom));
+	CHECK(store.save() == 0);
+	CHECK(store.load() == 0);
+	store.addReal(0x00, (const uint8_t*)"B", 1, &one);
+	CHECK(store.save() == -1);
+	CHECK(store.load() == -1);
+}
+
+static void testReal85() {
+	uint8_t n1234[10] = {0x00, 0x03, 0xFC, 0x12, 0x34, 0x00, 0x00, 0x00, 0x00, 0x00};
+	uint8_t half[10] = {0x80, 0xFF, 0xFB, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+	CHECK(TIVar::sizeOfReal(CBL85) == 10);
+	CHECK(TIVar::realToLong8x(n1234, CBL85) == 1234);
+	CHECK(fabs(TIVar::realToFloat8x(n1234, CBL85) - 1234) < 1234 * 1e-6);
+	CHECK(fabs(TIVar::realToFloat8x(half, CBL85) + 0.5) < 0.5 * 1e-6);
+
+	uint8_t real[10];
+	CHECK(TIVar::longToReal8x(1234, real, CBL85) == 10);
+	CHECK(0 == memcmp(real, n1234, sizeof(real)));
+	CHECK(TIVar::floatToReal8x(-0.5, real, CBL85) == 10);
+	CHECK(0 == memcmp(real, half, sizeof(real)));
+	const double values[] = {0, 1, -7, 42, 1e-5, 3.25e12, -123456789};
+	for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		CHECK(TIVar::floatToReal8x(values[i], real, CBL85) == 10);
+		CHECK(fabs(TIVar::realToFloat8x(real, CBL85) - values[i]) <= fabs(values[i]) * 1e-6);
+	}
+}
+
+// A Get( for a variable the CBL2 doesn't have is refused with SKIP at
+// once, rather than left to time out
+static void testCBL2Skip() {
+	FakeChip chip;
+	chip.wire(0, 2);
+	chip.wire(1, 3);
+	chip.setYield(true);
+	hostSetPinBackend(&chip);
+
+	uint8_t header[16];
+	uint8_t data[64];
+	uint8_t buffer[64];
+	long value = 42;
+	VarStore store(buffer, sizeof(buffer), CALC82);
+	store.addReal(0x00, (const uint8_t*)"A", 1, &value);
+	CalcEmulator calc(0, 1);
+	CBL2 cbl(2, 3);
+	calc.begin();
+	cbl.begin();
+	cbl.setupCallbacks(header, data, sizeof(data), NULL, NULL);
+	cbl.setupVarStore(&store);
+
+	std::atomic<bool> running(true);
+	std::thread library([&]() {
+		while (running) {
+			cbl.eventLoopTick(true);
+		}
+	});
+	uint8_t got[16];
+	int length;
+	CHECK(calc.programGet(0x00, "A", got, &length, sizeof(got)) == 0);
+	CHECK(TIVar::realToLong8x(got, CALC82) == 42);
+	unsigned long start = millis();
+	CHECK(calc.programGet(0x00, "AB", got, &length, sizeof(got)) == ERR_REJECTED);
+	CHECK(calc.programGet(0x00, "B", got, &length, sizeof(got)) == ERR_REJECTED);
+	CHECK(millis() - start < GET_ENTER_TIMEOUT / 1000);
+	running = false;
+	library.join();
+}
+
+// The simulated ADC: pin 0 ramps with the virtual clock, a step per
+// millisecond, and pin 1 is its negative
+static unsigned long virtualMicros;
+
+static int rampADC(int pin) {
+	int value = (int)(virtualMicros / 1000);
+	return pin == 0 ? value : -value;
+}
+
+// Polled on a virtual clock, a triggered capture keeps the pre-trigger
+// records, stops after the post-trigger ones, and reads out as lists
+// with times relative to the trigger
+static void testLoggerTrigger() {
+	int16_t buffer[2 * 64];
+	const int pins[2] = {0, 1};
+	DataLogger logger(buffer, 2 * 64);
+	logger.setReadCallback(rampADC);
+	CHECK(logger.setChannels(pins, 2) == 0);
+	CHECK(logger.setRate(1000, 2) == 0);
+	CHECK(logger.setTrigger(TRIGGER_RISING, 0, 50, 5, 10) == 0);
+
+	virtualMicros = 0;
+	logger.start(virtualMicros);
+	for(int i = 0; i < 200 && logger.state() != LOGGER_DONE; i++) {
+		CHECK(logger.tick(virtualMicros) == 1);
+		virtualMicros += 1000;
+	}
+	// Record r averages the samples 2r and 2r + 1, reading 2r; the
+	// first at or over 50 is record 25
+	CHECK(logger.state() == LOGGER_DONE);
+	CHECK(logger.records() == 15);
+	CHECK(logger.tick(virtualMicros + 10000) == 0);
+
+	uint8_t data[2 + 32 * 9];
+	int length = logger.readList(1, 0, 32, data, sizeof(data), CALC83P);
+	CHECK(length == 2 + 15 * 9);
+	CHECK(data[0] == 15 && data[1] == 0);
+	for(int i = 0; i < 15; i++) {
+		CHECK(TIVar::realToLong8x(&data[2 + 9 * i], CALC83P) == 2 * (20 + i));
+	}
+	logger.readList(2, 0, 32, data, sizeof(data), CALC83P);
+	CHECK(TIVar::realToLong8x(&data[2], CALC83P) == -40);
+	logger.readList(0, 0, 32, data, sizeof(data), CALC83P);
+	CHECK(fabs(TIVar::realToFloat8x(&data[2], CALC83P) + 0.010) < 1e-6);
+	CHECK(fabs(TIVar::realToFloat8x(&data[2 + 9 * 5], CALC83P)) < 1e-6);
+	CHECK(fabs(TIVar::realToFloat8x(&data[2 + 9 * 14], CALC83P) - 0.018) < 1e-6);
+
+	// Chunks of a variable too small for the whole list
+	CHECK(logger.chunkSize(2 + 4 * 9, CALC83P) == 4);
+	CHECK(logger.chunkCount(2 + 4 * 9, CALC83P) == 4);
+	CHECK(logger.readChunk(1, 3, data, 2 + 4 * 9, CALC83P) == 2 + 3 * 9);
+	CHECK(TIVar::realToLong8x(&data[2], CALC83P) == 2 * 32);
+}
+
+struct Sampler {
+	int16_t counter;
+	std::atomic<bool> running;
+};
+
+// Each sample one more than the last, wrapping at 1000
+static struct Sampler* sampler;
+
+static int counterADC(int pin) {
+	sampler->counter = (sampler->counter + 1) % 1000;
+	return sampler->counter;
+}
+
+static void sampleISR(void* context) {
+	((DataLogger*)context)->sample();
+}
+
+// With a timer interrupt filling a short ring, a list read from it is
+// still consecutive samples: never a mix of records and the ones that
+// overwrote them. Reading the newer half leaves the timer room to move
+// on while the list is read.
+static void testLoggerRace() {
+	int16_t buffer[16];
+	const int pins[1] = {0};
+	DataLogger logger(buffer, 16);
+	struct Sampler state;
+	state.counter = 0;
+	state.running = true;
+	sampler = &state;
+	logger.setReadCallback(counterADC);
+	logger.setChannels(pins, 1);
+	logger.start(0);
+
+	std::thread timer([&]() {
+		while (state.running) {
+			hostInterrupt(sampleISR, &logger);
+			delayMicroseconds(20);			// A 50kHz sample timer
+		}
+	});
+	while (logger.records() < 16) {
+		std::this_thread::yield();
+	}
+	uint8_t data[2 + 16 * 9];
+	int lists = 0;
+	int torn = 0;
+	unsigned long start = millis();
+	while (millis() - start < 200) {
+		if (logger.readList(1, 8, 8, data, sizeof(data), CALC83P) < 0) {
+			torn++;
+			continue;
+		}
+		int count = data[0] | (data[1] << 8);
+		for(int i = 1; i < count; i++) {
+			long long prev = TIVar::realToLong8x(&data[2 + 9 * (i - 1)], CALC83P);
+			long long next = TIVar::realToLong8x(&data[2 + 9 * i], CALC83P);
+			torn += ((prev + 1) % 1000 != next);
+		}
+		lists += (count > 0);
+	}
+	state.running = false;
+	timer.join();
+	CHECK(torn == 0);
+	CHECK(lists > 0);
+}
+
+// Events as feed() reports them, with each payload run spread out
+// into one PACKET_PAYLOAD per byte, as push() reports them
+static std::vector<int> fedEvents;
+
+static void recordEvent(enum PacketEvent event, const uint8_t* bytes, int length) {
+	int count = (event == PACKET_PAYLOAD) ? length : 1;
+	for(int i = 0; i < count; i++) {
+		fedEvents.push_back(event);
+	}
+}
+
+// push() a byte at a time and feed() in chunks of any size report the
+// same events, for packets with and without data and a bad checksum
+static void testParserEvents() {
+	const uint8_t data[5] = {1, 2, 3, 4, 5};
+	uint8_t stream[64];
+	int length = 0;
+	PacketSerializer serializer;
+	uint8_t rts[4] = {COMP83P, RTS, sizeof(data), 0};
+	uint8_t ack[4] = {CALC83P, ACK, 0x00, 0x00};
+	uint8_t cts[4] = {CALC83P, CTS, 0x0b, 0x00};	// Has a length, carries no data
+	serializer.begin(rts, data, sizeof(data));
+	length += serializer.read(&stream[length], sizeof(stream) - length);
+	serializer.begin(ack, NULL, 0);
+	length += serializer.read(&stream[length], sizeof(stream) - length);
+	serializer.begin(cts, NULL, 0);
+	length += serializer.read(&stream[length], sizeof(stream) - length);
+	serializer.begin(rts, data, sizeof(data));
+	int bad = length + serializer.remaining() - 1;
+	length += serializer.read(&stream[length], sizeof(stream) - length);
+	stream[bad] ^= 0x01;
+
+	std::vector<int> pushed;
+	PacketParser parser;
+	for(int i = 0; i < length; i++) {
+		pushed.push_back(parser.push(stream[i]));
+	}
+	CHECK(pushed[3] == PACKET_HEADER);
+	CHECK(pushed[10] == PACKET_COMPLETE);
+	CHECK(pushed[14] == PACKET_COMPLETE);
+	CHECK(pushed[18] == PACKET_COMPLETE);
+	CHECK(pushed[length - 1] == PACKET_ERROR);
+	pushed.erase(std::remove(pushed.begin(), pushed.end(), (int)PACKET_NONE), pushed.end());
+
+	for(int chunk = 1; chunk <= length; chunk++) {
+		fedEvents.clear();
+		parser.reset();
+		for(int i = 0; i < length; i += chunk) {
+			parser.feed(&stream[i], min(chunk, length - i), recordEvent);
+		}
+		CHECK(fedEvents == pushed);
+	}
+}
+
+// Fast mode is agreed to, and carries packets intact with both ends
+// sharing one CPU, where neither gets to watch the lines all the time
+static void testFastMode() {
+	FakeChip chip;
+	chip.wire(0, 2);
+	chip.wire(1, 3);
+	chip.setYield(true);
+	hostSetPinBackend(&chip);
+
+	TICL sender(0, 1);
+	TICL receiver(2, 3);
+	sender.begin();
+	receiver.begin();
+	uint8_t sent[256];
+	for(size_t i = 0; i < sizeof(sent); i++) {
+		sent[i] = (uint8_t)(i * 37 + 11);
+	}
+	std::atomic<bool> running(true);
+	int good = 0;
+	int bad = 0;
+	std::thread receiving([&]() {
+		uint8_t header[4];
+		uint8_t data[sizeof(sent)];
+		uint8_t ack[4] = {CALC83P, ACK, 0, 0};
+		int length;
+		while (running) {
+			int rval = receiver.get(header, data, &length, sizeof(data), TIMEOUT);
+			if (rval == 0 && header[1] == FST) {
+				receiver.acceptFast(header, data, length, CALC83P);
+			} else if (rval == 0 && header[1] == DATA) {
+				receiver.send(ack, NULL, 0);
+				if (length == sizeof(sent) && 0 == memcmp(data, sent, sizeof(sent))) {
+					good++;
+				} else {
+					bad++;
+				}
+			} else if (rval && rval != ERR_READ_ENTER_TIMEOUT) {
+				bad++;
+			}
+		}
+	});
+	CHECK(sender.negotiateFast(COMP83P) == 0);
+	CHECK(sender.fast());
+	uint8_t header[4] = {COMP83P, DATA, sizeof(sent) & 0xff, sizeof(sent) >> 8};
+	int acked = 0;
+	for(int i = 0; i < 20; i++) {
+		acked += (0 == sender.sendAwaitAck(header, sent, sizeof(sent)));
+	}
+	running = false;
+	receiving.join();
+	CHECK(receiver.fast());
+	CHECK(acked == 20);
+	CHECK(good == 20);
+	CHECK(bad == 0);
+}
+
+// A calculator that can stop partway through a packet, or send one
+// with a bad checksum
+class RawLink: public TICL {
+	public:
+		RawLink(int tip, int ring) : TICL(tip, ring) {}
+		using TICL::sendByte;
+};
+
+// A packet that's cut off, from either side, doesn't throw off the
+// bridge's framing of the packets after it: a status request still
+// gets its answer
+static void testBridgeFraming() {
+	FakeChip chip;
+	chip.wire(0, 2);
+	chip.wire(1, 3);
+	chip.setYield(true);
+	hostSetPinBackend(&chip);
+
+	int sv[2];
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	HardwareSerial serial(sv[1], sv[1]);
+	LinkBridge bridge(2, 3);
+	bridge.begin(&serial);
+	BridgePort port;
+	port.attach(sv[0]);
+	std::atomic<bool> running(true);
+	std::thread bridging([&]() {
+		while (running) {
+			bridge.bridgeTick();
+		}
+	});
+
+	// The host gives up on a DATA packet after its header. No one is on
+	// the link to take it either.
+	uint16_t counters[BRIDGE_STATUS_LEN / 2];
+	const uint8_t cut[6] = {COMP83P, DATA, 10, 0, 1, 2};
+	CHECK(port.write(cut, sizeof(cut)) == 0);
+	delay(BRIDGE_HOST_TIMEOUT + 200);
+	CHECK(port.bridgeStatus(counters, 1000) == 0);
+	CHECK(counters[STATUS_DROPPED_PACKETS] == 1);
+
+	// The calculator sends half a header, then stalls in a bit
+	RawLink calc(0, 1);
+	calc.begin();
+	CHECK(calc.sendByte(CALC83P) == 0);
+	CHECK(calc.sendByte(DATA) == 0);
+	pinMode(0, OUTPUT);
+	digitalWrite(0, LOW);
+	delay(300);
+	pinMode(0, INPUT_PULLUP);
+	delay(100);
+	port.flush();
+	CHECK(port.bridgeStatus(counters, 1000) == 0);
+	CHECK(counters[STATUS_LINK_ERRORS] >= 1);
+
+	running = false;
+	bridging.join();
+	port.close();
+	close(sv[0]);
+	close(sv[1]);
+}
+
+// With a bit in a thousand flipped in each direction, packets with bad
+// checksums are asked for again, and nothing damaged is ever accepted
+static void testBitErrors() {
+	FakeChip chip;
+	chip.wire(0, 2);
+	chip.wire(1, 3);
+	chip.setYield(true);
+	NoisyPins noisy(&chip);
+	noisy.setErrorRate(0, 1, 1e-3, 1);
+	noisy.setErrorRate(2, 3, 1e-3, 2);
+	hostSetPinBackend(&noisy);
+
+	TICL sender(0, 1);
+	TICL receiver(2, 3);
+	sender.begin();
+	receiver.begin();
+	uint8_t sent[64];
+	for(size_t i = 0; i < sizeof(sent); i++) {
+		sent[i] = (uint8_t)(i * 37 + 11);
+	}
+	std::atomic<bool> running(true);
+	int good = 0;
+	int damaged = 0;
+	std::thread receiving([&]() {
+		uint8_t header[4];
+		uint8_t data[sizeof(sent)];
+		uint8_t ack[4] = {CALC83P, ACK, 0, 0};
+		int length;
+		while (running) {
+			int rval = receiver.getOrRetry(header, data, &length, sizeof(data), CALC83P, TIMEOUT);
+			if (rval == 0 && header[1] == DATA) {
+				receiver.send(ack, NULL, 0);
+				if (length == sizeof(sent) && 0 == memcmp(data, sent, sizeof(sent))) {
+					good++;
+				} else {
+					damaged++;
+				}
+			} else if (rval && rval != ERR_READ_ENTER_TIMEOUT) {
+				receiver.resetLines();
+			}
+		}
+	});
+	uint8_t header[4] = {COMP83P, DATA, sizeof(sent), 0};
+	int acked = 0;
+	for(int i = 0; i < 50; i++) {
+		if (0 == sender.sendAwaitAck(header, sent, sizeof(sent))) {
+			acked++;
+		} else {
+			sender.resetLines();
+		}
+	}
+	running = false;
+	receiving.join();
+	CHECK(noisy.flips() > 0);
+	CHECK(damaged == 0);
+	CHECK(acked >= 45);
+	CHECK(good >= acked);
+}
+
+// A resend asked for by getOrRetry() is waited for only as long as the
+// caller asked, not GET_ENTER_TIMEOUT
+static void testRetryTimeout() {
+	FakeChip chip;
+	chip.wire(0, 2);
+	chip.wire(1, 3);
+	chip.setYield(true);
+	hostSetPinBackend(&chip);
+
+	RawLink sender(0, 1);
+	TICL receiver(2, 3);
+	sender.begin();
+	receiver.begin();
+	std::thread sending([&]() {
+		const uint8_t packet[8] = {COMP83P, DATA, 2, 0, 0x12, 0x34, 0x00, 0x00};
+		for(size_t i = 0; i < sizeof(packet); i++) {
+			sender.sendByte(packet[i]);
+		}
+		uint8_t header[4];
+		int length;
+		sender.get(header, NULL, &length, 0);		// The ERR, then silence
+	});
+	uint8_t header[4];
+	uint8_t data[8];
+	int length;
+	unsigned long start = millis();
+	int rval = receiver.getOrRetry(header, data, &length, sizeof(data), CALC83P, 200000);
+	unsigned long elapsed = millis() - start;
+	sending.join();
+	CHECK(rval == ERR_READ_ENTER_TIMEOUT);
+	CHECK(elapsed < 600);
+}
+
+// Bytes in memory as the Stream and Print that TIFile reads and writes
+class MemoryStream: public Stream {
+	public:
+		MemoryStream() : position_(0) {}
+		int available() { return bytes_.size() - position_; }
+		int read() { return position_ < bytes_.size() ? bytes_[position_++] : -1; }
+		int peek() { return position_ < bytes_.size() ? bytes_[position_] : -1; }
+		size_t write(uint8_t byte) { bytes_.push_back(byte); return 1; }
+		std::vector<uint8_t> bytes_;
+
+	private:
+		size_t position_;
+};
+
+// Run from extras/host, as make check does
+static const char* bundledFiles[] = {
+	"../../examples/CalcCam/ARTICAM.8xp",
+	"../../examples/HelloWorld/HELLO.8xp",
+	"../../examples/SimpleIO/SIMPLEIO.8xp",
+	"../../examples/WhackAMole/MSPWHACK.8xp",
+};
+
+// The programs shipped with the examples read with their checksums
+// intact, and written back from what was read, come out byte for byte
+static void testTIFileRoundTrip() {
+	for(size_t f = 0; f < sizeof(bundledFiles) / sizeof(bundledFiles[0]); f++) {
+		MemoryStream original;
+		FILE* file = fopen(bundledFiles[f], "rb");
+		CHECK(file != NULL);
+		if (file == NULL) {
+			continue;
+		}
+		int c;
+		while ((c = fgetc(file)) != EOF) {
+			original.write((uint8_t)c);
+		}
+		fclose(file);
+
+		TIFileReader reader;
+		std::vector<std::vector<uint8_t> > headers;
+		std::vector<std::vector<uint8_t> > datas;
+		uint8_t header[TIFILE_MAX_VAR_HEADER];
+		int headerlength;
+		int datalength;
+		CHECK(reader.begin(&original) == 0);
+		CHECK(reader.format() == TIFILE_83F);
+		int rval;
+		while (0 == (rval = reader.nextEntry(header, &headerlength, &datalength))) {
+			std::vector<uint8_t> data(datalength);
+			CHECK(reader.read(data.data(), datalength) == datalength);
+			headers.push_back(std::vector<uint8_t>(header, header + headerlength));
+			datas.push_back(data);
+		}
+		CHECK(rval == 1);
+		CHECK(reader.finish() == 0);
+		CHECK(headers.size() >= 1);
+
+		MemoryStream copy;
+		TIFileWriter writer;
+		uint16_t section = 0;
+		for(size_t i = 0; i < datas.size(); i++) {
+			section += TIFileWriter::entrySize(TIFILE_83F, datas[i].size());
+		}
+		CHECK(writer.begin(&copy, TIFILE_83F, section, reader.comment()) == 0);
+		for(size_t i = 0; i < datas.size(); i++) {
+			CHECK(writer.addEntry(headers[i].data(), headers[i].size()) == 0);
+			CHECK(writer.write(datas[i].data(), datas[i].size()) == 0);
+		}
+		CHECK(writer.end() == 0);
+		if (copy.bytes_ != original.bytes_) {
+			printf("  %s differs when written back\n", bundledFiles[f]);
+			failures++;
+		}
+	}
+}
+
+// A header hook that turns DATA into ACK would have the relay pass on
+// data the receiver isn't expecting, and one that turns an ACK whose
+// length bytes aren't zero into DATA would have the receiver wait for
+// data that never comes. Either is refused, and the sender's bytes are
+// taken and dropped; a rewrite of the machine ID goes through.
+static int rewriteCommand;
+
+static int rewriteHeader(enum RelayDirection direction, uint8_t* header) {
+	if (rewriteCommand) {
+		header[1] = rewriteCommand;
+	} else {
+		header[0] = CALC83P;
+	}
+	return 0;
+}
+
+// Sends the packet twice through a relay: once rewritten to command,
+// which must be refused, then with a new machine ID
+static void relayRewrite(uint8_t* header, uint8_t* data, int datalength, int command) {
+	FakeChip chip;
+	chip.wire(0, 2);
+	chip.wire(1, 3);
+	chip.wire(4, 6);
+	chip.wire(5, 7);
+	chip.setYield(true);
+	hostSetPinBackend(&chip);
+
+	TICL sender(0, 1);
+	TICL relayA(2, 3);
+	TICL relayB(4, 5);
+	TICL receiver(6, 7);
+	sender.begin();
+	relayA.begin();
+	relayB.begin();
+	receiver.begin();
+	LinkRelay relay(&relayA, &relayB);
+	relay.setHooks(rewriteHeader);
+
+	std::atomic<bool> running(true);
+	std::vector<std::vector<uint8_t> > got;
+	std::thread receiving([&]() {
+		uint8_t header[4];
+		uint8_t data[8];
+		int length;
+		while (running) {
+			if (0 == receiver.get(header, data, &length, sizeof(data), TIMEOUT)) {
+				std::vector<uint8_t> packet(header, header + 4);
+				if (PacketParser::commandHasData(header[1])) {
+					packet.insert(packet.end(), data, data + length);
+				}
+				got.push_back(packet);
+			}
+		}
+	});
+
+	int sent = 0;
+	std::thread sending([&]() {
+		sent += (0 == sender.send(header, data, datalength));
+		sent += (0 == sender.send(header, data, datalength));
+	});
+	rewriteCommand = command;
+	CHECK(relay.relayTick() == ERR_INVALID);
+	rewriteCommand = 0;
+	CHECK(relay.relayTick() == 0);
+	sending.join();
+	delay(50);
+	running = false;
+	receiving.join();
+
+	std::vector<uint8_t> expected(header, header + 4);
+	expected[0] = CALC83P;
+	expected.insert(expected.end(), data, data + datalength);
+	CHECK(sent == 2);
+	CHECK(got.size() == 1);
+	CHECK(got.size() == 1 && got[0] == expected);
+	CHECK(relay.errors() == 1);
+	CHECK(relay.dropped() == 0);
+}
+
+static void testRelayRewrite() {
+	uint8_t header[4] = {COMP83P, DATA, 3, 0};
+	uint8_t data[3] = {1, 2, 3};
+	relayRewrite(header, data, sizeof(data), ACK);
+}
+
+// An ACK's length bytes may hold something other than zero
+static void testRelayRewriteAck() {
+	uint8_t header[4] = {COMP83P, ACK, 0x34, 0x12};
+	relayRewrite(header, NULL, 0, DATA);
+}
+
+// A slot released twice, or released while it's queued, would end up
+// on the free list twice and be handed to two owners
+static void testPoolRelease() {
+	StaticPacketPool<2, 16> pool;
+	int a = pool.acquire();
+	pool.release(a);
+	pool.release(a);
+	CHECK(pool.available() == 2);
+	a = pool.acquire();
+	int b = pool.acquire();
+	CHECK(a >= 0 && b >= 0 && a != b);
+	CHECK(pool.acquire() == -1);
+
+	pool.queue(a);
+	pool.release(a);
+	pool.queue(a);
+	CHECK(pool.available() == 0);
+	CHECK(pool.queued() == 1);
+	CHECK(pool.dequeue() == a);
+	CHECK(pool.dequeue() == -1);
+	pool.release(a);
+	pool.release(b);
+	pool.release(b);
+	CHECK(pool.available() == 2);
+	CHECK(pool.queued() == 0);
+}
+
+// A calculator whose EOT went missing starts its next Send( while the
+// one slot still holds the last variable. The RTS is ACKed, but its
+// CTS waits for the application to release the slot, so the second
+// variable isn't ACKed and then lost.
+static int poolSend(TICL* calc, uint8_t value, bool eot) {
+	uint8_t rts[4] = {CALC82, RTS, 11, 0};
+	uint8_t var[11] = {9, 0, 0x00, 'A', 0, 0, 0, 0, 0, 0, 0};
+	uint8_t body[9] = {0x00, 0x80, value, 0, 0, 0, 0, 0, 0};
+	uint8_t msg_header[4] = {CALC82, DATA, 9, 0};
+	uint8_t ack[4] = {CALC82, ACK, 0, 0};
+	uint8_t eotHeader[4] = {CALC82, EOT, 0, 0};
+	uint8_t reply[4];
+	uint8_t scratch[16];
+	int length;
+	int rval;
+	if ((rval = calc->sendAwaitAck(rts, var, sizeof(var))) ||
+	    (rval = calc->get(reply, scratch, &length, sizeof(scratch))))
+	{
+		return rval;
+	}
+	if (reply[1] != CTS) {
+		return ERR_INVALID;
+	}
+	if ((rval = calc->send(ack, NULL, 0)) || (rval = calc->sendAwaitAck(msg_header, body, sizeof(body)))) {
+		return rval;
+	}
+	return eot ? calc->sendAwaitAck(eotHeader, NULL, 0) : 0;
+}
+
+static void testPoolBackpressure() {
+	FakeChip chip;
+	chip.wire(0, 2);
+	chip.wire(1, 3);
+	chip.setYield(true);
+	hostSetPinBackend(&chip);
+
+	uint8_t header[16];
+	uint8_t data[64];
+	StaticPacketPool<1, CBL2_HEADER_LEN + 16> pool;
+	TICL calc(0, 1);
+	CBL2 cbl(2, 3);
+	calc.begin();
+	cbl.begin();
+	cbl.setupCallbacks(header, data, sizeof(data), NULL, NULL);
+	CHECK(cbl.setupBufferPool(&pool) == 0);
+
+	std::atomic<bool> running(true);
+	std::thread library([&]() {
+		while (running) {
+			cbl.eventLoopTick(true);
+		}
+	});
+	CHECK(poolSend(&calc, 0x01, false) == 0);
+	std::atomic<bool> sent(false);
+	int second = -1;
+	std::thread sending([&]() {
+		second = poolSend(&calc, 0x02, true);
+		sent = true;
+	});
+
+	uint8_t* varHeader;
+	uint8_t* varData;
+	enum Endpoint model;
+	int length;
+	delay(100);
+	CHECK(!sent);							// Still waiting for the CTS
+	int buffer = cbl.nextVariable(&varHeader, &varData, &model, &length);
+	CHECK(buffer >= 0 && length == 9 && varData[2] == 0x01);
+	cbl.release(buffer);
+	sending.join();
+	CHECK(second == 0);
+
+	unsigned long start = millis();
+	while ((buffer = cbl.nextVariable(&varHeader, &varData, &model, &length)) < 0 && millis() - start < 500) {
+		delay(1);
+	}
+	CHECK(buffer >= 0 && length == 9 && varData[2] == 0x02 && varHeader[2] == 0x00);
+	running = false;
+	library.join();
+}
+
+// Get( needs no slot: it's answered from the VarStore while the one
+// slot holds a variable the application hasn't taken
+static void testPoolGet() {
+	FakeChip chip;
+	chip.wire(0, 2);
+	chip.wire(1, 3);
+	chip.setYield(true);
+	hostSetPinBackend(&chip);
+
+	uint8_t header[16];
+	uint8_t data[64];
+	uint8_t storage[64];
+	long value = 42;
+	VarStore store(storage, sizeof(storage), CALC82);
+	store.addReal(0x00, (const uint8_t*)"A", 1, &value);
+	StaticPacketPool<1, CBL2_HEADER_LEN + 16> pool;
+	CalcEmulator calc(0, 1);
+	CBL2 cbl(2, 3);
+	calc.begin();
+	cbl.begin();
+	cbl.setupCallbacks(header, data, sizeof(data), NULL, NULL);
+	cbl.setupVarStore(&store);
+	CHECK(cbl.setupBufferPool(&pool) == 0);
+
+	std::atomic<bool> running(true);
+	std::thread library([&]() {
+		while (running) {
+			cbl.eventLoopTick(true);
+		}
+	});
+	CHECK(poolSend(&calc, 0x01, true) == 0);
+	uint8_t got[16];
+	int length;
+	CHECK(calc.programGet(0x00, "A", got, &length, sizeof(got)) == 0);
+	CHECK(TIVar::realToLong8x(got, CALC82) == 42);
+
+	uint8_t* varHeader;
+	uint8_t* varData;
+	enum Endpoint model;
+	int buffer = cbl.nextVariable(&varHeader, &varData, &model, &length);
+	CHECK(buffer >= 0 && length == 9 && varData[2] == 0x01);
+	running = false;
+	library.join();
+}
+
+// Fast-mode bytes reach a capture and a recorder just as standard ones
+// do: every byte marked, its line changes in between, and each packet
+// in the session
+static void testFastRecord() {
+	FakeChip chip;
+	chip.wire(0, 2);
+	chip.wire(1, 3);
+	chip.setYield(true);
+	hostSetPinBackend(&chip);
+
+	TICL sender(0, 1);
+	TICL receiver(2, 3);
+	sender.begin();
+	receiver.begin();
+	std::atomic<bool> running(true);
+	std::thread receiving([&]() {
+		uint8_t header[4];
+		uint8_t data[16];
+		uint8_t ack[4] = {CALC83P, ACK, 0, 0};
+		int length;
+		while (running) {
+			int rval = receiver.get(header, data, &length, sizeof(data), TIMEOUT);
+			if (rval == 0 && header[1] == FST) {
+				receiver.acceptFast(header, data, length, CALC83P);
+			} else if (rval == 0 && header[1] == DATA) {
+				receiver.send(ack, NULL, 0);
+			}
+		}
+	});
+	CHECK(sender.negotiateFast(COMP83P) == 0);
+
+	static struct LineEvent events[2048];
+	LineCapture capture(events, 2048);
+	MemoryStream session;
+	SessionRecorder recorder;
+	CHECK(recorder.begin(&session) == 0);
+	sender.setCapture(&capture);
+	sender.setRecorder(&recorder);
+	uint8_t header[4] = {COMP83P, DATA, 16, 0};
+	uint8_t data[16] = {0x00, 0xff, 0x55, 0xaa, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+	CHECK(sender.sendAwaitAck(header, data, sizeof(data)) == 0);
+	recorder.end();
+	running = false;
+	receiving.join();
+
+	int bytes = 0;
+	int lines = 0;
+	for(int i = 0; i < capture.count(); i++) {
+		if (capture.event(i)->state & CAPTURE_BYTE) {
+			bytes++;
+		} else {
+			lines++;
+		}
+	}
+	CHECK(!capture.overflowed());
+	CHECK(bytes == 4 + 16 + 2 + 4);			// The DATA packet, then the ACK
+	CHECK(lines >= bytes * 8 * 2);
+	CHECK(recorder.packets() == 2);
+}
+
+// A peer is known by the machine ID on its ACK to RDY. A TI-86 is
+// converted for as one, not as the computer ID it's sent from, and a
+// TI-85 may answer as either of its IDs.
+static void testDiscoverModels() {
+	FakeChip chip;
+	chip.wire(0, 2);
+	chip.wire(1, 3);
+	chip.setYield(true);
+	hostSetPinBackend(&chip);
+
+	TICL host(0, 1);
+	TICL peer(2, 3);
+	host.begin();
+	peer.begin();
+	const uint8_t ids[] = {CALC86, CALC85a, CALC85b};
+	for(size_t i = 0; i < sizeof(ids); i++) {
+		std::thread answering([&]() {
+			uint8_t header[4];
+			uint8_t data[4];
+			int length;
+			if (0 == peer.get(header, data, &length, sizeof(data)) && header[1] == RDY) {
+				uint8_t ack[4] = {ids[i], ACK, 0, 0};
+				peer.send(ack, NULL, 0);
+			}
+		});
+		LinkProfile profile;
+		CHECK(host.discover(&profile, COMP83P) == 0);
+		answering.join();
+		CHECK(profile.machine_id == ids[i]);
+		CHECK(profile.model == (enum Endpoint)ids[i]);
+		CHECK(profile.computer_id == (ids[i] == CALC86 ? COMP86 : COMP85));
+		CHECK(TIVar::sizeOfReal(profile.model) == 10);
+	}
+}
+
+// Jobs still queued when a worker stops are finished with an error,
+// so whoever waits on them doesn't wait forever
+static std::atomic<bool> slowStarted;
+
+static int slowJob(TICL* link, void* arg) {
+	slowStarted = true;
+	delay(50);
+	return 0;
+}
+
+static int doneCount;
+
+static void countDone(struct LinkJob* job) {
+	doneCount++;
+}
+
+static void testWorkerStop() {
+	TICL link(0, 1);
+	LinkWorker worker(&link);
+	struct LinkJob first;
+	struct LinkJob second;
+	first.run = second.run = slowJob;
+	first.arg = second.arg = NULL;
+	first.done = second.done = countDone;
+	doneCount = 0;
+	slowStarted = false;
+	CHECK(worker.start() == 0);
+	CHECK(worker.submit(&first));
+	CHECK(worker.submit(&second));
+	while (!slowStarted) {
+		std::this_thread::yield();
+	}
+	worker.stop();
+	CHECK(first.finished && first.result == 0);
+	CHECK(second.finished);
+	CHECK(second.finished && LinkWorker::wait(&second) == ERR_READ_TIMEOUT);
+	CHECK(doneCount == 2);
+	CHECK(worker.jobsDone() == 1);
+}
+
+static const struct Test tests[] = {
+	{"varstore", testVarStoreNames},
+	{"varstoregrow", testVarStoreGrow},
+	{"real85", testReal85},
+	{"discover", testDiscoverModels},
+	{"cbl2skip", testCBL2Skip},
+	{"poolrelease", testPoolRelease},
+	{"poolwait", testPoolBackpressure},
+	{"poolget", testPoolGet},
+	{"parser", testParserEvents},
+	{"ber", testBitErrors},
+	{"retrytimeout", testRetryTimeout},
+	{"fast", testFastMode},
+	{"fastrecord", testFastRecord},
+	{"relayrewrite", testRelayRewrite},
+	{"relayack", testRelayRewriteAck},
+	{"workerstop", testWorkerStop},
+	{"logger", testLoggerTrigger},
+	{"loggerrace", testLoggerRace},
+	{"tifile", testTIFileRoundTrip},
+	{"bridgeframe", testBridgeFraming},
+};
+
+int main(int argc, char** argv) {
+	int run = 0;
+	for(size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); t++) {
+		bool chosen = (argc < 2);
+		for(int i = 1; i < argc; i++) {
+			chosen |= (0 == strcmp(argv[i], tests[t].name));
+		}
+		if (!chosen) {
+			continue;
+		}
+		int before = failures;
+		tests[t].run();
+		printf("%-12s %s\n", tests[t].name, failures == before ? "ok" : "FAILED");
+		run++;
+	}
+	if (run == 0) {
+		fprintf(stderr, "no such test\n");
+		return 1;
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/*************************************************
+ *  replaybench.cpp - Records a link session, or *
+ *           replays a recorded one against the  *
+ *           library to time it.                 *
+ *           Part of the ArTICL linking library. *
+ *           Created by Christopher Mitchell,    *
+ *           2011-2019, all rights reserved.     *
+ *************************************************/
+
+// The library side of every session is the same simple receiver: it
+// gets DATA packets and answers each with an ACK. With -w, a second
+// TICL plays the calculator, sending -n packets of -s bytes with -d
+// microseconds between them, and the receiver's recorder writes the
+// session out. Otherwise the named session is played back at its
+// recorded speed, so runs before and after a change to the library
+// can be compared on the same traffic. The replay needs a CPU for
+// each side to keep the recorded timing.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+#include "HostGPIO.h"
+#include "SessionReplay.h"
+#include "TICL.h"
+
+#define BENCH_MAX_DATA	4096
+
+class FilePrint: public Print {
+	public:
+		FilePrint(FILE* file) : file_(file) {}
+		size_t write(uint8_t byte) { return fputc(byte, file_) == EOF ? 0 : 1; }
+		size_t write(const uint8_t* buffer, size_t size) { return fwrite(buffer, 1, size, file_); }
+
+	private:
+		FILE* file_;
+};
+
+static std::atomic<bool> running;
+static unsigned long received;
+
+static void receiver(TICL* link) {
+	uint8_t header[4];
+	uint8_t data[BENCH_MAX_DATA];
+	uint8_t ack[4] = {COMP83P, ACK, 0, 0};
+	int length;
+	while (running) {
+		int rval = link->get(header, data, &length, sizeof(data), TIMEOUT);
+		if (rval == 0) {
+			received++;
+			link->send(ack, NULL, 0);
+		} else if (rval != ERR_READ_ENTER_TIMEOUT) {
+			link->resetLines();
+		}
+	}
+}
+
+static int record(const char* path, int count, int size, unsigned long gap) {
+	FILE* file = fopen(path, "wb");
+	if (file == NULL) {
+		perror(path);
+		return 1;
+	}
+	FilePrint out(file);
+	SessionRecorder recorder;
+	recorder.begin(&out);
+
+	TICL calc(0, 1);
+	TICL library(2, 3);
+	calc.begin();
+	library.begin();
+	library.setRecorder(&recorder);
+
+	uint8_t data[BENCH_MAX_DATA];
+	for(int i = 0; i < size; i++) {
+		data[i] = (uint8_t)(i * 37 + 11);
+	}
+	uint8_t header[4] = {CALC83P, DATA, (uint8_t)(size & 0xff), (uint8_t)(size >> 8)};
+
+	running = true;
+	std::thread thread(receiver, &library);
+	int errors = 0;
+	for(int i = 0; i < count; i++) {
+		delayMicroseconds(gap);
+		uint8_t reply[4];
+		int length;
+		if (calc.send(header, data, size) || calc.get(reply, NULL, &length, 0, TIMEOUT)) {
+			calc.resetLines();
+			errors++;
+		}
+	}
+	delay(TIMEOUT / 1000);
+	running = false;
+	thread.join();
+	recorder.end();
+	fclose(file);
+
+	printf("recorded %lu packets, %d errors\n", recorder.packets(), errors);
+	return errors ? 1 : 0;
+}
+
+static int replay(const char* path) {
+	SessionReplay session;
+	if (session.load(path)) {
+		fprintf(stderr, "%s: not a session file\n", path);
+		return 1;
+	}
+
+	TICL library(2, 3);
+	library.begin();
+	running = true;
+	std::thread thread(receiver, &library);
+	struct ReplayStats stats;
+	session.run(0, 1, &stats);
+	running = false;
+	thread.join();
+
+	printf("%lu of %lu packets, %lu mismatched bytes, %lu packets received\n",
+	       stats.packets, (unsigned long)session.packets().size(), stats.mismatches, received);
+	printf("wall %lu us, peer %lu us, library %ld us\n",
+	       stats.total_micros, stats.peer_micros, (long)(stats.total_micros - stats.peer_micros));
+	if (stats.error) {
+		fprintf(stderr, "replay stopped with error %d\n", stats.error);
+	}
+	return (stats.error || stats.mismatches) ? 1 : 0;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s session.bin\n"
+	                "       %s -w session.bin [-n packets] [-s packet size] [-d gap us]\n", name, name);
+}
+
+int main(int argc, char** argv) {
+	const char* out = NULL;
+	int count = 100;
+	int size = 256;
+	unsigned long gap = 1000;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "w:n:s:d:")) != -1) {
+		switch(opt) {
+			case 'w': out = optarg; break;
+			case 'n': count = atoi(optarg); break;
+			case 's': size = atoi(optarg); break;
+			case 'd': gap = strtoul(optarg, NULL, 0); break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if ((out == NULL && optind != argc - 1) || size < 1 || size > BENCH_MAX_DATA) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	FakeChip fake;
+	fake.wire(0, 2);
+	fake.wire(1, 3);
+	fake.setYield(std::thread::hardware_concurrency() < 2);
+	hostSetPinBackend(&fake);
+
+	return out ? record(out, count, size, gap) : replay(argv[optind]);
+}
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Builds a sketch against this copy of ArTICL for each board and set
+# of TIConfig.h options, and prints the flash and RAM each one uses.
+#
+#   extras/size-report.sh [sketch directory]
+#
+# The sketch defaults to examples/ReadAnalogSingle, a minimal CBL2.
+# Needs arduino-cli with the cores for the boards installed; set BOARDS
+# to a list of other fully-qualified board names to build for those.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SKETCH=${1:-$ROOT/examples/ReadAnalogSingle}
+BOARDS=${BOARDS:-"arduino:avr:uno energia:msp432r:MSP-EXP432P401R"}
+
+# name:compiler flags. A sketch that uses a module that's turned off
+# fails to link, and shows as failed.
+CONFIGS="full:
+nodebug:-DTICL_DEBUG=0
+nostring:-DTICL_DEBUG=0 -DTICL_STRINGS=0
+noreal:-DTICL_DEBUG=0 -DTICL_STRINGS=0 -DTICL_REALS=0
+lean:-DTICL_DEBUG=0 -DTICL_STRINGS=0 -DTICL_REALS=0 -DTICL_CAPTURE=0 -DTICL_RECORDER=0 -DTICL_FAST=0"
+
+printf "%-36s %-8s %8s %8s\n" "board" "options" "flash" "ram"
+for board in $BOARDS; do
+	echo "$CONFIGS" | while IFS=: read -r name flags; do
+		build=$(mktemp -d)
+		if output=$(arduino-cli compile --fqbn "$board" --library "$ROOT" --build-path "$build" \
+		            --build-property "compiler.cpp.extra_flags=$flags" \
+		            --build-property "compiler.c.extra_flags=$flags" "$SKETCH" 2>&1); then
+			flash=$(echo "$output" | sed -n 's/^Sketch uses \([0-9]*\) bytes.*/\1/p')
+			ram=$(echo "$output" | sed -n 's/^Global variables use \([0-9]*\) bytes.*/\1/p')
+		else
+			flash=failed
+			ram=
+		fi
+		rm -rf "$build"
+		printf "%-36s %-8s %8s %8s\n" "$board" "$name" "${flash:-?}" "${ram:-?}"
+	done
+done